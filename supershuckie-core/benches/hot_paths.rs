@@ -0,0 +1,531 @@
+//! Benchmarks for the emulator, recorder, and player hot paths.
+//!
+//! Run with `cargo bench -p supershuckie-core`, optionally followed by `-- <filter>` to only run
+//! benchmarks whose name contains `<filter>`.
+//!
+//! Everything runs on a synthetic emulator so no ROM is needed. To also benchmark SameBoy, set
+//! `SUPERSHUCKIE_BENCH_ROM` to the path of a Game Boy (Color) ROM.
+
+use std::hint::black_box;
+use std::io::Cursor;
+use std::time::{Duration, Instant};
+use supershuckie_core::emulator::{EmulatorCore, GameBoyColor, Input, Model, NullEmulatorCore, RunTime, ScreenData, ScreenDataEncoding};
+use supershuckie_core::screen_filter::{ScreenFilter, ScreenFilterSettings, ScreenScaler};
+use supershuckie_core::{ReplaySnapshotSettings, SuperShuckieCore, ThreadedSuperShuckieCore, MonotonicTimestampProvider, std_timestamp_provider};
+use supershuckie_replay_recorder::replay_file::playback::ReplayFilePlayer;
+use supershuckie_replay_recorder::replay_file::record::{ReplayFileRecorder, ReplayFileRecorderSettings};
+use supershuckie_replay_recorder::replay_file::{ReplayConsoleType, ReplayFileMetadata, ReplayHeaderBlake3Hash};
+use supershuckie_replay_recorder::{compress_data, decompress_data, ByteVec, InputBuffer, Packet, PacketIO, PacketWriteCommand, Speed, TimestampMillis, UnsignedInteger};
+
+const WARM_UP_TIME: Duration = Duration::from_millis(200);
+const SAMPLE_TIME: Duration = Duration::from_millis(50);
+const SAMPLE_COUNT: usize = 15;
+
+/// Frames in the synthetic replay.
+const REPLAY_FRAMES: u64 = 20_000;
+const REPLAY_KEYFRAME_INTERVAL: u64 = 300;
+
+fn main() {
+    // cargo passes --bench; anything else is a filter
+    let filter = std::env::args().skip(1).find(|a| !a.starts_with('-'));
+    let bench = Bench { filter };
+
+    bench_emulator(&bench, "synthetic", || Box::new(SyntheticEmulatorCore::new()));
+    if let Some(rom) = std::env::var_os("SUPERSHUCKIE_BENCH_ROM") {
+        let rom = std::fs::read(&rom).expect("failed to read SUPERSHUCKIE_BENCH_ROM");
+        bench_emulator(&bench, "gameboy", || Box::new(new_game_boy(rom.as_slice())));
+    }
+
+    bench_screen_handoff(&bench);
+    bench_screen_filter(&bench);
+    bench_packets(&bench);
+    bench_compression(&bench);
+    bench_seeking(&bench);
+}
+
+fn bench_emulator(bench: &Bench, name: &str, new_core: impl Fn() -> Box<dyn EmulatorCore>) {
+    let mut emulator = new_core();
+    bench.run(&format!("{name}/run"), Throughput::Frames(1), || {
+        run_frame(emulator.as_mut(), EmulatorCore::run);
+    });
+    bench.run(&format!("{name}/run_unlocked"), Throughput::Frames(1), || {
+        run_frame(emulator.as_mut(), EmulatorCore::run_unlocked);
+    });
+
+    let mut core = SuperShuckieCore::new(new_core(), std_timestamp_provider());
+    bench.run(&format!("{name}/SuperShuckieCore::run_unlocked"), Throughput::Frames(1), || {
+        core.run_unlocked();
+        core.finish_current_frame();
+    });
+
+    let state = emulator.create_save_state();
+    bench.run(&format!("{name}/create_save_state"), Throughput::Bytes(state.len()), || {
+        black_box(emulator.create_save_state());
+    });
+    bench.run(&format!("{name}/load_save_state"), Throughput::Bytes(state.len()), || {
+        emulator.load_save_state(black_box(state.as_slice())).expect("failed to load save state");
+    });
+
+    let mut screens = emulator.get_screens().to_vec();
+    bench.run(&format!("{name}/swap_screen_data"), Throughput::None, || {
+        emulator.swap_screen_data(black_box(screens.as_mut_slice()));
+    });
+}
+
+fn run_frame(emulator: &mut dyn EmulatorCore, run_fn: fn(&mut dyn EmulatorCore) -> RunTime) {
+    while run_fn(emulator).frames == 0 {}
+}
+
+fn bench_screen_handoff(bench: &Bench) {
+    if !bench.wants("threaded") {
+        return
+    }
+
+    let mut core = ThreadedSuperShuckieCore::new(Box::new(SyntheticEmulatorCore::new()));
+    core.start();
+
+    bench.run("threaded/read_screens", Throughput::None, || {
+        core.read_screens(|screens| black_box(screens[0].pixels[0]));
+    });
+
+    // How many unique frames actually make it to the reader per second.
+    let start = Instant::now();
+    let start_frames = core.get_elapsed_frames();
+    let mut sequence = core.get_screen_sequence();
+    let mut frames_read = 0u64;
+    while start.elapsed() < Duration::from_secs(1) {
+        core.read_screens_with_sequence(|screens, new_sequence| {
+            if new_sequence != sequence {
+                sequence = new_sequence;
+                frames_read += 1;
+                black_box(screens[0].pixels[0]);
+            }
+        });
+    }
+    let elapsed = start.elapsed().as_secs_f64();
+    let frames_run = core.get_elapsed_frames().wrapping_sub(start_frames);
+    println!(
+        "{:<56} {:>12.0} frames/s run, {:>12.0} frames/s read",
+        "threaded/frame_handoff", frames_run as f64 / elapsed, frames_read as f64 / elapsed
+    );
+
+    core.pause();
+}
+
+fn bench_screen_filter(bench: &Bench) {
+    let emulator = SyntheticEmulatorCore::new();
+    let screen = &emulator.get_screens()[0];
+    let mut into = ScreenData::default();
+
+    let filters = [
+        ("R5G6B5", ScreenDataEncoding::R5G6B5, ScreenScaler::Nearest, 1),
+        ("nearest_4x", ScreenDataEncoding::A8R8G8B8, ScreenScaler::Nearest, 4),
+        ("scale2x_4x", ScreenDataEncoding::A8R8G8B8, ScreenScaler::Scale2x, 4),
+        ("scale2x_4x_R5G6B5", ScreenDataEncoding::R5G6B5, ScreenScaler::Scale2x, 4)
+    ];
+
+    for (name, encoding, scaler, scale) in filters {
+        let scale = std::num::NonZeroU8::new(scale).unwrap();
+        let mut filter = ScreenFilter::new(ScreenFilterSettings { encoding, scaler, scale });
+        bench.run(&format!("screen_filter/{name}"), Throughput::Frames(1), || {
+            filter.apply(screen, &mut into);
+            black_box(into.pixels[0]);
+        });
+    }
+}
+
+fn bench_packets(bench: &Bench) {
+    let packets = synthetic_packets();
+    let mut bytes = Vec::new();
+    for packet in &packets {
+        write_packet(packet, &mut bytes);
+    }
+
+    bench.run("packets/write_packet_instructions", Throughput::Bytes(bytes.len()), || {
+        let mut output = Vec::with_capacity(bytes.len());
+        for packet in &packets {
+            write_packet(black_box(packet), &mut output);
+        }
+        black_box(output);
+    });
+
+    bench.run("packets/read_all", Throughput::Bytes(bytes.len()), || {
+        let mut remaining = bytes.as_slice();
+        while !remaining.is_empty() {
+            black_box(Packet::read_all(&mut remaining).expect("failed to read packet"));
+        }
+    });
+}
+
+fn bench_compression(bench: &Bench) {
+    let mut data = Vec::new();
+    for packet in &synthetic_packets() {
+        write_packet(packet, &mut data);
+    }
+
+    for level in [1, 3, 9, 19] {
+        let compressed = compress_data(data.as_slice(), level).expect("failed to compress");
+        bench.run(&format!("compression/compress_data level {level}"), Throughput::Bytes(data.len()), || {
+            black_box(compress_data(black_box(data.as_slice()), level).expect("failed to compress"));
+        });
+        bench.run(&format!("compression/decompress_data level {level}"), Throughput::Bytes(data.len()), || {
+            black_box(decompress_data(black_box(compressed.as_slice()), data.len()).expect("failed to decompress"));
+        });
+    }
+}
+
+fn bench_seeking(bench: &Bench) {
+    if !bench.wants("seeking") {
+        return
+    }
+
+    let replay = synthetic_replay();
+    let keyframes: Vec<UnsignedInteger> = (0..=REPLAY_FRAMES).step_by(REPLAY_KEYFRAME_INTERVAL as usize).collect();
+
+    let mut player = ReplayFilePlayer::new(replay.as_slice(), false).expect("failed to parse replay");
+    player.decompress_all_blobs();
+    let mut random = Lcg(1);
+    bench.run("seeking/go_to_keyframe (decompressed)", Throughput::None, || {
+        player.go_to_keyframe(keyframes[random.next_index(keyframes.len())]).expect("failed to seek");
+        black_box(player.next_packet().expect("failed to read keyframe"));
+    });
+
+    let mut player = ReplayFilePlayer::new_lazy(Cursor::new(replay.clone()), false).expect("failed to parse replay");
+    player.enable_threading();
+    let mut random = Lcg(2);
+    bench.run("seeking/go_to_keyframe (lazy)", Throughput::None, || {
+        player.go_to_keyframe(keyframes[random.next_index(keyframes.len())]).expect("failed to seek");
+        black_box(player.next_packet().expect("failed to read keyframe"));
+    });
+
+    for (name, snapshots) in [("no snapshots", ReplaySnapshotSettings { interval_frames: 0, memory_limit: 0 }), ("snapshots", ReplaySnapshotSettings::default())] {
+        let mut core = SuperShuckieCore::new(Box::new(SyntheticEmulatorCore::new()), Box::new(FakeTimestampProvider(0)));
+        core.set_replay_snapshot_settings(snapshots);
+        let mut player = ReplayFilePlayer::new_lazy(Cursor::new(replay.clone()), false).expect("failed to parse replay");
+        player.enable_threading();
+        core.attach_replay_player(player, false).expect("failed to attach replay");
+
+        let mut random = Lcg(3);
+        bench.run(&format!("seeking/go_to_replay_frame ({name})"), Throughput::None, || {
+            core.go_to_replay_frame(1 + random.next_index(REPLAY_FRAMES as usize - 1) as UnsignedInteger);
+        });
+    }
+}
+
+fn write_packet(packet: &Packet, into: &mut Vec<u8>) {
+    for command in packet.write_packet_instructions() {
+        match command {
+            PacketWriteCommand::WriteByte { byte } => into.push(byte),
+            PacketWriteCommand::WriteSlice { bytes } => into.extend_from_slice(bytes),
+            PacketWriteCommand::WriteVec { bytes } => into.extend_from_slice(bytes.as_slice())
+        }
+    }
+}
+
+/// Roughly what a few seconds of a recording looks like inside a blob.
+fn synthetic_packets() -> Vec<Packet> {
+    let mut emulator = SyntheticEmulatorCore::new();
+    let mut packets = Vec::new();
+    let mut random = Lcg(4);
+
+    // Frames with nothing in between are written as one packet, like the recorder does
+    let (mut count, mut total_delta) = (0, 0);
+    let push_frames = |packets: &mut Vec<Packet>, count: &mut UnsignedInteger, total_delta: &mut TimestampMillis| {
+        match core::mem::take(count) {
+            0 => {},
+            1 => packets.push(Packet::NextFrame { timestamp_delta: core::mem::take(total_delta) }),
+            count => packets.push(Packet::RepeatFrames { count, total_delta: core::mem::take(total_delta) })
+        }
+    };
+
+    for frame in 1..=600u64 {
+        if frame % 4 == 0 {
+            push_frames(&mut packets, &mut count, &mut total_delta);
+            packets.push(Packet::ChangeInput { data: InputBuffer::from([random.next() as u8].as_slice()) });
+        }
+        if frame % 50 == 0 {
+            push_frames(&mut packets, &mut count, &mut total_delta);
+            packets.push(Packet::WriteMemory { address: 0xC000 + frame, data: ByteVec::from([random.next() as u8; 4].as_slice()) });
+        }
+        run_frame(&mut emulator, EmulatorCore::run_unlocked);
+        count += 1;
+        total_delta += 16 + (frame % 3 == 0) as TimestampMillis;
+    }
+    push_frames(&mut packets, &mut count, &mut total_delta);
+
+    packets.push(Packet::LoadSaveState { state: ByteVec::Heap(emulator.create_save_state()) });
+    packets
+}
+
+fn synthetic_replay() -> Vec<u8> {
+    let mut emulator = SyntheticEmulatorCore::new();
+    let metadata = ReplayFileMetadata {
+        console_type: ReplayConsoleType::GameBoy,
+        rom_name: "SYNTHETIC".to_owned(),
+        rom_filename: "synthetic.gb".to_owned(),
+        rom_checksum: *emulator.rom_checksum(),
+        bios_checksum: *emulator.bios_checksum(),
+        emulator_core_name: emulator.core_name().to_owned(),
+        ..ReplayFileMetadata::default()
+    };
+
+    let mut recorder = ReplayFileRecorder::new_with_metadata(
+        metadata,
+        ByteVec::default(),
+        ReplayFileRecorderSettings::default(),
+        0,
+        InputBuffer::from([0u8].as_slice()),
+        Speed::default(),
+        ByteVec::Heap(emulator.create_save_state()),
+        Vec::<u8>::new(),
+        Vec::<u8>::new()
+    ).expect("failed to start recording");
+
+    let mut random = Lcg(5);
+    let mut input = Vec::new();
+    for frame in 1..=REPLAY_FRAMES {
+        if frame % 8 == 0 {
+            input.clear();
+            emulator.encode_input(Input { a: random.next() & 1 != 0, d_right: random.next() & 1 != 0, ..Input::new() }, &mut input);
+            emulator.set_input_encoded(input.as_slice());
+            recorder.set_input(InputBuffer::from(input.as_slice())).expect("failed to set input");
+        }
+
+        run_frame(&mut emulator, EmulatorCore::run_unlocked);
+        recorder.next_frame(frame * 16).expect("failed to record frame");
+
+        if frame % REPLAY_KEYFRAME_INTERVAL == 0 {
+            recorder.insert_keyframe(ByteVec::Heap(emulator.create_save_state()), frame * 16).expect("failed to insert keyframe");
+        }
+    }
+
+    recorder.close().map_err(|(_, _, e)| e).expect("failed to finish recording").0
+}
+
+fn new_game_boy(rom: &[u8]) -> GameBoyColor {
+    if rom.get(0x143).is_some_and(|flags| flags & 0x80 != 0) {
+        GameBoyColor::new_from_rom(rom, include_bytes!("../../bootrom/cgb/cgb_boot/cgb_boot_fast.bin"), Model::Cgb0)
+    }
+    else {
+        GameBoyColor::new_from_rom(rom, include_bytes!("../../bootrom/dmg/dmg.bin"), Model::DmgB)
+    }
+}
+
+/// A stand-in for a real emulator that does a similar kind of work without needing a ROM.
+///
+/// Every frame, it scrambles part of its RAM based on the input and draws the screen from it,
+/// using the same screen layout as [`NullEmulatorCore`].
+struct SyntheticEmulatorCore {
+    ram: Vec<u8>,
+    frames: u64,
+    input: u8,
+    screen: ScreenData
+}
+
+const SYNTHETIC_RAM_SIZE: usize = 0x8000;
+const SYNTHETIC_BYTES_PER_FRAME: usize = 0x400;
+
+impl SyntheticEmulatorCore {
+    fn new() -> Self {
+        Self {
+            ram: vec![0; SYNTHETIC_RAM_SIZE],
+            frames: 0,
+            input: 0,
+            screen: NullEmulatorCore.get_screens()[0].clone()
+        }
+    }
+}
+
+impl EmulatorCore for SyntheticEmulatorCore {
+    fn run(&mut self) -> RunTime {
+        self.run_unlocked()
+    }
+
+    fn run_unlocked(&mut self) -> RunTime {
+        let start = (self.frames as usize * SYNTHETIC_BYTES_PER_FRAME) % SYNTHETIC_RAM_SIZE;
+        let mut seed = (self.frames as u32) ^ ((self.input as u32) << 16);
+        for byte in &mut self.ram[start..start + SYNTHETIC_BYTES_PER_FRAME] {
+            seed = seed.wrapping_mul(1103515245).wrapping_add(12345);
+            *byte ^= (seed >> 16) as u8;
+        }
+
+        for (pixel, byte) in self.screen.pixels.iter_mut().zip(self.ram.iter().cycle().skip(start)) {
+            *pixel = 0xFF000000 | (*byte as u32 * 0x010101);
+        }
+
+        self.frames += 1;
+        RunTime { frames: 1 }
+    }
+
+    fn read_ram(&self, address: u32, into: &mut [u8]) -> Result<(), &'static str> {
+        let data = self.ram.get(address as usize..).and_then(|r| r.get(..into.len())).ok_or("address+length overflows")?;
+        into.copy_from_slice(data);
+        Ok(())
+    }
+
+    fn write_ram(&mut self, address: u32, from: &[u8]) -> Result<(), &'static str> {
+        let data = self.ram.get_mut(address as usize..).and_then(|r| r.get_mut(..from.len())).ok_or("address+length overflows")?;
+        data.copy_from_slice(from);
+        Ok(())
+    }
+
+    fn write_range_is_contiguous(&self, address: u32, length: usize) -> bool {
+        (address as usize).checked_add(length).is_some_and(|end| end <= self.ram.len())
+    }
+
+    fn set_speed(&mut self, _speed: f64) {}
+
+    fn save_sram(&self) -> Vec<u8> {
+        Vec::new()
+    }
+
+    fn load_sram(&mut self, _state: &[u8]) -> Result<(), String> {
+        Ok(())
+    }
+
+    fn create_save_state(&self) -> Vec<u8> {
+        let mut state = Vec::with_capacity(8 + 1 + self.ram.len());
+        state.extend_from_slice(&self.frames.to_le_bytes());
+        state.push(self.input);
+        state.extend_from_slice(self.ram.as_slice());
+        state
+    }
+
+    fn load_save_state(&mut self, state: &[u8]) -> Result<(), String> {
+        if state.len() != 8 + 1 + SYNTHETIC_RAM_SIZE {
+            return Err(format!("wrong save state size {}", state.len()))
+        }
+        self.frames = u64::from_le_bytes(state[..8].try_into().expect("8 bytes"));
+        self.input = state[8];
+        self.ram.copy_from_slice(&state[9..]);
+        Ok(())
+    }
+
+    fn encode_input(&self, input: Input, into: &mut Vec<u8>) {
+        into.push(input.a as u8 | (input.b as u8) << 1 | (input.d_left as u8) << 2 | (input.d_right as u8) << 3);
+    }
+
+    fn set_input_encoded(&mut self, input: &[u8]) {
+        self.input = input[0];
+    }
+
+    fn get_screens(&self) -> &[ScreenData] {
+        core::slice::from_ref(&self.screen)
+    }
+
+    fn swap_screen_data(&mut self, screens: &mut [ScreenData]) {
+        core::mem::swap(&mut screens[0].pixels, &mut self.screen.pixels);
+    }
+
+    fn hard_reset(&mut self) {
+        *self = Self::new();
+    }
+
+    fn replay_console_type(&self) -> Option<ReplayConsoleType> {
+        Some(ReplayConsoleType::GameBoy)
+    }
+
+    fn rom_checksum(&self) -> &ReplayHeaderBlake3Hash {
+        &const { [0x55; 32] }
+    }
+
+    fn bios_checksum(&self) -> &ReplayHeaderBlake3Hash {
+        &const { [0xAA; 32] }
+    }
+
+    fn core_name(&self) -> &'static str {
+        "Synthetic"
+    }
+}
+
+/// Replays don't read the clock, so there's no need to pay for it.
+struct FakeTimestampProvider(TimestampMillis);
+
+impl MonotonicTimestampProvider for FakeTimestampProvider {
+    fn get_timestamp(&mut self) -> TimestampMillis {
+        self.0 += 1;
+        self.0
+    }
+}
+
+struct Lcg(u32);
+
+impl Lcg {
+    fn next(&mut self) -> u32 {
+        self.0 = self.0.wrapping_mul(1103515245).wrapping_add(12345);
+        self.0 >> 8
+    }
+
+    fn next_index(&mut self, len: usize) -> usize {
+        self.next() as usize % len
+    }
+}
+
+enum Throughput {
+    None,
+    Frames(u64),
+    Bytes(usize)
+}
+
+struct Bench {
+    filter: Option<String>
+}
+
+impl Bench {
+    fn wants(&self, name: &str) -> bool {
+        self.filter.as_ref().is_none_or(|f| name.contains(f.as_str()) || f.contains(name))
+    }
+
+    /// Time `f`, printing the fastest, median, and slowest time per call along with the throughput.
+    fn run<F: FnMut()>(&self, name: &str, throughput: Throughput, mut f: F) {
+        if self.filter.as_ref().is_some_and(|filter| !name.contains(filter.as_str())) {
+            return
+        }
+
+        let warm_up_start = Instant::now();
+        let mut warm_up_iterations = 0u64;
+        while warm_up_start.elapsed() < WARM_UP_TIME {
+            f();
+            warm_up_iterations += 1;
+        }
+
+        let estimate = warm_up_start.elapsed().as_secs_f64() / warm_up_iterations as f64;
+        let iterations = ((SAMPLE_TIME.as_secs_f64() / estimate) as u64).max(1);
+
+        let mut samples: Vec<f64> = (0..SAMPLE_COUNT).map(|_| {
+            let start = Instant::now();
+            for _ in 0..iterations {
+                f();
+            }
+            start.elapsed().as_secs_f64() / iterations as f64
+        }).collect();
+        samples.sort_by(f64::total_cmp);
+
+        let median = samples[samples.len() / 2];
+        let throughput = match throughput {
+            Throughput::None => String::new(),
+            Throughput::Frames(frames) => format!("{:>12.0} frames/s", frames as f64 / median),
+            Throughput::Bytes(bytes) => format!("{:>10.1} MiB/s", bytes as f64 / median / (1024.0 * 1024.0))
+        };
+
+        println!(
+            "{name:<56} [{} {} {}] {throughput}",
+            format_seconds(samples[0]), format_seconds(median), format_seconds(samples[samples.len() - 1])
+        );
+    }
+}
+
+fn format_seconds(seconds: f64) -> String {
+    if seconds < 1e-6 {
+        format!("{:>7.1} ns", seconds * 1e9)
+    }
+    else if seconds < 1e-3 {
+        format!("{:>7.2} µs", seconds * 1e6)
+    }
+    else if seconds < 1.0 {
+        format!("{:>7.2} ms", seconds * 1e3)
+    }
+    else {
+        format!("{seconds:>7.2} s ")
+    }
+}
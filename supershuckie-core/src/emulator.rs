@@ -21,16 +21,44 @@ pub trait EmulatorCore: Send + 'static {
     /// Run the smallest amount of time without any timing.
     fn run_unlocked(&mut self) -> RunTime;
 
+    /// Get the number of frames per second at 1x speed, if known.
+    ///
+    /// If this returns `Some`, the core can be paced externally by calling `run_unlocked`.
+    fn frame_rate(&self) -> Option<f64> {
+        None
+    }
+
     /// Read RAM at the given address to the given data buffer.
     ///
     /// Note: The way `address` is interpreted is core-specific.
     fn read_ram(&self, address: u32, into: &mut [u8]) -> Result<(), &'static str>;
 
+    /// Borrow `length` bytes of RAM at the given address without copying them, if the core can.
+    ///
+    /// By default, this returns `None`, in which case [`EmulatorCore::read_ram`] must be used.
+    ///
+    /// Note: The way `address` is interpreted is core-specific.
+    fn ram_slice(&self, address: u32, length: usize) -> Option<&[u8]> {
+        let _ = (address, length);
+        None
+    }
+
     /// Write RAM to the given address from the given data buffer.
     ///
     /// Note: The way `address` is interpreted is core-specific.
     fn write_ram(&mut self, address: u32, from: &[u8]) -> Result<(), &'static str>;
 
+    /// Return `true` if `length` bytes at `address` can be written with one
+    /// [`EmulatorCore::write_ram`] call, the same as writing each byte at its own address in turn.
+    ///
+    /// By default, this returns `false`, in which case writes are never merged.
+    ///
+    /// Note: The way `address` is interpreted is core-specific.
+    fn write_range_is_contiguous(&self, address: u32, length: usize) -> bool {
+        let _ = (address, length);
+        false
+    }
+
     /// Set the game speed multiplier.
     fn set_speed(&mut self, speed: f64);
 
@@ -59,6 +87,17 @@ pub trait EmulatorCore: Send + 'static {
     /// Get the screen(s).
     fn get_screens(&self) -> &[ScreenData];
 
+    /// Set whether frames are rendered into the screen data.
+    ///
+    /// While disabled, the screens are left alone (and may be stale) and the core can skip
+    /// rendering entirely, which speeds up running frames that will never be shown. This must not
+    /// affect emulation. Changing this mid-frame may leave that frame partially rendered.
+    ///
+    /// By default, this does nothing.
+    fn set_rendering_enabled(&mut self, enabled: bool) {
+        let _ = enabled;
+    }
+
     /// Swap screen data.
     ///
     /// Note: Swapping twice does not guarantee getting the original screen data back, as the
@@ -270,9 +309,27 @@ impl Default for ScreenData {
 
 /// Describes the color encoding.
 #[derive(Copy, Clone, PartialEq, Debug)]
+#[repr(u32)]
 pub enum ScreenDataEncoding {
     /// 0xAARRGGBB
-    A8R8G8B8
+    A8R8G8B8 = 0,
+
+    /// 0bRRRRRGGGGGGBBBBB, two pixels per `u32`
+    ///
+    /// The first pixel of each pair is in the low 16 bits, so on little endian machines, pixels are
+    /// consecutive `u16`s. If there is an odd number of pixels, the high 16 bits of the last `u32`
+    /// are unused.
+    R5G6B5 = 1
+}
+
+impl ScreenDataEncoding {
+    /// Get the number of `u32`s needed to hold `pixel_count` pixels.
+    pub const fn words_for_pixels(self, pixel_count: usize) -> usize {
+        match self {
+            Self::A8R8G8B8 => pixel_count,
+            Self::R5G6B5 => pixel_count.div_ceil(2)
+        }
+    }
 }
 
 fn _ensure_emulator_core_is_dyn_compatible(_core: &dyn EmulatorCore) {}
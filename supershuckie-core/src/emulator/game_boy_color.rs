@@ -5,7 +5,7 @@ use alloc::string::String;
 use alloc::sync::Arc;
 use alloc::vec::Vec;
 use core::cell::UnsafeCell;
-use core::sync::atomic::{AtomicU32, Ordering};
+use core::sync::atomic::{AtomicBool, AtomicU32, Ordering};
 use safeboy::rgb_encoder::encode_a8r8g8b8;
 use safeboy::{BorderMode, DirectAccessRegion, Gameboy, GameboyCallbacks, InputButton, RtcMode, RunnableInstanceFunctions, RunningGameboy, TurboMode, VBlankType};
 pub use safeboy::Model;
@@ -27,6 +27,7 @@ pub struct GameBoyColor {
 
 struct GameBoyCallbackData {
     run_frames: AtomicU32,
+    rendering_enabled: AtomicBool,
     screen: UnsafeCell<ScreenData>
 }
 
@@ -39,6 +40,19 @@ impl GameBoyColor {
         rom: &[u8],
         bios: &[u8],
         model: Model
+    ) -> Self {
+        Self::new_from_rom_with_checksums(rom, bios, model, blake3_hash(rom), blake3_hash(bios))
+    }
+
+    /// Instantiate a `GameBoyColor` emulator from the given ROM, whose checksums are already known.
+    ///
+    /// The checksums must be the BLAKE3 hashes of `rom` and `bios`.
+    pub fn new_from_rom_with_checksums(
+        rom: &[u8],
+        bios: &[u8],
+        model: Model,
+        rom_checksum: ReplayHeaderBlake3Hash,
+        bios_checksum: ReplayHeaderBlake3Hash
     ) -> Self {
         let mut core = Gameboy::new(model);
         core.set_rtc_mode(RtcMode::Accurate);
@@ -58,6 +72,7 @@ impl GameBoyColor {
 
         let callback_data = Arc::new(GameBoyCallbackData {
             run_frames: AtomicU32::new(0),
+            rendering_enabled: AtomicBool::new(true),
             screen: UnsafeCell::new(screen_data)
         });
 
@@ -67,14 +82,28 @@ impl GameBoyColor {
             turbo_mode: TurboMode::Disabled,
             callback_data,
             core,
-            rom_checksum: blake3_hash(rom),
-            bios_checksum: blake3_hash(bios),
+            rom_checksum,
+            bios_checksum,
         };
         r.hard_reset();
         r
     }
 }
 
+impl GameBoyColor {
+    fn direct_ram(&self, address: u32, length: usize) -> Result<&[u8], &'static str> {
+        let Some((region, offset)) = pokeabyte_protocol_region_from_address(address) else {
+            return Err("invalid or unknown address");
+        };
+        let Some(offset_end) = offset.checked_add(length) else {
+            return Err("invalid length");
+        };
+
+        let region = self.core.direct_access(region);
+        region.data.get(offset..offset_end).ok_or("address+length overflows")
+    }
+}
+
 struct CallbackHandler {
     callback_data: Arc<GameBoyCallbackData>
 }
@@ -85,7 +114,9 @@ impl GameboyCallbacks for CallbackHandler {
         //         mutably borrowed.
         let screen = unsafe { &mut *self.callback_data.screen.get() };
 
-        screen.pixels.copy_from_slice(instance.get_pixel_buffer_pixels());
+        if self.callback_data.rendering_enabled.load(Ordering::Relaxed) {
+            screen.pixels.copy_from_slice(instance.get_pixel_buffer_pixels());
+        }
         self.callback_data.run_frames.fetch_add(1, Ordering::Relaxed);
     }
 }
@@ -123,22 +154,20 @@ impl EmulatorCore for GameBoyColor {
         timing
     }
 
-    fn read_ram(&self, address: u32, into: &mut [u8]) -> Result<(), &'static str> {
-        let Some((region, offset)) = pokeabyte_protocol_region_from_address(address) else {
-            return Err("invalid or unknown address");
-        };
-        let Some(offset_end) = offset.checked_add(into.len()) else {
-            return Err("invalid length");
-        };
+    fn frame_rate(&self) -> Option<f64> {
+        Some(GB_FRAME_RATE)
+    }
 
-        let region = self.core.direct_access(region);
-        let Some(data) = region.data.get(offset..offset_end) else {
-            return Err("address+length overflows");
-        };
-        into.copy_from_slice(data);
+    fn read_ram(&self, address: u32, into: &mut [u8]) -> Result<(), &'static str> {
+        into.copy_from_slice(self.direct_ram(address, into.len())?);
         Ok(())
     }
 
+    #[inline]
+    fn ram_slice(&self, address: u32, length: usize) -> Option<&[u8]> {
+        self.direct_ram(address, length).ok()
+    }
+
     fn write_ram(&mut self, address: u32, from: &[u8]) -> Result<(), &'static str> {
         let Some((region, offset)) = pokeabyte_protocol_region_from_address(address) else {
             return Err("invalid or unknown address");
@@ -154,6 +183,22 @@ impl EmulatorCore for GameBoyColor {
         Ok(())
     }
 
+    fn write_range_is_contiguous(&self, address: u32, length: usize) -> bool {
+        let Some(last) = length.checked_sub(1).and_then(|l| u32::try_from(l).ok()).and_then(|l| address.checked_add(l)) else {
+            return false
+        };
+        let (Some((first_region, first_offset)), Some((last_region, last_offset))) = (
+            pokeabyte_protocol_region_from_address(address),
+            pokeabyte_protocol_region_from_address(last)
+        ) else {
+            return false
+        };
+
+        // WRAM bank #1 follows bank #0 in the region but not in the address space
+        core::mem::discriminant(&first_region) == core::mem::discriminant(&last_region)
+            && last_offset.checked_sub(first_offset) == Some(length - 1)
+    }
+
     #[inline]
     fn set_speed(&mut self, speed: f64) {
         self.core.set_clock_multiplier(speed);
@@ -202,6 +247,11 @@ impl EmulatorCore for GameBoyColor {
         core::slice::from_ref(screen_data)
     }
 
+    fn set_rendering_enabled(&mut self, enabled: bool) {
+        self.callback_data.rendering_enabled.store(enabled, Ordering::Relaxed);
+        self.core.set_rendering_enabled(enabled);
+    }
+
     #[inline]
     fn swap_screen_data(&mut self, screens: &mut [ScreenData]) {
         assert_eq!(screens.len(), 1, "Invalid screen count");
@@ -258,6 +308,9 @@ impl EmulatorCore for GameBoyColor {
     }
 }
 
+/// 4194304 Hz / 70224 cycles per frame (the same in double speed mode).
+const GB_FRAME_RATE: f64 = 4194304.0 / 70224.0;
+
 static GB_VERSION_WITH_HACKS: Lazy<String> = Lazy::new(|| {
     alloc::format!("{} with SGB intro skipped", safeboy::GB_VERSION)
 });
@@ -7,28 +7,54 @@ extern crate alloc;
 extern crate std;
 
 use crate::emulator::{EmulatorCore, Input, PartialReplayRecordMetadata, RunTime};
+use crate::pacer::FramePacer;
+use crate::perf::PerfStats;
+use crate::rewind::RewindBuffer;
+use crate::snapshots::{ReplaySnapshot, ReplaySnapshotCache};
+use crate::verify::ReplayVerifier;
 use alloc::borrow::ToOwned;
 use alloc::boxed::Box;
 use alloc::format;
 use alloc::string::String;
+use alloc::sync::Arc;
 use alloc::vec::Vec;
 use core::fmt::{Display, Formatter};
 use core::num::NonZeroU64;
 use supershuckie_replay_recorder::replay_file::playback::{ReplayFilePlayer, ReplaySeekError};
 use supershuckie_replay_recorder::replay_file::record::{NonBlockingReplayFileRecorder, ReplayFileRecorder, ReplayFileRecorderFns, ReplayFileSink, ReplayFileWriteError};
 use supershuckie_replay_recorder::replay_file::{blake3_hash_to_ascii, ReplayFileMetadata, ReplayHeaderBlake3Hash, ReplayPatchFormat};
-use supershuckie_replay_recorder::{ByteVec, Packet, TimestampMillis, UnsignedInteger};
+use supershuckie_replay_recorder::{ByteVec, InputBuffer, Packet, TimestampMillis, UnsignedInteger};
 
 pub mod emulator;
 
 pub use supershuckie_replay_recorder::Speed;
 
+#[cfg(feature = "pokeabyte")]
+pub use supershuckie_pokeabyte_integration::{PokeAByteServerSettings, DEFAULT_PORT as DEFAULT_POKEABYTE_PORT, DEFAULT_SHARED_MEMORY_NAME as DEFAULT_POKEABYTE_SHARED_MEMORY_NAME};
+
+mod pacer;
+pub mod perf;
+mod rewind;
+pub mod screen_filter;
+mod snapshots;
+mod verify;
+
+pub use rewind::RewindSettings;
+pub use snapshots::ReplaySnapshotSettings;
+pub use verify::ReplayVerification;
+
 #[cfg(feature = "std")]
 mod thread;
 
+#[cfg(feature = "std")]
+mod triple_buffer;
+
 #[cfg(feature = "std")]
 pub use thread::*;
 
+/// Maximum number of frames [`SuperShuckieCore::set_run_ahead_frames`] accepts.
+pub const MAX_RUN_AHEAD_FRAMES: u8 = 4;
+
 /// Wrapper for [`EmulatorCore`] that provides useful desktop emulator functionality.
 pub struct SuperShuckieCore {
     core: Box<dyn EmulatorCore>,
@@ -37,6 +63,18 @@ pub struct SuperShuckieCore {
 
     replay_player: Option<ReplayFilePlayer>,
 
+    /// Save states taken while playing back the current replay.
+    replay_snapshots: ReplaySnapshotCache,
+
+    /// The last input applied by the replay player.
+    replay_input: InputBuffer,
+
+    /// Whether the emulator state came from the current replay, so seeking can continue from it.
+    replay_synced: bool,
+
+    /// If set, the emulator state is compared against every keyframe during playback.
+    replay_verifier: Option<ReplayVerifier>,
+
     /// The current user-defined input.
     base_input: Input,
 
@@ -68,9 +106,37 @@ pub struct SuperShuckieCore {
     paused_timer_at: Option<TimestampMillis>,
     game_speed: Speed,
 
+    /// If set, the core is run unthrottled and frames are paced here instead.
+    frame_pacer: Option<FramePacer>,
+
+    /// Save states taken during live play for rewinding.
+    rewind: RewindBuffer,
+    rewinding: bool,
+
+    /// Set if a rewind state was loaded while rewinding and recording, but not recorded yet.
+    rewind_unrecorded: bool,
+
+    /// Frames to speculatively run ahead of every frame; see [`SuperShuckieCore::set_run_ahead_frames`].
+    run_ahead_frames: u8,
+
+    /// Whether frames should be rendered; see [`SuperShuckieCore::set_frame_rendering`].
+    render_frames: bool,
+
+    /// What rendering was last set to on the emulator core.
+    core_rendering: bool,
+
+    /// Whether the current (or just completed) frame will end up on the screens.
+    frame_rendered: bool,
+
     frames_since_last_keyframe: u64,
     frames_per_keyframe: u64,
     total_frames: u64,
+
+    /// If set, timings are recorded here.
+    perf: Option<Arc<PerfStats>>,
+
+    /// Microseconds spent emulating the current frame so far.
+    frame_emulation_micros: u64,
 }
 
 #[derive(Clone, Debug)]
@@ -129,10 +195,24 @@ impl SuperShuckieCore {
             total_milliseconds: 0,
             starting_milliseconds: timestamp_provider.get_timestamp(),
             game_speed: Default::default(),
+            frame_pacer: None,
+            rewind: RewindBuffer::new(RewindSettings::default()),
+            rewinding: false,
+            rewind_unrecorded: false,
+            run_ahead_frames: 0,
+            render_frames: true,
+            core_rendering: true,
+            frame_rendered: true,
             frames_since_last_keyframe: 0,
             frames_per_keyframe: 0,
             total_frames: 0,
+            perf: None,
+            frame_emulation_micros: 0,
             replay_player: None,
+            replay_snapshots: ReplaySnapshotCache::new(ReplaySnapshotSettings::default()),
+            replay_input: InputBuffer::new(),
+            replay_synced: false,
+            replay_verifier: None,
             replay_stalled: false,
             paused_timer_at: None,
             core: emulator_core,
@@ -142,7 +222,52 @@ impl SuperShuckieCore {
 
     /// Run the emulator core for the shortest amount of time.
     pub fn run(&mut self) {
-        self.do_run_fn(EmulatorCore::run);
+        if self.frame_pacer.is_none() {
+            self.do_run_fn(EmulatorCore::run);
+            return
+        }
+
+        self.do_run_fn(EmulatorCore::run_unlocked);
+        if !self.mid_frame && !self.replay_stalled && let Some(pacer) = self.frame_pacer.as_mut() {
+            let start = self.perf.as_ref().map(|_| self.timestamp_provider.get_timestamp_micros());
+            pacer.wait(self.timestamp_provider.as_mut());
+            if let Some(perf) = self.perf.as_ref() && let Some(start) = start {
+                perf.frame_pacing.record(self.timestamp_provider.get_timestamp_micros().saturating_sub(start));
+            }
+        }
+    }
+
+    /// Record timings into `perf` from now on, or stop recording them if `None`.
+    pub fn set_perf_stats(&mut self, perf: Option<Arc<PerfStats>>) {
+        self.perf = perf;
+        self.frame_emulation_micros = 0;
+    }
+
+    /// Pace frames here rather than leaving it to the emulator core.
+    ///
+    /// This is more precise, but it only works if the core reports a frame rate; returns `true`
+    /// if precise pacing is now enabled.
+    pub fn set_precise_frame_pacing(&mut self, enabled: bool) -> bool {
+        if !enabled {
+            self.frame_pacer = None;
+            return false
+        }
+
+        if self.frame_pacer.is_some() {
+            return true
+        }
+
+        let Some(frame_rate) = self.core.frame_rate() else {
+            return false
+        };
+
+        self.frame_pacer = Some(FramePacer::new(frame_rate, self.game_speed.into_multiplier_float()));
+        true
+    }
+
+    /// Return `true` if frames are being paced with [`SuperShuckieCore::set_precise_frame_pacing`].
+    pub fn is_precise_frame_pacing(&self) -> bool {
+        self.frame_pacer.is_some()
     }
 
     /// Run the emulator core for the shortest amount of time without any timekeeping.
@@ -156,11 +281,85 @@ impl SuperShuckieCore {
         }
 
         if !self.replay_stalled {
+            let start = self.perf.as_ref().map(|_| self.timestamp_provider.get_timestamp_micros());
             let time = run_fn(Box::as_mut(&mut self.core));
+            if let Some(start) = start {
+                let elapsed = self.timestamp_provider.get_timestamp_micros().saturating_sub(start);
+                self.frame_emulation_micros = self.frame_emulation_micros.saturating_add(elapsed);
+            }
             self.after_run(&time);
+            self.run_ahead_if_needed();
         }
     }
 
+    /// Show the frame `frames` frames ahead of the current one with the current input, hiding that
+    /// many frames of input lag.
+    ///
+    /// After each frame, the emulator saves its state, runs ahead, and loads the state back, so
+    /// this costs `frames` extra frames of emulation plus a save state per frame. Only the real
+    /// frames are recorded to replays. Has no effect while playing back a replay or rewinding.
+    ///
+    /// `frames` is clamped to [`MAX_RUN_AHEAD_FRAMES`]; 0 disables it.
+    pub fn set_run_ahead_frames(&mut self, frames: u8) {
+        self.run_ahead_frames = frames.min(MAX_RUN_AHEAD_FRAMES);
+    }
+
+    /// Get the number of frames run ahead; see [`SuperShuckieCore::set_run_ahead_frames`].
+    pub fn get_run_ahead_frames(&self) -> u8 {
+        self.run_ahead_frames
+    }
+
+    fn is_running_ahead(&self) -> bool {
+        self.run_ahead_frames > 0 && self.replay_player.is_none() && !self.rewinding
+    }
+
+    fn run_ahead_if_needed(&mut self) {
+        if self.mid_frame || !self.is_running_ahead() {
+            return
+        }
+
+        // This bypasses before_run/after_run so none of it is recorded or counted. The screen
+        // buffer isn't part of the save state, so the last frame stays on screen after loading.
+        let state = self.core.create_save_state();
+        for frame in 1..=self.run_ahead_frames {
+            self.set_core_rendering(self.render_frames && frame == self.run_ahead_frames);
+            while self.core.run_unlocked().frames == 0 {}
+        }
+        let _ = self.core.load_save_state(state.as_slice());
+    }
+
+    /// Set whether frames are rendered, starting with the next frame.
+    ///
+    /// Turning this off speeds up running frames that will never be shown; the screens are left
+    /// alone until it is turned back on. Seeking in a replay only renders the frame sought to,
+    /// regardless of this.
+    pub fn set_frame_rendering(&mut self, enabled: bool) {
+        self.render_frames = enabled;
+    }
+
+    /// Return `true` if the most recently completed frame was rendered (including by running
+    /// ahead), so the screens are up-to-date.
+    pub fn is_frame_rendered(&self) -> bool {
+        self.frame_rendered
+    }
+
+    fn set_core_rendering(&mut self, enabled: bool) {
+        if self.core_rendering != enabled {
+            self.core_rendering = enabled;
+            self.core.set_rendering_enabled(enabled);
+        }
+    }
+
+    fn start_frame_rendering(&mut self) {
+        if self.mid_frame {
+            return
+        }
+
+        // When running ahead, the last frame run ahead is shown instead of this one.
+        self.set_core_rendering(self.render_frames && !self.is_running_ahead());
+        self.frame_rendered = self.render_frames;
+    }
+
     /// Run unlocked until the next frame.
     pub fn finish_current_frame(&mut self) {
         while self.mid_frame && !self.replay_stalled {
@@ -170,10 +369,36 @@ impl SuperShuckieCore {
 
     /// Enqueue a write for the next frame.
     pub fn enqueue_write(&mut self, address: u32, data: ByteVec) {
-        self.writes.push(QueuedWrite { address, data });
+        self.enqueue_writes(core::iter::once((address, data)));
+    }
+
+    /// Enqueue several writes for the next frame.
+    ///
+    /// Writes that overlap or follow on from the previous write are merged into it, so they are
+    /// applied (and recorded) as one, but only if the core says the merged range is contiguous
+    /// (see [`EmulatorCore::write_range_is_contiguous`]).
+    pub fn enqueue_writes<I: IntoIterator<Item = (u32, ByteVec)>>(&mut self, writes: I) {
+        for (address, data) in writes {
+            self.coalesce_write(address, data);
+        }
         self.flush_writes();
     }
 
+    fn coalesce_write(&mut self, address: u32, data: ByteVec) {
+        if let Some(last) = self.writes.last()
+            && let Some(offset) = address.checked_sub(last.address).map(|o| o as usize)
+            && offset <= last.data.len()
+            && self.core.write_range_is_contiguous(last.address, last.data.len().max(offset + data.len()))
+            && let Some(last) = self.writes.last_mut() {
+            let overlap = (last.data.len() - offset).min(data.len());
+            last.data[offset..offset + overlap].copy_from_slice(&data[..overlap]);
+            last.data.extend_from_slice(&data[overlap..]);
+            return
+        }
+
+        self.writes.push(QueuedWrite { address, data });
+    }
+
     /// Pause the current timer.
     pub fn pause_timer(&mut self) {
         self.paused_timer_at = Some(self.total_milliseconds + self.starting_milliseconds);
@@ -187,6 +412,10 @@ impl SuperShuckieCore {
         let unpaused_time = self.timestamp_provider.get_timestamp();
 
         self.starting_milliseconds = self.starting_milliseconds.wrapping_add(unpaused_time.wrapping_sub(paused_time));
+
+        if let Some(pacer) = self.frame_pacer.as_mut() {
+            pacer.reset();
+        }
     }
 
     fn restart_timer(&mut self) {
@@ -205,6 +434,9 @@ impl SuperShuckieCore {
     pub fn set_speed(&mut self, speed: Speed) {
         self.game_speed = Speed::from_multiplier_float(speed.into_multiplier_float());
         self.core.set_speed(speed.into_multiplier_float());
+        if let Some(pacer) = self.frame_pacer.as_mut() {
+            pacer.set_speed(speed.into_multiplier_float());
+        }
         self.with_recorder(|r| r.set_speed(speed));
     }
 
@@ -239,6 +471,7 @@ impl SuperShuckieCore {
                         }
                         Packet::ChangeInput { data } => {
                             self.core.set_input_encoded(data.as_slice());
+                            self.replay_input.clone_from(data);
                         }
                         Packet::ChangeSpeed { speed } => {
                             self.set_speed(*speed);
@@ -250,8 +483,14 @@ impl SuperShuckieCore {
                             let _ = self.core.load_save_state(state.as_slice());
                         },
                         Packet::Bookmark { .. } => {}
-                        Packet::Keyframe { .. } => {}
-                        Packet::CompressedBlob { .. } => unreachable!("compressed blob")
+                        Packet::Keyframe { .. } | Packet::DeltaKeyframe { .. } => {
+                            if let Some(verifier) = self.replay_verifier.as_mut() {
+                                verifier.check(n, self.total_frames, || self.core.create_save_state());
+                            }
+                        }
+                        Packet::SeekIndex { .. } => {}
+                        Packet::CompressedBlob { .. } => unreachable!("compressed blob"),
+                        Packet::RepeatFrames { .. } => unreachable!("repeated frames")
                     }
                 }
                 Err(_) => {
@@ -261,6 +500,14 @@ impl SuperShuckieCore {
             }
         }
 
+        #[cfg(feature = "std")]
+        {
+            let stall = player.take_decompression_stall();
+            if let Some(perf) = self.perf.as_ref() && !stall.is_zero() {
+                perf.decompression_stall.record(stall.as_micros() as u64);
+            }
+        }
+
         self.replay_player = Some(player);
     }
 
@@ -268,11 +515,136 @@ impl SuperShuckieCore {
         self.handle_replay();
         self.update_input();
         self.flush_writes();
+        self.start_frame_rendering();
     }
 
     fn after_run(&mut self, time: &RunTime) {
         self.do_frame_timekeeping(&time);
         self.push_keyframe_if_needed();
+        self.take_replay_snapshot_if_needed();
+        self.capture_rewind_state_if_needed(time);
+    }
+
+    fn capture_rewind_state_if_needed(&mut self, time: &RunTime) {
+        if self.rewinding || self.replay_player.is_some() {
+            return
+        }
+
+        if !self.rewind.advance(time.frames) || self.mid_frame {
+            return
+        }
+
+        self.rewind.push(self.core.create_save_state());
+    }
+
+    /// Set whether the emulator state is compared against every keyframe of a replay being played back.
+    ///
+    /// This creates a save state at every keyframe, so it is best left off outside of verifying replays.
+    pub fn set_replay_verification(&mut self, enabled: bool) {
+        if !enabled {
+            self.replay_verifier = None;
+        }
+        else if self.replay_verifier.is_none() {
+            self.replay_verifier = Some(ReplayVerifier::new());
+        }
+    }
+
+    /// Get the results of [`SuperShuckieCore::set_replay_verification`] since the current replay player was attached.
+    pub fn get_replay_verification(&self) -> Option<ReplayVerification> {
+        self.replay_verifier.as_ref().map(|v| v.results)
+    }
+
+    /// Get the number of frames elapsed since the game (or replay) started.
+    pub fn get_elapsed_frames(&self) -> UnsignedInteger {
+        self.total_frames
+    }
+
+    /// Return `true` if a replay player is attached and everything in it has been played back.
+    pub fn is_replay_finished(&self) -> bool {
+        self.replay_player.is_some() && self.replay_stalled
+    }
+
+    /// Set how often save states are taken during live play for rewinding.
+    ///
+    /// This has no effect while playing back a replay.
+    pub fn set_rewind_settings(&mut self, settings: RewindSettings) {
+        self.rewind.set_settings(settings);
+    }
+
+    /// Set whether the game is being rewound.
+    ///
+    /// No save states are taken for rewinding while this is set; see [`SuperShuckieCore::rewind`].
+    ///
+    /// When recording, states rewound to while this is set are not recorded; only the state the
+    /// game is in once it is cleared is.
+    pub fn set_rewinding(&mut self, rewinding: bool) {
+        self.rewinding = rewinding;
+        if !rewinding {
+            self.record_rewound_state();
+        }
+    }
+
+    fn record_rewound_state(&mut self) {
+        if !core::mem::take(&mut self.rewind_unrecorded) {
+            return
+        }
+
+        let state = self.core.create_save_state();
+        self.with_recorder(|r| r.load_save_state(ByteVec::Heap(state)));
+    }
+
+    /// Return `true` if the game is being rewound.
+    pub fn is_rewinding(&self) -> bool {
+        self.rewinding
+    }
+
+    /// Go back to the most recent save state taken for rewinding, discarding it.
+    ///
+    /// Returns `false` if there is nothing to rewind to or a replay is being played back.
+    pub fn rewind(&mut self) -> bool {
+        if self.replay_player.is_some() {
+            return false
+        }
+
+        let Some(state) = self.rewind.pop() else {
+            return false
+        };
+
+        // Holding rewind steps back many times a second, so only the last state is recorded.
+        let record = !self.rewinding;
+        let rewinding = core::mem::replace(&mut self.rewinding, true);
+        self.load_save_state_inner(state.as_slice(), record);
+        self.rewinding = rewinding;
+        self.rewind_unrecorded |= !record && self.replay_file_recorder.is_some();
+        true
+    }
+
+    fn take_replay_snapshot_if_needed(&mut self) {
+        if self.mid_frame || self.replay_stalled {
+            return
+        }
+
+        let Some(player) = self.replay_player.as_ref() else {
+            return
+        };
+
+        if !self.replay_snapshots.wants(self.total_frames) {
+            return
+        }
+
+        let snapshot = ReplaySnapshot {
+            state: self.core.create_save_state(),
+            input: self.replay_input.clone(),
+            elapsed_millis: self.total_milliseconds,
+            speed: self.game_speed,
+            position: player.get_position()
+        };
+        self.replay_snapshots.insert(self.total_frames, snapshot);
+    }
+
+    /// Set how often save states are taken during replay playback for seeking.
+    pub fn set_replay_snapshot_settings(&mut self, settings: ReplaySnapshotSettings) {
+        self.replay_snapshots.set_settings(settings);
     }
 
     fn flush_writes(&mut self) {
@@ -287,7 +659,10 @@ impl SuperShuckieCore {
         let mut writes = core::mem::take(&mut self.writes);
 
         for write in writes.drain(..) {
-            let _ = self.core.write_ram(write.address, write.data.as_slice());
+            // A write the core rejected didn't happen, so it must not be played back either
+            if self.core.write_ram(write.address, write.data.as_slice()).is_err() {
+                continue
+            }
             self.with_recorder(|recorder| {
                 let _ = recorder.write_memory(write.address as UnsignedInteger, write.data);
             });
@@ -350,6 +725,10 @@ impl SuperShuckieCore {
 
     /// Load a save state.
     pub fn load_save_state(&mut self, state: &[u8]) {
+        self.load_save_state_inner(state, true);
+    }
+
+    fn load_save_state_inner(&mut self, state: &[u8], record: bool) {
         if self.replay_player.is_some() {
             return
         }
@@ -358,7 +737,9 @@ impl SuperShuckieCore {
         let _ = self.core.load_save_state(state);
 
         if self.replay_file_recorder.is_some() {
-            self.with_recorder(|r| r.load_save_state(state.into()));
+            if record {
+                self.with_recorder(|r| r.load_save_state(state.into()));
+            }
         }
         else {
             self.mid_frame = true;
@@ -437,6 +818,8 @@ impl SuperShuckieCore {
     ///
     /// Returns None if no replay was being recorded. Otherwise, returns Some(true) if successfully closed, or Some(false) if not.
     pub fn stop_recording_replay(&mut self) -> Option<bool> {
+        self.record_rewound_state();
+
         if let Some(mut old_recorder) = self.replay_file_recorder.take() {
             return if !old_recorder.is_closed() {
                 Some(old_recorder.close().is_ok())
@@ -500,6 +883,17 @@ impl SuperShuckieCore {
         self.total_frames = self.total_frames.wrapping_add(time.frames);
         self.mid_frame = time.frames == 0;
 
+        if let Some(perf) = self.perf.as_ref() && !self.mid_frame {
+            perf.emulation.record(core::mem::take(&mut self.frame_emulation_micros));
+            if let Some(recorder) = self.replay_file_recorder.as_mut() {
+                perf.recorder_queue_depth.record(recorder.queue_depth() as u64);
+                let stall = recorder.take_queue_stall();
+                if !stall.is_zero() {
+                    perf.recorder_queue_stall.record(stall.as_micros() as u64);
+                }
+            }
+        }
+
         if let Some(rapid_fire) = self.rapid_fire_input.as_mut() {
             rapid_fire.current_frame = rapid_fire.current_frame.wrapping_add(1) % rapid_fire.total_frames;
         }
@@ -525,7 +919,11 @@ impl SuperShuckieCore {
 
         self.frames_since_last_keyframe = 0;
         let ms = self.total_milliseconds;
+        let start = self.perf.as_ref().map(|_| self.timestamp_provider.get_timestamp_micros());
         let save_state = ByteVec::Heap(self.core.create_save_state());
+        if let Some(perf) = self.perf.as_ref() && let Some(start) = start {
+            perf.keyframe_creation.record(self.timestamp_provider.get_timestamp_micros().saturating_sub(start));
+        }
         self.with_recorder(|f| {
             let _ = f.insert_keyframe(save_state, ms);
         });
@@ -567,11 +965,19 @@ impl SuperShuckieCore {
         }
 
         if let Err(e) = player.go_to_keyframe(0) {
-            todo!("can't go to 0th keyframe (and can't handle this error TODO): {e:?}")
+            return Err(ReplayPlayerAttachError::Incompatible {
+                description: format!("Can't read the first keyframe! ({e:?})")
+            })
         }
 
         self.current_input = Input::new();
         self.next_input = None;
+        self.replay_snapshots.clear();
+        self.replay_synced = false;
+        if let Some(verifier) = self.replay_verifier.as_mut() {
+            *verifier = ReplayVerifier::new();
+        }
+        self.rewind.clear();
         self.replay_player = Some(player);
         self.replay_stalled = false;
         self.restart_timer();
@@ -585,6 +991,8 @@ impl SuperShuckieCore {
     pub fn detach_replay_player(&mut self) {
         self.replay_stalled = false;
         self.replay_player = None;
+        self.replay_snapshots.clear();
+        self.replay_synced = false;
         self.reset_input();
     }
 
@@ -610,9 +1018,20 @@ impl SuperShuckieCore {
             return
         }
 
+        if self.resume_replay_closer_to(frame, desired) {
+            self.run_replay_until(desired);
+            return
+        }
+
+        let Some(p) = self.replay_player.as_mut() else {
+            return
+        };
+
         if let Err(e) = p.go_to_keyframe(frame) {
             match e {
-                ReplaySeekError::ReadError { error } => todo!("can't go to {frame}: {error:?} (can't handle this error TODO)"),
+                // The keyframe can't be read (e.g. a broken delta keyframe chain), so stop here
+                // rather than play from the wrong state.
+                ReplaySeekError::ReadError { .. } => return self.stall_broken_replay(),
                 ReplaySeekError::NoSuchKeyframe { best, .. } => {
                     return self.go_to_replay_frame_inner(best, desired);
                 }
@@ -620,12 +1039,19 @@ impl SuperShuckieCore {
         }
 
         let Ok(Some(Packet::Keyframe { metadata, state })) = p.next_packet() else {
-            todo!("replay file is broken (no keyframe found at frame {frame}!! and error handling not yet implemented)")
+            return self.stall_broken_replay()
         };
 
         let speed = metadata.speed;
 
-        self.core.load_save_state(state.as_slice()).expect("replay file is broken (can't load save state) and error handling not yet implemented!");
+        if self.core.load_save_state(state.as_slice()).is_err() {
+            return self.stall_broken_replay()
+        }
+        self.core.set_input_encoded(metadata.input.as_slice());
+        self.replay_input.clone_from(&metadata.input);
+        if let Some(verifier) = self.replay_verifier.as_mut() {
+            verifier.set_previous_keyframe(Some(state.as_slice()));
+        }
 
         self.mid_frame = false;
         self.total_frames = metadata.elapsed_frames;
@@ -633,11 +1059,73 @@ impl SuperShuckieCore {
         self.replay_stalled = false;
         self.frames_since_last_keyframe = 0;
 
+        self.replay_synced = true;
+
         self.set_speed(speed);
+        self.run_replay_until(desired);
+    }
+
+    /// Stop playback because the replay can't be played from here.
+    ///
+    /// The position is unknown afterwards, so the next seek always loads a keyframe.
+    fn stall_broken_replay(&mut self) {
+        self.mid_frame = false;
+        self.replay_stalled = true;
+        self.replay_synced = false;
+    }
+
+    /// Get to somewhere between the keyframe at or before `frame` and `desired` without loading
+    /// the keyframe, either by staying where we are or by loading a snapshot.
+    ///
+    /// Returns `false` if the keyframe needs to be loaded.
+    fn resume_replay_closer_to(&mut self, frame: UnsignedInteger, desired: UnsignedInteger) -> bool {
+        let Some(player) = self.replay_player.as_mut() else {
+            return false
+        };
+
+        let keyframe = player.all_keyframes().range(..=frame).next_back().map(|(k, _)| *k).unwrap_or(0);
+        let snapshot = self.replay_snapshots.closest_at_or_before(desired).filter(|(f, _)| *f >= keyframe);
 
+        // If we're already on the way there, just keep going (e.g. stepping forward a frame).
+        let current = self.total_frames;
+        if self.replay_synced && !self.mid_frame && !self.replay_stalled && (keyframe..=desired).contains(&current) && snapshot.is_none_or(|(f, _)| current >= f) {
+            return true
+        }
+
+        let Some((snapshot_frame, snapshot)) = snapshot else {
+            return false
+        };
+
+        if self.core.load_save_state(snapshot.state.as_slice()).is_err() {
+            return false
+        }
+        self.core.set_input_encoded(snapshot.input.as_slice());
+        self.replay_input.clone_from(&snapshot.input);
+        player.set_position(snapshot.position);
+        if let Some(verifier) = self.replay_verifier.as_mut() {
+            verifier.set_previous_keyframe(None);
+        }
+
+        let speed = snapshot.speed;
+        self.mid_frame = false;
+        self.total_frames = snapshot_frame;
+        self.total_milliseconds = snapshot.elapsed_millis;
+        self.replay_stalled = false;
+        self.frames_since_last_keyframe = 0;
+        self.replay_synced = true;
+
+        self.set_speed(speed);
+        true
+    }
+
+    fn run_replay_until(&mut self, desired: UnsignedInteger) {
+        // Only the frame being sought to is shown, so don't bother rendering the others.
+        let render_frames = self.render_frames;
         while self.total_frames <= desired && !self.replay_stalled {
+            self.render_frames = render_frames && self.total_frames == desired;
             self.run_unlocked();
         }
+        self.render_frames = render_frames;
     }
 }
 
@@ -709,6 +1197,21 @@ impl Display for ReplayPlayerMetadataMismatchKind {
 pub trait MonotonicTimestampProvider {
     /// Get the timestamp.
     fn get_timestamp(&mut self) -> TimestampMillis;
+
+    /// Get the timestamp in microseconds.
+    ///
+    /// This must use the same reference point as [`MonotonicTimestampProvider::get_timestamp`].
+    /// By default, this is just the millisecond timestamp scaled up.
+    fn get_timestamp_micros(&mut self) -> u64 {
+        (self.get_timestamp() as u64).saturating_mul(1000)
+    }
+
+    /// Sleep for approximately the given number of microseconds, or less.
+    ///
+    /// By default, this does nothing, in which case pacing will spin.
+    fn sleep_micros(&mut self, micros: u64) {
+        let _ = micros;
+    }
 }
 
 #[cfg(feature = "std")]
@@ -719,7 +1222,7 @@ pub fn std_timestamp_provider() -> Box<dyn MonotonicTimestampProvider> {
 
 #[cfg(feature = "std")]
 mod std_timestamp_provider {
-    use std::time::Instant;
+    use std::time::{Duration, Instant};
     use supershuckie_replay_recorder::TimestampMillis;
     use crate::MonotonicTimestampProvider;
 
@@ -737,5 +1240,13 @@ mod std_timestamp_provider {
         fn get_timestamp(&mut self) -> TimestampMillis {
             (Instant::now() - self.reference_time).as_millis() as TimestampMillis
         }
+
+        fn get_timestamp_micros(&mut self) -> u64 {
+            (Instant::now() - self.reference_time).as_micros() as u64
+        }
+
+        fn sleep_micros(&mut self, micros: u64) {
+            std::thread::sleep(Duration::from_micros(micros));
+        }
     }
 }
@@ -0,0 +1,76 @@
+//! Frame pacing for cores that can run unthrottled.
+
+use crate::MonotonicTimestampProvider;
+
+/// Anything closer than this to the deadline is spun out instead of slept, since sleeping is only
+/// as accurate as the OS scheduler.
+const SPIN_THRESHOLD_MICROS: u64 = 1500;
+
+/// If we are more than this many frames late, give up on catching up and start counting from now.
+///
+/// This prevents a hitch (e.g. the window being dragged) from being followed by a burst of frames.
+const MAX_FRAMES_BEHIND: f64 = 4.0;
+
+/// Paces frames to a fixed rate against absolute deadlines.
+///
+/// Each deadline is derived from the previous deadline rather than from when the previous frame
+/// actually finished, so oversleeping one frame makes the next one shorter and error does not
+/// accumulate.
+pub(crate) struct FramePacer {
+    /// Native frames per second at 1x speed.
+    frame_rate: f64,
+
+    /// Length of a frame at the current speed, in microseconds.
+    frame_duration: f64,
+
+    /// When the next frame is due, in microseconds, or `None` if the schedule needs to restart.
+    next_deadline: Option<f64>
+}
+
+impl FramePacer {
+    pub fn new(frame_rate: f64, speed: f64) -> Self {
+        let mut pacer = Self { frame_rate, frame_duration: 0.0, next_deadline: None };
+        pacer.set_speed(speed);
+        pacer
+    }
+
+    /// Change the speed multiplier, starting from the next frame.
+    pub fn set_speed(&mut self, speed: f64) {
+        self.frame_duration = 1_000_000.0 / (self.frame_rate * speed);
+    }
+
+    /// Forget the current schedule, such as after being paused.
+    pub fn reset(&mut self) {
+        self.next_deadline = None;
+    }
+
+    /// Wait until the current frame is due, then schedule the next one.
+    pub fn wait(&mut self, timestamp_provider: &mut dyn MonotonicTimestampProvider) {
+        let now = timestamp_provider.get_timestamp_micros() as f64;
+
+        let deadline = match self.next_deadline {
+            Some(deadline) if now - deadline <= self.frame_duration * MAX_FRAMES_BEHIND => deadline,
+            _ => {
+                self.next_deadline = Some(now + self.frame_duration);
+                return
+            }
+        };
+
+        loop {
+            let now = timestamp_provider.get_timestamp_micros() as f64;
+            if now >= deadline {
+                break
+            }
+
+            let remaining = (deadline - now) as u64;
+            if remaining > SPIN_THRESHOLD_MICROS {
+                timestamp_provider.sleep_micros(remaining - SPIN_THRESHOLD_MICROS);
+            }
+            else {
+                core::hint::spin_loop();
+            }
+        }
+
+        self.next_deadline = Some(deadline + self.frame_duration);
+    }
+}
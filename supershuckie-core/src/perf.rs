@@ -0,0 +1,229 @@
+//! Lock-free timing histograms for finding out where frame time goes.
+
+use core::sync::atomic::{AtomicU64, Ordering};
+
+/// Values below this each get their own bucket.
+const LINEAR_BUCKETS: usize = 8;
+
+/// Buckets per power of two past [`LINEAR_BUCKETS`], as a power of two.
+const SUB_BUCKET_BITS: u32 = 3;
+const SUB_BUCKETS: usize = 1 << SUB_BUCKET_BITS;
+
+const BUCKET_COUNT: usize = LINEAR_BUCKETS + (u64::BITS - SUB_BUCKET_BITS) as usize * SUB_BUCKETS;
+
+/// Log-linear histogram of `u64` samples, accurate to within 1/8th of the value.
+///
+/// Recording is wait-free, so it can be done from the core thread while another thread reads it.
+pub struct PerfHistogram {
+    buckets: [AtomicU64; BUCKET_COUNT],
+    count: AtomicU64,
+    sum: AtomicU64,
+    max: AtomicU64
+}
+
+impl PerfHistogram {
+    /// Instantiate an empty histogram.
+    pub const fn new() -> Self {
+        Self {
+            buckets: [const { AtomicU64::new(0) }; BUCKET_COUNT],
+            count: AtomicU64::new(0),
+            sum: AtomicU64::new(0),
+            max: AtomicU64::new(0)
+        }
+    }
+
+    /// Add a sample.
+    pub fn record(&self, value: u64) {
+        self.buckets[bucket_index(value)].fetch_add(1, Ordering::Relaxed);
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.sum.fetch_add(value, Ordering::Relaxed);
+        self.max.fetch_max(value, Ordering::Relaxed);
+    }
+
+    /// Remove all samples.
+    pub fn reset(&self) {
+        for bucket in &self.buckets {
+            bucket.store(0, Ordering::Relaxed);
+        }
+        self.count.store(0, Ordering::Relaxed);
+        self.sum.store(0, Ordering::Relaxed);
+        self.max.store(0, Ordering::Relaxed);
+    }
+
+    /// Summarize the samples.
+    ///
+    /// If samples are recorded while this runs, the result may be slightly inconsistent.
+    pub fn summary(&self) -> PerfSummary {
+        let mut buckets = [0u64; BUCKET_COUNT];
+        let mut count = 0u64;
+        for (into, bucket) in buckets.iter_mut().zip(self.buckets.iter()) {
+            *into = bucket.load(Ordering::Relaxed);
+            count = count.saturating_add(*into);
+        }
+
+        if count == 0 {
+            return PerfSummary::default()
+        }
+
+        let max = self.max.load(Ordering::Relaxed);
+        let percentile = |numerator: u64| -> u64 {
+            let target = count.saturating_mul(numerator).div_ceil(100).max(1);
+            let mut seen = 0u64;
+            for (index, bucket) in buckets.iter().enumerate() {
+                seen += *bucket;
+                if seen >= target {
+                    return bucket_upper_bound(index).min(max)
+                }
+            }
+            max
+        };
+
+        PerfSummary {
+            count,
+            mean: self.sum.load(Ordering::Relaxed) / count,
+            p50: percentile(50),
+            p95: percentile(95),
+            p99: percentile(99),
+            max
+        }
+    }
+}
+
+impl Default for PerfHistogram {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+fn bucket_index(value: u64) -> usize {
+    if value < LINEAR_BUCKETS as u64 {
+        return value as usize
+    }
+
+    let exponent = u64::BITS - 1 - value.leading_zeros();
+    let shift = exponent - SUB_BUCKET_BITS;
+    let sub_bucket = ((value >> shift) as usize) & (SUB_BUCKETS - 1);
+    LINEAR_BUCKETS + shift as usize * SUB_BUCKETS + sub_bucket
+}
+
+fn bucket_lower_bound(index: usize) -> u64 {
+    if index < LINEAR_BUCKETS {
+        return index as u64
+    }
+
+    let shift = (index - LINEAR_BUCKETS) / SUB_BUCKETS;
+    let sub_bucket = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+    ((SUB_BUCKETS + sub_bucket) as u64) << shift
+}
+
+fn bucket_upper_bound(index: usize) -> u64 {
+    if index + 1 >= BUCKET_COUNT {
+        return u64::MAX
+    }
+    bucket_lower_bound(index + 1) - 1
+}
+
+/// Summary of a [`PerfHistogram`].
+///
+/// Percentiles are rounded up to the end of the bucket they fall in.
+#[repr(C)]
+#[derive(Copy, Clone, Default, PartialEq, Debug)]
+pub struct PerfSummary {
+    /// Number of samples
+    pub count: u64,
+
+    /// Average value
+    pub mean: u64,
+
+    /// Median value
+    pub p50: u64,
+
+    /// 95th percentile
+    pub p95: u64,
+
+    /// 99th percentile
+    pub p99: u64,
+
+    /// Largest value
+    pub max: u64
+}
+
+/// Timings collected per frame by [`SuperShuckieCore`](crate::SuperShuckieCore) and the core thread.
+///
+/// All timings are in microseconds.
+#[derive(Default)]
+pub struct PerfStats {
+    /// Time spent running the emulator core per frame
+    pub emulation: PerfHistogram,
+
+    /// Time spent waiting for the next frame with precise frame pacing
+    pub frame_pacing: PerfHistogram,
+
+    /// Time spent handing a finished frame's screens to the frontend
+    pub screen_swap: PerfHistogram,
+
+    /// Time spent copying RAM into Poke-A-Byte's shared memory
+    pub pokeabyte_read: PerfHistogram,
+
+    /// Time spent creating save states for replay keyframes
+    pub keyframe_creation: PerfHistogram,
+
+    /// Time spent waiting on replay data that was not decompressed ahead of time
+    pub decompression_stall: PerfHistogram,
+
+    /// Operations queued for the replay recorder's thread at the end of each frame (not a timing)
+    pub recorder_queue_depth: PerfHistogram,
+
+    /// Time spent waiting for room in the replay recorder's queue
+    pub recorder_queue_stall: PerfHistogram
+}
+
+impl PerfStats {
+    /// Instantiate with no samples.
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Summarize every histogram.
+    pub fn summary(&self) -> PerfStatsSummary {
+        PerfStatsSummary {
+            emulation: self.emulation.summary(),
+            frame_pacing: self.frame_pacing.summary(),
+            screen_swap: self.screen_swap.summary(),
+            pokeabyte_read: self.pokeabyte_read.summary(),
+            keyframe_creation: self.keyframe_creation.summary(),
+            decompression_stall: self.decompression_stall.summary(),
+            recorder_queue_depth: self.recorder_queue_depth.summary(),
+            recorder_queue_stall: self.recorder_queue_stall.summary()
+        }
+    }
+
+    /// Remove all samples from every histogram.
+    pub fn reset(&self) {
+        self.emulation.reset();
+        self.frame_pacing.reset();
+        self.screen_swap.reset();
+        self.pokeabyte_read.reset();
+        self.keyframe_creation.reset();
+        self.decompression_stall.reset();
+        self.recorder_queue_depth.reset();
+        self.recorder_queue_stall.reset();
+    }
+}
+
+/// Summary of [`PerfStats`].
+///
+/// See it for what each field is.
+#[repr(C)]
+#[derive(Copy, Clone, Default, PartialEq, Debug)]
+#[expect(missing_docs)]
+pub struct PerfStatsSummary {
+    pub emulation: PerfSummary,
+    pub frame_pacing: PerfSummary,
+    pub screen_swap: PerfSummary,
+    pub pokeabyte_read: PerfSummary,
+    pub keyframe_creation: PerfSummary,
+    pub decompression_stall: PerfSummary,
+    pub recorder_queue_depth: PerfSummary,
+    pub recorder_queue_stall: PerfSummary
+}
@@ -0,0 +1,128 @@
+//! Save states taken during live play so it can be rewound.
+
+use alloc::collections::VecDeque;
+use alloc::vec::Vec;
+use supershuckie_replay_recorder::replay_file::delta::{apply_diff, diff_state};
+use supershuckie_replay_recorder::ByteVec;
+
+/// Settings for rewinding.
+#[derive(Copy, Clone, PartialEq, Debug)]
+pub struct RewindSettings {
+    /// Take a save state every this many frames, or 0 to disable rewinding.
+    pub interval_frames: u64,
+
+    /// Maximum bytes of save states to hold, or 0 to disable rewinding.
+    ///
+    /// Once exceeded, the oldest save states are dropped first.
+    pub memory_limit: usize
+}
+
+impl Default for RewindSettings {
+    fn default() -> Self {
+        Self {
+            interval_frames: 3,
+            memory_limit: 32 * 1024 * 1024
+        }
+    }
+}
+
+/// Ring of save states, newest last.
+///
+/// Only the newest state is kept in full. Every older state is stored as a diff against the state
+/// after it, so the oldest one can always be dropped without touching the rest.
+pub(crate) struct RewindBuffer {
+    settings: RewindSettings,
+
+    newest: Option<Vec<u8>>,
+
+    /// Diffs that turn each state into the one before it, oldest first.
+    older: VecDeque<ByteVec>,
+    older_bytes: usize,
+
+    frames_since_capture: u64
+}
+
+impl RewindBuffer {
+    pub fn new(settings: RewindSettings) -> Self {
+        Self {
+            settings,
+            newest: None,
+            older: VecDeque::new(),
+            older_bytes: 0,
+            frames_since_capture: 0
+        }
+    }
+
+    pub fn set_settings(&mut self, settings: RewindSettings) {
+        self.settings = settings;
+        if !self.is_enabled() {
+            self.clear();
+        }
+        else {
+            self.trim();
+        }
+    }
+
+    pub fn clear(&mut self) {
+        self.newest = None;
+        self.older.clear();
+        self.older_bytes = 0;
+        self.frames_since_capture = 0;
+    }
+
+    pub fn is_enabled(&self) -> bool {
+        self.settings.interval_frames != 0 && self.settings.memory_limit != 0
+    }
+
+    /// Count `frames` elapsed frames, returning `true` if a state should be captured now.
+    pub fn advance(&mut self, frames: u64) -> bool {
+        if !self.is_enabled() {
+            return false
+        }
+
+        self.frames_since_capture = self.frames_since_capture.saturating_add(frames);
+        self.frames_since_capture >= self.settings.interval_frames
+    }
+
+    pub fn push(&mut self, state: Vec<u8>) {
+        self.frames_since_capture = 0;
+
+        if let Some(previous) = self.newest.take() {
+            let diff = diff_state(state.as_slice(), previous.as_slice());
+            self.older_bytes += diff.len();
+            self.older.push_back(diff);
+        }
+
+        self.newest = Some(state);
+        self.trim();
+    }
+
+    /// Take the newest state, making the one before it the newest.
+    pub fn pop(&mut self) -> Option<Vec<u8>> {
+        let newest = self.newest.take()?;
+
+        if let Some(diff) = self.older.pop_back() {
+            self.older_bytes -= diff.len();
+
+            // A diff we made ourselves can only fail to apply if something is very wrong; give up
+            // on everything older rather than rewinding into garbage.
+            match apply_diff(newest.as_slice(), diff.as_slice()) {
+                Ok(previous) => self.newest = Some(previous),
+                Err(_) => self.clear()
+            }
+        }
+
+        self.frames_since_capture = 0;
+        Some(newest)
+    }
+
+    fn trim(&mut self) {
+        let newest_bytes = self.newest.as_ref().map(|s| s.len()).unwrap_or(0);
+        while newest_bytes + self.older_bytes > self.settings.memory_limit {
+            let Some(oldest) = self.older.pop_front() else {
+                break
+            };
+            self.older_bytes -= oldest.len();
+        }
+    }
+}
@@ -0,0 +1,199 @@
+//! Converting and upscaling screens on the CPU before they are handed to the frontend.
+
+use crate::emulator::{ScreenData, ScreenDataEncoding};
+use alloc::vec::Vec;
+use core::num::NonZeroU8;
+
+/// Upscaler used by [`ScreenFilter`].
+#[derive(Copy, Clone, PartialEq, Debug)]
+pub enum ScreenScaler {
+    /// Repeat each pixel.
+    Nearest,
+
+    /// Scale2x (also known as AdvMAME2x), which rounds off diagonal edges without blurring.
+    ///
+    /// This is applied once for every factor of two in the scale; anything left over is scaled
+    /// with [`ScreenScaler::Nearest`].
+    Scale2x
+}
+
+/// Settings for a [`ScreenFilter`].
+#[derive(Copy, Clone, PartialEq, Debug)]
+pub struct ScreenFilterSettings {
+    /// Encoding to output
+    pub encoding: ScreenDataEncoding,
+
+    /// Upscaler to use if `scale` is greater than 1
+    pub scaler: ScreenScaler,
+
+    /// Factor to scale by
+    pub scale: NonZeroU8
+}
+
+impl ScreenFilterSettings {
+    /// Return `true` if a filter with these settings would output screens unchanged.
+    pub fn is_passthrough(&self) -> bool {
+        self.encoding == ScreenDataEncoding::A8R8G8B8 && self.scale.get() == 1
+    }
+}
+
+impl Default for ScreenFilterSettings {
+    fn default() -> Self {
+        Self {
+            encoding: ScreenDataEncoding::A8R8G8B8,
+            scaler: ScreenScaler::Nearest,
+            scale: NonZeroU8::MIN
+        }
+    }
+}
+
+/// Scales and converts screens, keeping its intermediate buffers between frames.
+pub struct ScreenFilter {
+    settings: ScreenFilterSettings,
+    front: Vec<u32>,
+    back: Vec<u32>
+}
+
+impl ScreenFilter {
+    /// Instantiate a filter with the given settings.
+    pub fn new(settings: ScreenFilterSettings) -> Self {
+        Self { settings, front: Vec::new(), back: Vec::new() }
+    }
+
+    /// Get the settings.
+    pub fn settings(&self) -> &ScreenFilterSettings {
+        &self.settings
+    }
+
+    /// Scale and convert `from` into `into`, resizing `into` as needed.
+    ///
+    /// `from` must be [`ScreenDataEncoding::A8R8G8B8`], which is what every core outputs.
+    pub fn apply(&mut self, from: &ScreenData, into: &mut ScreenData) {
+        debug_assert_eq!(from.encoding, ScreenDataEncoding::A8R8G8B8, "can only filter A8R8G8B8 screens");
+
+        let (mut width, mut height) = (from.width, from.height);
+        let mut scale = if from.pixels.is_empty() { 1 } else { self.settings.scale.get() as usize };
+
+        // Whether the image so far is in `front` rather than still in `from`
+        let mut scaled = false;
+
+        if self.settings.scaler == ScreenScaler::Scale2x {
+            while scale % 2 == 0 {
+                let source: &[u32] = if scaled { &self.front } else { &from.pixels };
+                scale2x(source, width, height, &mut self.back);
+                core::mem::swap(&mut self.front, &mut self.back);
+                scaled = true;
+                width *= 2;
+                height *= 2;
+                scale /= 2;
+            }
+        }
+
+        if scale > 1 {
+            let source: &[u32] = if scaled { &self.front } else { &from.pixels };
+            scale_nearest(source, width, height, scale, &mut self.back);
+            core::mem::swap(&mut self.front, &mut self.back);
+            scaled = true;
+            width *= scale;
+            height *= scale;
+        }
+
+        into.width = width;
+        into.height = height;
+        into.encoding = self.settings.encoding;
+
+        match self.settings.encoding {
+            // Hand over the scaled image rather than copying it; the old buffer is reused next frame.
+            ScreenDataEncoding::A8R8G8B8 if scaled => core::mem::swap(&mut into.pixels, &mut self.front),
+            ScreenDataEncoding::A8R8G8B8 => into.pixels.clone_from(&from.pixels),
+            ScreenDataEncoding::R5G6B5 => {
+                let source: &[u32] = if scaled { &self.front } else { &from.pixels };
+                into.pixels.resize(ScreenDataEncoding::R5G6B5.words_for_pixels(source.len()), 0);
+                convert_to_r5g6b5(source, into.pixels.as_mut_slice());
+            }
+        }
+    }
+}
+
+fn scale_nearest(from: &[u32], width: usize, height: usize, scale: usize, into: &mut Vec<u32>) {
+    let out_width = width * scale;
+    into.resize(out_width * height * scale, 0);
+
+    for (row, out_rows) in from.chunks_exact(width).zip(into.chunks_exact_mut(out_width * scale)) {
+        let (first, rest) = out_rows.split_at_mut(out_width);
+        for (pixel, out) in row.iter().zip(first.chunks_exact_mut(scale)) {
+            out.fill(*pixel);
+        }
+        for out_row in rest.chunks_exact_mut(out_width) {
+            out_row.copy_from_slice(first);
+        }
+    }
+}
+
+fn scale2x(from: &[u32], width: usize, height: usize, into: &mut Vec<u32>) {
+    let out_width = width * 2;
+    into.resize(out_width * height * 2, 0);
+
+    for y in 0..height {
+        let row = &from[y * width..][..width];
+        let above = &from[y.saturating_sub(1) * width..][..width];
+        let below = &from[(y + 1).min(height - 1) * width..][..width];
+
+        let (out_top, out_bottom) = into[y * out_width * 2..][..out_width * 2].split_at_mut(out_width);
+
+        for x in 0..width {
+            let center = row[x];
+            let left = row[x.saturating_sub(1)];
+            let right = row[(x + 1).min(width - 1)];
+            let (a, b) = (above[x], below[x]);
+
+            let mut e = [center; 4];
+            if a != b && left != right {
+                if left == a { e[0] = left }
+                if a == right { e[1] = right }
+                if left == b { e[2] = left }
+                if b == right { e[3] = right }
+            }
+
+            out_top[x * 2..][..2].copy_from_slice(&e[..2]);
+            out_bottom[x * 2..][..2].copy_from_slice(&e[2..]);
+        }
+    }
+}
+
+fn convert_to_r5g6b5(from: &[u32], into: &mut [u32]) {
+    #[cfg(all(feature = "std", any(target_arch = "x86", target_arch = "x86_64")))]
+    if std::is_x86_feature_detected!("avx2") {
+        // SAFETY: AVX2 is supported.
+        return unsafe { convert_to_r5g6b5_avx2(from, into) }
+    }
+
+    // SSE2 on x86-64 and NEON on AArch64 are always available, so this is vectorized for them too
+    convert_to_r5g6b5_generic(from, into)
+}
+
+#[cfg(all(feature = "std", any(target_arch = "x86", target_arch = "x86_64")))]
+#[target_feature(enable = "avx2")]
+fn convert_to_r5g6b5_avx2(from: &[u32], into: &mut [u32]) {
+    convert_to_r5g6b5_generic(from, into)
+}
+
+/// Written so it is vectorized for whatever target features it is inlined into.
+#[inline(always)]
+fn convert_to_r5g6b5_generic(from: &[u32], into: &mut [u32]) {
+    #[inline(always)]
+    fn pixel(argb: u32) -> u32 {
+        ((argb >> 8) & 0xF800) | ((argb >> 5) & 0x07E0) | ((argb >> 3) & 0x001F)
+    }
+
+    let pairs = from.chunks_exact(2);
+    let remainder = pairs.remainder();
+    let (into_pairs, into_remainder) = into.split_at_mut(from.len() / 2);
+
+    for (out, pair) in into_pairs.iter_mut().zip(pairs) {
+        *out = pixel(pair[0]) | (pixel(pair[1]) << 16);
+    }
+    if let ([last], [out]) = (remainder, into_remainder) {
+        *out = pixel(*last);
+    }
+}
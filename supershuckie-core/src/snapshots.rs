@@ -0,0 +1,105 @@
+//! Save states taken during replay playback, so seeking does not have to re-emulate from a keyframe.
+
+use alloc::collections::BTreeMap;
+use alloc::vec::Vec;
+use supershuckie_replay_recorder::replay_file::playback::ReplayPlaybackPosition;
+use supershuckie_replay_recorder::{InputBuffer, Speed, TimestampMillis, UnsignedInteger};
+
+/// Settings for the replay snapshot cache.
+#[derive(Copy, Clone, PartialEq, Debug)]
+pub struct ReplaySnapshotSettings {
+    /// Take a snapshot every this many frames during playback, or 0 to disable snapshots.
+    pub interval_frames: u64,
+
+    /// Maximum bytes of snapshots to hold, or 0 to disable snapshots.
+    ///
+    /// Once exceeded, snapshots farthest from the current frame are dropped first.
+    pub memory_limit: usize
+}
+
+impl Default for ReplaySnapshotSettings {
+    fn default() -> Self {
+        Self {
+            interval_frames: 30,
+            memory_limit: 64 * 1024 * 1024
+        }
+    }
+}
+
+pub(crate) struct ReplaySnapshot {
+    pub state: Vec<u8>,
+    pub input: InputBuffer,
+    pub elapsed_millis: TimestampMillis,
+    pub speed: Speed,
+
+    /// Where the player was right after the snapshot's last frame.
+    pub position: ReplayPlaybackPosition
+}
+
+pub(crate) struct ReplaySnapshotCache {
+    settings: ReplaySnapshotSettings,
+    used_bytes: usize,
+
+    /// Keyed by the number of elapsed frames.
+    snapshots: BTreeMap<UnsignedInteger, ReplaySnapshot>
+}
+
+impl ReplaySnapshotCache {
+    pub fn new(settings: ReplaySnapshotSettings) -> Self {
+        Self { settings, used_bytes: 0, snapshots: BTreeMap::new() }
+    }
+
+    pub fn set_settings(&mut self, settings: ReplaySnapshotSettings) {
+        self.settings = settings;
+        if !self.is_enabled() {
+            self.clear();
+        }
+        else if let Some(&last) = self.snapshots.keys().next_back() {
+            self.trim(last);
+        }
+    }
+
+    /// Drop all snapshots, such as when a different replay is played.
+    pub fn clear(&mut self) {
+        self.snapshots.clear();
+        self.used_bytes = 0;
+    }
+
+    fn is_enabled(&self) -> bool {
+        self.settings.interval_frames != 0 && self.settings.memory_limit != 0
+    }
+
+    /// Return `true` if a snapshot should be taken at `frame`.
+    pub fn wants(&self, frame: UnsignedInteger) -> bool {
+        self.is_enabled() && frame % self.settings.interval_frames == 0 && !self.snapshots.contains_key(&frame)
+    }
+
+    pub fn insert(&mut self, frame: UnsignedInteger, snapshot: ReplaySnapshot) {
+        self.used_bytes += snapshot_size(&snapshot);
+        if let Some(old) = self.snapshots.insert(frame, snapshot) {
+            self.used_bytes -= snapshot_size(&old);
+        }
+        self.trim(frame);
+    }
+
+    /// Get the latest snapshot at or before `frame`.
+    pub fn closest_at_or_before(&self, frame: UnsignedInteger) -> Option<(UnsignedInteger, &ReplaySnapshot)> {
+        self.snapshots.range(..=frame).next_back().map(|(frame, snapshot)| (*frame, snapshot))
+    }
+
+    /// Drop snapshots farthest from `frame` until within the memory limit, keeping at least one.
+    fn trim(&mut self, frame: UnsignedInteger) {
+        while self.used_bytes > self.settings.memory_limit && self.snapshots.len() > 1 {
+            let (&first, _) = self.snapshots.first_key_value().expect("no first snapshot");
+            let (&last, _) = self.snapshots.last_key_value().expect("no last snapshot");
+            let farthest = if frame.abs_diff(first) >= frame.abs_diff(last) { first } else { last };
+
+            let removed = self.snapshots.remove(&farthest).expect("no farthest snapshot");
+            self.used_bytes -= snapshot_size(&removed);
+        }
+    }
+}
+
+fn snapshot_size(snapshot: &ReplaySnapshot) -> usize {
+    snapshot.state.len() + snapshot.input.len()
+}
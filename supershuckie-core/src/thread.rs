@@ -1,31 +1,41 @@
 use crate::emulator::{EmulatorCore, Input, PartialReplayRecordMetadata, ScreenData};
+use crate::perf::{PerfStats, PerfStatsSummary};
+use crate::screen_filter::{ScreenFilter, ScreenFilterSettings};
 use crate::{std_timestamp_provider, ReplayPlayerAttachError, Speed};
-use crate::{SuperShuckieCore, SuperShuckieRapidFire};
+use crate::{ReplaySnapshotSettings, RewindSettings, SuperShuckieCore, SuperShuckieRapidFire};
+use crate::triple_buffer::{triple_buffer, TripleBufferReader, TripleBufferWriter};
 use std::borrow::ToOwned;
 use std::boxed::Box;
 use std::fs::File;
 use std::string::String;
-use std::sync::atomic::{AtomicI32, AtomicU32, Ordering};
-use std::sync::mpsc::{channel, Receiver, Sender};
-use std::sync::{Arc, Mutex, TryLockError, Weak};
-use std::time::Duration;
+use std::sync::atomic::{AtomicBool, AtomicI32, AtomicU32, Ordering};
+use std::sync::mpsc::{channel, Receiver, RecvTimeoutError, Sender};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
 use std::vec::Vec;
 use std::format;
 #[cfg(feature = "pokeabyte")]
-use supershuckie_pokeabyte_integration::PokeAByteIntegrationServer;
+use supershuckie_pokeabyte_integration::{PokeAByteIntegrationServer, PokeAByteServerSettings};
 use supershuckie_replay_recorder::replay_file::playback::ReplayFilePlayer;
 use supershuckie_replay_recorder::UnsignedInteger;
 
+/// Callback invoked on the core thread whenever new screens are published.
+///
+/// This should return quickly (e.g. by waking up another thread), since it blocks emulation.
+pub type FrameReadyCallback = Arc<dyn Fn() + Send + Sync>;
+
 /// A (mostly) non-blocking, threaded wrapper for [`SuperShuckieCore`].
 pub struct ThreadedSuperShuckieCore {
-    screens: Arc<Mutex<Vec<ScreenData>>>,
+    screens: TripleBufferReader<Vec<ScreenData>>,
     sender: Sender<ThreadCommand>,
     receiver_close: Receiver<()>,
+    waker: ThreadWaker,
 
     frame_count: Arc<AtomicU32>,
     elapsed_milliseconds: Arc<AtomicU32>,
     desired_replay_frame: Arc<AtomicU32>,
     delta_replay_frames: Arc<AtomicI32>,
+    perf: Arc<PerfStats>,
 
     playback: bool,
     playback_total_frames: UnsignedInteger,
@@ -36,37 +46,52 @@ impl ThreadedSuperShuckieCore {
     /// Wrap the given `core`.
     pub fn new(emulator_core: Box<dyn EmulatorCore>) -> Self {
         let frame_count = Arc::new(AtomicU32::new(0));
-        let screens = Arc::new(Mutex::new(emulator_core.get_screens().to_vec()));
+        let (screens_writer, screens) = triple_buffer(emulator_core.get_screens().to_vec());
         let (sender, receiver) = channel();
         let (sender_close, receiver_close) = channel();
+        let waker = ThreadWaker { sender: sender.clone(), wake_pending: Arc::new(AtomicBool::new(false)) };
 
         let replay_milliseconds = Arc::new(AtomicU32::new(0));
         let playback_total_frames = 0;
         let playback_total_milliseconds = 0;
         let desired_replay_frame = Arc::new(AtomicU32::new(u32::MAX));
         let delta_replay_frames = Arc::new(AtomicI32::new(0));
+        let perf = Arc::new(PerfStats::new());
 
         {
             let frame_count = frame_count.clone();
-            let screens = Arc::downgrade(&screens);
             let replay_milliseconds = replay_milliseconds.clone();
             let desired_replay_frame = desired_replay_frame.clone();
             let delta_replay_frames = delta_replay_frames.clone();
+            let waker = waker.clone();
+            let perf = perf.clone();
             let _ = std::thread::Builder::new().name("ThreadedSuperShuckieCore".to_owned()).spawn(move || {
+                let mut core = SuperShuckieCore::new(emulator_core, std_timestamp_provider());
+                core.set_perf_stats(Some(perf.clone()));
+
                 ThreadedSuperShuckieCoreThread {
-                    screens,
-                    screens_queued: emulator_core.get_screens().to_vec(),
-                    screen_ready_for_copy: false,
+                    screens: screens_writer,
+                    published_frames: 0,
+                    frame_ready_callback: None,
                     is_running: false,
-                    core: SuperShuckieCore::new(emulator_core, std_timestamp_provider()),
+                    core,
                     pokeabyte_integration: None,
+                    pokeabyte_notified: Arc::new(AtomicBool::new(false)),
+                    pokeabyte_read_frames: None,
+                    pokeabyte_scratch: Vec::new(),
                     receiver,
                     sender_close,
+                    waker,
                     desired_replay_frame,
                     frame_count,
                     replay_milliseconds,
                     delta_replay_frames,
-                    playback_frozen: false
+                    playback_frozen: false,
+                    next_rewind_step: None,
+                    min_render_interval: min_render_interval(DEFAULT_DISPLAY_REFRESH_RATE),
+                    last_rendered_frame: None,
+                    screen_filter: None,
+                    perf
                 }.run_thread();
             });
         }
@@ -75,31 +100,59 @@ impl ThreadedSuperShuckieCore {
             sender,
             screens,
             receiver_close,
+            waker,
             frame_count,
             elapsed_milliseconds: replay_milliseconds,
             playback_total_frames,
             playback_total_milliseconds,
             playback: false,
             desired_replay_frame,
-            delta_replay_frames
+            delta_replay_frames,
+            perf
         }
     }
 
-    /// Get the elapsed frame count.
+    /// Summarize the timings collected since the core was created or [`Self::reset_perf_stats`] was called.
     ///
-    /// This can be called to ensure that a unique frame is ready to be read. Note, however, that
-    /// this number may be slightly outdated.
+    /// This does not block the core thread.
+    pub fn get_perf_stats(&self) -> PerfStatsSummary {
+        self.perf.summary()
+    }
+
+    /// Discard all timings collected so far.
+    pub fn reset_perf_stats(&self) {
+        self.perf.reset();
+    }
+
+    /// Get the elapsed frame count of the most recently published screens.
+    ///
+    /// Note that this number may be slightly outdated.
     pub fn get_elapsed_frames(&self) -> u32 {
         self.frame_count.load(Ordering::Relaxed)
     }
 
-    /// Read the screens.
+    /// Get the sequence number of the newest screens.
     ///
-    /// Note that while this function is running, the screen buffer will be blocked from being
-    /// updated and may not be immediately updated until later.
-    pub fn read_screens<T, F: FnOnce(&[ScreenData]) -> T>(&self, reader: F) -> T {
-        let lock = self.screens.lock().expect("screen mutex is poisoned");
-        reader(lock.as_slice())
+    /// This increases every time the core thread publishes new screens, so it can be compared
+    /// against a previous value to see if a unique frame is ready to be read. To read the screens
+    /// along with their sequence number, use [`Self::read_screens_with_sequence`] instead, as new
+    /// screens may be published between two calls.
+    pub fn get_screen_sequence(&mut self) -> u64 {
+        self.screens.update();
+        self.screens.sequence()
+    }
+
+    /// Read the newest screens.
+    ///
+    /// This never blocks the core thread, which can keep publishing new screens while this runs.
+    pub fn read_screens<T, F: FnOnce(&[ScreenData]) -> T>(&mut self, reader: F) -> T {
+        self.read_screens_with_sequence(|screens, _| reader(screens))
+    }
+
+    /// Read the newest screens along with their sequence number (see [`Self::get_screen_sequence`]).
+    pub fn read_screens_with_sequence<T, F: FnOnce(&[ScreenData], u64) -> T>(&mut self, reader: F) -> T {
+        self.screens.update();
+        reader(self.screens.front().as_slice(), self.screens.sequence())
     }
 
     /// Start running continuously.
@@ -120,11 +173,21 @@ impl ThreadedSuperShuckieCore {
             .expect("SetPlaybackFrozen - the core thread has crashed");
     }
 
-    /// Attach/detach a Poke-A-Byte integration server.
-    pub fn set_pokeabyte_enabled(&self, enabled: bool) -> Result<(), String> {
+    /// Set a callback to call whenever new screens are published.
+    ///
+    /// This lets the caller wait for new frames instead of polling [`Self::get_screen_sequence`].
+    pub fn set_frame_ready_callback(&self, callback: Option<FrameReadyCallback>) {
+        self.sender.send(ThreadCommand::SetFrameReadyCallback(callback))
+            .expect("SetFrameReadyCallback - the core thread has crashed");
+    }
+
+    /// Attach a Poke-A-Byte integration server with the given settings, or detach it if `None`.
+    ///
+    /// Any server already attached is closed first, so this can also be used to change settings.
+    pub fn set_pokeabyte_enabled(&self, settings: Option<PokeAByteServerSettings>) -> Result<(), String> {
         let (sender, receiver) = channel();
 
-        self.sender.send(ThreadCommand::SetPokeAByteEnabled(enabled, sender))
+        self.sender.send(ThreadCommand::SetPokeAByteEnabled(settings, sender))
             .expect("SetPokeAByteEnabled - the core thread has crashed");
 
         receiver.recv().ok().unwrap_or(Ok(()))
@@ -158,6 +221,68 @@ impl ThreadedSuperShuckieCore {
             .expect("SetSpeed - the core thread has crashed");
     }
 
+    /// Set whether frames are paced by the core thread rather than the emulator core.
+    ///
+    /// Returns `true` if precise pacing is now enabled.
+    pub fn set_precise_frame_pacing(&self, enabled: bool) -> bool {
+        let (sender, receiver) = channel();
+
+        self.sender.send(ThreadCommand::SetPreciseFramePacing(enabled, sender))
+            .expect("SetPreciseFramePacing - the core thread has crashed");
+
+        receiver.recv().ok().unwrap_or(false)
+    }
+
+    /// Set the number of frames to run ahead to hide input lag, or 0 to disable it.
+    ///
+    /// See [`SuperShuckieCore::set_run_ahead_frames`].
+    pub fn set_run_ahead_frames(&self, frames: u8) {
+        self.sender.send(ThreadCommand::SetRunAheadFrames(frames))
+            .expect("SetRunAheadFrames - the core thread has crashed");
+    }
+
+    /// Set the refresh rate of the display the screens are shown on, in Hz.
+    ///
+    /// When frames come in faster than this can show, some are not rendered at all, which makes
+    /// fast-forwarding faster. Default is 60 Hz.
+    pub fn set_display_refresh_rate(&self, refresh_rate: f64) {
+        self.sender.send(ThreadCommand::SetDisplayRefreshRate(refresh_rate))
+            .expect("SetDisplayRefreshRate - the core thread has crashed");
+    }
+
+    /// Set how screens are scaled and converted on the core thread before they are published.
+    ///
+    /// Once this returns, screens read from this core use the new settings.
+    pub fn set_screen_filter(&self, settings: ScreenFilterSettings) {
+        let (sender, receiver) = channel();
+
+        self.sender.send(ThreadCommand::SetScreenFilter(settings, sender))
+            .expect("SetScreenFilter - the core thread has crashed");
+
+        let _ = receiver.recv();
+    }
+
+    /// Set how often save states are taken during replay playback for seeking.
+    pub fn set_replay_snapshot_settings(&self, settings: ReplaySnapshotSettings) {
+        self.sender.send(ThreadCommand::SetReplaySnapshotSettings(settings))
+            .expect("SetReplaySnapshotSettings - the core thread has crashed");
+    }
+
+    /// Set how often save states are taken during live play for rewinding.
+    pub fn set_rewind_settings(&self, settings: RewindSettings) {
+        self.sender.send(ThreadCommand::SetRewindSettings(settings))
+            .expect("SetRewindSettings - the core thread has crashed");
+    }
+
+    /// Set whether the game is being rewound.
+    ///
+    /// While set, the core thread steps back through its rewind save states instead of running
+    /// the game, stopping at the oldest one.
+    pub fn set_rewinding(&self, rewinding: bool) {
+        self.sender.send(ThreadCommand::SetRewinding(rewinding))
+            .expect("SetRewinding - the core thread has crashed");
+    }
+
     /// Set the speed.
     pub fn hard_reset(&self) {
         self.sender.send(ThreadCommand::HardReset)
@@ -182,10 +307,18 @@ impl ThreadedSuperShuckieCore {
     ///
     /// NOTE: This is blocking.
     pub fn create_save_state(&self) -> Option<Vec<u8>> {
+        self.request_save_state().recv().ok()
+    }
+
+    /// Create a save state without waiting for it.
+    ///
+    /// The save state is sent to the returned receiver once the core thread gets to it, so it can
+    /// be waited on elsewhere (e.g. by a thread that writes it to disk).
+    pub fn request_save_state(&self) -> Receiver<Vec<u8>> {
         let (sender, receiver) = channel();
         self.sender.send(ThreadCommand::CreateSaveState(sender))
             .expect("CreateSaveState - the core thread has crashed");
-        receiver.recv().ok()
+        receiver
     }
 
     /// Load a save state.
@@ -200,10 +333,17 @@ impl ThreadedSuperShuckieCore {
     ///
     /// NOTE: This is blocking.
     pub fn get_sram(&self) -> Option<Vec<u8>> {
+        self.request_sram().recv().ok()
+    }
+
+    /// Get SRAM without waiting for it.
+    ///
+    /// See [`Self::request_save_state`].
+    pub fn request_sram(&self) -> Receiver<Vec<u8>> {
         let (sender, receiver) = channel();
         self.sender.send(ThreadCommand::SaveSRAM(sender))
             .expect("SaveSRAM - the core thread has crashed");
-        receiver.recv().ok()
+        receiver
     }
 
     /// Get the number of milliseconds a replay has been recorded.
@@ -270,12 +410,14 @@ impl ThreadedSuperShuckieCore {
         // we use an AtomicU32 instead of just directly going to a frame
         // because we do not want to clog the queue with goto requests
         self.desired_replay_frame.store(frame, Ordering::Relaxed);
+        self.waker.wake();
     }
 
     /// Advance or go back some frames.
     pub fn advance_playback_frames(&self, amount: i32) {
         // similarly use AtomicI32 to avoid clogging the queue
         self.delta_replay_frames.store(amount, Ordering::Relaxed);
+        self.waker.wake();
     }
 }
 
@@ -294,7 +436,8 @@ enum ThreadCommand {
     Start,
     Pause,
     SetPlaybackFrozen(bool),
-    SetPokeAByteEnabled(bool, Sender<Result<(), String>>),
+    SetPokeAByteEnabled(Option<PokeAByteServerSettings>, Sender<Result<(), String>>),
+    SetFrameReadyCallback(Option<FrameReadyCallback>),
     StartRecordingReplay(PartialReplayRecordMetadata<File, File>),
     StopRecordingReplay(Sender<bool>),
     AttachReplayPlayer {
@@ -307,63 +450,146 @@ enum ThreadCommand {
     SetRapidFireInput(Option<SuperShuckieRapidFire>),
     SetToggledInput(Option<Input>),
     SetSpeed(Speed),
+    SetPreciseFramePacing(bool, Sender<bool>),
+    SetRunAheadFrames(u8),
+    SetDisplayRefreshRate(f64),
+    SetScreenFilter(ScreenFilterSettings, Sender<()>),
+    SetReplaySnapshotSettings(ReplaySnapshotSettings),
+    SetRewindSettings(RewindSettings),
+    SetRewinding(bool),
     HardReset,
     CreateSaveState(Sender<Vec<u8>>),
     LoadSaveState(Vec<u8>),
     SaveSRAM(Sender<Vec<u8>>),
+
+    /// Do nothing; just makes the thread look at its atomics/Poke-A-Byte session again.
+    Wake,
     Close
 }
 
+/// Wakes up the core thread if it's blocked waiting for a command.
+///
+/// Repeated wakes are coalesced into one [`ThreadCommand::Wake`] so they don't clog the queue.
+#[derive(Clone)]
+struct ThreadWaker {
+    sender: Sender<ThreadCommand>,
+    wake_pending: Arc<AtomicBool>
+}
+
+impl ThreadWaker {
+    fn wake(&self) {
+        if !self.wake_pending.swap(true, Ordering::AcqRel) {
+            let _ = self.sender.send(ThreadCommand::Wake);
+        }
+    }
+}
+
+/// Maximum time to block while idle.
+///
+/// Everything that needs the thread's attention wakes it up, so this is only a safety net.
+const IDLE_TIMEOUT: Duration = Duration::from_secs(1);
+
+/// Refresh rate assumed until [`ThreadedSuperShuckieCore::set_display_refresh_rate`] is called.
+const DEFAULT_DISPLAY_REFRESH_RATE: f64 = 60.0;
+
+/// Frames are rendered at up to this many times the display refresh rate, so that a frame is
+/// always ready for every refresh even with some jitter.
+const RENDER_RATE_PER_REFRESH: f64 = 2.0;
+
+fn min_render_interval(display_refresh_rate: f64) -> Duration {
+    let rate = if display_refresh_rate.is_finite() && display_refresh_rate > 0.0 { display_refresh_rate } else { DEFAULT_DISPLAY_REFRESH_RATE };
+    Duration::from_secs_f64(1.0 / (rate * RENDER_RATE_PER_REFRESH))
+}
+
+/// Time shown per rewind step.
+const REWIND_STEP_DURATION: Duration = Duration::from_micros(1_000_000 / 60);
+
 struct ThreadedSuperShuckieCoreThread {
-    screens: Weak<Mutex<Vec<ScreenData>>>,
+    screens: TripleBufferWriter<Vec<ScreenData>>,
 
-    screens_queued: Vec<ScreenData>,
-    screen_ready_for_copy: bool,
+    /// Value of `total_frames` when screens were last published.
+    published_frames: UnsignedInteger,
+    frame_ready_callback: Option<FrameReadyCallback>,
     frame_count: Arc<AtomicU32>,
     replay_milliseconds: Arc<AtomicU32>,
     desired_replay_frame: Arc<AtomicU32>,
     delta_replay_frames: Arc<AtomicI32>,
     playback_frozen: bool,
 
+    /// When the next rewind step is due.
+    next_rewind_step: Option<Instant>,
+
+    /// Frames started sooner than this after the last rendered frame aren't rendered.
+    min_render_interval: Duration,
+    last_rendered_frame: Option<Instant>,
+
+    /// Applied to screens before publishing them, if they aren't published as-is.
+    screen_filter: Option<ScreenFilter>,
+    perf: Arc<PerfStats>,
+
     core: SuperShuckieCore,
     receiver: Receiver<ThreadCommand>,
     is_running: bool,
     pokeabyte_integration: Option<PokeAByteIntegrationServer>,
-    sender_close: Sender<()>
+
+    /// Set by the Poke-A-Byte server when it has a new session or writes for us.
+    pokeabyte_notified: Arc<AtomicBool>,
+
+    /// Value of `total_frames` when RAM was last copied to Poke-A-Byte.
+    pokeabyte_read_frames: Option<UnsignedInteger>,
+
+    /// RAM copied out for cores that can't lend it out directly.
+    pokeabyte_scratch: Vec<u8>,
+    sender_close: Sender<()>,
+    waker: ThreadWaker
 }
 
 impl ThreadedSuperShuckieCoreThread {
     fn run_thread(mut self) {
+        let mut idle = false;
+
         loop {
-            if let Ok(cmd) = self.receiver.try_recv() {
+            let command = if idle {
+                match self.receiver.recv_timeout(IDLE_TIMEOUT) {
+                    Ok(n) => Some(n),
+                    Err(RecvTimeoutError::Timeout) => None,
+                    Err(RecvTimeoutError::Disconnected) => break
+                }
+            }
+            else {
+                self.receiver.try_recv().ok()
+            };
+
+            if let Some(cmd) = command {
                 if matches!(cmd, ThreadCommand::Close) {
                     break
                 }
 
                 self.handle_command(cmd);
+
+                // drain any other commands before doing anything else
+                idle = false;
                 continue
             }
 
             self.go_to_desired_frame();
             self.refresh_screen_data();
-            self.update_queued_screens();
             self.handle_pokeabyte_integration();
             self.replay_milliseconds.store(self.core.get_recording_milliseconds() as u32, Ordering::Relaxed);
 
-            if self.is_running {
-                if !self.playback_frozen {
-                    self.core.run();
+            if self.core.is_rewinding() {
+                // Hold on the oldest state until rewinding stops.
+                if !self.rewind_step() {
+                    idle = true;
                 }
             }
-            else if self.core.replay_player.is_none() {
-                // unfortunately we can't just block until we're running again because we still need
-                // to handle pokeabyte writes
-                std::thread::sleep(Duration::from_millis(100));
+            else if self.is_running && !self.playback_frozen {
+                self.run_core();
             }
             else {
-                // we can't really sleep for a definite amount of time because it'll make seeking
-                // choppy
-                std::thread::yield_now();
+                // Nothing to do until we get a command. Seeks and Poke-A-Byte writes also send a
+                // wake command, so we can block here.
+                idle = true;
             }
         }
 
@@ -373,6 +599,26 @@ impl ThreadedSuperShuckieCoreThread {
         let _ = self.sender_close.send(());
     }
 
+    /// Run the core, skipping rendering for frames that would only be dropped because they come
+    /// in faster than the display can show them.
+    fn run_core(&mut self) {
+        if !self.core.mid_frame {
+            let now = Instant::now();
+            let render = self.last_rendered_frame.is_none_or(|t| now.duration_since(t) >= self.min_render_interval);
+            if render {
+                self.last_rendered_frame = Some(now);
+            }
+            self.core.set_frame_rendering(render);
+        }
+
+        self.core.run();
+
+        if !self.core.mid_frame {
+            // Anything else that runs frames (loading save states, etc.) has them shown immediately.
+            self.core.set_frame_rendering(true);
+        }
+    }
+
     fn go_to_desired_frame(&mut self) {
         let delta = self.delta_replay_frames.swap(0, Ordering::Relaxed);
         let frame = self.desired_replay_frame.swap(u32::MAX, Ordering::Relaxed);
@@ -390,74 +636,87 @@ impl ThreadedSuperShuckieCoreThread {
         self.force_refresh_screen_data();
     }
 
-    /// If the mutex was blocked, we can copy it in when it's no longer blocked.
-    fn update_queued_screens(&mut self) {
-        if !self.screen_ready_for_copy {
-            return
+    /// Step back one rewind state once the last one has been shown long enough.
+    ///
+    /// Returns `false` if there is nothing left to rewind to.
+    fn rewind_step(&mut self) -> bool {
+        let now = Instant::now();
+        if let Some(next) = self.next_rewind_step && next > now {
+            std::thread::sleep(next - now);
         }
+        self.next_rewind_step = Some(self.next_rewind_step.unwrap_or(now).max(now) + REWIND_STEP_DURATION);
 
-        let Some(screen_data) = self.screens.upgrade() else {
-            panic!("update_queued_screens Can't get screen_data: owning thread must have crashed");
-        };
-
-        let mut out_screens = match screen_data.try_lock() {
-            Ok(n) => n,
-            Err(TryLockError::WouldBlock) => return,
-            Err(e) => panic!("update_queued_screens Can't get screens mutex: {e}")
-        };
-
-        self.screen_ready_for_copy = false;
-
-        let in_screens = &mut self.screens_queued;
-        core::mem::swap(in_screens, &mut *out_screens);
+        if !self.core.rewind() {
+            return false
+        }
 
-        self.frame_count.store(self.core.total_frames as u32, Ordering::Relaxed);
+        self.force_refresh_screen_data();
+        true
     }
 
-    /// Attempt to copy the screen data, or store it for later.
+    /// Publish the screen data if a new frame was completed.
     fn refresh_screen_data(&mut self) {
         if self.is_running && self.core.mid_frame {
             return
         }
 
-        let Some(screen_data) = self.screens.upgrade() else {
-            panic!("refresh_screen_data Can't get screen_data: owning thread must have crashed");
-        };
+        if self.core.total_frames == self.published_frames || !self.core.is_frame_rendered() {
+            return
+        }
 
-        let mut out_screens_maybe = screen_data.try_lock();
+        let start = Instant::now();
+        self.write_screen_data(false);
+        self.publish_screen_data();
+        self.perf.screen_swap.record(start.elapsed().as_micros() as u64);
+    }
 
-        let out_screens_result = match out_screens_maybe.as_mut() {
-            Ok(n) => {
-                self.screen_ready_for_copy = false;
+    /// Publish the screen data regardless of whether a new frame was completed.
+    fn force_refresh_screen_data(&mut self) {
+        let start = Instant::now();
+        self.write_screen_data(true);
+        self.publish_screen_data();
+        self.perf.screen_swap.record(start.elapsed().as_micros() as u64);
+    }
 
-                // this is safe to update early since we have the mutex locked
-                self.frame_count.store(self.core.total_frames as u32, Ordering::Relaxed);
-                &mut *n
-            },
-            Err(TryLockError::WouldBlock) => {
-                self.screen_ready_for_copy = true;
-                &mut self.screens_queued
-            },
-            Err(e) => panic!("refresh_screen_data Can't get screens mutex: {e}")
-        };
+    /// Write the core's screens into the back buffer, filtering them if needed.
+    ///
+    /// If `keep_screens` is `false`, the core's screens may be swapped out rather than copied.
+    fn write_screen_data(&mut self, keep_screens: bool) {
+        let out_screens = self.screens.back_mut();
+        let screens = self.core.core.get_screens();
+
+        if let Some(filter) = self.screen_filter.as_mut() {
+            for (screen_from, screen_to) in screens.iter().zip(out_screens.iter_mut()) {
+                filter.apply(screen_from, screen_to);
+            }
+            return
+        }
 
-        self.core.core.swap_screen_data(out_screens_result.as_mut_slice());
-    }
+        // Buffers last written with a filter won't match, so they can't be swapped.
+        let can_swap = !keep_screens && screens.iter().zip(out_screens.iter()).all(|(screen_from, screen_to)| {
+            screen_to.encoding == screen_from.encoding && screen_to.pixels.len() == screen_from.pixels.len()
+        });
 
-    fn force_refresh_screen_data(&mut self) {
-        let Some(screen_data) = self.screens.upgrade() else {
-            panic!("force_refresh_screen_data Can't get screen_data: owning thread must have crashed");
-        };
+        if can_swap {
+            self.core.core.swap_screen_data(out_screens.as_mut_slice());
+            return
+        }
 
-        let mut out_screens = screen_data
-            .lock()
-            .expect("can't get screens mutex force_get_screen_data");
+        for (screen_from, screen_to) in screens.iter().zip(out_screens.iter_mut()) {
+            screen_to.pixels.clone_from(&screen_from.pixels);
+            screen_to.width = screen_from.width;
+            screen_to.height = screen_from.height;
+            screen_to.encoding = screen_from.encoding;
+        }
+    }
 
+    fn publish_screen_data(&mut self) {
+        self.screens.publish();
+        self.published_frames = self.core.total_frames;
         self.frame_count.store(self.core.total_frames as u32, Ordering::Relaxed);
-        self.screen_ready_for_copy = false;
 
-        for (screen_from, screen_to) in self.core.core.get_screens().iter().zip(out_screens.iter_mut()) {
-            screen_to.pixels.copy_from_slice(screen_from.pixels.as_slice());
+        if let Some(callback) = self.frame_ready_callback.as_ref() {
+            callback();
         }
     }
 
@@ -467,31 +726,53 @@ impl ThreadedSuperShuckieCoreThread {
             return
         };
 
+        // While running, only bother with the session lock if something happened: a new frame or
+        // a notification from the server. While paused, this only runs after a command (which may
+        // have changed RAM), so always check.
+        let notified = self.pokeabyte_notified.swap(false, Ordering::AcqRel);
+        let frame_finished = !self.core.mid_frame && self.pokeabyte_read_frames != Some(self.core.total_frames);
+        if self.is_running && !notified && !frame_finished {
+            return
+        }
+
         let mut session_lock = integration.get_session();
         let Some(session) = session_lock.as_mut() else {
             return;
         };
 
-        for write in &mut session.writes {
-            self.core.enqueue_write(write.address as u32, write.data);
-        }
+        self.core.enqueue_writes((&mut session.writes).map(|write| (write.address as u32, write.data)));
 
         // don't update reads mid-frame; it's too slow
         if self.core.mid_frame && self.is_running {
             return;
         }
 
+        self.pokeabyte_read_frames = Some(self.core.total_frames);
+
         // handle frame skipping unless we're paused
         if self.is_running && let Some(skipping) = session.config.frame_skip && self.core.total_frames % ((skipping as u64) + 1) != 0 {
             return
         }
 
-        // SAFETY: "Only one way to find out"
-        let ram = unsafe { session.shared_memory.get_memory_mut() };
-        for read in &session.config.blocks {
-            let into = ram.get_mut(read.range.clone()).expect("read range was wrong (this should have been checked!)");
-            let _ = self.core.get_core().read_ram(read.game_address, into); // TODO: handle this?
+        let start = Instant::now();
+
+        let core = self.core.get_core();
+        for index in 0..session.config.blocks.len() {
+            let read = &session.config.blocks[index];
+            let (address, length) = (read.game_address, read.range.len());
+
+            match core.ram_slice(address, length) {
+                Some(data) => session.update_block(index, data),
+                None => {
+                    self.pokeabyte_scratch.resize(length, 0);
+                    let _ = core.read_ram(address, &mut self.pokeabyte_scratch); // TODO: handle this?
+                    session.update_block(index, &self.pokeabyte_scratch);
+                }
+            }
         }
+        session.finish_frame();
+
+        self.perf.pokeabyte_read.record(start.elapsed().as_micros() as u64);
     }
 
     fn handle_command(&mut self, command: ThreadCommand) {
@@ -508,13 +789,18 @@ impl ThreadedSuperShuckieCoreThread {
                     self.core.pause_timer();
                 }
             }
-            ThreadCommand::SetPokeAByteEnabled(enabled, err) => {
-                if !enabled && self.pokeabyte_integration.is_some() {
-                    self.pokeabyte_integration = None;
-                    let _ = err.send(Ok(()));
-                }
-                else if enabled {
-                    let integration = match PokeAByteIntegrationServer::begin_listen() {
+            ThreadCommand::SetPokeAByteEnabled(settings, err) => {
+                // Close the old server first so its port and shared memory are free again.
+                self.pokeabyte_integration = None;
+
+                if let Some(settings) = settings {
+                    let waker = self.waker.clone();
+                    let notified = self.pokeabyte_notified.clone();
+                    let notifier = Box::new(move || {
+                        notified.store(true, Ordering::Release);
+                        waker.wake();
+                    });
+                    let integration = match PokeAByteIntegrationServer::begin_listen_with_settings(settings, notifier) {
                         Ok(n) => {
                             let _ = err.send(Ok(()));
                             n
@@ -524,11 +810,15 @@ impl ThreadedSuperShuckieCoreThread {
                             return
                         }
                     };
-                    self.pokeabyte_integration = Some(integration)
+                    self.pokeabyte_integration = Some(integration);
+                    self.pokeabyte_read_frames = None;
                 } else {
                     let _ = err.send(Ok(()));
                 }
             }
+            ThreadCommand::SetFrameReadyCallback(callback) => {
+                self.frame_ready_callback = callback;
+            }
             ThreadCommand::StartRecordingReplay(metadata) => {
                 // FIXME: error if this fails
                 self.core.start_recording_replay(metadata).expect("FAILED TO START RECORDING REPLAY OH NO");
@@ -545,6 +835,30 @@ impl ThreadedSuperShuckieCoreThread {
             ThreadCommand::SetSpeed(speed) => {
                 self.core.set_speed(speed);
             }
+            ThreadCommand::SetPreciseFramePacing(enabled, sender) => {
+                let _ = sender.send(self.core.set_precise_frame_pacing(enabled));
+            }
+            ThreadCommand::SetRunAheadFrames(frames) => {
+                self.core.set_run_ahead_frames(frames);
+            }
+            ThreadCommand::SetDisplayRefreshRate(refresh_rate) => {
+                self.min_render_interval = min_render_interval(refresh_rate);
+            }
+            ThreadCommand::SetScreenFilter(settings, sender) => {
+                self.screen_filter = (!settings.is_passthrough()).then(|| ScreenFilter::new(settings));
+                self.force_refresh_screen_data();
+                let _ = sender.send(());
+            }
+            ThreadCommand::SetReplaySnapshotSettings(settings) => {
+                self.core.set_replay_snapshot_settings(settings);
+            }
+            ThreadCommand::SetRewindSettings(settings) => {
+                self.core.set_rewind_settings(settings);
+            }
+            ThreadCommand::SetRewinding(rewinding) => {
+                self.core.set_rewinding(rewinding);
+                self.next_rewind_step = None;
+            }
             ThreadCommand::SetRapidFireInput(input) => {
                 self.core.set_rapid_fire_input(input);
             }
@@ -567,6 +881,9 @@ impl ThreadedSuperShuckieCoreThread {
             ThreadCommand::SaveSRAM(sender) => {
                 let _ = sender.send(self.core.save_sram());
             }
+            ThreadCommand::Wake => {
+                self.waker.wake_pending.store(false, Ordering::Release);
+            }
             ThreadCommand::Close => {
                 unreachable!("handle_command(ThreadCommand::Close) should not happen")
             },
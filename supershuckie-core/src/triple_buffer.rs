@@ -0,0 +1,110 @@
+//! Lock-free triple buffer for handing data from one producer thread to one consumer thread.
+//!
+//! The producer always has a buffer to write into and never waits on the consumer, and the
+//! consumer always gets the newest complete buffer without taking a lock. Intermediate buffers
+//! are dropped if the consumer falls behind.
+
+use alloc::sync::Arc;
+use core::cell::UnsafeCell;
+use core::sync::atomic::{AtomicU8, Ordering};
+
+const INDEX_MASK: u8 = 0b011;
+const NEW_DATA: u8 = 0b100;
+
+struct TripleBufferSlot<T> {
+    value: T,
+    sequence: u64
+}
+
+struct TripleBufferShared<T> {
+    slots: [UnsafeCell<TripleBufferSlot<T>>; 3],
+
+    /// Index of the slot owned by neither side, OR'd with `NEW_DATA` if it was published since
+    /// the reader last took it.
+    middle: AtomicU8
+}
+
+// SAFETY: Each slot is only ever accessed by whichever side currently owns its index, and
+//         ownership is only transferred through `middle`.
+unsafe impl<T: Send> Sync for TripleBufferShared<T> {}
+
+/// Producer half of a triple buffer.
+pub struct TripleBufferWriter<T> {
+    shared: Arc<TripleBufferShared<T>>,
+    back: u8,
+    next_sequence: u64
+}
+
+/// Consumer half of a triple buffer.
+pub struct TripleBufferReader<T> {
+    shared: Arc<TripleBufferShared<T>>,
+    front: u8
+}
+
+/// Make a triple buffer where all three buffers start as a copy of `initial`.
+pub fn triple_buffer<T: Clone>(initial: T) -> (TripleBufferWriter<T>, TripleBufferReader<T>) {
+    let slot = || UnsafeCell::new(TripleBufferSlot { value: initial.clone(), sequence: 0 });
+    let shared = Arc::new(TripleBufferShared {
+        slots: [slot(), slot(), slot()],
+        middle: AtomicU8::new(1)
+    });
+
+    let writer = TripleBufferWriter { shared: shared.clone(), back: 2, next_sequence: 1 };
+    let reader = TripleBufferReader { shared, front: 0 };
+    (writer, reader)
+}
+
+impl<T> TripleBufferWriter<T> {
+    /// Get the buffer to write the next value into.
+    ///
+    /// This may contain any older value.
+    #[inline]
+    pub fn back_mut(&mut self) -> &mut T {
+        // SAFETY: The writer exclusively owns the back slot until it is published.
+        unsafe { &mut (*self.shared.slots[self.back as usize].get()).value }
+    }
+
+    /// Publish the back buffer, making it the newest value the reader can take.
+    ///
+    /// Returns the sequence number of the published value.
+    pub fn publish(&mut self) -> u64 {
+        let sequence = self.next_sequence;
+        self.next_sequence += 1;
+
+        // SAFETY: Same as back_mut.
+        unsafe { (*self.shared.slots[self.back as usize].get()).sequence = sequence };
+
+        let old = self.shared.middle.swap(self.back | NEW_DATA, Ordering::AcqRel);
+        self.back = old & INDEX_MASK;
+        sequence
+    }
+}
+
+impl<T> TripleBufferReader<T> {
+    /// Take the newest published value, if there is one.
+    ///
+    /// Returns `true` if the front buffer changed.
+    pub fn update(&mut self) -> bool {
+        if self.shared.middle.load(Ordering::Relaxed) & NEW_DATA == 0 {
+            return false
+        }
+
+        let old = self.shared.middle.swap(self.front, Ordering::AcqRel);
+        self.front = old & INDEX_MASK;
+        true
+    }
+
+    /// Get the buffer that was most recently taken with [`TripleBufferReader::update`].
+    #[inline]
+    pub fn front(&self) -> &T {
+        // SAFETY: The reader exclusively owns the front slot until it is swapped back in update.
+        unsafe { &(*self.shared.slots[self.front as usize].get()).value }
+    }
+
+    /// Get the sequence number of the front buffer, or 0 if nothing has been published yet.
+    #[inline]
+    pub fn sequence(&self) -> u64 {
+        // SAFETY: Same as front.
+        unsafe { (*self.shared.slots[self.front as usize].get()).sequence }
+    }
+}
@@ -0,0 +1,62 @@
+//! Checking that replay playback matches what was recorded.
+
+use alloc::vec::Vec;
+use supershuckie_replay_recorder::replay_file::delta::apply_diff;
+use supershuckie_replay_recorder::{Packet, UnsignedInteger};
+
+/// Results of comparing the emulator state against the keyframes of a replay during playback.
+#[derive(Copy, Clone, PartialEq, Debug, Default)]
+pub struct ReplayVerification {
+    /// Number of keyframes the emulator state was compared against.
+    pub keyframes_checked: u64,
+
+    /// Number of those keyframes that did not match the emulator state.
+    pub keyframes_mismatched: u64,
+
+    /// Elapsed frames of the first keyframe that did not match, if any.
+    pub first_mismatched_frame: Option<UnsignedInteger>
+}
+
+pub(crate) struct ReplayVerifier {
+    pub results: ReplayVerification,
+
+    /// Full state of the last keyframe passed, which the next delta keyframe is based on.
+    previous_keyframe: Option<Vec<u8>>
+}
+
+impl ReplayVerifier {
+    pub fn new() -> Self {
+        Self { results: ReplayVerification::default(), previous_keyframe: None }
+    }
+
+    /// Set the keyframe that was just seeked to, or `None` if playback did not resume from one.
+    pub fn set_previous_keyframe(&mut self, state: Option<&[u8]>) {
+        self.previous_keyframe = state.map(|s| s.to_vec());
+    }
+
+    /// Check a keyframe packet reached during playback after `frame` elapsed frames.
+    pub fn check<F: FnOnce() -> Vec<u8>>(&mut self, packet: &Packet, frame: UnsignedInteger, current_state: F) {
+        let (metadata, expected) = match packet {
+            Packet::Keyframe { metadata, state } => (metadata, state.to_vec()),
+            Packet::DeltaKeyframe { metadata, delta } => {
+                let Some(expected) = self.previous_keyframe.as_ref().and_then(|base| apply_diff(base.as_slice(), delta.as_slice()).ok()) else {
+                    // Can't rebuild this one, but the next full keyframe gets us back on track.
+                    self.previous_keyframe = None;
+                    return
+                };
+                (metadata, expected)
+            },
+            _ => return
+        };
+
+        if metadata.elapsed_frames == frame {
+            self.results.keyframes_checked += 1;
+            if current_state() != expected {
+                self.results.keyframes_mismatched += 1;
+                self.results.first_mismatched_frame.get_or_insert(frame);
+            }
+        }
+
+        self.previous_keyframe = Some(expected);
+    }
+}
@@ -21,6 +21,20 @@ struct SuperShuckieFrontendRaw;
 
 typedef uint32_t SuperShuckieConnectedControllerIndex;
 
+enum SuperShuckieScreenDataEncoding {
+    /**
+     * 0xAARRGGBB
+     */
+    SuperShuckieScreenDataEncoding__A8R8G8B8 = 0,
+
+    /**
+     * 0bRRRRRGGGGGGBBBBB, two pixels per uint32_t with the first in the low 16 bits
+     *
+     * Rows are not padded, so a row may start in the middle of a uint32_t.
+     */
+    SuperShuckieScreenDataEncoding__R5G6B5 = 1
+};
+
 struct SuperShuckieScreenData {
     uint32_t width;
     uint32_t height;
@@ -35,12 +49,38 @@ enum SuperShuckieReplayState {
 
 typedef void (*SuperShuckieRefreshScreensCallback)(void *user_data, size_t screen_count, const uint32_t *const *pixels);
 typedef void (*SuperShuckieChangeVideoModeCallback)(void *user_data, size_t screen_count, const struct SuperShuckieScreenData *screen_data, uint8_t scaling);
+typedef void (*SuperShuckieFrameReadyCallback)(void *user_data);
+
+enum SuperShuckieFileWriteKind {
+    SuperShuckieFileWriteKind__SaveState = 0,
+    SuperShuckieFileWriteKind__SRAM = 1
+};
+
+/**
+ * Called from supershuckie_frontend_tick() when a save state or SRAM has finished being written.
+ *
+ * kind is a SuperShuckieFileWriteKind, and name is the name of the file without the extension. automatic is set for
+ * automatic SRAM saves, which are only reported if they fail.
+ *
+ * error is null if the file was written successfully.
+ */
+typedef void (*SuperShuckieFileWrittenCallback)(void *user_data, uint32_t kind, const char *name, bool automatic, const char *error);
+
+/**
+ * Called from supershuckie_frontend_tick() when a ROM passed to supershuckie_frontend_load_rom() has finished loading.
+ *
+ * path is the path that was passed to supershuckie_frontend_load_rom(). error is null if the ROM was loaded
+ * successfully, in which case it is now running.
+ */
+typedef void (*SuperShuckieRomLoadedCallback)(void *user_data, const char *path, const char *error);
 
 struct SuperShuckieFrontendCallbacks {
     void *user_data;
 
     SuperShuckieRefreshScreensCallback refresh_screens;
     SuperShuckieChangeVideoModeCallback change_video_mode;
+    SuperShuckieFileWrittenCallback file_written;
+    SuperShuckieRomLoadedCallback rom_loaded;
 };
 
 /**
@@ -131,6 +171,40 @@ void supershuckie_frontend_force_refresh_screens(struct SuperShuckieFrontendRaw
  */
 void supershuckie_frontend_set_video_scale(struct SuperShuckieFrontendRaw *frontend, uint8_t scale);
 
+/**
+ * Get the video scale.
+ */
+uint8_t supershuckie_frontend_get_video_scale(struct SuperShuckieFrontendRaw *frontend);
+
+enum SuperShuckieVideoScaler {
+    SuperShuckieVideoScaler__Frontend = 0,
+    SuperShuckieVideoScaler__Nearest = 1,
+    SuperShuckieVideoScaler__Scale2x = 2
+};
+
+/**
+ * Set how screens are scaled before being passed to the frontend.
+ *
+ * If this isn't SuperShuckieVideoScaler__Frontend, screens are already scaled to the video scale and the change video mode
+ * callback is given a scale of 1.
+ */
+void supershuckie_frontend_set_video_scaler(struct SuperShuckieFrontendRaw *frontend, uint32_t scaler);
+
+/**
+ * Get how screens are scaled before being passed to the frontend.
+ */
+uint32_t supershuckie_frontend_get_video_scaler(struct SuperShuckieFrontendRaw *frontend);
+
+/**
+ * Set the encoding (SuperShuckieScreenDataEncoding) of screens passed to the frontend.
+ */
+void supershuckie_frontend_set_video_encoding(struct SuperShuckieFrontendRaw *frontend, uint32_t encoding);
+
+/**
+ * Get the encoding (SuperShuckieScreenDataEncoding) of screens passed to the frontend.
+ */
+uint32_t supershuckie_frontend_get_video_encoding(struct SuperShuckieFrontendRaw *frontend);
+
 /**
  * Get the current speed settings.
  *
@@ -144,6 +218,119 @@ void supershuckie_frontend_get_speed_settings(const struct SuperShuckieFrontendR
  */
 void supershuckie_frontend_set_speed_settings(struct SuperShuckieFrontendRaw *frontend, double base, double turbo);
 
+/**
+ * Get whether frames are paced precisely by the frontend rather than by the emulator core.
+ */
+bool supershuckie_frontend_get_precise_frame_pacing(const struct SuperShuckieFrontendRaw *frontend);
+
+/**
+ * Set whether frames are paced precisely by the frontend rather than by the emulator core.
+ *
+ * Returns true if the setting was applied, or false if the current core does not support it (the setting is still
+ * saved for future cores).
+ */
+bool supershuckie_frontend_set_precise_frame_pacing(struct SuperShuckieFrontendRaw *frontend, bool enabled);
+
+/**
+ * Maximum number of frames that can be run ahead.
+ */
+#define SUPERSHUCKIE_MAX_RUN_AHEAD_FRAMES 4
+
+/**
+ * Get the number of frames run ahead to hide input lag (0 = disabled).
+ */
+uint8_t supershuckie_frontend_get_run_ahead_frames(const struct SuperShuckieFrontendRaw *frontend);
+
+/**
+ * Set the number of frames run ahead to hide input lag (0 = disabled).
+ *
+ * Each frame, the emulator runs this many frames ahead with the current input and shows the result, then goes back.
+ * This costs this many frames' worth of extra emulation per frame. Replays only record the real frames.
+ *
+ * This is clamped to SUPERSHUCKIE_MAX_RUN_AHEAD_FRAMES.
+ */
+void supershuckie_frontend_set_run_ahead_frames(struct SuperShuckieFrontendRaw *frontend, uint8_t frames);
+
+/**
+ * Set whether the game is being rewound.
+ *
+ * While rewinding, the game steps backwards through recently taken save states instead of running.
+ */
+void supershuckie_frontend_set_rewinding(struct SuperShuckieFrontendRaw *frontend, bool rewinding);
+
+/**
+ * Get the current rewind settings.
+ *
+ * Safety:
+ * - interval_frames and/or memory_mb can be null
+ */
+void supershuckie_frontend_get_rewind_settings(const struct SuperShuckieFrontendRaw *frontend, uint64_t *interval_frames, uint32_t *memory_mb);
+
+/**
+ * Set how often save states are taken for rewinding and how much memory (in MiB) they may use.
+ *
+ * Setting either to 0 disables rewinding.
+ */
+void supershuckie_frontend_set_rewind_settings(struct SuperShuckieFrontendRaw *frontend, uint64_t interval_frames, uint32_t memory_mb);
+
+/**
+ * Distribution of one kind of per-frame timing.
+ *
+ * Percentiles are approximate (within 1/8th of the actual value, rounded up).
+ */
+struct SuperShuckiePerfTiming {
+    uint64_t count;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p95;
+    uint64_t p99;
+    uint64_t max;
+};
+
+/**
+ * Per-frame timings, in microseconds unless otherwise noted.
+ */
+struct SuperShuckiePerfStats {
+    /** Running the emulator core for a frame */
+    struct SuperShuckiePerfTiming emulation;
+
+    /** Waiting for the next frame with precise frame pacing */
+    struct SuperShuckiePerfTiming frame_pacing;
+
+    /** Handing a finished frame's screens over to be presented */
+    struct SuperShuckiePerfTiming screen_swap;
+
+    /** Copying RAM into Poke-A-Byte's shared memory */
+    struct SuperShuckiePerfTiming pokeabyte_read;
+
+    /** Creating save states for replay keyframes */
+    struct SuperShuckiePerfTiming keyframe_creation;
+
+    /** Waiting on replay data that was not decompressed ahead of time */
+    struct SuperShuckiePerfTiming decompression_stall;
+
+    /** Replay recorder operations not yet written at the end of each frame (a count, not a time) */
+    struct SuperShuckiePerfTiming recorder_queue_depth;
+
+    /** Waiting for room in the replay recorder's queue when it falls behind */
+    struct SuperShuckiePerfTiming recorder_queue_stall;
+};
+
+/**
+ * Get the timings collected since the ROM was loaded or supershuckie_frontend_reset_perf_stats() was called.
+ *
+ * This does not block emulation.
+ *
+ * Safety:
+ * - stats can be null
+ */
+void supershuckie_frontend_get_perf_stats(const struct SuperShuckieFrontendRaw *frontend, struct SuperShuckiePerfStats *stats);
+
+/**
+ * Discard all timings collected so far.
+ */
+void supershuckie_frontend_reset_perf_stats(struct SuperShuckieFrontendRaw *frontend);
+
 /**
  * Get the setting, or null if no setting is set.
  *
@@ -199,6 +386,28 @@ bool supershuckie_frontend_is_pokeabyte_enabled(const struct SuperShuckieFronten
  */
 bool supershuckie_frontend_set_pokeabyte_enabled(const struct SuperShuckieFrontendRaw *frontend, bool enabled, char *error, size_t error_len);
 
+/**
+ * Get the UDP port and shared memory name Poke-A-Byte uses.
+ *
+ * Safety:
+ * - port must not be null.
+ * - shared_memory_name must not be null and must be at least shared_memory_name_len bytes long.
+ */
+void supershuckie_frontend_get_pokeabyte_settings(const struct SuperShuckieFrontendRaw *frontend, uint16_t *port, char *shared_memory_name, size_t shared_memory_name_len);
+
+/**
+ * Set the UDP port and shared memory name Poke-A-Byte uses, restarting it if it is enabled.
+ *
+ * Using a different port and name for each instance allows several instances to use Poke-A-Byte at once.
+ *
+ * Returns false if an error occurs, filling the error buffer with the error.
+ *
+ * Safety:
+ * - shared_memory_name must not be null and must be a null-terminated UTF-8 string.
+ * - error must not be null and must be at least error_len bytes long.
+ */
+bool supershuckie_frontend_set_pokeabyte_settings(struct SuperShuckieFrontendRaw *frontend, uint16_t port, const char *shared_memory_name, char *error, size_t error_len);
+
 /**
  * Return true if the emulator is currently manually paused.
  */
@@ -212,7 +421,10 @@ const char *supershuckie_frontend_get_recording_replay_file(const struct SuperSh
 /**
  * Create a save state of the given name, or null to use a default name.
  *
- * If true is returned, the name of the save state (besides the extension) will be written to result (ensure it is long enough).
+ * The save state is written in the background; the file_written callback is called once it is.
+ *
+ * If true is returned, the name of the save state (besides the extension) will be written to result (ensure it is long
+ * enough). If name is null, result will be empty, as the name is picked when the save state is written.
  *
  * If false is returned, an error will be written.
  *
@@ -247,8 +459,46 @@ bool supershuckie_frontend_undo_load_save_state(struct SuperShuckieFrontendRaw *
  */
 bool supershuckie_frontend_redo_load_save_state(struct SuperShuckieFrontendRaw *frontend);
 
+struct SuperShuckieSaveStateInfo {
+    /** Milliseconds since the Unix epoch */
+    uint64_t created_unix_millis;
+
+    /** 0 if there is no thumbnail */
+    uint32_t thumbnail_width;
+    uint32_t thumbnail_height;
+
+    /** The save state is stored as a diff against the ROM's base state */
+    bool deduplicated;
+};
+
 /**
- * Load the given ROM, returning true or false depending on whether or not it was successfully loaded.
+ * Get information about a save state of the current ROM without loading it.
+ *
+ * The thumbnail (0bRRRRRGGGGGGBBBBB, row by row, at most 80 pixels wide) is written to thumbnail, truncated to
+ * thumbnail_len pixels.
+ *
+ * This is read from the ROM's library index, so the save state itself is only read if it changed since it was indexed.
+ *
+ * Returns false if the save state does not exist. Save states made by older versions (or whose header can't be read)
+ * have no information, in which case true is returned and info is zeroed.
+ *
+ * Safety:
+ * - name and info must not be null
+ * - thumbnail must be at least thumbnail_len pixels long (it can be null if thumbnail_len is 0)
+ */
+bool supershuckie_frontend_get_save_state_info(
+    const struct SuperShuckieFrontendRaw *frontend,
+    const char *name,
+    struct SuperShuckieSaveStateInfo *info,
+    uint16_t *thumbnail,
+    size_t thumbnail_len
+);
+
+/**
+ * Start loading the given ROM in the background, returning false if it can't be loaded at all.
+ *
+ * The rom_loaded callback is called once it has loaded or failed to, at which point the current ROM is closed if it
+ * loaded. Loading another ROM or unloading the current one before then cancels it.
  *
  * Safety:
  * - path must be null-terminated, UTF-8
@@ -259,11 +509,25 @@ bool supershuckie_frontend_load_rom(struct SuperShuckieFrontendRaw *frontend, co
 /**
  * Write SRAM to disk, returning true if successful.
  *
+ * SRAM is written in the background; the file_written callback is called once it is.
+ *
  * Safety:
  * - error must be at least result_len bytes long.
  */
 bool supershuckie_frontend_save_sram(struct SuperShuckieFrontendRaw *frontend, char *error, size_t error_len);
 
+/**
+ * Set how often SRAM is saved automatically, in seconds, or 0 to disable it.
+ *
+ * SRAM is only written if it changed since it was last written.
+ */
+void supershuckie_frontend_set_sram_autosave_interval(struct SuperShuckieFrontendRaw *frontend, uint32_t seconds);
+
+/**
+ * Get how often SRAM is saved automatically, in seconds (0 = disabled).
+ */
+uint32_t supershuckie_frontend_get_sram_autosave_interval(struct SuperShuckieFrontendRaw *frontend);
+
 /**
  * Set the auto stop playback setting.
  */
@@ -294,6 +558,18 @@ void supershuckie_frontend_set_auto_pause_on_record_setting(struct SuperShuckieF
  */
 bool supershuckie_frontend_get_auto_pause_on_record_setting(const struct SuperShuckieFrontendRaw *frontend);
 
+/**
+ * Set whether new save states are stored as diffs against a base state for the ROM.
+ *
+ * The base state is made from the first save state created with this enabled.
+ */
+void supershuckie_frontend_set_deduplicate_save_states_setting(struct SuperShuckieFrontendRaw *frontend, bool new_setting);
+
+/**
+ * Get whether new save states are stored as diffs against a base state for the ROM.
+ */
+bool supershuckie_frontend_get_deduplicate_save_states_setting(const struct SuperShuckieFrontendRaw *frontend);
+
 /**
  * Set the current frame for playback.
  */
@@ -408,6 +684,30 @@ void supershuckie_frontend_hard_reset_console(struct SuperShuckieFrontendRaw *fr
  */
 void supershuckie_frontend_tick(struct SuperShuckieFrontendRaw *frontend);
 
+/**
+ * Set a callback that is called whenever the core has a new frame ready, or NULL to clear it.
+ *
+ * This allows the frontend to only call supershuckie_frontend_tick() when there is something new to present rather than
+ * polling it constantly.
+ *
+ * Safety:
+ * - The callback is called from the core thread, NOT the thread that owns the frontend. It must be thread-safe and must
+ *   not call any supershuckie_frontend_* functions; it should only schedule a tick on the frontend's thread.
+ * - user_data must remain valid until the callback is cleared or the frontend is freed.
+ */
+void supershuckie_frontend_set_frame_ready_callback(
+    struct SuperShuckieFrontendRaw *frontend,
+    SuperShuckieFrameReadyCallback callback,
+    void *user_data
+);
+
+/**
+ * Set the refresh rate of the display the game is shown on, in Hz (default 60).
+ *
+ * Frames that come in faster than this can show (e.g. during turbo) are not rendered, which speeds up emulation.
+ */
+void supershuckie_frontend_set_display_refresh_rate(struct SuperShuckieFrontendRaw *frontend, double refresh_rate);
+
 /**
  * Get all replays for the given rom, or the currently loaded ROM if no ROM passed in.
  *
@@ -415,6 +715,29 @@ void supershuckie_frontend_tick(struct SuperShuckieFrontendRaw *frontend);
  */
 struct SuperShuckieStringArrayRaw *supershuckie_frontend_get_all_replays_for_rom(const struct SuperShuckieFrontendRaw *frontend, const char *rom);
 
+struct SuperShuckieReplayInfo {
+    uint64_t total_frames;
+    uint64_t total_milliseconds;
+    size_t bookmark_count;
+};
+
+/**
+ * Get information about a replay of the given rom, or the currently loaded ROM if no ROM passed in.
+ *
+ * This is read from the ROM's library index, so the replay itself is only read if it changed since it was indexed.
+ *
+ * Returns false if the replay does not exist or can't be read, in which case info is zeroed.
+ *
+ * Safety:
+ * - name and info must not be null
+ */
+bool supershuckie_frontend_get_replay_info(
+    const struct SuperShuckieFrontendRaw *frontend,
+    const char *rom,
+    const char *name,
+    struct SuperShuckieReplayInfo *info
+);
+
 /**
  * Get all save states for the given rom, or the currently loaded ROM if no ROM passed in.
  *
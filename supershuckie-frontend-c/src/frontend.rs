@@ -1,11 +1,15 @@
 use std::ffi::{c_char, c_void, CStr};
 use std::mem::MaybeUninit;
 use std::num::NonZeroU8;
+use std::path::Path;
 use std::ptr::null;
 use std::slice::from_raw_parts_mut;
+use std::sync::Arc;
+use supershuckie_core::FrameReadyCallback;
+use supershuckie_core::perf::PerfStatsSummary;
 use supershuckie_core::emulator::{ScreenData, ScreenDataEncoding};
-use supershuckie_frontend::{ConnectedControllerIndex, SuperShuckieFrontend, SuperShuckieFrontendCallbacks, UserInput};
-use supershuckie_frontend::settings::GameBoyMode;
+use supershuckie_frontend::{ConnectedControllerIndex, FileWriteResult, SuperShuckieFrontend, SuperShuckieFrontendCallbacks, UserInput};
+use supershuckie_frontend::settings::{GameBoyMode, VideoEncoding, VideoScaler};
 use supershuckie_frontend::util::UTF8CString;
 use crate::control_settings::SuperShuckieControlSettings;
 use crate::string_array::SuperShuckieStringArray;
@@ -25,6 +29,8 @@ pub struct SuperShuckieFrontendCallbacksC {
 
     pub refresh_screens: Option<unsafe extern "C" fn(userdata: *mut c_void, screen_count: usize, screen_data: *const *const u32)>,
     pub change_video_mode: Option<unsafe extern "C" fn(userdata: *mut c_void, screen_count: usize, screen_data: *const SuperShuckieScreenDataC, screen_scale: NonZeroU8)>,
+    pub file_written: Option<unsafe extern "C" fn(userdata: *mut c_void, kind: u32, name: *const c_char, automatic: bool, error: *const c_char)>,
+    pub rom_loaded: Option<unsafe extern "C" fn(userdata: *mut c_void, path: *const c_char, error: *const c_char)>,
 }
 
 impl SuperShuckieFrontendCallbacks for SuperShuckieFrontendCallbacksC {
@@ -53,6 +59,30 @@ impl SuperShuckieFrontendCallbacks for SuperShuckieFrontendCallbacksC {
 
         unsafe { s(self.userdata, screens.len(), screens_buf.as_ptr() as *const SuperShuckieScreenDataC, scaling) };
     }
+
+    fn file_written(&mut self, result: &FileWriteResult) {
+        let Some(s) = self.file_written else { return };
+
+        let error = match &result.result {
+            Ok(()) => null(),
+            Err(e) => e.as_c_str().as_ptr()
+        };
+
+        unsafe { s(self.userdata, result.kind as u32, result.name.as_c_str().as_ptr(), result.automatic, error) };
+    }
+
+    fn rom_loaded(&mut self, path: &Path, result: &Result<(), UTF8CString>) {
+        let Some(s) = self.rom_loaded else { return };
+
+        // load_rom only takes UTF-8 paths
+        let path = UTF8CString::from_str(path.to_str().unwrap_or_default());
+        let error = match result {
+            Ok(()) => null(),
+            Err(e) => e.as_c_str().as_ptr()
+        };
+
+        unsafe { s(self.userdata, path.as_c_str().as_ptr(), error) };
+    }
 }
 
 #[unsafe(no_mangle)]
@@ -111,6 +141,42 @@ pub unsafe extern "C" fn supershuckie_frontend_tick(
     frontend.tick();
 }
 
+struct FrameReadyCallbackC {
+    userdata: *mut c_void,
+    callback: unsafe extern "C" fn(userdata: *mut c_void)
+}
+
+// SAFETY: The caller promises the callback is thread-safe (see supershuckie_frontend_set_frame_ready_callback).
+unsafe impl Send for FrameReadyCallbackC {}
+unsafe impl Sync for FrameReadyCallbackC {}
+
+impl FrameReadyCallbackC {
+    fn call(&self) {
+        unsafe { (self.callback)(self.userdata) }
+    }
+}
+
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn supershuckie_frontend_set_frame_ready_callback(
+    frontend: &mut SuperShuckieFrontend,
+    callback: Option<unsafe extern "C" fn(userdata: *mut c_void)>,
+    userdata: *mut c_void
+) {
+    let callback = callback.map(|callback| {
+        let callback = FrameReadyCallbackC { userdata, callback };
+        Arc::new(move || callback.call()) as FrameReadyCallback
+    });
+    frontend.set_frame_ready_callback(callback);
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_set_display_refresh_rate(
+    frontend: &mut SuperShuckieFrontend,
+    refresh_rate: f64
+) {
+    frontend.set_display_refresh_rate(refresh_rate);
+}
+
 #[unsafe(no_mangle)]
 pub unsafe extern "C" fn supershuckie_frontend_load_rom(
     frontend: &mut SuperShuckieFrontend,
@@ -213,6 +279,35 @@ pub unsafe extern "C" fn supershuckie_frontend_set_video_scale(
     frontend.set_video_scale(NonZeroU8::new(scale).unwrap_or(unsafe { NonZeroU8::new_unchecked(1) }));
 }
 
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_get_video_scale(frontend: &SuperShuckieFrontend) -> u8 {
+    frontend.get_video_scale().get()
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_get_video_scaler(frontend: &SuperShuckieFrontend) -> VideoScaler {
+    frontend.get_video_scaler()
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_set_video_scaler(frontend: &mut SuperShuckieFrontend, scaler: u32) {
+    if let Ok(s) = VideoScaler::try_from(scaler) {
+        frontend.set_video_scaler(s)
+    }
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_get_video_encoding(frontend: &SuperShuckieFrontend) -> VideoEncoding {
+    frontend.get_video_encoding()
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_set_video_encoding(frontend: &mut SuperShuckieFrontend, encoding: u32) {
+    if let Ok(e) = VideoEncoding::try_from(encoding) {
+        frontend.set_video_encoding(e)
+    }
+}
+
 #[unsafe(no_mangle)]
 pub unsafe extern "C" fn supershuckie_frontend_get_custom_setting(
     frontend: &SuperShuckieFrontend,
@@ -285,6 +380,45 @@ pub unsafe extern "C" fn supershuckie_frontend_redo_load_save_state(
     frontend.redo_load_save_state()
 }
 
+#[repr(C)]
+#[derive(Copy, Clone, Default)]
+pub struct SuperShuckieSaveStateInfoC {
+    pub created_unix_millis: u64,
+    pub thumbnail_width: u32,
+    pub thumbnail_height: u32,
+    pub deduplicated: bool
+}
+
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn supershuckie_frontend_get_save_state_info(
+    frontend: &SuperShuckieFrontend,
+    name: *const c_char,
+    info: &mut SuperShuckieSaveStateInfoC,
+    thumbnail: *mut u16,
+    thumbnail_len: usize
+) -> bool {
+    let name = unsafe { CStr::from_ptr(name) }.to_str().expect("name not UTF-8");
+    *info = SuperShuckieSaveStateInfoC::default();
+
+    let Some(header) = frontend.get_save_state_info(name) else {
+        return false
+    };
+
+    info.created_unix_millis = header.created_unix_millis;
+    info.deduplicated = header.deduplicated;
+    if let Some(t) = header.thumbnail {
+        info.thumbnail_width = t.width as u32;
+        info.thumbnail_height = t.height as u32;
+        if thumbnail_len > 0 {
+            let into = unsafe { from_raw_parts_mut(thumbnail, thumbnail_len) };
+            let len = into.len().min(t.pixels.len());
+            into[..len].copy_from_slice(&t.pixels[..len]);
+        }
+    }
+
+    true
+}
+
 #[unsafe(no_mangle)]
 pub unsafe extern "C" fn supershuckie_frontend_load_save_state(
     frontend: &mut SuperShuckieFrontend,
@@ -350,6 +484,36 @@ pub unsafe extern "C" fn supershuckie_frontend_set_pokeabyte_enabled(
     }
 }
 
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn supershuckie_frontend_get_pokeabyte_settings(
+    frontend: &SuperShuckieFrontend,
+    port: *mut u16,
+    shared_memory_name: *mut u8,
+    shared_memory_name_len: usize
+) {
+    let (p, name) = frontend.get_pokeabyte_settings();
+    unsafe { *port = p };
+    write_str_to_data(name, unsafe { from_raw_parts_mut(shared_memory_name, shared_memory_name_len) });
+}
+
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn supershuckie_frontend_set_pokeabyte_settings(
+    frontend: &mut SuperShuckieFrontend,
+    port: u16,
+    shared_memory_name: *const c_char,
+    error: *mut u8,
+    error_len: usize
+) -> bool {
+    let shared_memory_name = unsafe { CStr::from_ptr(shared_memory_name) }.to_str().expect("shared_memory_name not UTF-8");
+    match frontend.set_pokeabyte_settings(port, shared_memory_name) {
+        Ok(_) => true,
+        Err(e) => {
+            write_str_to_data(e.as_str(), unsafe { from_raw_parts_mut(error, error_len) });
+            false
+        }
+    }
+}
+
 #[unsafe(no_mangle)]
 pub extern "C" fn supershuckie_frontend_set_auto_stop_playback_on_input_setting(
     frontend: &mut SuperShuckieFrontend,
@@ -389,6 +553,19 @@ pub extern "C" fn supershuckie_frontend_get_auto_pause_on_record_setting(fronten
     frontend.get_auto_pause_on_record_setting()
 }
 
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_set_deduplicate_save_states_setting(
+    frontend: &mut SuperShuckieFrontend,
+    new_setting: bool
+) {
+    frontend.set_deduplicate_save_states_setting(new_setting);
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_get_deduplicate_save_states_setting(frontend: &SuperShuckieFrontend) -> bool {
+    frontend.get_deduplicate_save_states_setting()
+}
+
 #[unsafe(no_mangle)]
 pub extern "C" fn supershuckie_frontend_set_auto_decompress_replays_upfront_setting(
     frontend: &mut SuperShuckieFrontend,
@@ -418,6 +595,16 @@ pub unsafe extern "C" fn supershuckie_frontend_save_sram(
     }
 }
 
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_get_sram_autosave_interval(frontend: &SuperShuckieFrontend) -> u32 {
+    frontend.get_sram_autosave_interval()
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_set_sram_autosave_interval(frontend: &mut SuperShuckieFrontend, seconds: u32) {
+    frontend.set_sram_autosave_interval(seconds)
+}
+
 #[unsafe(no_mangle)]
 pub unsafe extern "C" fn supershuckie_frontend_set_custom_setting(
     frontend: &mut SuperShuckieFrontend,
@@ -469,6 +656,80 @@ pub extern "C" fn supershuckie_frontend_set_speed_settings(
     frontend.set_speed_settings(base, turbo);
 }
 
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_get_precise_frame_pacing(
+    frontend: &SuperShuckieFrontend
+) -> bool {
+    frontend.get_precise_frame_pacing()
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_set_precise_frame_pacing(
+    frontend: &mut SuperShuckieFrontend,
+    enabled: bool
+) -> bool {
+    frontend.set_precise_frame_pacing(enabled)
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_get_run_ahead_frames(
+    frontend: &SuperShuckieFrontend
+) -> u8 {
+    frontend.get_run_ahead_frames()
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_set_run_ahead_frames(
+    frontend: &mut SuperShuckieFrontend,
+    frames: u8
+) {
+    frontend.set_run_ahead_frames(frames)
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_set_rewinding(
+    frontend: &mut SuperShuckieFrontend,
+    rewinding: bool
+) {
+    frontend.set_rewinding(rewinding);
+}
+
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn supershuckie_frontend_get_rewind_settings(
+    frontend: &SuperShuckieFrontend,
+    interval_frames: *mut u64,
+    memory_mb: *mut u32
+) {
+    let interval_frames = unsafe { nullable_reference!(interval_frames) };
+    let memory_mb = unsafe { nullable_reference!(memory_mb) };
+    frontend.get_rewind_settings(interval_frames, memory_mb);
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_set_rewind_settings(
+    frontend: &mut SuperShuckieFrontend,
+    interval_frames: u64,
+    memory_mb: u32
+) {
+    frontend.set_rewind_settings(interval_frames, memory_mb);
+}
+
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn supershuckie_frontend_get_perf_stats(
+    frontend: &SuperShuckieFrontend,
+    stats: *mut PerfStatsSummary
+) {
+    let stats = unsafe { nullable_reference!(stats) };
+    *stats = frontend.get_perf_stats();
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn supershuckie_frontend_reset_perf_stats(
+    frontend: &mut SuperShuckieFrontend
+) {
+    frontend.reset_perf_stats();
+}
+
 #[unsafe(no_mangle)]
 pub unsafe extern "C" fn supershuckie_frontend_free(
     frontend: *mut SuperShuckieFrontend
@@ -490,6 +751,34 @@ pub unsafe extern "C" fn supershuckie_frontend_get_all_replays_for_rom(
     Box::into_raw(Box::new(array))
 }
 
+#[repr(C)]
+#[derive(Copy, Clone, Default)]
+pub struct SuperShuckieReplayInfoC {
+    pub total_frames: u64,
+    pub total_milliseconds: u64,
+    pub bookmark_count: usize
+}
+
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn supershuckie_frontend_get_replay_info(
+    frontend: &SuperShuckieFrontend,
+    rom: *const c_char,
+    name: *const c_char,
+    info: &mut SuperShuckieReplayInfoC
+) -> bool {
+    let name = unsafe { CStr::from_ptr(name) }.to_str().expect("name not UTF-8");
+    *info = SuperShuckieReplayInfoC::default();
+
+    let Some(replay) = unsafe { current_rom_or_null(frontend, rom) }.and_then(|rom| frontend.get_replay_info(rom, name)) else {
+        return false
+    };
+
+    info.total_frames = replay.total_frames;
+    info.total_milliseconds = replay.total_milliseconds;
+    info.bookmark_count = replay.bookmarks.len();
+    true
+}
+
 #[unsafe(no_mangle)]
 pub unsafe extern "C" fn supershuckie_frontend_get_all_saves_for_rom(
     frontend: &SuperShuckieFrontend,
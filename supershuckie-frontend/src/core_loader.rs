@@ -0,0 +1,214 @@
+//! Loads ROMs and builds emulator cores on a background thread, so the frontend isn't blocked.
+
+use crate::settings::{GameBoyMode, GameBoySettings};
+use crate::util::UTF8CString;
+use crate::SuperShuckieEmulatorType;
+use std::collections::BTreeMap;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::{Arc, LazyLock};
+use std::thread::JoinHandle;
+use std::time::SystemTime;
+use supershuckie_core::emulator::{EmulatorCore, GameBoyColor, Model};
+use supershuckie_replay_recorder::blake3_hash;
+use supershuckie_replay_recorder::replay_file::ReplayHeaderBlake3Hash;
+
+// TODO: Let these be configurable.
+static DMG_BIOS: &[u8] = include_bytes!("../../bootrom/dmg/dmg.bin");
+static CGB_BIOS: &[u8] = include_bytes!("../../bootrom/cgb/cgb_boot/cgb_boot_fast.bin");
+
+static DMG_BIOS_CHECKSUM: LazyLock<ReplayHeaderBlake3Hash> = LazyLock::new(|| blake3_hash(DMG_BIOS));
+static CGB_BIOS_CHECKSUM: LazyLock<ReplayHeaderBlake3Hash> = LazyLock::new(|| blake3_hash(CGB_BIOS));
+
+/// ROM data and its checksum.
+#[derive(Clone)]
+pub(crate) struct RomData {
+    pub data: Arc<Vec<u8>>,
+    pub checksum: ReplayHeaderBlake3Hash
+}
+
+/// A ROM loaded by [`CoreLoader::load_rom`], with a core built for it.
+pub(crate) struct LoadedRom {
+    pub rom: RomData,
+    pub emulator_type: SuperShuckieEmulatorType,
+    pub core: Box<dyn EmulatorCore>
+}
+
+pub(crate) enum CoreLoaderResult {
+    /// A ROM requested with [`CoreLoader::load_rom`] finished loading (or failed to).
+    Rom { path: PathBuf, result: Result<LoadedRom, UTF8CString> },
+
+    /// A core requested with [`CoreLoader::prewarm`] was built.
+    Prewarmed { emulator_type: SuperShuckieEmulatorType, core: Box<dyn EmulatorCore> }
+}
+
+enum Job {
+    LoadRom { path: PathBuf, game_boy_settings: GameBoySettings },
+    Prewarm { rom: RomData, emulator_type: SuperShuckieEmulatorType }
+}
+
+/// Owns the loader thread, which handles requests in the order they were made.
+///
+/// Cores are built without SRAM, since it may still be written to before the core is used.
+pub(crate) struct CoreLoader {
+    sender: Option<Sender<(u64, Job)>>,
+    results: Receiver<(u64, CoreLoaderResult)>,
+    thread: Option<JoinHandle<()>>,
+
+    /// Requests made before this last changed are dropped, along with their results
+    generation: Arc<AtomicU64>
+}
+
+impl CoreLoader {
+    pub fn new() -> Self {
+        let (sender, jobs) = channel();
+        let (results_sender, results) = channel();
+        let generation = Arc::new(AtomicU64::new(0));
+        let thread_generation = generation.clone();
+        let thread = std::thread::Builder::new()
+            .name("SuperShuckieCoreLoader".to_owned())
+            .spawn(move || run_thread(jobs, results_sender, thread_generation))
+            .expect("failed to start the core loader thread");
+
+        Self { sender: Some(sender), results, thread: Some(thread), generation }
+    }
+
+    /// Read the ROM at `path` and build a core for it, cancelling every earlier request.
+    pub fn load_rom(&self, path: PathBuf, game_boy_settings: GameBoySettings) {
+        self.cancel();
+        self.send(Job::LoadRom { path, game_boy_settings });
+    }
+
+    /// Build a core of the given type for `rom`.
+    pub fn prewarm(&self, rom: RomData, emulator_type: SuperShuckieEmulatorType) {
+        self.send(Job::Prewarm { rom, emulator_type });
+    }
+
+    /// Drop every request made so far, including any that have finished but not been polled.
+    pub fn cancel(&self) {
+        self.generation.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Get the result of a finished request, if there is one.
+    pub fn poll_result(&self) -> Option<CoreLoaderResult> {
+        let generation = self.generation.load(Ordering::Relaxed);
+        loop {
+            let (result_generation, result) = self.results.try_recv().ok()?;
+            if result_generation == generation {
+                return Some(result)
+            }
+        }
+    }
+
+    fn send(&self, job: Job) {
+        let generation = self.generation.load(Ordering::Relaxed);
+        self.sender.as_ref()
+            .expect("core loader used after being dropped")
+            .send((generation, job))
+            .expect("the core loader thread has crashed");
+    }
+}
+
+impl Drop for CoreLoader {
+    fn drop(&mut self) {
+        self.cancel();
+        drop(self.sender.take());
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+fn run_thread(jobs: Receiver<(u64, Job)>, results: Sender<(u64, CoreLoaderResult)>, generation: Arc<AtomicU64>) {
+    let mut checksums = RomChecksumCache::default();
+
+    for (job_generation, job) in jobs {
+        if job_generation != generation.load(Ordering::Relaxed) {
+            continue
+        }
+
+        let result = match job {
+            Job::LoadRom { path, game_boy_settings } => {
+                let result = load_rom(&path, &game_boy_settings, &mut checksums);
+                CoreLoaderResult::Rom { path, result }
+            },
+            Job::Prewarm { rom, emulator_type } => {
+                CoreLoaderResult::Prewarmed { emulator_type, core: build_core(&rom, emulator_type) }
+            }
+        };
+
+        if results.send((job_generation, result)).is_err() {
+            break
+        }
+    }
+}
+
+fn load_rom(path: &Path, game_boy_settings: &GameBoySettings, checksums: &mut RomChecksumCache) -> Result<LoadedRom, UTF8CString> {
+    let filename = path.file_name().and_then(|i| i.to_str()).unwrap_or_default();
+    let key = RomChecksumCache::key(path);
+
+    let data = std::fs::read(path).map_err(|e| {
+        format!("Failed to read ROM at {filename}: {e}")
+    })?;
+
+    let checksum = checksums.get_or_hash(key, data.as_slice());
+    let rom = RomData { data: Arc::new(data), checksum };
+    let emulator_type = choose_for_game_boy(game_boy_settings, rom.data.as_slice());
+    let core = build_core(&rom, emulator_type);
+
+    Ok(LoadedRom { rom, emulator_type, core })
+}
+
+/// ROM checksums keyed by path, modification time, and size, so unchanged ROMs aren't hashed again.
+#[derive(Default)]
+struct RomChecksumCache {
+    checksums: BTreeMap<(PathBuf, SystemTime, u64), ReplayHeaderBlake3Hash>
+}
+
+impl RomChecksumCache {
+    fn key(path: &Path) -> Option<(PathBuf, SystemTime, u64)> {
+        let metadata = std::fs::metadata(path).ok()?;
+        Some((path.to_owned(), metadata.modified().ok()?, metadata.len()))
+    }
+
+    fn get_or_hash(&mut self, key: Option<(PathBuf, SystemTime, u64)>, data: &[u8]) -> ReplayHeaderBlake3Hash {
+        // If the size changed, the file was written to while it was read.
+        let Some(key) = key.filter(|k| k.2 == data.len() as u64) else {
+            return blake3_hash(data)
+        };
+        *self.checksums.entry(key).or_insert_with(|| blake3_hash(data))
+    }
+}
+
+/// Build a core of the given type for `rom`, without SRAM.
+pub(crate) fn build_core(rom: &RomData, emulator_type: SuperShuckieEmulatorType) -> Box<dyn EmulatorCore> {
+    let (model, bios, bios_checksum) = match emulator_type {
+        SuperShuckieEmulatorType::GameBoy => (Model::DmgB, DMG_BIOS, *DMG_BIOS_CHECKSUM),
+        SuperShuckieEmulatorType::GameBoySGB2 => (Model::Sgb2, DMG_BIOS, *DMG_BIOS_CHECKSUM),
+        SuperShuckieEmulatorType::GameBoyColor => (Model::Cgb0, CGB_BIOS, *CGB_BIOS_CHECKSUM)
+    };
+
+    Box::new(GameBoyColor::new_from_rom_with_checksums(rom.data.as_slice(), bios, model, rom.checksum, bios_checksum))
+}
+
+/// Pick which console to run a Game Boy ROM on.
+pub(crate) fn choose_for_game_boy(settings: &GameBoySettings, data: &[u8]) -> SuperShuckieEmulatorType {
+    let game_boy = match settings.sgb {
+        true => SuperShuckieEmulatorType::GameBoySGB2,
+        false => SuperShuckieEmulatorType::GameBoy
+    };
+
+    match settings.gbc_mode {
+        GameBoyMode::AlwaysGBC => SuperShuckieEmulatorType::GameBoyColor,
+        GameBoyMode::AlwaysGB => game_boy,
+        GameBoyMode::GBInGBMode => {
+            if data.get(0x143).copied() == Some(0x00) {
+                game_boy
+            }
+            else {
+                SuperShuckieEmulatorType::GameBoyColor
+            }
+        },
+    }
+}
@@ -0,0 +1,242 @@
+//! Writes save states and SRAM on a background thread, so slow disks don't block the frontend.
+
+use crate::util::UTF8CString;
+use num_enum::TryFromPrimitive;
+use std::collections::BTreeMap;
+use std::fs::File;
+use std::io::Write;
+use std::path::{Path, PathBuf};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::thread::JoinHandle;
+
+/// What kind of file was written.
+#[derive(Copy, Clone, PartialEq, Debug, TryFromPrimitive)]
+#[repr(u32)]
+pub enum FileWriteKind {
+    SaveState = 0,
+    SRAM = 1
+}
+
+/// Where a [`FileWrite`] goes.
+pub(crate) enum FileWriteTarget {
+    /// Overwrite this path.
+    Path(PathBuf),
+
+    /// Write to `{prefix}-{i}.{extension}` in `dir` for the first `i` that isn't taken.
+    Generic { dir: PathBuf, prefix: String, extension: &'static str }
+}
+
+pub(crate) struct FileWrite {
+    pub kind: FileWriteKind,
+    pub target: FileWriteTarget,
+
+    /// Receives the data to write; this is usually sent by the core thread once it gets to it
+    pub data: Receiver<Vec<u8>>,
+
+    /// If set, this turns the data into what is actually written, off of the frontend's thread
+    pub encode: Option<Encoder>,
+
+    /// If set, the write isn't reported unless it fails
+    pub automatic: bool
+}
+
+pub(crate) type Encoder = Box<dyn FnOnce(Vec<u8>) -> Result<Vec<u8>, UTF8CString> + Send>;
+
+/// Result of a finished write.
+pub struct FileWriteResult {
+    pub kind: FileWriteKind,
+
+    /// Name of the file written, without the extension
+    pub name: UTF8CString,
+
+    /// Set if this was an automatic save
+    pub automatic: bool,
+
+    pub result: Result<(), UTF8CString>
+}
+
+enum Job {
+    Write(FileWrite),
+    Flush(Sender<()>)
+}
+
+/// Owns the writer thread, which writes files in the order they were queued.
+///
+/// Dropping this waits for everything queued to be written.
+pub(crate) struct FileWriter {
+    sender: Option<Sender<Job>>,
+    results: Receiver<FileWriteResult>,
+    thread: Option<JoinHandle<()>>
+}
+
+impl FileWriter {
+    pub fn new() -> Self {
+        let (sender, jobs) = channel();
+        let (results_sender, results) = channel();
+        let thread = std::thread::Builder::new()
+            .name("SuperShuckieFileWriter".to_owned())
+            .spawn(move || run_thread(jobs, results_sender))
+            .expect("failed to start the file writer thread");
+
+        Self { sender: Some(sender), results, thread: Some(thread) }
+    }
+
+    /// Queue a write.
+    pub fn write(&self, write: FileWrite) {
+        self.send(Job::Write(write));
+    }
+
+    /// Block until everything queued so far has been written.
+    ///
+    /// This must be done before reading or deleting a file that may still be being written.
+    pub fn flush(&self) {
+        let (sender, receiver) = channel();
+        self.send(Job::Flush(sender));
+        let _ = receiver.recv();
+    }
+
+    /// Get the result of a finished write, if there is one.
+    pub fn poll_result(&self) -> Option<FileWriteResult> {
+        self.results.try_recv().ok()
+    }
+
+    fn send(&self, job: Job) {
+        self.sender.as_ref()
+            .expect("file writer used after being dropped")
+            .send(job)
+            .expect("the file writer thread has crashed");
+    }
+}
+
+impl Drop for FileWriter {
+    fn drop(&mut self) {
+        drop(self.sender.take());
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+fn run_thread(jobs: Receiver<Job>, results: Sender<FileWriteResult>) {
+    // Last SRAM written to each path, so unchanged SRAM isn't written again
+    let mut last_sram: BTreeMap<PathBuf, Vec<u8>> = BTreeMap::new();
+
+    for job in jobs {
+        let write = match job {
+            Job::Write(write) => write,
+            Job::Flush(sender) => {
+                let _ = sender.send(());
+                continue
+            }
+        };
+
+        let FileWrite { kind, target, data, encode, automatic } = write;
+        let finish = |path: Option<&Path>, result: Result<(), UTF8CString>| {
+            if automatic && result.is_ok() {
+                return
+            }
+            let name = path.and_then(|p| p.file_stem()).and_then(|n| n.to_str()).unwrap_or_default().into();
+            let _ = results.send(FileWriteResult { kind, name, automatic, result });
+        };
+
+        let target_path = match &target {
+            FileWriteTarget::Path(path) => Some(path.as_path()),
+            FileWriteTarget::Generic { .. } => None
+        };
+
+        let Ok(data) = data.recv() else {
+            finish(target_path, Err("The emulator did not provide any data to write".into()));
+            continue
+        };
+
+        let data = match encode {
+            Some(encode) => match encode(data) {
+                Ok(data) => data,
+                Err(e) => {
+                    finish(target_path, Err(e));
+                    continue
+                }
+            },
+            None => data
+        };
+
+        let (path, reserved) = match target {
+            FileWriteTarget::Path(path) => (path, false),
+            FileWriteTarget::Generic { dir, prefix, extension } => match reserve_generic_path(&dir, &prefix, extension) {
+                Ok(path) => (path, true),
+                Err(e) => {
+                    finish(None, Err(e));
+                    continue
+                }
+            }
+        };
+
+        if kind == FileWriteKind::SRAM {
+            if last_sram.get(&path).is_some_and(|last| *last == data) && path.is_file() {
+                finish(Some(&path), Ok(()));
+                continue
+            }
+            last_sram.remove(&path);
+        }
+
+        match write_atomically(&path, &data) {
+            Ok(()) => {
+                finish(Some(&path), Ok(()));
+                if kind == FileWriteKind::SRAM {
+                    last_sram.insert(path, data);
+                }
+            },
+            Err(e) => {
+                if reserved {
+                    let _ = std::fs::remove_file(&path);
+                }
+                let filename = path.file_name().and_then(|n| n.to_str()).unwrap_or_default();
+                finish(Some(&path), Err(format!("Can't write to {filename}: {e}").into()));
+            }
+        }
+    }
+}
+
+fn reserve_generic_path(dir: &Path, prefix: &str, extension: &str) -> Result<PathBuf, UTF8CString> {
+    let mut i = 0u64;
+    loop {
+        let path = dir.join(format!("{prefix}-{i}.{extension}"));
+        match File::create_new(&path) {
+            Ok(_) => return Ok(path),
+            Err(e) if e.kind() == std::io::ErrorKind::AlreadyExists => {
+                i = i.checked_add(1).ok_or_else(|| UTF8CString::from_str("Maximum number of generics reached."))?;
+            },
+            Err(e) => return Err(format!("Can't create a file in {}: {e}", dir.display()).into())
+        }
+    }
+}
+
+/// Write to a temporary file next to `path`, sync it, then move it over `path`.
+///
+/// If this fails at any point, whatever was at `path` is left intact.
+pub(crate) fn write_atomically(path: &Path, data: &[u8]) -> std::io::Result<()> {
+    let mut temp_name = path.file_name().unwrap_or_default().to_owned();
+    temp_name.push(".tmp");
+    let temp_path = path.with_file_name(temp_name);
+
+    let result = (|| {
+        let mut file = File::create(&temp_path)?;
+        file.write_all(data)?;
+        file.sync_all()?;
+        drop(file);
+        std::fs::rename(&temp_path, path)
+    })();
+
+    if result.is_err() {
+        let _ = std::fs::remove_file(&temp_path);
+        return result
+    }
+
+    // Also make the rename itself durable
+    #[cfg(unix)]
+    if let Some(dir) = path.parent() {
+        let _ = File::open(dir).and_then(|d| d.sync_all());
+    }
+
+    Ok(())
+}
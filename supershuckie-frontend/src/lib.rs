@@ -1,20 +1,35 @@
 pub mod util;
 pub mod settings;
+mod core_loader;
+mod file_writer;
+mod library;
+mod save_state_file;
 
-use std::collections::BTreeMap;
+pub use file_writer::{FileWriteKind, FileWriteResult};
+pub use library::{LibraryBookmark, LibraryReplay, LibrarySaveState};
+pub use save_state_file::{SaveStateHeader, SaveStateThumbnail};
+
+use std::cell::RefCell;
+use std::collections::{BTreeMap, VecDeque};
 use crate::settings::*;
 use crate::util::UTF8CString;
 use std::ffi::CStr;
 use std::fs::File;
-use std::io::Write;
 use std::num::{NonZeroU64, NonZeroU8};
 use std::path::{Path, PathBuf};
 use std::sync::Arc;
-use supershuckie_core::emulator::{EmulatorCore, GameBoyColor, Input, Model, NullEmulatorCore, PartialReplayRecordMetadata, ScreenData};
-use supershuckie_core::{ReplayPlayerAttachError, Speed, SuperShuckieRapidFire, ThreadedSuperShuckieCore};
+use std::time::{Duration, Instant, SystemTime};
+use crate::core_loader::{build_core, choose_for_game_boy, CoreLoader, CoreLoaderResult, LoadedRom, RomData};
+use crate::file_writer::{FileWrite, FileWriteTarget, FileWriter};
+use crate::library::{RomLibrary, LIBRARY_FILE_NAME};
+use crate::save_state_file::{decode_save_state, encode_save_state, load_or_create_base_state, CompressedSaveState, SaveStateBase, BASE_STATE_FILE_NAME};
+use supershuckie_core::emulator::{EmulatorCore, Input, NullEmulatorCore, PartialReplayRecordMetadata, ScreenData, ScreenDataEncoding};
+use supershuckie_core::perf::PerfStatsSummary;
+use supershuckie_core::screen_filter::{ScreenFilterSettings, ScreenScaler};
+use supershuckie_core::{FrameReadyCallback, PokeAByteServerSettings, MAX_RUN_AHEAD_FRAMES, ReplayPlayerAttachError, ReplaySnapshotSettings, RewindSettings, Speed, SuperShuckieRapidFire, ThreadedSuperShuckieCore};
 use supershuckie_replay_recorder::replay_file::{ReplayConsoleType, ReplayHeaderBlake3Hash, ReplayPatchFormat};
-use supershuckie_replay_recorder::ByteVec;
-use supershuckie_replay_recorder::replay_file::playback::ReplayFilePlayer;
+use supershuckie_replay_recorder::{blake3_hash, ByteVec};
+use supershuckie_replay_recorder::replay_file::playback::{ReplayFilePlayer, ReplayFilePlayerCacheSettings};
 use supershuckie_replay_recorder::replay_file::record::ReplayFileRecorderSettings;
 
 const SETTINGS_FILE: &str = "settings.json";
@@ -31,6 +46,10 @@ pub enum SuperShuckieEmulatorType {
     GameBoyColor
 }
 
+impl SuperShuckieEmulatorType {
+    const ALL: [SuperShuckieEmulatorType; 3] = [Self::GameBoy, Self::GameBoySGB2, Self::GameBoyColor];
+}
+
 pub enum UserInput {
     Keyboard { keycode: i32 },
     Button { controller: ConnectedControllerIndex, button: i32 },
@@ -42,17 +61,27 @@ pub struct SuperShuckieFrontend {
     core_metadata: CoreMetadata,
 
     callbacks: Box<dyn SuperShuckieFrontendCallbacks>,
+    frame_ready_callback: Option<FrameReadyCallback>,
+    display_refresh_rate: Option<f64>,
 
     user_dir: PathBuf,
-    frame_count: u32,
+    file_writer: FileWriter,
+    core_loader: CoreLoader,
+
+    /// Cores built ahead of time for the loaded ROM, at most one per emulator type, so switching to
+    /// them (e.g. for a replay) is instant
+    prewarmed_cores: Vec<(SuperShuckieEmulatorType, Box<dyn EmulatorCore>)>,
+    libraries: RefCell<BTreeMap<String, RomLibrary>>,
+    next_sram_autosave: Option<Instant>,
+    screen_sequence: u64,
     pokeabyte_error: Option<UTF8CString>,
 
-    loaded_rom_data: Option<Vec<u8>>,
+    loaded_rom: Option<RomData>,
 
     current_input: Input,
     current_rapid_fire_input: Option<SuperShuckieRapidFire>,
     current_toggled_input: Option<Input>,
-    current_save_state_history: Vec<Vec<u8>>,
+    current_save_state_history: VecDeque<CompressedSaveState>,
     current_save_state_history_position: usize,
 
     connected_controllers: BTreeMap<ConnectedControllerIndex, UTF8CString>,
@@ -77,16 +106,23 @@ impl SuperShuckieFrontend {
             core: ThreadedSuperShuckieCore::new(Box::new(NullEmulatorCore)),
             core_metadata: CoreMetadata { emulator_type: None },
             user_dir,
+            file_writer: FileWriter::new(),
+            core_loader: CoreLoader::new(),
+            prewarmed_cores: Vec::new(),
+            libraries: RefCell::new(BTreeMap::new()),
+            next_sram_autosave: None,
             rom_name: None,
             save_file: None,
-            loaded_rom_data: None,
-            frame_count: 0,
+            loaded_rom: None,
+            screen_sequence: 0,
             current_rapid_fire_input: None,
             current_toggled_input: None,
             callbacks,
+            frame_ready_callback: None,
+            display_refresh_rate: None,
             settings,
             current_input: Input::default(),
-            current_save_state_history: Vec::new(),
+            current_save_state_history: VecDeque::new(),
             current_save_state_history_position: 0,
             recording_replay_file: None,
             pokeabyte_error: None,
@@ -103,7 +139,11 @@ impl SuperShuckieFrontend {
     ///
     /// If `name` is set, that name will be used.
     ///
-    /// Returns the name of the save state if created.
+    /// This does not wait for the save state to be written; the `file_written` callback is called
+    /// from [`Self::tick`] once it is.
+    ///
+    /// Returns the name of the save state, or an empty string if `name` is `None`, in which case
+    /// the name is picked when the save state is written.
     pub fn create_save_state(&mut self, name: Option<&str>) -> Result<UTF8CString, UTF8CString> {
         if !self.is_game_running() {
             return Err("Game not running".into())
@@ -112,12 +152,32 @@ impl SuperShuckieFrontend {
         let current_rom_name = self.get_current_rom_name().expect("no rom name when game is running in create_save_state");
         let save_states_dir = self.get_save_states_dir_for_rom(current_rom_name);
 
-        let (mut file, filename, _) = self.load_file_or_make_generic(&save_states_dir, name, None, SAVE_STATE_EXTENSION)?;
+        let thumbnail = self.core.read_screens(|screens| screens.first().map(SaveStateThumbnail::from_screen));
+        let created_unix_millis = SystemTime::now().duration_since(SystemTime::UNIX_EPOCH).map_or(0, |d| d.as_millis() as u64);
+        let base_path = self.settings.emulation.deduplicate_save_states.then(|| save_states_dir.join(BASE_STATE_FILE_NAME));
+
+        let target = match name {
+            Some(name) => FileWriteTarget::Path(save_states_dir.join(format!("{name}.{SAVE_STATE_EXTENSION}"))),
+            None => FileWriteTarget::Generic {
+                dir: save_states_dir,
+                prefix: self.get_current_save_name().expect("no save name when game is running in create_save_state").to_owned(),
+                extension: SAVE_STATE_EXTENSION
+            }
+        };
 
-        let state = self.create_save_state_now();
-        file.write_all(&state)
-            .map_err(|e| format!("Can't write to {filename}: {e}").into())
-            .map(|_| filename.into())
+        self.file_writer.write(FileWrite {
+            kind: FileWriteKind::SaveState,
+            target,
+            data: self.core.request_save_state(),
+            encode: Some(Box::new(move |state| {
+                let base = base_path.map(|path| load_or_create_base_state(&path, &state)).transpose()?;
+                let base = base.as_deref().map(|base| SaveStateBase { state: base, hash: blake3_hash(base) });
+                encode_save_state(&state, base, thumbnail.as_ref(), created_unix_millis)
+            })),
+            automatic: false
+        });
+
+        Ok(name.unwrap_or_default().into())
     }
 
     /// Connect a controller.
@@ -190,17 +250,33 @@ impl SuperShuckieFrontend {
         let save_states_dir = self.get_save_states_dir_for_rom(current_rom_name);
         let save_state_file = save_states_dir.join(format!("{name}.{SAVE_STATE_EXTENSION}"));
 
+        self.file_writer.flush();
         if !save_state_file.is_file() {
             return Ok(false)
         }
 
-        self.push_save_state_history();
-
         let save_state = std::fs::read(save_state_file).map_err(|e| format!("Failed to load save state {name}: {e}"))?;
+        let save_state = decode_save_state(save_state, |_| std::fs::read(save_states_dir.join(BASE_STATE_FILE_NAME)).ok())
+            .map_err(|e| format!("Failed to load save state {name}: {e}"))?;
+
+        self.push_save_state_history();
         self.core.load_save_state(save_state);
         Ok(true)
     }
 
+    /// Get the indexed header of a save state for the current ROM.
+    ///
+    /// Returns `None` if there is no such save state. Save states made by older versions have no
+    /// header, so their info is all zeroes.
+    pub fn get_save_state_info(&self, name: &str) -> Option<LibrarySaveState> {
+        let current_rom_name = self.get_current_rom_name()?;
+        let path = self.get_save_states_dir_for_rom(current_rom_name).join(format!("{name}.{SAVE_STATE_EXTENSION}"));
+
+        self.with_library(current_rom_name, |l| l.refresh_save_state(name, &path), |l| {
+            l.save_state(name).map(|info| info.cloned().unwrap_or_default())
+        })
+    }
+
     /// Loads a replay with the given name if it exists.
     ///
     /// If it does, and it is successfully loaded, `Ok(true)` is returned.
@@ -219,21 +295,29 @@ impl SuperShuckieFrontend {
             return Ok(false)
         }
 
-        let file = match std::fs::read(replay_file) {
+        let file = match File::open(replay_file) {
             Ok(n) => n,
             Err(e) => {
                 return Err(format!("Failed to read replay {name}:\n\n{e}").into())
             }
         };
 
-        let mut player = match ReplayFilePlayer::new(file, override_errors) {
+        let mut player = match ReplayFilePlayer::new_lazy(file, override_errors) {
             Ok(n) => n,
             Err(e) => {
                 return Err(format!("Failed to parse replay {name}:\n\n{e:?}").into())
             }
         };
 
-        if self.settings.replay_settings.auto_decompress_replays_upfront {
+        let replay_settings = &self.settings.replay_settings;
+        player.set_cache_settings(ReplayFilePlayerCacheSettings {
+            read_ahead_blobs: replay_settings.playback_read_ahead_blobs as usize,
+            read_behind_blobs: replay_settings.playback_read_behind_blobs as usize,
+            memory_budget: (replay_settings.playback_cache_memory_mb as usize).saturating_mul(1024 * 1024),
+            ..ReplayFilePlayerCacheSettings::default()
+        });
+
+        if replay_settings.auto_decompress_replays_upfront {
             player.decompress_all_blobs();
         }
 
@@ -296,10 +380,10 @@ impl SuperShuckieFrontend {
 
     fn push_save_state_history(&mut self) {
         self.current_save_state_history.truncate(self.current_save_state_history_position);
-        self.current_save_state_history.push(self.create_save_state_now());
+        self.current_save_state_history.push_back(CompressedSaveState::new(&self.create_save_state_now()));
 
         while self.current_save_state_history.len() > self.settings.emulation.max_save_state_history.get() {
-            self.current_save_state_history.remove(0);
+            self.current_save_state_history.pop_front();
         }
 
         self.current_save_state_history_position = self.current_save_state_history.len();
@@ -320,9 +404,9 @@ impl SuperShuckieFrontend {
         self.current_save_state_history_position -= 1;
 
         let history = &mut self.current_save_state_history[self.current_save_state_history_position];
-        let state_to_load = std::mem::replace(history, backup);
+        let state_to_load = std::mem::replace(history, CompressedSaveState::new(&backup));
 
-        self.core.load_save_state(state_to_load);
+        self.core.load_save_state(state_to_load.decompress());
         true
     }
 
@@ -337,9 +421,9 @@ impl SuperShuckieFrontend {
         let history = &mut self.current_save_state_history[self.current_save_state_history_position];
         self.current_save_state_history_position += 1;
 
-        let state_to_load = std::mem::replace(history, backup);
+        let state_to_load = std::mem::replace(history, CompressedSaveState::new(&backup));
 
-        self.core.load_save_state(state_to_load);
+        self.core.load_save_state(state_to_load.decompress());
         true
     }
 
@@ -425,6 +509,7 @@ impl SuperShuckieFrontend {
                 Control::Pause => if pressed && self.is_game_running() {
                     self.set_paused(!self.paused);
                 }
+                Control::Rewind => self.set_rewinding(pressed),
 
                 Control::A => unreachable!(),
                 Control::B => unreachable!(),
@@ -442,6 +527,13 @@ impl SuperShuckieFrontend {
         }
     }
 
+    /// Start loading the ROM at `path`.
+    ///
+    /// This does not wait for the ROM to be loaded; the `rom_loaded` callback is called from
+    /// [`Self::tick`] once it is, at which point the current ROM is closed. Loading another ROM or
+    /// unloading the current one before then cancels it.
+    ///
+    /// Returns `Err` only if `path` can't be a ROM.
     pub fn load_rom<P: AsRef<Path>>(&mut self, path: P) -> Result<(), UTF8CString> {
         let path = path.as_ref();
 
@@ -456,22 +548,33 @@ impl SuperShuckieFrontend {
             return Err(format!("{filename} does not appear to be a valid ROM file (missing extension)").into())
         };
 
-        let data = std::fs::read(path).map_err(|e| {
-            format!("Failed to read ROM at {filename}: {e}")
-        })?;
-
-        let emulator_to_use = match extension.to_lowercase().as_str() {
-            "gb" | "gbc" => self.choose_for_game_boy(data.as_slice()),
+        match extension.to_lowercase().as_str() {
+            "gb" | "gbc" => (),
             unknown => return Err(format!("Unknown or unsupported ROM file type .{unknown}").into())
         };
 
+        self.core_loader.load_rom(path.to_owned(), self.settings.game_boy_settings.clone());
+        Ok(())
+    }
+
+    fn finish_loading_rom(&mut self, path: &Path, loaded: LoadedRom) -> Result<(), UTF8CString> {
+        let filename = path.file_name().and_then(|i| i.to_str()).expect("load_rom checked the filename");
+
         self.create_userdata_for_rom(filename)?;
         self.close_rom();
-        self.loaded_rom_data = Some(data);
         self.rom_name = Some(Arc::new(UTF8CString::from_str(filename)));
-        self.core_metadata.emulator_type = Some(emulator_to_use);
+        self.core_metadata.emulator_type = Some(loaded.emulator_type);
         self.save_file = Some(Arc::new(self.get_current_save_file_name_for_rom(filename)));
-        self.reload_rom_in_place();
+        self.loaded_rom = Some(loaded.rom);
+
+        let core = self.with_current_sram(loaded.core);
+        let core = self.new_threaded_core(core);
+        self.switch_core(core);
+
+        for emulator_type in SuperShuckieEmulatorType::ALL {
+            self.prewarm_core(emulator_type);
+        }
+
         Ok(())
     }
 
@@ -528,12 +631,58 @@ impl SuperShuckieFrontend {
     }
 
     fn instantiate_and_load_core(&mut self, emulator_type: SuperShuckieEmulatorType) {
-        let rom_name = self.get_current_rom_name().expect("reload_rom_in_place with no loaded ROM");
-        let save_file = self.get_current_save_name().expect("reload_rom_in_place with no save file");
-        let save_file_data = self.get_save_file_data(rom_name, save_file);
-        let rom_data = self.loaded_rom_data.as_ref().expect("reload_rom_in_place with no loaded rom");
-        let core = self.make_new_core(rom_data, save_file_data, emulator_type);
-        self.switch_core(ThreadedSuperShuckieCore::new(core));
+        let core = match self.prewarmed_cores.iter().position(|(t, _)| *t == emulator_type) {
+            Some(index) => self.prewarmed_cores.swap_remove(index).1,
+            None => build_core(self.loaded_rom.as_ref().expect("reload_rom_in_place with no loaded rom"), emulator_type)
+        };
+        let core = self.with_current_sram(core);
+        let core = self.new_threaded_core(core);
+        self.switch_core(core);
+
+        // Replace the one that was used
+        self.prewarm_core(emulator_type);
+    }
+
+    fn prewarm_core(&mut self, emulator_type: SuperShuckieEmulatorType) {
+        if let Some(rom) = self.loaded_rom.as_ref() && !self.prewarmed_cores.iter().any(|(t, _)| *t == emulator_type) {
+            self.core_loader.prewarm(rom.clone(), emulator_type);
+        }
+    }
+
+    fn with_current_sram(&self, mut core: Box<dyn EmulatorCore>) -> Box<dyn EmulatorCore> {
+        let rom_name = self.get_current_rom_name().expect("with_current_sram with no loaded ROM");
+        let save_file = self.get_current_save_name().expect("with_current_sram with no save file");
+        if let Some(sram) = self.get_save_file_data(rom_name, save_file) {
+            let _ = core.load_sram(sram.as_slice()); // TODO: handle this?
+        }
+        core
+    }
+
+    fn new_threaded_core(&self, core: Box<dyn EmulatorCore>) -> ThreadedSuperShuckieCore {
+        let core = ThreadedSuperShuckieCore::new(core);
+        if self.frame_ready_callback.is_some() {
+            core.set_frame_ready_callback(self.frame_ready_callback.clone());
+        }
+        if let Some(refresh_rate) = self.display_refresh_rate {
+            core.set_display_refresh_rate(refresh_rate);
+        }
+        if self.settings.emulation.precise_frame_pacing {
+            core.set_precise_frame_pacing(true);
+        }
+        if self.settings.emulation.run_ahead_frames > 0 {
+            core.set_run_ahead_frames(self.settings.emulation.run_ahead_frames);
+        }
+        let screen_filter = self.screen_filter_settings();
+        if !screen_filter.is_passthrough() {
+            core.set_screen_filter(screen_filter);
+        }
+        core.set_rewind_settings(self.rewind_settings());
+        let replay_settings = &self.settings.replay_settings;
+        core.set_replay_snapshot_settings(ReplaySnapshotSettings {
+            interval_frames: replay_settings.seek_snapshot_interval_frames,
+            memory_limit: (replay_settings.seek_snapshot_memory_mb as usize).saturating_mul(1024 * 1024)
+        });
+        core
     }
 
     fn switch_core(&mut self, core: ThreadedSuperShuckieCore) {
@@ -544,35 +693,21 @@ impl SuperShuckieFrontend {
     }
 
     fn reset_save_state_history(&mut self) {
-        self.current_save_state_history = Vec::new();
+        self.current_save_state_history = VecDeque::new();
         self.current_save_state_history_position = 0;
     }
 
-    fn make_new_core(&self, rom_data: &[u8], save_file: Option<Vec<u8>>, emulator_type: SuperShuckieEmulatorType) -> Box<dyn EmulatorCore> {
-        let bios = self.get_bios_for_core(emulator_type);
-
-        let mut core: Box<dyn EmulatorCore> = match emulator_type {
-            SuperShuckieEmulatorType::GameBoy => Box::new(GameBoyColor::new_from_rom(rom_data, bios.as_slice(), Model::DmgB)),
-            SuperShuckieEmulatorType::GameBoySGB2 => Box::new(GameBoyColor::new_from_rom(rom_data, bios.as_slice(), Model::Sgb2)),
-            SuperShuckieEmulatorType::GameBoyColor => Box::new(GameBoyColor::new_from_rom(rom_data, bios.as_slice(), Model::Cgb0))
-        };
-
-        if let Some(sram) = save_file {
-            let _ = core.load_sram(sram.as_slice()); // TODO: handle this?
-        }
-
-        core
-    }
-
     fn get_current_save_file_name_for_rom(&mut self, rom: &str) -> UTF8CString {
         self.settings.get_rom_config_or_default(rom).save_name.clone()
     }
 
     fn get_save_file_data(&self, rom: &str, save_file: &str) -> Option<Vec<u8>> {
+        self.file_writer.flush();
         std::fs::read(self.get_save_path(rom, save_file)).ok()
     }
 
     fn delete_save_file_data(&mut self, rom: &str, save_file: &str) {
+        self.file_writer.flush();
         let _ = std::fs::remove_file(self.get_save_path(rom, save_file)).ok();
     }
 
@@ -581,14 +716,6 @@ impl SuperShuckieFrontend {
             .join(format!("{save_file}.{SAVE_DATA_EXTENSION}"))
     }
 
-    fn get_bios_for_core(&self, emulator_kind: SuperShuckieEmulatorType) -> Vec<u8> {
-        // TODO: Let this be configurable.
-        match emulator_kind {
-            SuperShuckieEmulatorType::GameBoy | SuperShuckieEmulatorType::GameBoySGB2 => include_bytes!("../../bootrom/dmg/dmg.bin").to_vec(),
-            SuperShuckieEmulatorType::GameBoyColor => include_bytes!("../../bootrom/cgb/cgb_boot/cgb_boot_fast.bin").to_vec()
-        }
-    }
-
     /// Close the ROM, saving.
     pub fn close_rom(&mut self) {
         self.save_sram_unchecked();
@@ -598,7 +725,9 @@ impl SuperShuckieFrontend {
     /// Unload the ROM without saving.
     pub fn unload_rom(&mut self) {
         self.before_unload_or_reload_rom();
-        self.core = ThreadedSuperShuckieCore::new(Box::new(NullEmulatorCore));
+        self.core_loader.cancel();
+        self.prewarmed_cores.clear();
+        self.core = self.new_threaded_core(Box::new(NullEmulatorCore));
         self.save_file = None;
         self.rom_name = None;
         self.core_metadata.emulator_type = None;
@@ -632,18 +761,64 @@ impl SuperShuckieFrontend {
     }
 
     /// Save the SRAM.
+    ///
+    /// This does not wait for the SRAM to be written; the `file_written` callback is called from
+    /// [`Self::tick`] once it is.
     pub fn save_sram(&mut self) -> Result<(), UTF8CString> {
+        self.queue_sram_write(false)
+    }
+
+    fn queue_sram_write(&mut self, automatic: bool) -> Result<(), UTF8CString> {
         if !self.is_game_running() {
             return Err("Game not running".into())
         }
 
         let current_rom = self.get_current_rom_name().expect("save_sram with no current ROM");
         let current_save = self.get_current_save_name().expect("save_sram with no current save");
-
-        let sram = self.core.get_sram().expect("save_sram failed to get sram (BUG!)");
         let save_file = self.get_save_path(current_rom, current_save);
 
-        std::fs::write(&save_file, sram).map_err(|e| format!("Failed to write SRAM to disk: {e}").into())
+        self.file_writer.write(FileWrite {
+            kind: FileWriteKind::SRAM,
+            target: FileWriteTarget::Path(save_file),
+            data: self.core.request_sram(),
+            encode: None,
+            automatic
+        });
+
+        Ok(())
+    }
+
+    /// Get how often SRAM is saved automatically, in seconds (0 = never).
+    pub fn get_sram_autosave_interval(&self) -> u32 {
+        self.settings.emulation.sram_autosave_interval_seconds
+    }
+
+    /// Set how often SRAM is saved automatically, in seconds (0 = never).
+    ///
+    /// SRAM is only written if it changed since it was last written.
+    pub fn set_sram_autosave_interval(&mut self, seconds: u32) {
+        self.settings.emulation.sram_autosave_interval_seconds = seconds;
+        self.next_sram_autosave = None;
+    }
+
+    fn autosave_sram_if_needed(&mut self) {
+        let interval = self.settings.emulation.sram_autosave_interval_seconds;
+        if interval == 0 || !self.is_game_running() || self.core.is_playing_back() {
+            self.next_sram_autosave = None;
+            return
+        }
+
+        let now = Instant::now();
+        let interval = Duration::from_secs(interval as u64);
+        let Some(next) = self.next_sram_autosave else {
+            self.next_sram_autosave = Some(now + interval);
+            return
+        };
+
+        if now >= next {
+            self.next_sram_autosave = Some(now + interval);
+            let _ = self.queue_sram_write(true);
+        }
     }
 
     fn save_sram_unchecked(&mut self) {
@@ -670,7 +845,65 @@ impl SuperShuckieFrontend {
         }
 
         *old_scale = scale;
+        self.update_screen_filter();
+    }
+
+    /// Get the video scale.
+    pub fn get_video_scale(&self) -> NonZeroU8 {
+        self.settings.emulation.video_scale
+    }
+
+    /// Get how screens are scaled on the core thread.
+    pub fn get_video_scaler(&self) -> VideoScaler {
+        self.settings.emulation.video_scaler
+    }
+
+    /// Set how screens are scaled on the core thread.
+    ///
+    /// If this isn't [`VideoScaler::Frontend`], screens are passed to the frontend already scaled
+    /// to the video scale, and the frontend is told to scale them by 1.
+    pub fn set_video_scaler(&mut self, scaler: VideoScaler) {
+        if scaler == self.settings.emulation.video_scaler {
+            return
+        }
+
+        self.settings.emulation.video_scaler = scaler;
+        self.update_screen_filter();
+    }
+
+    /// Get the color encoding of screens passed to the frontend.
+    pub fn get_video_encoding(&self) -> VideoEncoding {
+        self.settings.emulation.video_encoding
+    }
+
+    /// Set the color encoding of screens passed to the frontend.
+    pub fn set_video_encoding(&mut self, encoding: VideoEncoding) {
+        if encoding == self.settings.emulation.video_encoding {
+            return
+        }
+
+        self.settings.emulation.video_encoding = encoding;
+        self.update_screen_filter();
+    }
+
+    fn screen_filter_settings(&self) -> ScreenFilterSettings {
+        let emulation = &self.settings.emulation;
+        let (scaler, scale) = match emulation.video_scaler {
+            VideoScaler::Frontend => (ScreenScaler::Nearest, NonZeroU8::MIN),
+            VideoScaler::Nearest => (ScreenScaler::Nearest, emulation.video_scale),
+            VideoScaler::Scale2x => (ScreenScaler::Scale2x, emulation.video_scale)
+        };
+        let encoding = match emulation.video_encoding {
+            VideoEncoding::A8R8G8B8 => ScreenDataEncoding::A8R8G8B8,
+            VideoEncoding::R5G6B5 => ScreenDataEncoding::R5G6B5
+        };
+        ScreenFilterSettings { encoding, scaler, scale }
+    }
+
+    fn update_screen_filter(&mut self) {
+        self.core.set_screen_filter(self.screen_filter_settings());
         self.update_video_mode();
+        self.force_refresh_screens();
     }
 
     /// Get the game speed settings.
@@ -690,6 +923,33 @@ impl SuperShuckieFrontend {
         self.reset_speed();
     }
 
+    /// Get whether frames are paced precisely by the frontend rather than by the emulator core.
+    pub fn get_precise_frame_pacing(&self) -> bool {
+        self.settings.emulation.precise_frame_pacing
+    }
+
+    /// Set whether frames are paced precisely by the frontend rather than by the emulator core.
+    ///
+    /// This is only supported by some cores; returns `true` if the current core supports it.
+    pub fn set_precise_frame_pacing(&mut self, enabled: bool) -> bool {
+        self.settings.emulation.precise_frame_pacing = enabled;
+        self.core.set_precise_frame_pacing(enabled) == enabled
+    }
+
+    /// Get the number of frames run ahead to hide input lag (0 = disabled).
+    pub fn get_run_ahead_frames(&self) -> u8 {
+        self.settings.emulation.run_ahead_frames
+    }
+
+    /// Set the number of frames run ahead to hide input lag (0 = disabled).
+    ///
+    /// This is clamped to [`MAX_RUN_AHEAD_FRAMES`].
+    pub fn set_run_ahead_frames(&mut self, frames: u8) {
+        let frames = frames.min(MAX_RUN_AHEAD_FRAMES);
+        self.settings.emulation.run_ahead_frames = frames;
+        self.core.set_run_ahead_frames(frames);
+    }
+
     /// Set a custom setting.
     pub fn set_custom_setting(&mut self, setting: &str, value: Option<UTF8CString>) {
         match value {
@@ -736,19 +996,54 @@ impl SuperShuckieFrontend {
         self.save_file = Some(Arc::new(save_file.into()));
     }
 
+    /// Set a callback to call (from the core thread) whenever a new frame is ready.
+    ///
+    /// The callback should just wake up whatever calls [`Self::tick`]; it must not call into the
+    /// frontend itself.
+    pub fn set_frame_ready_callback(&mut self, callback: Option<FrameReadyCallback>) {
+        self.frame_ready_callback = callback;
+        self.core.set_frame_ready_callback(self.frame_ready_callback.clone());
+    }
+
+    /// Set the refresh rate of the display the game is shown on, in Hz.
+    ///
+    /// Frames that come in faster than this can show are not rendered, which speeds up turbo.
+    pub fn set_display_refresh_rate(&mut self, refresh_rate: f64) {
+        self.display_refresh_rate = Some(refresh_rate);
+        self.core.set_display_refresh_rate(refresh_rate);
+    }
+
     /// Handle any logic that needs to be done regularly.
     pub fn tick(&mut self) {
         self.refresh_screen(false);
+        self.autosave_sram_if_needed();
+
+        while let Some(result) = self.file_writer.poll_result() {
+            self.callbacks.file_written(&result);
+        }
+
+        while let Some(result) = self.core_loader.poll_result() {
+            match result {
+                CoreLoaderResult::Rom { path, result } => {
+                    let result = result.and_then(|loaded| self.finish_loading_rom(&path, loaded));
+                    self.callbacks.rom_loaded(&path, &result);
+                },
+                CoreLoaderResult::Prewarmed { emulator_type, core } => {
+                    if !self.prewarmed_cores.iter().any(|(t, _)| *t == emulator_type) {
+                        self.prewarmed_cores.push((emulator_type, core));
+                    }
+                }
+            }
+        }
     }
 
     fn refresh_screen(&mut self, force: bool) {
-        let current_frame_count = self.core.get_elapsed_frames();
-        if force || current_frame_count == self.frame_count {
-            return
-        }
+        self.core.read_screens_with_sequence(|screens, sequence| {
+            if !force && sequence == self.screen_sequence {
+                return
+            }
 
-        self.frame_count = current_frame_count;
-        self.core.read_screens(|screens| {
+            self.screen_sequence = sequence;
             self.callbacks.refresh_screens(screens);
         })
     }
@@ -813,6 +1108,18 @@ impl SuperShuckieFrontend {
         self.settings.replay_settings.auto_decompress_replays_upfront
     }
 
+    /// If enabled, new save states are stored as diffs against a base state for the ROM, which
+    /// is made from the first save state created with this enabled.
+    #[inline]
+    pub fn set_deduplicate_save_states_setting(&mut self, new_setting: bool) {
+        self.settings.emulation.deduplicate_save_states = new_setting;
+    }
+
+    #[inline]
+    pub fn get_deduplicate_save_states_setting(&self) -> bool {
+        self.settings.emulation.deduplicate_save_states
+    }
+
     /// Get the number of milliseconds elapsed.
     #[inline]
     pub fn get_elapsed_milliseconds(&self) -> u32 {
@@ -877,7 +1184,12 @@ impl SuperShuckieFrontend {
                 minimum_uncompressed_bytes_per_blob: (self.settings.replay_settings.max_recording_blob_size_mb.get() as usize)
                     .saturating_mul(1024)
                     .saturating_mul(1024),
-                compression_level: self.settings.replay_settings.zstd_compression_level
+                compression_level: self.settings.replay_settings.zstd_compression_level,
+                memory_budget: (self.settings.replay_settings.max_recording_memory_mb as usize)
+                    .saturating_mul(1024)
+                    .saturating_mul(1024),
+                full_keyframe_interval: self.settings.replay_settings.full_keyframe_interval.get(),
+                ..ReplayFileRecorderSettings::default()
             },
 
             // TODO: patches
@@ -918,21 +1230,40 @@ impl SuperShuckieFrontend {
     }
 
     /// Get all saves for the given ROM.
-    #[inline]
     pub fn get_all_saves_for_rom(&self, rom: &str) -> Vec<UTF8CString> {
-        list_files_in_dir_with_extension(&self.get_save_data_dir_for_rom(rom), SAVE_DATA_EXTENSION)
+        let dir = self.get_save_data_dir_for_rom(rom);
+        self.with_library(rom, |l| l.refresh_saves(&dir, SAVE_DATA_EXTENSION), |l| l.saves().map(UTF8CString::from_str).collect())
     }
 
     /// Get all save states for the given ROM.
-    #[inline]
     pub fn get_all_save_states_for_rom(&self, rom: &str) -> Vec<UTF8CString> {
-        list_files_in_dir_with_extension(&self.get_save_states_dir_for_rom(rom), SAVE_STATE_EXTENSION)
+        let dir = self.get_save_states_dir_for_rom(rom);
+        self.with_library(rom, |l| l.refresh_save_states(&dir, SAVE_STATE_EXTENSION), |l| l.save_states().map(|(name, _)| UTF8CString::from_str(name)).collect())
     }
 
     /// Get all replays for the given ROM.
-    #[inline]
     pub fn get_all_replays_for_rom(&self, rom: &str) -> Vec<UTF8CString> {
-        list_files_in_dir_with_extension(&self.get_replays_dir_for_rom(rom), REPLAY_EXTENSION)
+        let dir = self.get_replays_dir_for_rom(rom);
+        self.with_library(rom, |l| l.refresh_replays(&dir, REPLAY_EXTENSION), |l| l.replays().map(|(name, _)| UTF8CString::from_str(name)).collect())
+    }
+
+    /// Get the indexed info of a replay for the given ROM.
+    ///
+    /// Returns `None` if there is no such replay or it couldn't be read.
+    pub fn get_replay_info(&self, rom: &str, name: &str) -> Option<LibraryReplay> {
+        let path = self.get_replays_dir_for_rom(rom).join(format!("{name}.{REPLAY_EXTENSION}"));
+        self.with_library(rom, |l| l.refresh_replay(name, &path), |l| l.replay(name).flatten().cloned())
+    }
+
+    /// Refresh the library index for `rom` with `refresh`, writing it back if it changed, then read from it.
+    fn with_library<T>(&self, rom: &str, refresh: impl FnOnce(&mut RomLibrary) -> bool, read: impl FnOnce(&RomLibrary) -> T) -> T {
+        let path = self.get_userdir_for_rom(rom).join(LIBRARY_FILE_NAME);
+        let mut libraries = self.libraries.borrow_mut();
+        let library = libraries.entry(rom.to_owned()).or_insert_with(|| RomLibrary::load(&path));
+        if refresh(library) {
+            library.save(&path);
+        }
+        read(library)
     }
 
     fn after_switch_core(&mut self) {
@@ -941,7 +1272,11 @@ impl SuperShuckieFrontend {
 
     fn update_video_mode(&mut self) {
         self.core.read_screens(|screens| {
-            self.callbacks.change_video_mode(screens, self.settings.emulation.video_scale);
+            let scale = match self.settings.emulation.video_scaler {
+                VideoScaler::Frontend => self.settings.emulation.video_scale,
+                _ => NonZeroU8::MIN
+            };
+            self.callbacks.change_video_mode(screens, scale);
         });
     }
 
@@ -962,6 +1297,43 @@ impl SuperShuckieFrontend {
         self.apply_turbo(0.0);
     }
 
+    /// Set whether the game is being rewound (e.g. while a rewind button is held).
+    pub fn set_rewinding(&mut self, rewinding: bool) {
+        self.core.set_rewinding(rewinding);
+    }
+
+    /// Get the rewind settings.
+    pub fn get_rewind_settings(&self, interval_frames: &mut u64, memory_mb: &mut u32) {
+        *interval_frames = self.settings.emulation.rewind_interval_frames;
+        *memory_mb = self.settings.emulation.rewind_memory_mb;
+    }
+
+    /// Set the rewind settings.
+    ///
+    /// Setting either to 0 disables rewinding.
+    pub fn set_rewind_settings(&mut self, interval_frames: u64, memory_mb: u32) {
+        self.settings.emulation.rewind_interval_frames = interval_frames;
+        self.settings.emulation.rewind_memory_mb = memory_mb;
+        self.core.set_rewind_settings(self.rewind_settings());
+    }
+
+    /// Summarize the timings collected since the ROM was loaded or [`Self::reset_perf_stats`] was called.
+    pub fn get_perf_stats(&self) -> PerfStatsSummary {
+        self.core.get_perf_stats()
+    }
+
+    /// Discard all timings collected so far.
+    pub fn reset_perf_stats(&mut self) {
+        self.core.reset_perf_stats();
+    }
+
+    fn rewind_settings(&self) -> RewindSettings {
+        RewindSettings {
+            interval_frames: self.settings.emulation.rewind_interval_frames,
+            memory_limit: (self.settings.emulation.rewind_memory_mb as usize).saturating_mul(1024 * 1024)
+        }
+    }
+
     fn apply_turbo(&mut self, turbo: f64) {
         let base_speed = self.settings.emulation.base_speed_multiplier;
         let max_speed = self.settings.emulation.turbo_speed_multiplier * base_speed;
@@ -987,7 +1359,7 @@ impl SuperShuckieFrontend {
     pub fn set_pokeabyte_enabled(&mut self, enabled: bool) -> Result<(), &UTF8CString> {
         self.settings.pokeabyte.enabled = enabled;
         self.pokeabyte_error = None;
-        match self.core.set_pokeabyte_enabled(enabled) {
+        match self.core.set_pokeabyte_enabled(enabled.then(|| self.pokeabyte_server_settings())) {
             Ok(_) => Ok(()),
             Err(e) => {
                 self.pokeabyte_error = Some(e.into());
@@ -996,6 +1368,34 @@ impl SuperShuckieFrontend {
         }
     }
 
+    /// Get the port and shared memory name used by the Poke-A-Byte integration server.
+    pub fn get_pokeabyte_settings(&self) -> (u16, &str) {
+        (self.settings.pokeabyte.port, self.settings.pokeabyte.shared_memory_name.as_str())
+    }
+
+    /// Set the port and shared memory name used by the Poke-A-Byte integration server.
+    ///
+    /// If the server is enabled, it is restarted with the new settings.
+    pub fn set_pokeabyte_settings(&mut self, port: u16, shared_memory_name: &str) -> Result<(), &UTF8CString> {
+        self.settings.pokeabyte.port = port;
+        self.settings.pokeabyte.shared_memory_name = shared_memory_name.to_owned();
+        if self.settings.pokeabyte.enabled {
+            self.set_pokeabyte_enabled(true)
+        }
+        else {
+            self.pokeabyte_error = None;
+            Ok(())
+        }
+    }
+
+    fn pokeabyte_server_settings(&self) -> PokeAByteServerSettings {
+        PokeAByteServerSettings {
+            bind_address: (std::net::Ipv4Addr::LOCALHOST, self.settings.pokeabyte.port).into(),
+            shared_memory_name: self.settings.pokeabyte.shared_memory_name.clone(),
+            ..Default::default()
+        }
+    }
+
     #[inline]
     pub fn get_gbc_mode(&self) -> GameBoyMode {
         self.settings.game_boy_settings.gbc_mode
@@ -1024,64 +1424,17 @@ impl SuperShuckieFrontend {
             _ => return
         };
 
-        let Some(rom) = self.loaded_rom_data.as_ref() else {
+        let Some(rom) = self.loaded_rom.as_ref() else {
             panic!("emulator_type is non-None but we have no loaded rom data???")
         };
 
-        let expected = self.choose_for_game_boy(rom.as_slice());
+        let expected = choose_for_game_boy(&self.settings.game_boy_settings, rom.data.as_slice());
 
         if expected != current {
             self.core_metadata.emulator_type = Some(expected);
             self.reload_rom_in_place();
         }
     }
-
-    fn choose_for_game_boy(&self, data: &[u8]) -> SuperShuckieEmulatorType {
-        let game_boy = match self.settings.game_boy_settings.sgb {
-            true => SuperShuckieEmulatorType::GameBoySGB2,
-            false => SuperShuckieEmulatorType::GameBoy
-        };
-
-        match self.settings.game_boy_settings.gbc_mode {
-            GameBoyMode::AlwaysGBC => SuperShuckieEmulatorType::GameBoyColor,
-            GameBoyMode::AlwaysGB => game_boy,
-            GameBoyMode::GBInGBMode => {
-                if data.get(0x143).copied() == Some(0x00) {
-                    game_boy
-                }
-                else {
-                    SuperShuckieEmulatorType::GameBoyColor
-                }
-            },
-        }
-    }
-}
-
-fn list_files_in_dir_with_extension(dir: &Path, extension: &str) -> Vec<UTF8CString> {
-    let Ok(n) = std::fs::read_dir(dir) else {
-        return Vec::new()
-    };
-
-    let mut options = Vec::new();
-    for item in n {
-        let Ok(item) = item else { continue };
-        let path = item.path();
-        if path.extension() != Some(extension.as_ref()) {
-            continue
-        }
-        if !path.is_file() {
-            continue
-        }
-        let Some(stem) = path.file_stem() else {
-            continue
-        };
-        let Some(stem_utf8) = stem.to_str() else {
-            continue
-        };
-        options.push(stem_utf8.into());
-    }
-
-    options
 }
 
 #[derive(Copy, Clone, Debug)]
@@ -1109,6 +1462,13 @@ pub struct ReplayFileInfo {
 pub trait SuperShuckieFrontendCallbacks {
     fn refresh_screens(&mut self, screens: &[ScreenData]);
     fn change_video_mode(&mut self, screens: &[ScreenData], screen_scaling: NonZeroU8);
+
+    /// Called from [`SuperShuckieFrontend::tick`] when a save state or SRAM has been written (or failed to be).
+    fn file_written(&mut self, result: &FileWriteResult);
+
+    /// Called from [`SuperShuckieFrontend::tick`] when a ROM passed to [`SuperShuckieFrontend::load_rom`]
+    /// has been loaded (or failed to be).
+    fn rom_loaded(&mut self, path: &Path, result: &Result<(), UTF8CString>);
 }
 
 fn _ensure_callbacks_are_object_safe(_: Box<dyn SuperShuckieFrontendCallbacks>) {}
@@ -0,0 +1,241 @@
+//! Index of each ROM's save data, save states, and replays, so listing them doesn't read every file.
+//!
+//! The index is stored as JSON in the ROM's data directory. When it is refreshed, only files whose
+//! modification time or size changed since they were indexed are read again.
+
+use crate::file_writer::write_atomically;
+use crate::save_state_file::{read_save_state_header, SaveStateThumbnail};
+use serde::{Deserialize, Serialize};
+use std::collections::BTreeMap;
+use std::fs::File;
+use std::path::Path;
+use std::time::{SystemTime, UNIX_EPOCH};
+use supershuckie_replay_recorder::replay_file::playback::ReplayFilePlayer;
+use supershuckie_replay_recorder::replay_file::{ReplayConsoleType, ReplayHeaderBlake3Hash};
+use supershuckie_replay_recorder::{TimestampMillis, UnsignedInteger};
+
+/// Name of the index file in a ROM's data directory.
+pub const LIBRARY_FILE_NAME: &str = "library.json";
+
+/// Indexes with a different version are thrown away and rebuilt.
+const LIBRARY_VERSION: u32 = 1;
+
+/// What is indexed for a save state.
+#[derive(Clone, Default, PartialEq, Debug, Serialize, Deserialize)]
+pub struct LibrarySaveState {
+    pub created_unix_millis: u64,
+    pub deduplicated: bool,
+    pub thumbnail: Option<SaveStateThumbnail>
+}
+
+/// What is indexed for a replay.
+#[derive(Clone, Default, PartialEq, Debug, Serialize, Deserialize)]
+pub struct LibraryReplay {
+    pub rom_name: String,
+    pub rom_filename: String,
+    pub rom_checksum: ReplayHeaderBlake3Hash,
+    pub emulator_core_name: String,
+    pub total_frames: UnsignedInteger,
+    pub total_milliseconds: TimestampMillis,
+
+    /// Every bookmark, in the order they appear in the replay
+    pub bookmarks: Vec<LibraryBookmark>,
+
+    console_type: u32
+}
+
+impl LibraryReplay {
+    pub fn console_type(&self) -> ReplayConsoleType {
+        ReplayConsoleType::try_from(self.console_type).unwrap_or_default()
+    }
+}
+
+#[derive(Clone, Default, PartialEq, Debug, Serialize, Deserialize)]
+pub struct LibraryBookmark {
+    pub name: String,
+    pub elapsed_frames: UnsignedInteger,
+    pub elapsed_millis: TimestampMillis
+}
+
+/// When a file was last changed, as far as the index knows.
+#[derive(Copy, Clone, Default, PartialEq, Debug, Serialize, Deserialize)]
+struct FileStamp {
+    modified_secs: u64,
+    modified_nanos: u32,
+    size: u64
+}
+
+impl FileStamp {
+    fn of(path: &Path) -> Option<Self> {
+        let metadata = std::fs::metadata(path).ok().filter(|m| m.is_file())?;
+        let modified = metadata.modified().unwrap_or(SystemTime::UNIX_EPOCH).duration_since(UNIX_EPOCH).unwrap_or_default();
+        Some(Self { modified_secs: modified.as_secs(), modified_nanos: modified.subsec_nanos(), size: metadata.len() })
+    }
+}
+
+#[derive(Clone, Debug, Serialize, Deserialize)]
+struct LibraryEntry<T> {
+    stamp: FileStamp,
+
+    /// `None` if the file couldn't be read; it is still listed so the user can try to open it
+    info: Option<T>
+}
+
+/// Index of one ROM's files.
+#[derive(Default, Serialize, Deserialize)]
+pub(crate) struct RomLibrary {
+    #[serde(default)]
+    version: u32,
+
+    #[serde(default)]
+    saves: BTreeMap<String, LibraryEntry<()>>,
+
+    #[serde(default)]
+    save_states: BTreeMap<String, LibraryEntry<LibrarySaveState>>,
+
+    #[serde(default)]
+    replays: BTreeMap<String, LibraryEntry<LibraryReplay>>
+}
+
+impl RomLibrary {
+    /// Load the index at `path`, or start a new one if it is missing or unreadable.
+    pub fn load(path: &Path) -> Self {
+        std::fs::read(path).ok()
+            .and_then(|data| serde_json::from_slice::<RomLibrary>(&data).ok())
+            .filter(|library| library.version == LIBRARY_VERSION)
+            .unwrap_or_else(|| Self { version: LIBRARY_VERSION, ..Self::default() })
+    }
+
+    /// Write the index to `path`.
+    ///
+    /// This is only a cache, so failing to write it is not an error.
+    pub fn save(&self, path: &Path) {
+        let Some(dir) = path.parent() else { return };
+        if dir.is_dir() {
+            let _ = write_atomically(path, serde_json::to_string(self).expect("failed to serialize").as_bytes());
+        }
+    }
+
+    pub fn saves(&self) -> impl Iterator<Item = &str> {
+        self.saves.keys().map(String::as_str)
+    }
+
+    pub fn save_states(&self) -> impl Iterator<Item = (&str, Option<&LibrarySaveState>)> {
+        self.save_states.iter().map(|(name, entry)| (name.as_str(), entry.info.as_ref()))
+    }
+
+    pub fn replays(&self) -> impl Iterator<Item = (&str, Option<&LibraryReplay>)> {
+        self.replays.iter().map(|(name, entry)| (name.as_str(), entry.info.as_ref()))
+    }
+
+    /// Get a save state's entry; the outer `Option` is `None` if it isn't indexed.
+    pub fn save_state(&self, name: &str) -> Option<Option<&LibrarySaveState>> {
+        self.save_states.get(name).map(|entry| entry.info.as_ref())
+    }
+
+    /// Get a replay's entry; the outer `Option` is `None` if it isn't indexed.
+    pub fn replay(&self, name: &str) -> Option<Option<&LibraryReplay>> {
+        self.replays.get(name).map(|entry| entry.info.as_ref())
+    }
+
+    /// Refresh the saves in `dir`, returning `true` if anything changed.
+    pub fn refresh_saves(&mut self, dir: &Path, extension: &str) -> bool {
+        refresh_dir(&mut self.saves, dir, extension, |_| Some(()))
+    }
+
+    /// Refresh the save states in `dir`, returning `true` if anything changed.
+    pub fn refresh_save_states(&mut self, dir: &Path, extension: &str) -> bool {
+        refresh_dir(&mut self.save_states, dir, extension, read_save_state)
+    }
+
+    /// Refresh the replays in `dir`, returning `true` if anything changed.
+    pub fn refresh_replays(&mut self, dir: &Path, extension: &str) -> bool {
+        refresh_dir(&mut self.replays, dir, extension, read_replay)
+    }
+
+    /// Refresh just the save state at `path`, returning `true` if anything changed.
+    pub fn refresh_save_state(&mut self, name: &str, path: &Path) -> bool {
+        refresh_file(&mut self.save_states, name, path, read_save_state)
+    }
+
+    /// Refresh just the replay at `path`, returning `true` if anything changed.
+    pub fn refresh_replay(&mut self, name: &str, path: &Path) -> bool {
+        refresh_file(&mut self.replays, name, path, read_replay)
+    }
+}
+
+fn refresh_dir<T>(entries: &mut BTreeMap<String, LibraryEntry<T>>, dir: &Path, extension: &str, read: impl Fn(&Path) -> Option<T>) -> bool {
+    let mut seen = Vec::new();
+    let mut changed = false;
+
+    for item in std::fs::read_dir(dir).into_iter().flatten() {
+        let Ok(item) = item else { continue };
+        let path = item.path();
+        if path.extension() != Some(extension.as_ref()) {
+            continue
+        }
+        let Some(name) = path.file_stem().and_then(|s| s.to_str()) else {
+            continue
+        };
+        let name = name.to_owned();
+        changed |= refresh_file(entries, &name, &path, &read);
+        seen.push(name);
+    }
+
+    seen.sort_unstable();
+    let before = entries.len();
+    entries.retain(|name, _| seen.binary_search(name).is_ok());
+    changed | (entries.len() != before)
+}
+
+fn refresh_file<T>(entries: &mut BTreeMap<String, LibraryEntry<T>>, name: &str, path: &Path, read: impl Fn(&Path) -> Option<T>) -> bool {
+    let Some(stamp) = FileStamp::of(path) else {
+        return entries.remove(name).is_some()
+    };
+    if entries.get(name).is_some_and(|entry| entry.stamp == stamp) {
+        return false
+    }
+
+    entries.insert(name.to_owned(), LibraryEntry { stamp, info: read(path) });
+    true
+}
+
+fn read_save_state(path: &Path) -> Option<LibrarySaveState> {
+    let mut file = File::open(path).ok()?;
+
+    // Raw save states from older versions have no header, but they are still save states
+    let Some(header) = read_save_state_header(&mut file).ok()? else {
+        return Some(LibrarySaveState::default())
+    };
+
+    Some(LibrarySaveState {
+        created_unix_millis: header.created_unix_millis,
+        deduplicated: header.base_hash.is_some(),
+        thumbnail: header.thumbnail
+    })
+}
+
+/// Only the header and the seek index are read, unless the replay has no seek index.
+fn read_replay(path: &Path) -> Option<LibraryReplay> {
+    let file = File::open(path).ok()?;
+    let player = ReplayFilePlayer::new_lazy(file, true).ok()?;
+    let metadata = player.get_replay_metadata();
+
+    let mut bookmarks: Vec<LibraryBookmark> = player.all_bookmarks()
+        .values()
+        .flatten()
+        .map(|b| LibraryBookmark { name: b.name.clone(), elapsed_frames: b.elapsed_frames, elapsed_millis: b.elapsed_millis })
+        .collect();
+    bookmarks.sort_by_key(|b| b.elapsed_frames);
+
+    Some(LibraryReplay {
+        rom_name: metadata.rom_name.clone(),
+        rom_filename: metadata.rom_filename.clone(),
+        rom_checksum: metadata.rom_checksum,
+        emulator_core_name: metadata.emulator_core_name.clone(),
+        total_frames: player.get_total_frames(),
+        total_milliseconds: player.get_total_milliseconds(),
+        bookmarks,
+        console_type: metadata.console_type.into()
+    })
+}
@@ -0,0 +1,342 @@
+//! Container for save states on disk.
+//!
+//! All integers are little endian:
+//!
+//! | Offset | Type       | Description                                                             |
+//! |--------|------------|-------------------------------------------------------------------------|
+//! | 0      | `[u8; 8]`  | [`MAGIC`]                                                               |
+//! | 8      | `u16`      | Version ([`VERSION`])                                                   |
+//! | 10     | `u16`      | Flags ([`FLAG_DIFF`])                                                   |
+//! | 12     | `u32`      | Header size (offset of the payload)                                     |
+//! | 16     | `u64`      | Creation time, in milliseconds since the Unix epoch                      |
+//! | 24     | `u32`      | Size of the save state                                                  |
+//! | 28     | `u32`      | Uncompressed size of the payload                                        |
+//! | 32     | `[u8; 32]` | blake3 hash of the base state if [`FLAG_DIFF`] is set, otherwise zeroes |
+//! | 64     | `u16`      | Thumbnail width (0 if there is no thumbnail)                            |
+//! | 66     | `u16`      | Thumbnail height                                                        |
+//! | 68     | `[u16]`    | Thumbnail pixels, 0bRRRRRGGGGGGBBBBB, row by row                        |
+//!
+//! The payload is the zstd-compressed save state or, if [`FLAG_DIFF`] is set, its diff against
+//! the base state (see [`diff_state`]).
+//!
+//! Files without the magic are raw save states, as written by older versions.
+
+use crate::file_writer::write_atomically;
+use crate::util::UTF8CString;
+use serde::{Deserialize, Serialize};
+use std::io::Read;
+use std::path::Path;
+use supershuckie_core::emulator::{ScreenData, ScreenDataEncoding};
+use supershuckie_replay_recorder::replay_file::delta::{apply_diff, diff_state};
+use supershuckie_replay_recorder::replay_file::ReplayHeaderBlake3Hash;
+use supershuckie_replay_recorder::{blake3_hash, compress_data, decompress_data};
+
+pub const MAGIC: [u8; 8] = *b"SSHKSTAT";
+pub const VERSION: u16 = 1;
+
+/// The payload is a diff against a base state rather than the whole state.
+pub const FLAG_DIFF: u16 = 1 << 0;
+
+const FIXED_HEADER_SIZE: usize = 68;
+
+/// Thumbnails are at most this wide.
+pub const THUMBNAIL_MAX_WIDTH: usize = 80;
+
+/// Save states on disk are compressed at this level.
+pub const COMPRESSION_LEVEL: i32 = 9;
+
+/// Small preview of the screen when a save state was made.
+#[derive(Clone, Default, PartialEq, Debug, Serialize, Deserialize)]
+pub struct SaveStateThumbnail {
+    pub width: u16,
+    pub height: u16,
+
+    /// 0bRRRRRGGGGGGBBBBB
+    pub pixels: Vec<u16>
+}
+
+impl SaveStateThumbnail {
+    /// Downscale `screen` to at most [`THUMBNAIL_MAX_WIDTH`] wide.
+    pub fn from_screen(screen: &ScreenData) -> Self {
+        if screen.width == 0 || screen.height == 0 {
+            return Self::default()
+        }
+
+        let width = screen.width.min(THUMBNAIL_MAX_WIDTH);
+        let height = (screen.height * width / screen.width).max(1);
+
+        let mut pixels = Vec::with_capacity(width * height);
+        for y in 0..height {
+            let row = y * screen.height / height * screen.width;
+            for x in 0..width {
+                let index = row + x * screen.width / width;
+                let pixel = match screen.encoding {
+                    ScreenDataEncoding::A8R8G8B8 => {
+                        let argb = screen.pixels[index];
+                        (((argb >> 8) & 0xF800) | ((argb >> 5) & 0x07E0) | ((argb >> 3) & 0x001F)) as u16
+                    }
+                    ScreenDataEncoding::R5G6B5 => (screen.pixels[index / 2] >> ((index % 2) * 16)) as u16
+                };
+                pixels.push(pixel);
+            }
+        }
+
+        Self { width: width as u16, height: height as u16, pixels }
+    }
+}
+
+/// Everything in a save state file besides the save state itself.
+#[derive(Clone, Default, PartialEq, Debug)]
+pub struct SaveStateHeader {
+    pub created_unix_millis: u64,
+    pub state_size: usize,
+    pub base_hash: Option<ReplayHeaderBlake3Hash>,
+    pub thumbnail: Option<SaveStateThumbnail>,
+
+    payload_size: usize,
+    header_size: usize
+}
+
+/// Base state to diff save states against.
+pub struct SaveStateBase<'a> {
+    pub state: &'a [u8],
+    pub hash: ReplayHeaderBlake3Hash
+}
+
+/// Encode a save state into a save state file.
+pub fn encode_save_state(
+    state: &[u8],
+    base: Option<SaveStateBase>,
+    thumbnail: Option<&SaveStateThumbnail>,
+    created_unix_millis: u64
+) -> Result<Vec<u8>, UTF8CString> {
+    let too_big = || UTF8CString::from_str("Save state is too big");
+    let state_size = u32::try_from(state.len()).map_err(|_| too_big())?;
+
+    let diff;
+    let (flags, base_hash, payload) = match base {
+        Some(base) => {
+            diff = diff_state(base.state, state);
+            (FLAG_DIFF, base.hash, diff.as_slice())
+        },
+        None => (0, ReplayHeaderBlake3Hash::default(), state)
+    };
+    let payload_size = u32::try_from(payload.len()).map_err(|_| too_big())?;
+    let compressed = compress_data(payload, COMPRESSION_LEVEL).map_err(|e| format!("Failed to compress save state: {e}"))?;
+
+    let (thumbnail_width, thumbnail_height, thumbnail_pixels) = match thumbnail {
+        Some(t) if t.pixels.len() == t.width as usize * t.height as usize => (t.width, t.height, t.pixels.as_slice()),
+        _ => (0, 0, [].as_slice())
+    };
+    let header_size = FIXED_HEADER_SIZE + thumbnail_pixels.len() * 2;
+
+    let mut file = Vec::with_capacity(header_size + compressed.len());
+    file.extend_from_slice(&MAGIC);
+    file.extend_from_slice(&VERSION.to_le_bytes());
+    file.extend_from_slice(&flags.to_le_bytes());
+    file.extend_from_slice(&(header_size as u32).to_le_bytes());
+    file.extend_from_slice(&created_unix_millis.to_le_bytes());
+    file.extend_from_slice(&state_size.to_le_bytes());
+    file.extend_from_slice(&payload_size.to_le_bytes());
+    file.extend_from_slice(&base_hash);
+    file.extend_from_slice(&thumbnail_width.to_le_bytes());
+    file.extend_from_slice(&thumbnail_height.to_le_bytes());
+    for pixel in thumbnail_pixels {
+        file.extend_from_slice(&pixel.to_le_bytes());
+    }
+    debug_assert_eq!(file.len(), header_size);
+
+    file.extend_from_slice(compressed.as_slice());
+    Ok(file)
+}
+
+/// Read just the header of a save state file.
+///
+/// Returns `Ok(None)` if this is a raw save state without a header.
+pub fn read_save_state_header<R: Read>(reader: &mut R) -> Result<Option<SaveStateHeader>, UTF8CString> {
+    let truncated = |_| UTF8CString::from_str("Save state file is truncated");
+
+    let mut fixed = [0u8; FIXED_HEADER_SIZE];
+    let mut read = 0;
+    while read < fixed.len() {
+        match reader.read(&mut fixed[read..]) {
+            Ok(0) => break,
+            Ok(n) => read += n,
+            Err(e) if e.kind() == std::io::ErrorKind::Interrupted => continue,
+            Err(e) => return Err(format!("Failed to read save state: {e}").into())
+        }
+    }
+    if read < MAGIC.len() || fixed[..MAGIC.len()] != MAGIC {
+        return Ok(None)
+    }
+    if read < fixed.len() {
+        return Err(truncated(()))
+    }
+
+    let u16_at = |offset: usize| u16::from_le_bytes([fixed[offset], fixed[offset + 1]]);
+    let u32_at = |offset: usize| u32::from_le_bytes(fixed[offset..offset + 4].try_into().expect("4 bytes"));
+
+    let version = u16_at(8);
+    if version != VERSION {
+        return Err(format!("Unsupported save state version {version}").into())
+    }
+
+    let flags = u16_at(10);
+    let header_size = u32_at(12) as usize;
+    let created_unix_millis = u64::from_le_bytes(fixed[16..24].try_into().expect("8 bytes"));
+    let state_size = u32_at(24) as usize;
+    let payload_size = u32_at(28) as usize;
+    let base_hash: ReplayHeaderBlake3Hash = fixed[32..64].try_into().expect("32 bytes");
+    let thumbnail_width = u16_at(64);
+    let thumbnail_height = u16_at(66);
+
+    let thumbnail_size = thumbnail_width as usize * thumbnail_height as usize * 2;
+    if header_size < FIXED_HEADER_SIZE + thumbnail_size {
+        return Err("Save state header is corrupted".into())
+    }
+
+    // Skip anything a newer writer put after the thumbnail, too
+    let mut rest = vec![0u8; header_size - FIXED_HEADER_SIZE];
+    reader.read_exact(&mut rest).map_err(|_| truncated(()))?;
+
+    let thumbnail = (thumbnail_size > 0).then(|| SaveStateThumbnail {
+        width: thumbnail_width,
+        height: thumbnail_height,
+        pixels: rest[..thumbnail_size].chunks_exact(2).map(|p| u16::from_le_bytes([p[0], p[1]])).collect()
+    });
+
+    Ok(Some(SaveStateHeader {
+        created_unix_millis,
+        state_size,
+        base_hash: (flags & FLAG_DIFF != 0).then_some(base_hash),
+        thumbnail,
+        payload_size,
+        header_size
+    }))
+}
+
+/// Decode a save state file into a save state.
+///
+/// `get_base` is called with the base state's hash if the save state was diffed against one.
+pub fn decode_save_state<F: FnOnce(&ReplayHeaderBlake3Hash) -> Option<Vec<u8>>>(file: Vec<u8>, get_base: F) -> Result<Vec<u8>, UTF8CString> {
+    let Some(header) = read_save_state_header(&mut file.as_slice())? else {
+        return Ok(file)
+    };
+
+    let payload = decompress_data(&file[header.header_size..], header.payload_size)
+        .map_err(|e| format!("Failed to decompress save state: {e}"))?;
+
+    let state = match header.base_hash {
+        None => payload,
+        Some(hash) => {
+            let base = get_base(&hash).ok_or_else(|| UTF8CString::from_str("The base state this save state was deduplicated against is missing"))?;
+            if blake3_hash(base.as_slice()) != hash {
+                return Err("The base state this save state was deduplicated against has changed".into())
+            }
+            apply_diff(base.as_slice(), payload.as_slice()).map_err(|e| format!("Failed to apply save state diff: {e}"))?
+        }
+    };
+
+    if state.len() != header.state_size {
+        return Err("Save state is corrupted".into())
+    }
+
+    Ok(state)
+}
+
+/// Name of the file in a ROM's save states directory that deduplicated save states are diffed against.
+///
+/// This is the first save state made with deduplication enabled, stored raw. It is never
+/// overwritten, since every deduplicated save state depends on it.
+pub const BASE_STATE_FILE_NAME: &str = ".base_state";
+
+/// Get the base state at `path`, making `state` the base state if there isn't one yet.
+pub(crate) fn load_or_create_base_state(path: &Path, state: &[u8]) -> Result<Vec<u8>, UTF8CString> {
+    match std::fs::read(path) {
+        Ok(base) => Ok(base),
+        Err(e) if e.kind() == std::io::ErrorKind::NotFound => {
+            write_atomically(path, state).map_err(|e| format!("Can't write the base save state: {e}"))?;
+            Ok(state.to_vec())
+        },
+        Err(e) => Err(format!("Can't read the base save state: {e}").into())
+    }
+}
+
+/// Save state compressed in memory, for the undo history.
+pub(crate) struct CompressedSaveState {
+    data: Vec<u8>,
+    size: usize
+}
+
+impl CompressedSaveState {
+    /// Compressing for undo history should not be noticeably slower than copying.
+    const COMPRESSION_LEVEL: i32 = 1;
+
+    pub fn new(state: &[u8]) -> Self {
+        let data = compress_data(state, Self::COMPRESSION_LEVEL).expect("failed to compress a save state in memory");
+        Self { data, size: state.len() }
+    }
+
+    pub fn decompress(&self) -> Vec<u8> {
+        decompress_data(&self.data, self.size).expect("failed to decompress a save state in memory")
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn state(seed: u8) -> Vec<u8> {
+        (0..3000u32).map(|i| (i as u8).wrapping_mul(seed)).collect()
+    }
+
+    #[test]
+    fn round_trip_without_base() {
+        let state = state(3);
+        let thumbnail = SaveStateThumbnail { width: 2, height: 1, pixels: vec![0xF800, 0x001F] };
+        let file = encode_save_state(&state, None, Some(&thumbnail), 1234).unwrap();
+
+        let header = read_save_state_header(&mut file.as_slice()).unwrap().unwrap();
+        assert_eq!(header.created_unix_millis, 1234);
+        assert_eq!(header.state_size, state.len());
+        assert_eq!(header.base_hash, None);
+        assert_eq!(header.thumbnail, Some(thumbnail));
+
+        let decoded = decode_save_state(file, |_| panic!("no base needed")).unwrap();
+        assert_eq!(decoded, state);
+    }
+
+    #[test]
+    fn round_trip_with_base() {
+        let base = state(3);
+        let mut state = base.clone();
+        state[100] ^= 0xFF;
+        state.extend_from_slice(&[1, 2, 3]);
+
+        let hash = blake3_hash(&base);
+        let file = encode_save_state(&state, Some(SaveStateBase { state: &base, hash }), None, 0).unwrap();
+
+        let header = read_save_state_header(&mut file.as_slice()).unwrap().unwrap();
+        assert_eq!(header.base_hash, Some(hash));
+        assert_eq!(header.thumbnail, None);
+
+        let decoded = decode_save_state(file.clone(), |h| (*h == hash).then(|| base.clone())).unwrap();
+        assert_eq!(decoded, state);
+
+        assert!(decode_save_state(file, |_| None).is_err());
+    }
+
+    #[test]
+    fn raw_save_states_pass_through() {
+        let state = state(5);
+        assert_eq!(read_save_state_header(&mut state.as_slice()), Ok(None));
+        assert_eq!(decode_save_state(state.clone(), |_| None), Ok(state));
+    }
+
+    #[test]
+    fn truncated_files_are_rejected() {
+        let file = encode_save_state(&state(7), None, None, 0).unwrap();
+        assert!(read_save_state_header(&mut &file[..FIXED_HEADER_SIZE - 1]).is_err());
+        assert!(decode_save_state(file[..file.len() - 4].to_vec(), |_| None).is_err());
+    }
+}
@@ -9,7 +9,9 @@ use std::path::Path;
 use num_enum::TryFromPrimitive;
 use serde::{Deserialize, Serialize};
 use supershuckie_core::emulator::Input;
+use supershuckie_core::{ReplaySnapshotSettings, RewindSettings, DEFAULT_POKEABYTE_PORT, DEFAULT_POKEABYTE_SHARED_MEMORY_NAME};
 use supershuckie_replay_recorder::replay_file::record::ReplayFileRecorderSettings;
+use supershuckie_replay_recorder::replay_file::playback::ReplayFilePlayerCacheSettings;
 use crate::SETTINGS_FILE;
 use crate::util::UTF8CString;
 
@@ -96,6 +98,34 @@ pub struct ReplaySettings {
 
     #[serde(default = "ReplaySettings::AUTO_PAUSE_ON_RECORD")]
     pub auto_pause_on_record: bool,
+
+    /// 0 = unlimited
+    #[serde(default = "ReplaySettings::MAX_RECORDING_MEMORY_MB")]
+    pub max_recording_memory_mb: u32,
+
+    /// Every nth keyframe is stored in full; the rest are diffs against the previous keyframe
+    #[serde(default = "ReplaySettings::DEFAULT_FULL_KEYFRAME_INTERVAL")]
+    pub full_keyframe_interval: NonZeroU64,
+
+    /// Blobs to decompress ahead of the current one during playback
+    #[serde(default = "ReplaySettings::DEFAULT_PLAYBACK_READ_AHEAD_BLOBS")]
+    pub playback_read_ahead_blobs: u32,
+
+    /// Blobs to keep decompressed behind the current one during playback
+    #[serde(default = "ReplaySettings::DEFAULT_PLAYBACK_READ_BEHIND_BLOBS")]
+    pub playback_read_behind_blobs: u32,
+
+    /// Decompressed blobs outside the read-ahead/read-behind window are kept up to this much
+    #[serde(default = "ReplaySettings::DEFAULT_PLAYBACK_CACHE_MEMORY_MB")]
+    pub playback_cache_memory_mb: u32,
+
+    /// Save states are taken this often during playback to speed up seeking; 0 = disabled
+    #[serde(default = "ReplaySettings::DEFAULT_SEEK_SNAPSHOT_INTERVAL_FRAMES")]
+    pub seek_snapshot_interval_frames: u64,
+
+    /// 0 = disabled
+    #[serde(default = "ReplaySettings::DEFAULT_SEEK_SNAPSHOT_MEMORY_MB")]
+    pub seek_snapshot_memory_mb: u32,
 }
 
 impl Default for ReplaySettings {
@@ -108,6 +138,13 @@ impl Default for ReplaySettings {
             auto_stop_playback_on_input: Self::AUTO_STOP_PLAYBACK_ON_INPUT(),
             auto_unpause_on_input: Self::AUTO_UNPAUSE_ON_INPUT(),
             auto_pause_on_record: Self::AUTO_PAUSE_ON_RECORD(),
+            max_recording_memory_mb: Self::MAX_RECORDING_MEMORY_MB(),
+            full_keyframe_interval: Self::DEFAULT_FULL_KEYFRAME_INTERVAL(),
+            playback_read_ahead_blobs: Self::DEFAULT_PLAYBACK_READ_AHEAD_BLOBS(),
+            playback_read_behind_blobs: Self::DEFAULT_PLAYBACK_READ_BEHIND_BLOBS(),
+            playback_cache_memory_mb: Self::DEFAULT_PLAYBACK_CACHE_MEMORY_MB(),
+            seek_snapshot_interval_frames: Self::DEFAULT_SEEK_SNAPSHOT_INTERVAL_FRAMES(),
+            seek_snapshot_memory_mb: Self::DEFAULT_SEEK_SNAPSHOT_MEMORY_MB(),
         }
     }
 }
@@ -122,6 +159,13 @@ impl ReplaySettings {
     const AUTO_STOP_PLAYBACK_ON_INPUT: fn() -> bool = || false;
     const AUTO_UNPAUSE_ON_INPUT: fn() -> bool = || false;
     const AUTO_PAUSE_ON_RECORD: fn() -> bool = || false;
+    const MAX_RECORDING_MEMORY_MB: fn() -> u32 = || 64;
+    const DEFAULT_FULL_KEYFRAME_INTERVAL: fn() -> NonZeroU64 = || unsafe { NonZeroU64::new_unchecked(10) };
+    const DEFAULT_PLAYBACK_READ_AHEAD_BLOBS: fn() -> u32 = || ReplayFilePlayerCacheSettings::default().read_ahead_blobs as u32;
+    const DEFAULT_PLAYBACK_READ_BEHIND_BLOBS: fn() -> u32 = || ReplayFilePlayerCacheSettings::default().read_behind_blobs as u32;
+    const DEFAULT_PLAYBACK_CACHE_MEMORY_MB: fn() -> u32 = || (ReplayFilePlayerCacheSettings::default().memory_budget / 1024 / 1024) as u32;
+    const DEFAULT_SEEK_SNAPSHOT_INTERVAL_FRAMES: fn() -> u64 = || ReplaySnapshotSettings::default().interval_frames;
+    const DEFAULT_SEEK_SNAPSHOT_MEMORY_MB: fn() -> u32 = || (ReplaySnapshotSettings::default().memory_limit / 1024 / 1024) as u32;
 }
 
 #[derive(Clone, PartialEq, Serialize, Deserialize)]
@@ -137,10 +181,33 @@ impl Default for ROMConfig {
     }
 }
 
-#[derive(Clone, PartialEq, Default, Serialize, Deserialize)]
+#[derive(Clone, PartialEq, Serialize, Deserialize)]
 pub struct PokeAByteSettings {
     #[serde(default = "bool::default")]
-    pub enabled: bool
+    pub enabled: bool,
+
+    /// UDP port on localhost to listen on
+    #[serde(default = "PokeAByteSettings::DEFAULT_PORT")]
+    pub port: u16,
+
+    /// Give each running instance its own name (and port) to use Poke-A-Byte with several at once
+    #[serde(default = "PokeAByteSettings::DEFAULT_SHARED_MEMORY_NAME")]
+    pub shared_memory_name: String
+}
+
+impl PokeAByteSettings {
+    const DEFAULT_PORT: fn() -> u16 = || DEFAULT_POKEABYTE_PORT;
+    const DEFAULT_SHARED_MEMORY_NAME: fn() -> String = || DEFAULT_POKEABYTE_SHARED_MEMORY_NAME.to_owned();
+}
+
+impl Default for PokeAByteSettings {
+    fn default() -> Self {
+        Self {
+            enabled: false,
+            port: Self::DEFAULT_PORT(),
+            shared_memory_name: Self::DEFAULT_SHARED_MEMORY_NAME()
+        }
+    }
 }
 
 #[derive(Clone, PartialEq, Serialize, Deserialize)]
@@ -154,8 +221,37 @@ pub struct EmulationSettings {
     #[serde(default = "EmulationSettings::DEFAULT_VIDEO_SCALE")]
     pub video_scale: NonZeroU8,
 
+    #[serde(default = "VideoScaler::default")]
+    pub video_scaler: VideoScaler,
+
+    #[serde(default = "VideoEncoding::default")]
+    pub video_encoding: VideoEncoding,
+
     #[serde(default = "EmulationSettings::DEFAULT_MAX_SAVE_STATE_HISTORY")]
-    pub max_save_state_history: NonZeroUsize
+    pub max_save_state_history: NonZeroUsize,
+
+    /// Store save states as diffs against a base state shared by every save state of the ROM
+    #[serde(default = "bool::default")]
+    pub deduplicate_save_states: bool,
+
+    #[serde(default = "bool::default")]
+    pub precise_frame_pacing: bool,
+
+    /// Frames to run ahead to hide input lag; 0 = disabled
+    #[serde(default = "u8::default")]
+    pub run_ahead_frames: u8,
+
+    /// 0 = disabled
+    #[serde(default = "u32::default")]
+    pub sram_autosave_interval_seconds: u32,
+
+    /// Save states are taken this often for rewinding; 0 = disabled
+    #[serde(default = "EmulationSettings::DEFAULT_REWIND_INTERVAL_FRAMES")]
+    pub rewind_interval_frames: u64,
+
+    /// 0 = disabled
+    #[serde(default = "EmulationSettings::DEFAULT_REWIND_MEMORY_MB")]
+    pub rewind_memory_mb: u32
 }
 
 impl EmulationSettings {
@@ -163,6 +259,8 @@ impl EmulationSettings {
     const DEFAULT_TURBO_SPEED_MULTIPLIER: fn() -> f64 = || 2.0;
     const DEFAULT_VIDEO_SCALE: fn() -> NonZeroU8 = || unsafe { NonZeroU8::new_unchecked(4) };
     const DEFAULT_MAX_SAVE_STATE_HISTORY: fn() -> NonZeroUsize = || unsafe { NonZeroUsize::new_unchecked(100) };
+    const DEFAULT_REWIND_INTERVAL_FRAMES: fn() -> u64 = || RewindSettings::default().interval_frames;
+    const DEFAULT_REWIND_MEMORY_MB: fn() -> u32 = || (RewindSettings::default().memory_limit / 1024 / 1024) as u32;
 }
 
 impl Default for EmulationSettings {
@@ -171,11 +269,49 @@ impl Default for EmulationSettings {
             base_speed_multiplier: EmulationSettings::DEFAULT_BASE_SPEED_MULTIPLIER(),
             turbo_speed_multiplier: EmulationSettings::DEFAULT_TURBO_SPEED_MULTIPLIER(),
             video_scale: EmulationSettings::DEFAULT_VIDEO_SCALE(),
-            max_save_state_history: EmulationSettings::DEFAULT_MAX_SAVE_STATE_HISTORY()
+            video_scaler: VideoScaler::default(),
+            video_encoding: VideoEncoding::default(),
+            max_save_state_history: EmulationSettings::DEFAULT_MAX_SAVE_STATE_HISTORY(),
+            deduplicate_save_states: false,
+            precise_frame_pacing: false,
+            run_ahead_frames: 0,
+            sram_autosave_interval_seconds: 0,
+            rewind_interval_frames: EmulationSettings::DEFAULT_REWIND_INTERVAL_FRAMES(),
+            rewind_memory_mb: EmulationSettings::DEFAULT_REWIND_MEMORY_MB()
         }
     }
 }
 
+#[derive(Copy, Clone, PartialEq, Debug, Serialize, Deserialize, Default, TryFromPrimitive)]
+#[repr(u32)]
+pub enum VideoScaler {
+    /// Leave scaling to the frontend
+    #[serde(rename = "frontend")]
+    #[default]
+    Frontend = 0,
+
+    /// Scale on the core thread by repeating pixels
+    #[serde(rename = "nearest")]
+    Nearest = 1,
+
+    /// Scale on the core thread with Scale2x
+    #[serde(rename = "scale2x")]
+    Scale2x = 2
+}
+
+#[derive(Copy, Clone, PartialEq, Debug, Serialize, Deserialize, Default, TryFromPrimitive)]
+#[repr(u32)]
+pub enum VideoEncoding {
+    /// 32-bit color
+    #[serde(rename = "A8R8G8B8")]
+    #[default]
+    A8R8G8B8 = 0,
+
+    /// 16-bit color, which halves the size of each frame
+    #[serde(rename = "R5G6B5")]
+    R5G6B5 = 1
+}
+
 #[derive(Clone, Default, PartialEq, Serialize, Deserialize)]
 pub struct GameBoySettings {
     #[serde(default = "GameBoyMode::default")]
@@ -313,7 +449,8 @@ pub enum Control {
 
     Turbo,
     Reset,
-    Pause
+    Pause,
+    Rewind
 }
 impl Control {
     pub const fn is_button(self) -> bool {
@@ -332,7 +469,8 @@ impl Control {
             Control::Y => true,
             Control::Turbo => false,
             Control::Reset => false,
-            Control::Pause => false
+            Control::Pause => false,
+            Control::Rewind => false
         }
     }
 
@@ -364,6 +502,7 @@ impl Control {
             Control::Turbo => {}
             Control::Reset => {}
             Control::Pause => {}
+            Control::Rewind => {}
         }
     }
 
@@ -384,6 +523,7 @@ impl Control {
             Control::Turbo => {}
             Control::Reset => {}
             Control::Pause => {}
+            Control::Rewind => {}
         }
     }
 
@@ -413,7 +553,8 @@ impl Control {
             Control::Y => c"Y",
             Control::Turbo => c"Turbo",
             Control::Reset => c"Reset console",
-            Control::Pause => c"Pause"
+            Control::Pause => c"Pause",
+            Control::Rewind => c"Rewind (hold)"
         }
     }
 }
@@ -0,0 +1,73 @@
+//! Writing screens out as images.
+
+use std::fs::File;
+use std::io::{BufWriter, Write};
+use std::path::PathBuf;
+use supershuckie_core::emulator::{ScreenData, ScreenDataEncoding};
+use supershuckie_replay_recorder::UnsignedInteger;
+
+/// Writes every `interval`th frame into a directory as binary PPM images.
+pub struct FrameDumper {
+    dir: PathBuf,
+    interval: UnsignedInteger,
+    rgb_scratch: Vec<u8>,
+    frames_dumped: u64
+}
+
+impl FrameDumper {
+    pub fn new(dir: PathBuf, interval: UnsignedInteger) -> Result<Self, String> {
+        std::fs::create_dir_all(&dir).map_err(|e| format!("Failed to create {}: {e}", dir.display()))?;
+        Ok(Self { dir, interval: interval.max(1), rgb_scratch: Vec::new(), frames_dumped: 0 })
+    }
+
+    pub fn frames_dumped(&self) -> u64 {
+        self.frames_dumped
+    }
+
+    /// Return `true` if `frame` falls on the interval.
+    pub fn wants(&self, frame: UnsignedInteger) -> bool {
+        frame % self.interval == 0
+    }
+
+    /// Dump `screens` if `frame` falls on the interval.
+    pub fn dump_if_needed(&mut self, frame: UnsignedInteger, screens: &[ScreenData]) -> Result<(), String> {
+        if !self.wants(frame) {
+            return Ok(())
+        }
+
+        for (index, screen) in screens.iter().enumerate() {
+            let name = if screens.len() == 1 { format!("{frame:08}.ppm") } else { format!("{frame:08}-{index}.ppm") };
+            let path = self.dir.join(name);
+            self.write_ppm(screen, &path).map_err(|e| format!("Failed to write {}: {e}", path.display()))?;
+        }
+
+        self.frames_dumped += 1;
+        Ok(())
+    }
+
+    fn write_ppm(&mut self, screen: &ScreenData, path: &PathBuf) -> std::io::Result<()> {
+        self.rgb_scratch.clear();
+        self.rgb_scratch.reserve(screen.width * screen.height * 3);
+
+        match screen.encoding {
+            ScreenDataEncoding::A8R8G8B8 => {
+                for pixel in &screen.pixels {
+                    let [_, r, g, b] = pixel.to_be_bytes();
+                    self.rgb_scratch.extend_from_slice(&[r, g, b]);
+                }
+            }
+            ScreenDataEncoding::R5G6B5 => {
+                let pixels = screen.pixels.iter().flat_map(|p| [*p as u16, (*p >> 16) as u16]);
+                for pixel in pixels.take(screen.width * screen.height) {
+                    let expand = |value: u16, bits: u32| ((value as u32 * 255) / ((1 << bits) - 1)) as u8;
+                    self.rgb_scratch.extend_from_slice(&[expand(pixel >> 11, 5), expand((pixel >> 5) & 0x3F, 6), expand(pixel & 0x1F, 5)]);
+                }
+            }
+        }
+
+        let mut file = BufWriter::new(File::create(path)?);
+        write!(file, "P6\n{} {}\n255\n", screen.width, screen.height)?;
+        file.write_all(self.rgb_scratch.as_slice())?;
+        file.flush()
+    }
+}
@@ -0,0 +1,366 @@
+//! Exporting replays to video by playing back segments of them in parallel.
+//!
+//! Every keyframe holds a full save state, so the replay is split at keyframes into segments that
+//! are played back independently, each on whichever worker is free. Frames are then written out in
+//! order. Every emulated frame is exported, so the video plays at 1x no matter what speed the
+//! replay was recorded at.
+
+use crate::playback::{describe_attach_error, emulator_for_replay};
+use crate::roms::RomLibrary;
+use std::fs::File;
+use std::io::{BufReader, Write};
+use std::path::Path;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc::{sync_channel, Receiver, SyncSender};
+use std::sync::{Condvar, Mutex};
+use std::time::{Duration, Instant};
+use supershuckie_core::emulator::{EmulatorCore, ScreenData, ScreenDataEncoding};
+use supershuckie_core::{std_timestamp_provider, ReplaySnapshotSettings, SuperShuckieCore};
+use supershuckie_replay_recorder::replay_file::playback::ReplayFilePlayer;
+use supershuckie_replay_recorder::UnsignedInteger;
+
+/// Keyframes are merged into segments of at least this many frames, so seeking is a small part of
+/// the work.
+const TARGET_SEGMENT_FRAMES: UnsignedInteger = 300;
+
+/// Frames buffered per segment before its worker waits for them to be written.
+const MAX_BUFFERED_FRAMES_PER_SEGMENT: usize = 600;
+
+#[derive(Copy, Clone, PartialEq, Debug)]
+pub enum ExportFormat {
+    /// YUV4MPEG2 with full range BT.601 4:2:0 samples, flagged with `XCOLORRANGE=FULL` so encoders
+    /// don't treat them as limited range
+    Y4m,
+
+    /// Raw 24-bit RGB frames with no header
+    Rgb
+}
+
+impl ExportFormat {
+    pub fn extension(self) -> &'static str {
+        match self {
+            ExportFormat::Y4m => "y4m",
+            ExportFormat::Rgb => "rgb"
+        }
+    }
+}
+
+pub struct ExportOptions {
+    pub format: ExportFormat,
+
+    /// Export replays even if they are corrupted or mismatched.
+    pub override_errors: bool,
+
+    /// Segments to play back at once.
+    pub jobs: usize
+}
+
+pub struct ExportReport {
+    /// Frames actually written.
+    pub frames: UnsignedInteger,
+
+    /// Frames the replay says it has.
+    pub total_frames: UnsignedInteger,
+
+    pub segments: usize,
+    pub width: usize,
+    pub height: usize,
+
+    /// Frames per second at 1x speed, as written to the Y4M header.
+    pub frame_rate: (u64, u64),
+
+    pub elapsed: Duration
+}
+
+impl ExportReport {
+    /// Return `true` if the replay stopped before its last frame (e.g. it is truncated).
+    pub fn ended_early(&self) -> bool {
+        self.frames < self.total_frames
+    }
+}
+
+/// Frames `(start, end]` of the replay, where `start` is a keyframe.
+#[derive(Copy, Clone, Debug)]
+struct Segment {
+    start: UnsignedInteger,
+    end: UnsignedInteger
+}
+
+struct Frame {
+    number: UnsignedInteger,
+    width: usize,
+    height: usize,
+    data: Vec<u8>
+}
+
+type SegmentMessage = Result<Frame, String>;
+
+/// Number of segments written so far, which workers wait on so they don't get too far ahead.
+struct Progress {
+    written: Mutex<usize>,
+    changed: Condvar
+}
+
+impl Progress {
+    fn set(&self, written: usize) {
+        *self.written.lock().expect("export progress poisoned") = written;
+        self.changed.notify_all();
+    }
+
+    /// Block until fewer than `window` segments before `segment` are left to write.
+    fn wait_for(&self, segment: usize, window: usize) {
+        let mut written = self.written.lock().expect("export progress poisoned");
+        while segment >= written.saturating_add(window) {
+            written = self.changed.wait(written).expect("export progress poisoned");
+        }
+    }
+}
+
+/// Export the replay at `path` to `sink`.
+pub fn export(path: &Path, roms: &RomLibrary, options: &ExportOptions, sink: &mut dyn Write) -> Result<ExportReport, String> {
+    let open = || -> Result<ReplayFilePlayer, String> {
+        let file = File::open(path).map_err(|e| format!("Failed to open: {e}"))?;
+        ReplayFilePlayer::new_lazy(BufReader::new(file), options.override_errors).map_err(|e| format!("Failed to parse: {e:?}"))
+    };
+
+    let player = open()?;
+    let total_frames = player.get_total_frames();
+    let segments = plan_segments(player.all_keyframes().keys().copied(), total_frames);
+    let jobs = options.jobs.clamp(1, segments.len().max(1));
+
+    // Each worker keeps its own core and player across segments, so seeking is all it has to redo.
+    let mut player = Some(player);
+    let mut workers = Vec::with_capacity(jobs);
+    for _ in 0..jobs {
+        let player = match player.take() {
+            Some(player) => player,
+            None => open()?
+        };
+        let emulator = emulator_for_replay(player.get_replay_metadata(), roms, options.override_errors)?;
+        workers.push((emulator, player));
+    }
+
+    let frame_rate = match workers[0].0.frame_rate() {
+        Some(rate) => ((rate * 1_000_000.0).round() as u64, 1_000_000),
+        None => (60, 1)
+    };
+
+    let (senders, receivers): (Vec<_>, Vec<_>) = segments.iter()
+        .map(|s| sync_channel::<SegmentMessage>(((s.end - s.start) as usize).min(MAX_BUFFERED_FRAMES_PER_SEGMENT)))
+        .unzip();
+    let senders: Vec<Mutex<Option<SyncSender<SegmentMessage>>>> = senders.into_iter().map(|s| Mutex::new(Some(s))).collect();
+
+    let next_segment = AtomicUsize::new(0);
+    let progress = Progress { written: Mutex::new(0), changed: Condvar::new() };
+    let start = Instant::now();
+
+    let written = std::thread::scope(|scope| {
+        for (emulator, player) in workers {
+            let (segments, senders, next_segment, progress) = (&segments, &senders, &next_segment, &progress);
+            let (format, override_errors) = (options.format, options.override_errors);
+            scope.spawn(move || {
+                let mut core = SuperShuckieCore::new(Box::new(emulator), std_timestamp_provider());
+                core.set_replay_snapshot_settings(ReplaySnapshotSettings { interval_frames: 0, memory_limit: 0 });
+
+                let attached = core.attach_replay_player(player, override_errors).map_err(describe_attach_error);
+
+                loop {
+                    let index = next_segment.fetch_add(1, Ordering::Relaxed);
+                    let Some(segment) = segments.get(index) else {
+                        break
+                    };
+                    progress.wait_for(index, jobs);
+
+                    let sender = senders[index].lock().expect("export senders poisoned").take().expect("segment taken twice");
+                    let result = match attached.as_ref() {
+                        Ok(()) => play_segment(&mut core, *segment, format, &sender),
+                        Err(e) => sender.send(Err(e.clone())).map_err(|_| ())
+                    };
+
+                    // The writer stopped, so nothing else will be written either.
+                    if result.is_err() {
+                        break
+                    }
+                }
+            });
+        }
+
+        let written = write_frames(receivers, &progress, sink, options.format, frame_rate);
+
+        // Make sure no worker is left waiting for its turn.
+        progress.set(usize::MAX);
+        written
+    })?;
+
+    Ok(ExportReport {
+        frames: written.frames,
+        total_frames,
+        segments: segments.len(),
+        width: written.width,
+        height: written.height,
+        frame_rate,
+        elapsed: start.elapsed()
+    })
+}
+
+/// Merge the spans between keyframes into segments of at least [`TARGET_SEGMENT_FRAMES`].
+fn plan_segments<I: Iterator<Item = UnsignedInteger>>(keyframes: I, total_frames: UnsignedInteger) -> Vec<Segment> {
+    let mut segments = Vec::new();
+    let mut start = 0;
+
+    for keyframe in keyframes.take_while(|k| *k < total_frames) {
+        if keyframe >= start + TARGET_SEGMENT_FRAMES {
+            segments.push(Segment { start, end: keyframe });
+            start = keyframe;
+        }
+    }
+    if total_frames > start {
+        segments.push(Segment { start, end: total_frames });
+    }
+
+    segments
+}
+
+/// Play back `segment`, sending each frame to `sender`.
+///
+/// Returns `Err` if the receiver is gone.
+fn play_segment(core: &mut SuperShuckieCore, segment: Segment, format: ExportFormat, sender: &SyncSender<SegmentMessage>) -> Result<(), ()> {
+    // This loads the keyframe at `start` and plays, rendering, up to the segment's first frame.
+    core.go_to_replay_frame(segment.start + 1);
+
+    let mut frame = core.get_elapsed_frames();
+    if frame != segment.start + 1 {
+        return sender.send(Err(format!("Failed to seek to frame {}", segment.start + 1))).map_err(|_| ())
+    }
+
+    loop {
+        let Some(screen) = core.get_core().get_screens().first() else {
+            return sender.send(Err("The emulator has no screen".to_owned())).map_err(|_| ())
+        };
+        let mut data = Vec::new();
+        encode_frame(format, screen, &mut data);
+        sender.send(Ok(Frame { number: frame, width: screen.width, height: screen.height, data })).map_err(|_| ())?;
+
+        if frame >= segment.end {
+            return Ok(())
+        }
+
+        loop {
+            if core.is_replay_finished() {
+                return Ok(())
+            }
+            core.run_unlocked();
+            if core.get_elapsed_frames() != frame {
+                break
+            }
+        }
+        frame = core.get_elapsed_frames();
+    }
+}
+
+struct Written {
+    frames: UnsignedInteger,
+    width: usize,
+    height: usize
+}
+
+/// Write each segment's frames in order, stopping early if a segment is missing frames.
+fn write_frames(receivers: Vec<Receiver<SegmentMessage>>, progress: &Progress, sink: &mut dyn Write, format: ExportFormat, frame_rate: (u64, u64)) -> Result<Written, String> {
+    let write_error = |e: std::io::Error| format!("Failed to write video: {e}");
+    let mut written = Written { frames: 0, width: 0, height: 0 };
+
+    'segments: for (index, receiver) in receivers.into_iter().enumerate() {
+        for message in receiver {
+            let frame = message?;
+
+            // A segment that ended early means the replay did too.
+            if frame.number != written.frames + 1 {
+                break 'segments
+            }
+
+            if written.frames == 0 {
+                written.width = frame.width;
+                written.height = frame.height;
+                if format == ExportFormat::Y4m {
+                    let (numerator, denominator) = frame_rate;
+                    write!(sink, "YUV4MPEG2 W{} H{} F{numerator}:{denominator} Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", frame.width, frame.height).map_err(write_error)?;
+                }
+            }
+            else if (frame.width, frame.height) != (written.width, written.height) {
+                return Err(format!("Screen size changed from {}x{} to {}x{} at frame {}", written.width, written.height, frame.width, frame.height, frame.number))
+            }
+
+            if format == ExportFormat::Y4m {
+                sink.write_all(b"FRAME\n").map_err(write_error)?;
+            }
+            sink.write_all(frame.data.as_slice()).map_err(write_error)?;
+            written.frames = frame.number;
+        }
+
+        progress.set(index + 1);
+    }
+
+    sink.flush().map_err(write_error)?;
+    Ok(written)
+}
+
+fn encode_frame(format: ExportFormat, screen: &ScreenData, into: &mut Vec<u8>) {
+    let (width, height) = (screen.width, screen.height);
+    let rgb = |x: usize, y: usize| -> [i32; 3] {
+        let index = y * width + x;
+        match screen.encoding {
+            ScreenDataEncoding::A8R8G8B8 => {
+                let [_, r, g, b] = screen.pixels[index].to_be_bytes();
+                [r as i32, g as i32, b as i32]
+            }
+            ScreenDataEncoding::R5G6B5 => {
+                let pixel = (screen.pixels[index / 2] >> ((index % 2) * 16)) as u16 as i32;
+                [(pixel >> 11) * 255 / 31, ((pixel >> 5) & 0x3F) * 255 / 63, (pixel & 0x1F) * 255 / 31]
+            }
+        }
+    };
+
+    match format {
+        ExportFormat::Rgb => {
+            into.reserve(width * height * 3);
+            for y in 0..height {
+                for x in 0..width {
+                    into.extend(rgb(x, y).map(|c| c as u8));
+                }
+            }
+        }
+
+        // BT.601 full range, with each chroma sample averaged over (up to) 2x2 pixels
+        ExportFormat::Y4m => {
+            let (chroma_width, chroma_height) = (width.div_ceil(2), height.div_ceil(2));
+            into.reserve(width * height + chroma_width * chroma_height * 2);
+
+            for y in 0..height {
+                for x in 0..width {
+                    let [r, g, b] = rgb(x, y);
+                    into.push(((77 * r + 150 * g + 29 * b + 128) >> 8) as u8);
+                }
+            }
+
+            let mut cb = Vec::with_capacity(chroma_width * chroma_height);
+            let mut cr = Vec::with_capacity(chroma_width * chroma_height);
+            for cy in 0..chroma_height {
+                for cx in 0..chroma_width {
+                    let (mut sum, mut count) = ([0i32; 3], 0);
+                    for y in (cy * 2)..(cy * 2 + 2).min(height) {
+                        for x in (cx * 2)..(cx * 2 + 2).min(width) {
+                            let pixel = rgb(x, y);
+                            sum = [sum[0] + pixel[0], sum[1] + pixel[1], sum[2] + pixel[2]];
+                            count += 1;
+                        }
+                    }
+                    let [r, g, b] = sum.map(|c| c / count);
+                    cb.push((((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128).clamp(0, 255) as u8);
+                    cr.push((((128 * r - 107 * g - 21 * b + 128) >> 8) + 128).clamp(0, 255) as u8);
+                }
+            }
+            into.extend_from_slice(&cb);
+            into.extend_from_slice(&cr);
+        }
+    }
+}
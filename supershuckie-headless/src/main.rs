@@ -0,0 +1,333 @@
+//! Plays back replays without a frontend, as fast as possible, to check that they still play back
+//! correctly or to export them to video.
+
+mod dump;
+mod export;
+mod playback;
+mod roms;
+
+use crate::export::{export, ExportFormat, ExportOptions, ExportReport};
+use crate::playback::{play_back, PlaybackOptions, PlaybackReport};
+use crate::roms::RomLibrary;
+use std::fs::File;
+use std::io::BufWriter;
+use std::num::NonZeroUsize;
+use std::path::{Path, PathBuf};
+use std::process::ExitCode;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc::channel;
+use std::time::Instant;
+use supershuckie_replay_recorder::replay_file::blake3_hash_to_ascii;
+
+const REPLAY_EXTENSION: &str = "replay";
+
+const USAGE: &str = "\
+Usage: supershuckie-headless [options] --rom <path> <replay or directory>...
+
+Plays back each replay to the end as fast as possible, reporting its speed and whether it desynced.
+Directories are searched recursively for .replay files.
+
+With --export, each replay is instead exported to video, one at a time, with its segments (split at
+keyframes) played back in parallel. Pipe Y4M to an encoder with, for example:
+
+  supershuckie-headless --rom <path> --export - <replay> | ffmpeg -i - out.mp4
+
+Options:
+  --rom <path>            ROM file, or directory of ROMs, to match replays against (repeatable)
+  -j, --jobs <count>      Replays (or segments, when exporting) to play back at once (default: number of CPUs)
+  --export <dir>          Export each replay to <dir>/<replay name>.<format>, or to stdout if <dir> is -
+  --export-format <fmt>   y4m (default) or rgb (raw 24-bit RGB frames)
+  --dump-frames <dir>     Write frames as PPM images into <dir>/<replay name>/
+  --dump-interval <n>     Only dump every nth frame (default: 1)
+  --no-verify             Don't compare the emulator state against the replay's keyframes
+  --override-errors       Play back replays even if corrupted or recorded with a different ROM/BIOS/core
+  -h, --help              Show this message";
+
+struct Arguments {
+    roms: Vec<PathBuf>,
+    replays: Vec<PathBuf>,
+    jobs: usize,
+    options: PlaybackOptions,
+    export: Option<PathBuf>,
+    export_format: ExportFormat
+}
+
+fn main() -> ExitCode {
+    let arguments = match parse_arguments(std::env::args().skip(1)) {
+        Ok(Some(n)) => n,
+        Ok(None) => {
+            println!("{USAGE}");
+            return ExitCode::SUCCESS
+        },
+        Err(e) => {
+            eprintln!("{e}\n\n{USAGE}");
+            return ExitCode::FAILURE
+        }
+    };
+
+    let mut roms = RomLibrary::default();
+    for path in &arguments.roms {
+        if let Err(e) = roms.add(path) {
+            eprintln!("{e}");
+            return ExitCode::FAILURE
+        }
+    }
+
+    let mut replays = Vec::new();
+    for path in &arguments.replays {
+        if let Err(e) = find_replays(path, &mut replays) {
+            eprintln!("{e}");
+            return ExitCode::FAILURE
+        }
+    }
+
+    if replays.is_empty() {
+        eprintln!("No replays found");
+        return ExitCode::FAILURE
+    }
+
+    if let Some(export_to) = arguments.export.as_ref() {
+        return export_all(&replays, &roms, export_to, &arguments)
+    }
+
+    eprintln!("Playing back {} replay(s) with {} ROM(s) on {} job(s)...", replays.len(), roms.len(), arguments.jobs);
+
+    let start = Instant::now();
+    let next_replay = AtomicUsize::new(0);
+    let (sender, receiver) = channel::<(usize, Result<PlaybackReport, String>)>();
+
+    let mut passed = 0usize;
+    let mut desynced = 0usize;
+    let mut failed = 0usize;
+    let mut total_frames = 0u64;
+
+    std::thread::scope(|scope| {
+        for _ in 0..arguments.jobs.min(replays.len()) {
+            let sender = sender.clone();
+            let (replays, roms, options, next_replay) = (&replays, &roms, &arguments.options, &next_replay);
+            scope.spawn(move || {
+                loop {
+                    let index = next_replay.fetch_add(1, Ordering::Relaxed);
+                    let Some(path) = replays.get(index) else {
+                        break
+                    };
+                    if sender.send((index, play_back(path, roms, options))).is_err() {
+                        break
+                    }
+                }
+            });
+        }
+        drop(sender);
+
+        for (index, result) in receiver {
+            let path = replays[index].display();
+            match result {
+                Ok(report) => {
+                    total_frames += report.frames;
+                    let status = if report.desynced() {
+                        desynced += 1;
+                        "DESYNC"
+                    }
+                    else if report.ended_early() {
+                        failed += 1;
+                        "SHORT"
+                    }
+                    else {
+                        passed += 1;
+                        "OK"
+                    };
+                    println!("{status:<7}{path}  {}", describe_report(&report));
+                },
+                Err(e) => {
+                    failed += 1;
+                    println!("{:<7}{path}  {}", "ERROR", e.replace('\n', " "));
+                }
+            }
+        }
+    });
+
+    let elapsed = start.elapsed().as_secs_f64();
+    eprintln!(
+        "{} replay(s) in {elapsed:.2} s ({:.0} frames/s overall): {passed} ok, {desynced} desynced, {failed} failed",
+        replays.len(),
+        total_frames as f64 / elapsed.max(f64::EPSILON)
+    );
+
+    if desynced == 0 && failed == 0 { ExitCode::SUCCESS } else { ExitCode::FAILURE }
+}
+
+fn export_all(replays: &[PathBuf], roms: &RomLibrary, export_to: &Path, arguments: &Arguments) -> ExitCode {
+    let to_stdout = export_to.as_os_str() == "-";
+    if to_stdout && replays.len() > 1 {
+        eprintln!("Only one replay can be exported to stdout");
+        return ExitCode::FAILURE
+    }
+    if !to_stdout && let Err(e) = std::fs::create_dir_all(export_to) {
+        eprintln!("Failed to create {}: {e}", export_to.display());
+        return ExitCode::FAILURE
+    }
+
+    let options = ExportOptions {
+        format: arguments.export_format,
+        override_errors: arguments.options.override_errors,
+        jobs: arguments.jobs
+    };
+
+    eprintln!("Exporting {} replay(s) with {} ROM(s) on {} job(s)...", replays.len(), roms.len(), arguments.jobs);
+
+    let mut failed = 0usize;
+    for path in replays {
+        let result = if to_stdout {
+            // stdout is line buffered, which would split up the frames
+            export(path, roms, &options, &mut BufWriter::new(std::io::stdout().lock()))
+        }
+        else {
+            let name = path.file_stem().unwrap_or(path.as_os_str()).to_string_lossy();
+            let output = export_to.join(format!("{name}.{}", options.format.extension()));
+            File::create(&output)
+                .map_err(|e| format!("Failed to create {}: {e}", output.display()))
+                .and_then(|file| export(path, roms, &options, &mut BufWriter::new(file)))
+        };
+
+        // stdout may be the video, so report on stderr
+        let path = path.display();
+        match result {
+            Ok(report) => {
+                let status = if report.ended_early() {
+                    failed += 1;
+                    "SHORT"
+                }
+                else {
+                    "OK"
+                };
+                eprintln!("{status:<7}{path}  {}", describe_export_report(&report));
+            },
+            Err(e) => {
+                failed += 1;
+                eprintln!("{:<7}{path}  {}", "ERROR", e.replace('\n', " "));
+            }
+        }
+    }
+
+    if failed == 0 { ExitCode::SUCCESS } else { ExitCode::FAILURE }
+}
+
+fn describe_export_report(report: &ExportReport) -> String {
+    let seconds = report.elapsed.as_secs_f64().max(f64::EPSILON);
+    let (numerator, denominator) = report.frame_rate;
+    format!(
+        "frames={}/{} segments={} size={}x{} rate={numerator}/{denominator} time={seconds:.2}s fps={:.0}",
+        report.frames,
+        report.total_frames,
+        report.segments,
+        report.width,
+        report.height,
+        report.frames as f64 / seconds
+    )
+}
+
+fn describe_report(report: &PlaybackReport) -> String {
+    let seconds = report.elapsed.as_secs_f64().max(f64::EPSILON);
+    let fps = report.frames as f64 / seconds;
+
+    let mut description = format!("frames={}/{} time={seconds:.2}s fps={fps:.0}", report.frames, report.total_frames);
+    if let Some(frame_rate) = report.frame_rate {
+        description += &format!(" speed={:.1}x", fps / frame_rate);
+    }
+
+    match report.verification {
+        Some(v) => {
+            description += &format!(" keyframes={}/{}", v.keyframes_checked - v.keyframes_mismatched, v.keyframes_checked);
+            if let Some(frame) = v.first_mismatched_frame {
+                description += &format!(" first_desync={frame}");
+            }
+        },
+        None => description += " keyframes=unchecked"
+    }
+
+    if report.frames_dumped > 0 {
+        description += &format!(" dumped={}", report.frames_dumped);
+    }
+
+    description += &format!(" state={} ram={}", blake3_hash_to_ascii(report.state_hash), blake3_hash_to_ascii(report.ram_hash));
+    description
+}
+
+/// Returns `Ok(None)` if help was requested.
+fn parse_arguments<I: Iterator<Item = String>>(mut args: I) -> Result<Option<Arguments>, String> {
+    let mut arguments = Arguments {
+        roms: Vec::new(),
+        replays: Vec::new(),
+        jobs: std::thread::available_parallelism().map(NonZeroUsize::get).unwrap_or(1),
+        options: PlaybackOptions {
+            override_errors: false,
+            verify_keyframes: true,
+            dump_frames: None,
+            dump_interval: 1
+        },
+        export: None,
+        export_format: ExportFormat::Y4m
+    };
+
+    fn value<I: Iterator<Item = String>>(args: &mut I, option: &str) -> Result<String, String> {
+        args.next().ok_or_else(|| format!("{option} requires a value"))
+    }
+
+    fn number<T: std::str::FromStr, I: Iterator<Item = String>>(args: &mut I, option: &str) -> Result<T, String> {
+        let value = value(args, option)?;
+        value.parse().map_err(|_| format!("{option} requires a number, got {value}"))
+    }
+
+    while let Some(arg) = args.next() {
+        match arg.as_str() {
+            "-h" | "--help" => return Ok(None),
+            "--rom" => arguments.roms.push(value(&mut args, &arg)?.into()),
+            "-j" | "--jobs" => arguments.jobs = number::<NonZeroUsize, _>(&mut args, &arg)?.get(),
+            "--dump-frames" => arguments.options.dump_frames = Some(value(&mut args, &arg)?.into()),
+            "--dump-interval" => arguments.options.dump_interval = number::<u64, _>(&mut args, &arg)?.max(1),
+            "--export" => arguments.export = Some(value(&mut args, &arg)?.into()),
+            "--export-format" => arguments.export_format = match value(&mut args, &arg)?.as_str() {
+                "y4m" => ExportFormat::Y4m,
+                "rgb" => ExportFormat::Rgb,
+                other => return Err(format!("Unknown export format {other}"))
+            },
+            "--no-verify" => arguments.options.verify_keyframes = false,
+            "--override-errors" => arguments.options.override_errors = true,
+            unknown if unknown.starts_with('-') => return Err(format!("Unknown option {unknown}")),
+            _ => arguments.replays.push(arg.into())
+        }
+    }
+
+    if arguments.roms.is_empty() {
+        return Err("No ROMs given (use --rom)".to_owned())
+    }
+
+    if arguments.replays.is_empty() {
+        return Err("No replays given".to_owned())
+    }
+
+    Ok(Some(arguments))
+}
+
+fn find_replays(path: &Path, replays: &mut Vec<PathBuf>) -> Result<(), String> {
+    if !path.is_dir() {
+        replays.push(path.to_owned());
+        return Ok(())
+    }
+
+    let mut entries = std::fs::read_dir(path)
+        .and_then(|entries| entries.map(|e| e.map(|e| e.path())).collect::<Result<Vec<_>, _>>())
+        .map_err(|e| format!("Failed to read {}: {e}", path.display()))?;
+    entries.sort();
+
+    for entry in entries {
+        if entry.is_dir() {
+            find_replays(&entry, replays)?;
+        }
+        else if entry.extension().and_then(|e| e.to_str()) == Some(REPLAY_EXTENSION) {
+            replays.push(entry);
+        }
+    }
+
+    Ok(())
+}
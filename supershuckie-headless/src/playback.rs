@@ -0,0 +1,165 @@
+//! Playing back a single replay as fast as possible.
+
+use crate::dump::FrameDumper;
+use crate::roms::RomLibrary;
+use std::fs::File;
+use std::io::BufReader;
+use std::path::{Path, PathBuf};
+use std::time::{Duration, Instant};
+use supershuckie_core::emulator::{EmulatorCore, GameBoyColor, Model};
+use supershuckie_core::{std_timestamp_provider, ReplayPlayerAttachError, ReplaySnapshotSettings, ReplayVerification, SuperShuckieCore};
+use supershuckie_replay_recorder::replay_file::playback::ReplayFilePlayer;
+use supershuckie_replay_recorder::replay_file::{blake3_hash_to_ascii, ReplayConsoleType, ReplayFileMetadata, ReplayHeaderBlake3Hash};
+use supershuckie_replay_recorder::{blake3_hash, UnsignedInteger};
+
+/// Memory hashed for desync detection, as `(address, length)` in [`EmulatorCore::read_ram`] terms.
+const GAME_BOY_RAM: &[(u32, usize)] = &[
+    (0xC000, 0x2000),  // WRAM bank #0
+    (0x10000, 0x2000), // WRAM bank #1
+    (0xFF80, 0x7F)     // HRAM
+];
+
+pub struct PlaybackOptions {
+    /// Play back replays even if they are corrupted or mismatched.
+    pub override_errors: bool,
+
+    /// Compare the emulator state against every keyframe.
+    pub verify_keyframes: bool,
+
+    /// Dump frames into a subdirectory (named after the replay) of this directory.
+    pub dump_frames: Option<PathBuf>,
+    pub dump_interval: UnsignedInteger
+}
+
+pub struct PlaybackReport {
+    /// Frames actually played back.
+    pub frames: UnsignedInteger,
+
+    /// Frames the replay says it has.
+    pub total_frames: UnsignedInteger,
+
+    pub elapsed: Duration,
+
+    /// Frames per second at 1x speed, if the core knows it.
+    pub frame_rate: Option<f64>,
+
+    pub verification: Option<ReplayVerification>,
+    pub state_hash: ReplayHeaderBlake3Hash,
+    pub ram_hash: ReplayHeaderBlake3Hash,
+    pub frames_dumped: u64
+}
+
+impl PlaybackReport {
+    /// Return `true` if the replay did not play back the same way it was recorded.
+    pub fn desynced(&self) -> bool {
+        self.verification.is_some_and(|v| v.keyframes_mismatched > 0)
+    }
+
+    /// Return `true` if the replay stopped before its last frame (e.g. it is truncated).
+    pub fn ended_early(&self) -> bool {
+        self.frames < self.total_frames
+    }
+}
+
+/// Play back the replay at `path` to the end.
+pub fn play_back(path: &Path, roms: &RomLibrary, options: &PlaybackOptions) -> Result<PlaybackReport, String> {
+    let file = File::open(path).map_err(|e| format!("Failed to open: {e}"))?;
+
+    // Blobs are decompressed on the worker's own thread; every other core is already busy.
+    let player = ReplayFilePlayer::new_lazy(BufReader::new(file), options.override_errors)
+        .map_err(|e| format!("Failed to parse: {e:?}"))?;
+
+    let emulator = emulator_for_replay(player.get_replay_metadata(), roms, options.override_errors)?;
+    let frame_rate = emulator.frame_rate();
+    let total_frames = player.get_total_frames();
+
+    let mut core = SuperShuckieCore::new(Box::new(emulator), std_timestamp_provider());
+
+    // Nothing seeks, so snapshots would only slow playback down.
+    core.set_replay_snapshot_settings(ReplaySnapshotSettings { interval_frames: 0, memory_limit: 0 });
+    core.set_replay_verification(options.verify_keyframes);
+
+    let mut dumper = match options.dump_frames.as_ref() {
+        Some(dir) => {
+            let name = path.file_stem().unwrap_or(path.as_os_str());
+            Some(FrameDumper::new(dir.join(name), options.dump_interval)?)
+        },
+        None => None
+    };
+
+    let start = Instant::now();
+    core.attach_replay_player(player, options.override_errors).map_err(describe_attach_error)?;
+
+    let mut last_frame = core.get_elapsed_frames();
+    while !core.is_replay_finished() {
+        // Only render frames that get dumped; this only takes effect at the start of a frame.
+        core.set_frame_rendering(dumper.as_ref().is_some_and(|d| d.wants(last_frame + 1)));
+        core.run_unlocked();
+
+        let frame = core.get_elapsed_frames();
+        if frame == last_frame {
+            continue
+        }
+        last_frame = frame;
+
+        if let Some(dumper) = dumper.as_mut() {
+            dumper.dump_if_needed(frame, core.get_core().get_screens())?;
+        }
+    }
+    let elapsed = start.elapsed();
+
+    Ok(PlaybackReport {
+        frames: core.get_elapsed_frames(),
+        total_frames,
+        elapsed,
+        frame_rate,
+        verification: core.get_replay_verification(),
+        state_hash: blake3_hash(core.create_save_state().as_slice()),
+        ram_hash: hash_ram(core.get_core()),
+        frames_dumped: dumper.map(|d| d.frames_dumped()).unwrap_or(0)
+    })
+}
+
+/// Make an emulator for the console and ROM a replay was recorded with.
+pub fn emulator_for_replay(metadata: &ReplayFileMetadata, roms: &RomLibrary, override_errors: bool) -> Result<GameBoyColor, String> {
+    let (model, bios): (Model, &[u8]) = match metadata.console_type {
+        ReplayConsoleType::GameBoy => (Model::DmgB, include_bytes!("../../bootrom/dmg/dmg.bin")),
+        ReplayConsoleType::SuperGameBoy2 => (Model::Sgb2, include_bytes!("../../bootrom/dmg/dmg.bin")),
+        ReplayConsoleType::GameBoyColor => (Model::Cgb0, include_bytes!("../../bootrom/cgb/cgb_boot/cgb_boot_fast.bin")),
+        unsupported => return Err(format!("Unsupported console type {}", unsupported.name()))
+    };
+
+    let rom = roms.get(&metadata.rom_checksum)
+        .or_else(|| if override_errors { roms.get_by_filename(&metadata.rom_filename) } else { None })
+        .ok_or_else(|| format!("No ROM found for {} ({})", metadata.rom_filename, blake3_hash_to_ascii(metadata.rom_checksum)))?;
+
+    Ok(GameBoyColor::new_from_rom(rom, bios, model))
+}
+
+fn hash_ram(core: &dyn EmulatorCore) -> ReplayHeaderBlake3Hash {
+    let mut ram = Vec::new();
+    for &(address, length) in GAME_BOY_RAM {
+        let start = ram.len();
+        ram.resize(start + length, 0);
+
+        // Not every model has every region.
+        if core.read_ram(address, &mut ram[start..]).is_err() {
+            ram.truncate(start);
+        }
+    }
+    blake3_hash(ram.as_slice())
+}
+
+pub fn describe_attach_error(error: ReplayPlayerAttachError) -> String {
+    match error {
+        ReplayPlayerAttachError::Incompatible { description } => format!("Incompatible replay: {description}"),
+        ReplayPlayerAttachError::MismatchedMetadata { issues } => {
+            let mut err = String::from("Mismatched replay (use --override-errors to play it anyway):");
+            for issue in issues {
+                err += "\n\n";
+                err += &issue.to_string();
+            }
+            err
+        }
+    }
+}
@@ -0,0 +1,63 @@
+//! ROMs that replays can be matched against.
+
+use std::collections::BTreeMap;
+use std::path::Path;
+use supershuckie_replay_recorder::blake3_hash;
+use supershuckie_replay_recorder::replay_file::ReplayHeaderBlake3Hash;
+
+const ROM_EXTENSIONS: &[&str] = &["gb", "gbc"];
+
+struct Rom {
+    filename: String,
+    data: Vec<u8>
+}
+
+/// ROMs keyed by their blake3 hash, which is what replays record.
+#[derive(Default)]
+pub struct RomLibrary {
+    roms: BTreeMap<ReplayHeaderBlake3Hash, Rom>
+}
+
+impl RomLibrary {
+    /// Add the ROM at `path`, or every ROM directly inside it if it is a directory.
+    pub fn add(&mut self, path: &Path) -> Result<(), String> {
+        if !path.is_dir() {
+            return self.add_file(path)
+        }
+
+        let entries = std::fs::read_dir(path).map_err(|e| format!("Failed to read {}: {e}", path.display()))?;
+        for entry in entries {
+            let path = entry.map_err(|e| format!("Failed to read {}: {e}", path.display()))?.path();
+            let is_rom = path.extension()
+                .and_then(|e| e.to_str())
+                .is_some_and(|e| ROM_EXTENSIONS.contains(&e.to_lowercase().as_str()));
+
+            if is_rom && path.is_file() {
+                self.add_file(&path)?;
+            }
+        }
+
+        Ok(())
+    }
+
+    fn add_file(&mut self, path: &Path) -> Result<(), String> {
+        let data = std::fs::read(path).map_err(|e| format!("Failed to read ROM {}: {e}", path.display()))?;
+        let filename = path.file_name().and_then(|f| f.to_str()).unwrap_or_default().to_owned();
+        self.roms.insert(blake3_hash(data.as_slice()), Rom { filename, data });
+        Ok(())
+    }
+
+    pub fn len(&self) -> usize {
+        self.roms.len()
+    }
+
+    /// Get the ROM with the given blake3 hash.
+    pub fn get(&self, checksum: &ReplayHeaderBlake3Hash) -> Option<&[u8]> {
+        self.roms.get(checksum).map(|r| r.data.as_slice())
+    }
+
+    /// Get a ROM with the given filename, for when the checksum doesn't match anything.
+    pub fn get_by_filename(&self, filename: &str) -> Option<&[u8]> {
+        self.roms.values().find(|r| r.filename == filename).map(|r| r.data.as_slice())
+    }
+}
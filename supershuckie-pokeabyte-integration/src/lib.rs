@@ -1,17 +1,36 @@
 use std::borrow::Cow;
-use std::net::UdpSocket;
+use std::net::{IpAddr, Ipv4Addr, Ipv6Addr, SocketAddr, UdpSocket};
 use std::sync::{Arc, Mutex, MutexGuard, Weak};
 use std::sync::mpsc::{channel, Receiver, Sender};
-use std::time::Duration;
+use std::time::{Duration, Instant};
 use tinyvec::{ArrayVec, TinyVec};
 use crate::protocol::{Instruction, MetadataHeader, PokeAByteProtocolRequestPacket, PokeAByteProtocolRequestReadBlock, MAX_NUMBER_OF_READ_BLOCKS};
-use crate::shared_memory::PokeAByteSharedMemory;
+use crate::shared_memory::{validate_shared_memory_name, PokeAByteSharedMemory};
+use crate::write_queue::{write_queue, WriteQueueProducer};
+
+pub use crate::write_queue::{PokeAByteWriteQueue, WRITE_QUEUE_CAPACITY};
 
 #[cfg(not(target_pointer_width = "64"))]
 compile_error!("must be compiled for 64-bit");
 
-// FIXME: this is not currently configurable
-const POKEABYTE_UDP: &str = "127.0.0.1:55356";
+/// Port Poke-A-Byte connects to by default.
+pub const DEFAULT_PORT: u16 = 55356;
+
+/// Name of the shared memory file Poke-A-Byte opens by default.
+pub const DEFAULT_SHARED_MEMORY_NAME: &str = "EDPS_MemoryData.bin";
+
+/// Shared memory mapped up front by default, enough for any Game Boy or Game Boy Color block layout.
+pub const DEFAULT_SHARED_MEMORY_RESERVE: usize = 64 * 1024;
+
+/// Safety net for noticing the server was closed if the wake-up datagram is somehow lost.
+const SOCKET_TIMEOUT: Duration = Duration::from_millis(500);
+
+/// How long to wait for the emulator to make room in a full write queue before dropping a write.
+const WRITE_QUEUE_FULL_TIMEOUT: Duration = Duration::from_millis(100);
+
+/// Called from the server thread whenever Poke-A-Byte changes something the emulator needs to
+/// handle, such as a new session or a write request.
+pub type PokeAByteNotifier = Box<dyn Fn() + Send>;
 
 pub struct PokeAByteWrite {
     pub address: u64,
@@ -20,7 +39,44 @@ pub struct PokeAByteWrite {
 
 pub struct PokeAByteIntegrationServer {
     session: Arc<Mutex<Option<PokeAByteSession>>>,
-    server_close_notifier: Mutex<Receiver<()>>
+    server_close_notifier: Mutex<Receiver<()>>,
+
+    /// Where to send a datagram to wake up the server thread.
+    wake_address: SocketAddr
+}
+
+/// Where a [`PokeAByteIntegrationServer`] listens and shares memory.
+///
+/// Running several emulators at once requires giving each its own port and shared memory name.
+#[derive(Clone, PartialEq, Debug)]
+pub struct PokeAByteServerSettings {
+    /// Address to listen on for Poke-A-Byte.
+    ///
+    /// Default is `127.0.0.1:`[`DEFAULT_PORT`]
+    pub bind_address: SocketAddr,
+
+    /// Name of the shared memory file (not a path).
+    ///
+    /// Default is [`DEFAULT_SHARED_MEMORY_NAME`]
+    pub shared_memory_name: String,
+
+    /// Bytes of shared memory to map when the server starts, rather than when Poke-A-Byte sets up.
+    ///
+    /// The mapping is reused (and only grown if needed) across setups. If 0, nothing is mapped
+    /// until the first setup.
+    ///
+    /// Default is [`DEFAULT_SHARED_MEMORY_RESERVE`]
+    pub shared_memory_reserve: usize
+}
+
+impl Default for PokeAByteServerSettings {
+    fn default() -> Self {
+        Self {
+            bind_address: SocketAddr::new(IpAddr::V4(Ipv4Addr::LOCALHOST), DEFAULT_PORT),
+            shared_memory_name: DEFAULT_SHARED_MEMORY_NAME.to_owned(),
+            shared_memory_reserve: DEFAULT_SHARED_MEMORY_RESERVE
+        }
+    }
 }
 
 /// All session-related data from Poke-A-Byte.
@@ -32,18 +88,65 @@ pub struct PokeAByteSession {
     pub writes: PokeAByteWriteQueue,
 
     /// Current setup configuration from the Poke-A-Byte client.
-    pub config: PokeAByteSetup
-}
+    pub config: PokeAByteSetup,
 
-/// Write queue from Poke-A-Byte.
-pub struct PokeAByteWriteQueue {
-    queue: Receiver<PokeAByteWrite>
+    /// What was last written to the shared memory, so unchanged bytes aren't written again.
+    shadow: Vec<u8>,
+
+    /// Whether the shared memory changed since the frame sequence was last incremented.
+    dirty: bool,
+    frame_sequence: u64
 }
 
-impl Iterator for PokeAByteWriteQueue {
-    type Item = PokeAByteWrite;
-    fn next(&mut self) -> Option<Self::Item> {
-        self.queue.try_recv().ok()
+/// Granularity of writes to the shared memory when a block changes.
+const DIRTY_CHUNK_SIZE: usize = 64;
+
+impl PokeAByteSession {
+    /// Copy the current contents of the block at `block_index` into the shared memory.
+    ///
+    /// Only chunks that differ from what was last written are written, so the shared memory is
+    /// left alone if nothing changed.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `block_index` is out of bounds or `data` is not the length of the block.
+    pub fn update_block(&mut self, block_index: usize, data: &[u8]) {
+        let range = self.config.blocks[block_index].range.clone();
+        let shadow = &mut self.shadow[range.clone()];
+        assert_eq!(shadow.len(), data.len(), "block {block_index} is {} bytes, not {}", shadow.len(), data.len());
+
+        if shadow == data {
+            return
+        }
+
+        // SAFETY: We only write bytes.
+        let memory = &mut unsafe { self.shared_memory.get_memory_mut() }[range];
+        let chunks = shadow.chunks_mut(DIRTY_CHUNK_SIZE)
+            .zip(memory.chunks_mut(DIRTY_CHUNK_SIZE))
+            .zip(data.chunks(DIRTY_CHUNK_SIZE));
+
+        for ((shadow, memory), data) in chunks {
+            if shadow != data {
+                shadow.copy_from_slice(data);
+                memory.copy_from_slice(data);
+            }
+        }
+
+        self.dirty = true;
+    }
+
+    /// Finish updating blocks for this frame, incrementing the frame sequence counter if anything
+    /// changed.
+    ///
+    /// Returns `true` if anything changed.
+    pub fn finish_frame(&mut self) -> bool {
+        if !core::mem::take(&mut self.dirty) {
+            return false
+        }
+
+        self.frame_sequence = self.frame_sequence.wrapping_add(1);
+        self.shared_memory.set_frame_sequence(self.frame_sequence);
+        true
     }
 }
 
@@ -67,18 +170,48 @@ pub struct PokeAByteSetup {
 impl Drop for PokeAByteIntegrationServer {
     fn drop(&mut self) {
         self.session = Arc::new(Mutex::new(None));
+
+        // Wake the thread up so it notices right away instead of after the socket times out.
+        if let Ok(waker) = UdpSocket::bind(SocketAddr::new(self.wake_address.ip(), 0)) {
+            let _ = waker.send_to(&[], self.wake_address);
+        }
+
         let _ = self.server_close_notifier.lock().and_then(|i| Ok(i.recv()));
     }
 }
 
 impl PokeAByteIntegrationServer {
     /// Begin listening.
+    #[inline]
     pub fn begin_listen() -> Result<Self, PokeAByteError> {
-        let socket = UdpSocket::bind(&POKEABYTE_UDP)
-            .map_err(|e| PokeAByteError::SocketFailure { explanation: Cow::Owned(format!("Failed to bind: {e:?}")) })?;
+        Self::begin_listen_with_notifier(Box::new(|| {}))
+    }
+
+    /// Begin listening, calling `notifier` whenever a session is set up or a write is received.
+    ///
+    /// This lets the emulator sleep until there is something to do rather than polling the
+    /// session.
+    #[inline]
+    pub fn begin_listen_with_notifier(notifier: PokeAByteNotifier) -> Result<Self, PokeAByteError> {
+        Self::begin_listen_with_settings(PokeAByteServerSettings::default(), notifier)
+    }
+
+    /// Begin listening with the given settings, calling `notifier` whenever a session is set up or
+    /// a write is received.
+    pub fn begin_listen_with_settings(settings: PokeAByteServerSettings, notifier: PokeAByteNotifier) -> Result<Self, PokeAByteError> {
+        validate_shared_memory_name(&settings.shared_memory_name)?;
 
-        let _ = socket.set_read_timeout(Some(Duration::from_millis(500)));
-        let _ = socket.set_write_timeout(Some(Duration::from_millis(500)));
+        let socket = UdpSocket::bind(settings.bind_address)
+            .map_err(|e| PokeAByteError::SocketFailure { explanation: Cow::Owned(format!("Failed to bind to {}: {e:?}", settings.bind_address)) })?;
+
+        let mut wake_address = socket.local_addr()
+            .map_err(|e| PokeAByteError::SocketFailure { explanation: Cow::Owned(format!("Failed to get the bound address: {e:?}")) })?;
+        if wake_address.ip().is_unspecified() {
+            wake_address.set_ip(if wake_address.is_ipv4() { IpAddr::V4(Ipv4Addr::LOCALHOST) } else { IpAddr::V6(Ipv6Addr::LOCALHOST) });
+        }
+
+        let _ = socket.set_read_timeout(Some(SOCKET_TIMEOUT));
+        let _ = socket.set_write_timeout(Some(SOCKET_TIMEOUT));
 
         let (sender, receiver) = channel();
 
@@ -87,11 +220,12 @@ impl PokeAByteIntegrationServer {
 
         let this = Self {
             session,
-            server_close_notifier: Mutex::new(receiver)
+            server_close_notifier: Mutex::new(receiver),
+            wake_address
         };
 
         let _ = std::thread::Builder::new().name("PokeAByteIntegrationServer".to_owned()).spawn(move || {
-            PokeAByteIntegrationServer::thread(session_downgraded, socket, sender)
+            PokeAByteIntegrationServer::thread(session_downgraded, socket, settings, sender, notifier)
         });
 
         Ok(this)
@@ -102,10 +236,27 @@ impl PokeAByteIntegrationServer {
         self.session.lock().expect("could not get session???")
     }
 
-    fn thread(session: Weak<Mutex<Option<PokeAByteSession>>>, socket: UdpSocket, close_notifier: Sender<()>) {
+    fn thread(session: Weak<Mutex<Option<PokeAByteSession>>>, socket: UdpSocket, settings: PokeAByteServerSettings, close_notifier: Sender<()>, notifier: PokeAByteNotifier) {
         let mut buffer = vec![0u8; 65536];
 
-        let mut writer: Option<Sender<PokeAByteWrite>> = None;
+        let mut writer: Option<WriteQueueProducer> = None;
+
+        // Mapping (and shadow buffer) not currently used by a session, kept to be reused by the next.
+        let mut spare_memory: Option<PokeAByteSharedMemory> = None;
+        let mut spare_shadow = Vec::new();
+
+        if settings.shared_memory_reserve > 0 {
+            // Safety: Every block is zeroed on setup before it's used.
+            match unsafe { PokeAByteSharedMemory::new(&settings.shared_memory_name, settings.shared_memory_reserve) } {
+                Ok(n) => spare_memory = Some(n),
+                Err(e) => {
+                    // Not fatal; we'll try again on setup.
+                    if cfg!(debug_assertions) {
+                        eprintln!("PokeAByte error: {e:?}");
+                    }
+                }
+            }
+        }
 
         loop {
             let Some(promotion) = session.upgrade() else {
@@ -118,6 +269,11 @@ impl PokeAByteIntegrationServer {
                 continue
             };
 
+            // Probably the wake-up from dropping the server.
+            if len == 0 {
+                continue
+            }
+
             let bytes_received = &buffer.as_slice()[..len];
             let packet = match PokeAByteProtocolRequestPacket::parse_bytes(bytes_received) {
                 Ok(n) => n,
@@ -145,32 +301,77 @@ impl PokeAByteIntegrationServer {
                         .max()
                         .unwrap_or(0);
 
-                    let mut session = promotion.lock().expect("Failed to lock: crash?");
-                    *session = None; // For cleaning up the old SHM and clearing the file descriptor.
-
-                    // Safety: We're going to zero-initialize this before we use it.
-                    let mut shared_memory = unsafe { PokeAByteSharedMemory::new(memory_size) }
-                        .expect("Failed to initialize shared memory");
+                    // Take the old session's mapping so it can be reused; the lock is only held
+                    // for this and for installing the new session, not while preparing it.
+                    let old_session = promotion.lock().expect("Failed to lock: crash?").take();
+                    if let Some(old_session) = old_session {
+                        spare_memory = Some(old_session.shared_memory);
+                        spare_shadow = old_session.shadow;
+                    }
 
-                    let (writer_queue, writes_queue) = channel();
+                    let mut shared_memory = spare_memory.take();
+                    let reused = shared_memory.as_mut().is_some_and(|m| m.set_len(memory_size));
+                    let mut shared_memory = match shared_memory {
+                        Some(n) if reused => n,
+                        too_small => {
+                            // Unmap the old one first, since it's the same file.
+                            let capacity = too_small.as_ref().map(|m| m.capacity() * 2).unwrap_or(0);
+                            drop(too_small);
+
+                            // Safety: We're going to zero-initialize this before we use it.
+                            let new_memory = unsafe {
+                                PokeAByteSharedMemory::new(&settings.shared_memory_name, capacity.max(memory_size).max(settings.shared_memory_reserve))
+                            };
+
+                            match new_memory {
+                                Ok(mut n) => {
+                                    n.set_len(memory_size);
+                                    n
+                                },
+                                Err(e) => {
+                                    // Don't acknowledge a setup we can't serve.
+                                    if cfg!(debug_assertions) {
+                                        eprintln!("PokeAByte error: {e:?}");
+                                    }
+                                    continue
+                                }
+                            }
+                        }
+                    };
 
-                    let writes = PokeAByteWriteQueue { queue: writes_queue };
+                    let (writer_queue, writes) = write_queue();
                     writer = Some(writer_queue);
 
                     // let Poke-A-Byte know that we're open for business, since zero initialization
                     // is not instant (though it'll probably still be quick)
                     let _ = socket.send_to(&MetadataHeader::new_response(Instruction::Setup).into_bytes(), addr);
 
-                    // Zero-initialize
-                    unsafe { shared_memory.get_memory_mut() }.fill(0);
+                    // Zero-initialize only what the blocks cover, since the rest is never read.
+                    let memory = unsafe { shared_memory.get_memory_mut() };
+                    for block in &blocks {
+                        memory[block.range.clone()].fill(0);
+                    }
+
+                    let mut shadow = core::mem::take(&mut spare_shadow);
+                    shadow.clear();
+                    shadow.resize(memory_size, 0);
 
+                    let mut session = promotion.lock().expect("Failed to lock: crash?");
                     *session = Some(PokeAByteSession {
                         shared_memory,
                         writes,
                         config: PokeAByteSetup {
                             blocks, frame_skip, _cant_let_you_instantiate_that_stair_fax: ()
                         },
+                        shadow,
+
+                        // Make sure the first frame is published, even if it's all zeroes.
+                        dirty: true,
+                        frame_sequence: 0
                     });
+                    drop(session);
+
+                    notifier();
 
                 },
                 PokeAByteProtocolRequestPacket::Write { data, address } => {
@@ -178,13 +379,31 @@ impl PokeAByteIntegrationServer {
                         continue
                     }
 
-                    let Some(writer) = writer.as_ref() else {
+                    let Some(writer) = writer.as_mut() else {
                         continue
                     };
 
-                    let _ = writer.send(PokeAByteWrite {
-                        address, data: data.into()
-                    });
+                    let mut write = PokeAByteWrite { address, data: data.into() };
+                    let mut deadline = None;
+                    while let Err(returned) = writer.push(write) {
+                        // The emulator is behind; make sure it knows there's work and wait for it
+                        // to make room.
+                        notifier();
+
+                        let deadline = *deadline.get_or_insert_with(|| Instant::now() + WRITE_QUEUE_FULL_TIMEOUT);
+                        let now = Instant::now();
+                        if writer.is_disconnected() || now >= deadline {
+                            if cfg!(debug_assertions) {
+                                eprintln!("PokeAByte write queue is full; dropping write to 0x{address:X}");
+                            }
+                            break
+                        }
+
+                        write = returned;
+                        writer.wait_for_room(deadline - now);
+                    }
+
+                    notifier();
                 }
             }
         }
@@ -200,3 +419,4 @@ pub enum PokeAByteError {
 
 mod shared_memory;
 mod protocol;
+mod write_queue;
@@ -5,7 +5,7 @@ use tinyvec::ArrayVec;
 use crate::PokeAByteError;
 
 #[cfg(target_os = "macos")]
-use crate::shared_memory::MACOS_MAX_MMAP_MEMORY_LENGTH;
+use crate::shared_memory::{FRAME_SEQUENCE_SIZE, MACOS_MAX_MMAP_MEMORY_LENGTH};
 
 const PROTOCOL_VERSION: u8 = 1;
 
@@ -130,7 +130,7 @@ impl<'a> PokeAByteProtocolRequestPacket<'a> {
 
                     // On macOS, error out as shm_open fails above 4 MiB.
                     #[cfg(target_os = "macos")]
-                    if end > MACOS_MAX_MMAP_MEMORY_LENGTH {
+                    if end > MACOS_MAX_MMAP_MEMORY_LENGTH - FRAME_SEQUENCE_SIZE {
                         return Err(PokeAByteError::BadPacketFromClient { explanation: Cow::Borrowed("maximum shared memory size of 4 MiB exceeded") });
                     }
 
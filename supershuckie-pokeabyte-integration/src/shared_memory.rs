@@ -1,10 +1,35 @@
 use std::borrow::Cow;
-use std::ffi::{c_char, CStr};
+use std::ffi::{c_char, CStr, CString};
 use std::ptr::null_mut;
+use std::sync::atomic::{AtomicU64, Ordering};
 use crate::PokeAByteError;
 
+/// Size of the frame sequence counter placed after the blocks.
+pub const FRAME_SEQUENCE_SIZE: usize = size_of::<u64>();
+
+/// Shared memory mapped with Poke-A-Byte.
+///
+/// The blocks Poke-A-Byte asked for are followed by a little endian `u64` frame sequence counter,
+/// aligned to 8 bytes, which goes up every time the emulator changes the blocks. Clients that
+/// don't know about it only map the blocks and never see it.
+///
+/// The mapping can be larger than the blocks currently use, so it can be reused by later setups
+/// without mapping it again.
 pub struct PokeAByteSharedMemory {
-    memory: &'static mut [u8]
+    memory: *mut u8,
+    frame_sequence: &'static AtomicU64,
+
+    /// Length of the blocks currently in use.
+    len: usize,
+
+    /// Largest length the blocks can be set to without mapping again.
+    capacity: usize,
+
+    /// Length actually mapped, including the frame sequence counter.
+    mapped_len: usize,
+
+    /// Platform-specific handle to close when done.
+    handle: isize
 }
 
 // macOS mmap is limited to 4 MiB. As such, we cannot (presently) support larger memory mapped files
@@ -12,56 +37,123 @@ pub struct PokeAByteSharedMemory {
 #[cfg(target_os = "macos")]
 pub(crate) const MACOS_MAX_MMAP_MEMORY_LENGTH: usize = 1024 * 1024 * 4;
 
+/// Capacities are rounded up to this so that slightly larger setups can reuse the mapping.
+const CAPACITY_GRANULARITY: usize = 64 * 1024;
+
 unsafe extern "C" {
-    fn supershuckie_pokeabyte_try_create_shared_memory(len: usize, error: *mut *mut c_char) -> *mut u8;
-    fn supershuckie_pokeabyte_close_shared_memory();
+    fn supershuckie_pokeabyte_try_create_shared_memory(name: *const c_char, len: usize, handle: *mut isize, error: *mut *mut c_char) -> *mut u8;
+    fn supershuckie_pokeabyte_close_shared_memory(memory: *mut u8, len: usize, handle: isize);
 }
 
 impl PokeAByteSharedMemory {
+    /// Create (or open) the shared memory file with the given name, able to hold at least
+    /// `capacity` bytes of blocks.
+    ///
+    /// The blocks start out with a length of 0; use [`set_len`](Self::set_len) to resize them.
+    ///
     /// # Safety
     ///
     /// The memory returned is not guaranteed to be initialized and must be zero-initialized
     /// manually.
-    pub(crate) unsafe fn new(len: usize) -> Result<PokeAByteSharedMemory, PokeAByteError> {
+    pub(crate) unsafe fn new(name: &str, capacity: usize) -> Result<PokeAByteSharedMemory, PokeAByteError> {
+        let name = validate_shared_memory_name(name)?;
+        let capacity = capacity.max(1).next_multiple_of(CAPACITY_GRANULARITY);
+
+        #[cfg(target_os = "macos")]
+        let capacity = capacity.min(MACOS_MAX_MMAP_MEMORY_LENGTH - FRAME_SEQUENCE_SIZE);
+
+        let mapped_len = capacity.next_multiple_of(FRAME_SEQUENCE_SIZE) + FRAME_SEQUENCE_SIZE;
+
         let mut error = null_mut();
+        let mut handle = 0;
         let memory = unsafe {
-            let ram = supershuckie_pokeabyte_try_create_shared_memory(len, &mut error);
+            let ram = supershuckie_pokeabyte_try_create_shared_memory(name.as_ptr(), mapped_len, &mut handle, &mut error);
             if ram.is_null() {
                 return Err(PokeAByteError::SharedMemoryFailure { explanation: Cow::Owned(format!("Error: {}", CStr::from_ptr(error).to_str().unwrap())) })
             }
-            std::slice::from_raw_parts_mut(ram, len)
+            ram
         };
 
-        Ok(Self {
-            memory
-        })
+        let mut result = Self {
+            memory,
+            // SAFETY: Mappings are page aligned, so this is 8-byte aligned.
+            frame_sequence: unsafe { AtomicU64::from_ptr(memory.cast()) },
+            len: 0,
+            capacity,
+            mapped_len,
+            handle
+        };
+        result.set_len(0);
+        Ok(result)
+    }
+
+    /// Set the length of the blocks, moving the frame sequence counter after them and resetting it
+    /// to 0.
+    ///
+    /// Returns `false` (and does nothing) if `len` exceeds the capacity.
+    pub(crate) fn set_len(&mut self, len: usize) -> bool {
+        if len > self.capacity {
+            return false
+        }
+
+        // SAFETY: This is within the mapping (see new) and 8-byte aligned.
+        let frame_sequence = unsafe { AtomicU64::from_ptr(self.memory.add(len.next_multiple_of(FRAME_SEQUENCE_SIZE)).cast()) };
+        frame_sequence.store(0, Ordering::Relaxed);
+        self.frame_sequence = frame_sequence;
+        self.len = len;
+        true
+    }
+
+    /// Get the largest length the blocks can be set to without mapping again.
+    #[inline]
+    pub fn capacity(&self) -> usize {
+        self.capacity
+    }
+
+    /// Set the frame sequence counter, publishing all changes made to the blocks before it.
+    #[inline]
+    pub fn set_frame_sequence(&self, sequence: u64) {
+        self.frame_sequence.store(sequence.to_le(), Ordering::Release);
     }
 
+    /// Get the blocks' memory (not including the frame sequence counter).
+    ///
     /// # Safety
     ///
     /// There is no protection against data races from other processes. It is not recommended to use
     /// this for anything except reading bytes.
     #[inline]
     pub unsafe fn get_memory(&self) -> &[u8] {
-        self.memory
+        unsafe { std::slice::from_raw_parts(self.memory, self.len) }
     }
 
+    /// Get the blocks' memory (not including the frame sequence counter) mutably.
+    ///
     /// # Safety
     ///
     /// There is no protection against data races from other processes. It is not recommended to use
     /// this for anything except reading and writing bytes.
     #[inline]
     pub unsafe fn get_memory_mut(&mut self) -> &mut [u8] {
-        self.memory
+        unsafe { std::slice::from_raw_parts_mut(self.memory, self.len) }
     }
 }
 
 impl Drop for PokeAByteSharedMemory {
     fn drop(&mut self) {
-        unsafe { supershuckie_pokeabyte_close_shared_memory() };
+        unsafe { supershuckie_pokeabyte_close_shared_memory(self.memory, self.mapped_len, self.handle) };
     }
 }
 
+/// Check that `name` can be used as a shared memory file name on every platform.
+pub(crate) fn validate_shared_memory_name(name: &str) -> Result<CString, PokeAByteError> {
+    if name.is_empty() || name.contains(['/', '\\']) {
+        return Err(PokeAByteError::SharedMemoryFailure { explanation: Cow::Owned(format!("Invalid shared memory name {name:?}")) })
+    }
+
+    CString::new(name).map_err(|_| PokeAByteError::SharedMemoryFailure { explanation: Cow::Borrowed("Shared memory name contains a null byte") })
+}
+
 
 unsafe impl Sync for PokeAByteSharedMemory {}
 unsafe impl Send for PokeAByteSharedMemory {}
@@ -9,13 +9,11 @@
 #include <string.h>
 #include <stdbool.h>
 
-static int fd = -1;
-static const char *shm = "/dev/shm/EDPS_MemoryData.bin";
-
-uint8_t *supershuckie_pokeabyte_try_create_shared_memory(size_t len, const char **error) {
-    if(fd != -1) {
+uint8_t *supershuckie_pokeabyte_try_create_shared_memory(const char *name, size_t len, intptr_t *handle, const char **error) {
+    char shm[256];
+    if(snprintf(shm, sizeof(shm), "/dev/shm/%s", name) >= (int)sizeof(shm)) {
         if(error) {
-            *error = "shared memory already created";
+            *error = "shared memory name too long";
         }
         return NULL;
     }
@@ -29,7 +27,9 @@ uint8_t *supershuckie_pokeabyte_try_create_shared_memory(size_t len, const char
     }
 
     ftruncate(new_fd, len);
-    uint8_t *f = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, new_fd, 0);
+
+    // Fault everything in now rather than on the first frames after a setup.
+    uint8_t *f = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, new_fd, 0);
 
     if(f == (void *)-1) {
         if(error) {
@@ -39,7 +39,12 @@ uint8_t *supershuckie_pokeabyte_try_create_shared_memory(size_t len, const char
         return NULL;
     }
 
-    fd = new_fd;
+#ifdef MADV_HUGEPAGE
+    // Only a hint; this fails harmlessly if huge pages aren't enabled for shared memory.
+    madvise(f, len, MADV_HUGEPAGE);
+#endif
+
+    *handle = new_fd;
 
     if(error) {
         *error = "succeeded";
@@ -48,11 +53,7 @@ uint8_t *supershuckie_pokeabyte_try_create_shared_memory(size_t len, const char
     return f;
 }
 
-void supershuckie_pokeabyte_close_shared_memory(void) {
-    if(fd == -1) {
-        abort();
-    }
-
-    close(fd);
-    fd = -1;
+void supershuckie_pokeabyte_close_shared_memory(uint8_t *memory, size_t len, intptr_t handle) {
+    munmap(memory, len);
+    close((int)handle);
 }
@@ -10,13 +10,11 @@
 #include <string.h>
 #include <stdbool.h>
 
-static int fd = -1;
-static const char *shm = "/tmp/EDPS_MemoryData.bin";
-
-uint8_t *supershuckie_pokeabyte_try_create_shared_memory(size_t len, const char **error) {
-    if(fd != -1) {
+uint8_t *supershuckie_pokeabyte_try_create_shared_memory(const char *name, size_t len, intptr_t *handle, const char **error) {
+    char shm[256];
+    if(snprintf(shm, sizeof(shm), "/tmp/%s", name) >= (int)sizeof(shm)) {
         if(error) {
-            *error = "shared memory already created";
+            *error = "shared memory name too long";
         }
         return NULL;
     }
@@ -40,7 +38,10 @@ uint8_t *supershuckie_pokeabyte_try_create_shared_memory(size_t len, const char
         return NULL;
     }
 
-    fd = new_fd;
+    // No MAP_POPULATE here, but we can at least ask for everything to be paged in ahead of time.
+    madvise(f, len, MADV_WILLNEED);
+
+    *handle = new_fd;
 
     if(error) {
         *error = "succeeded";
@@ -49,11 +50,7 @@ uint8_t *supershuckie_pokeabyte_try_create_shared_memory(size_t len, const char
     return f;
 }
 
-void supershuckie_pokeabyte_close_shared_memory(void) {
-    if(fd == -1) {
-        abort();
-    }
-
-    close(fd);
-    fd = -1;
+void supershuckie_pokeabyte_close_shared_memory(uint8_t *memory, size_t len, intptr_t handle) {
+    munmap(memory, len);
+    close((int)handle);
 }
@@ -3,27 +3,17 @@
 #include <stdint.h>
 #include <windows.h>
 
-static HANDLE handle = INVALID_HANDLE_VALUE;
-static const char *mmf_name = "EDPS_MemoryData.bin";
-
-uint8_t *supershuckie_pokeabyte_try_create_shared_memory(size_t len, const char **error) {
-    if(handle != INVALID_HANDLE_VALUE) {
-        if(error) {
-            *error = "shared memory already created";
-        }
-        return NULL;
-    }
-
+uint8_t *supershuckie_pokeabyte_try_create_shared_memory(const char *name, size_t len, intptr_t *handle, const char **error) {
     HANDLE handle_maybe = CreateFileMappingA(
         INVALID_HANDLE_VALUE,
         NULL,
         PAGE_READWRITE,
         (uint32_t)((uint64_t)(len) >> 32),
         (uint32_t)len,
-        mmf_name
+        name
     );
 
-    if(handle_maybe == INVALID_HANDLE_VALUE) {
+    if(handle_maybe == NULL) {
         if(error) {
             *error = "CreateFileMappingA failed";
         }
@@ -31,20 +21,40 @@ uint8_t *supershuckie_pokeabyte_try_create_shared_memory(size_t len, const char
         return NULL;
     }
 
-    handle = handle_maybe;
-
-    return MapViewOfFile(
-        handle,
+    uint8_t *memory = MapViewOfFile(
+        handle_maybe,
         FILE_MAP_ALL_ACCESS,
         0,
         0,
         len
     );
-}
 
-void supershuckie_pokeabyte_close_shared_memory(void) {
-    if(handle != INVALID_HANDLE_VALUE) {
-        CloseHandle(handle);
-        handle = INVALID_HANDLE_VALUE;
+    if(memory == NULL) {
+        if(error) {
+            *error = "MapViewOfFile failed";
+        }
+
+        CloseHandle(handle_maybe);
+        return NULL;
     }
+
+#if _WIN32_WINNT >= 0x0602
+    // Page everything in ahead of time (Windows 8+). Only a hint, so failure is fine.
+    WIN32_MEMORY_RANGE_ENTRY range = { memory, len };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+
+    *handle = (intptr_t)handle_maybe;
+
+    if(error) {
+        *error = "succeeded";
+    }
+
+    return memory;
+}
+
+void supershuckie_pokeabyte_close_shared_memory(uint8_t *memory, size_t len, intptr_t handle) {
+    (void)len;
+    UnmapViewOfFile(memory);
+    CloseHandle((HANDLE)handle);
 }
@@ -0,0 +1,144 @@
+use std::cell::UnsafeCell;
+use std::mem::MaybeUninit;
+use std::sync::Arc;
+use std::sync::atomic::{fence, AtomicBool, AtomicUsize, Ordering};
+use std::thread::Thread;
+use std::time::Duration;
+use crate::PokeAByteWrite;
+
+/// Maximum number of writes that can be waiting for the emulator at once.
+///
+/// Must be a power of two.
+pub const WRITE_QUEUE_CAPACITY: usize = 256;
+
+const _: () = assert!(WRITE_QUEUE_CAPACITY.is_power_of_two());
+
+/// Fixed-capacity ring buffer shared by exactly one producer and one consumer.
+struct WriteRing {
+    slots: Box<[UnsafeCell<MaybeUninit<PokeAByteWrite>>]>,
+
+    /// Total writes popped; only changed by the consumer.
+    head: AtomicUsize,
+
+    /// Total writes pushed; only changed by the producer.
+    tail: AtomicUsize,
+
+    /// The producer's thread, unparked when it is waiting for room.
+    producer: Thread,
+
+    /// Set by the producer while it is waiting for the consumer to pop something.
+    producer_waiting: AtomicBool
+}
+
+// SAFETY: Each slot is only accessed by one side at a time, as handed off by head/tail.
+unsafe impl Sync for WriteRing {}
+unsafe impl Send for WriteRing {}
+
+impl WriteRing {
+    fn slot(&self, index: usize) -> *mut MaybeUninit<PokeAByteWrite> {
+        self.slots[index & (WRITE_QUEUE_CAPACITY - 1)].get()
+    }
+}
+
+impl Drop for WriteRing {
+    fn drop(&mut self) {
+        let tail = *self.tail.get_mut();
+        let mut head = *self.head.get_mut();
+        while head != tail {
+            // SAFETY: Everything between head and tail was pushed and not yet popped.
+            unsafe { (*self.slot(head)).assume_init_drop() };
+            head = head.wrapping_add(1);
+        }
+    }
+}
+
+/// Create a write queue, returning the sending and receiving halves.
+///
+/// This must be called on the thread that will own the producer.
+pub(crate) fn write_queue() -> (WriteQueueProducer, PokeAByteWriteQueue) {
+    let ring = Arc::new(WriteRing {
+        slots: (0..WRITE_QUEUE_CAPACITY).map(|_| UnsafeCell::new(MaybeUninit::uninit())).collect(),
+        head: AtomicUsize::new(0),
+        tail: AtomicUsize::new(0),
+        producer: std::thread::current(),
+        producer_waiting: AtomicBool::new(false)
+    });
+
+    (WriteQueueProducer { ring: ring.clone() }, PokeAByteWriteQueue { ring })
+}
+
+/// Sending half of the write queue, owned by the server thread.
+pub(crate) struct WriteQueueProducer {
+    ring: Arc<WriteRing>
+}
+
+impl WriteQueueProducer {
+    /// Push a write, or give it back if the queue is full.
+    pub fn push(&mut self, write: PokeAByteWrite) -> Result<(), PokeAByteWrite> {
+        let tail = self.ring.tail.load(Ordering::Relaxed);
+        let head = self.ring.head.load(Ordering::Acquire);
+        if tail.wrapping_sub(head) == WRITE_QUEUE_CAPACITY {
+            return Err(write)
+        }
+
+        // SAFETY: The consumer does not touch this slot until tail is moved past it.
+        unsafe { (*self.ring.slot(tail)).write(write) };
+        self.ring.tail.store(tail.wrapping_add(1), Ordering::Release);
+        Ok(())
+    }
+
+    /// Block until the consumer pops a write or `timeout` passes, if the queue is full.
+    ///
+    /// This may return early, so check again with [`WriteQueueProducer::push`].
+    pub fn wait_for_room(&self, timeout: Duration) {
+        self.ring.producer_waiting.store(true, Ordering::Relaxed);
+
+        // Pairs with the fence in the consumer, so either it sees that we are waiting or we see
+        // what it popped.
+        fence(Ordering::SeqCst);
+
+        let tail = self.ring.tail.load(Ordering::Relaxed);
+        let head = self.ring.head.load(Ordering::Relaxed);
+        if tail.wrapping_sub(head) == WRITE_QUEUE_CAPACITY {
+            std::thread::park_timeout(timeout);
+        }
+
+        self.ring.producer_waiting.store(false, Ordering::Relaxed);
+    }
+
+    /// Return `true` if the consumer was dropped, in which case nothing will ever be popped again.
+    pub fn is_disconnected(&self) -> bool {
+        Arc::strong_count(&self.ring) == 1
+    }
+}
+
+/// Write queue from Poke-A-Byte.
+///
+/// Iterating pops writes in the order they were received. This never blocks or allocates, though it
+/// wakes up Poke-A-Byte's thread if it was waiting for room.
+pub struct PokeAByteWriteQueue {
+    ring: Arc<WriteRing>
+}
+
+impl Iterator for PokeAByteWriteQueue {
+    type Item = PokeAByteWrite;
+    fn next(&mut self) -> Option<Self::Item> {
+        let head = self.ring.head.load(Ordering::Relaxed);
+        let tail = self.ring.tail.load(Ordering::Acquire);
+        if head == tail {
+            return None
+        }
+
+        // SAFETY: The producer initialized this slot before moving tail past it, and won't reuse
+        //         it until head is moved past it.
+        let write = unsafe { (*self.ring.slot(head)).assume_init_read() };
+        self.ring.head.store(head.wrapping_add(1), Ordering::Release);
+
+        fence(Ordering::SeqCst);
+        if self.ring.producer_waiting.swap(false, Ordering::Relaxed) {
+            self.ring.producer.unpark();
+        }
+
+        Some(write)
+    }
+}
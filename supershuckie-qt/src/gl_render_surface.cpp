@@ -0,0 +1,181 @@
+#include "gl_render_surface.hpp"
+
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <supershuckie/supershuckie.h>
+
+using namespace SuperShuckie64;
+
+// Frames are ARGB32 words, so in memory (little endian) each pixel is B, G, R, A. We upload them as RGBA bytes (which
+// is available everywhere, including GLES) and swap red/blue in the shader instead of relying on GL_BGRA. RGB565 frames
+// are uploaded as GL_UNSIGNED_SHORT_5_6_5, which already has red in the high bits, so they are not swapped.
+static const char *VERTEX_SHADER = R"(
+attribute highp vec2 position;
+attribute highp vec2 tex_coord_in;
+varying highp vec2 tex_coord;
+
+void main() {
+    tex_coord = tex_coord_in;
+    gl_Position = vec4(position, 0.0, 1.0);
+}
+)";
+
+static const char *FRAGMENT_SHADER = R"(
+uniform sampler2D frame;
+uniform bool swap_red_blue;
+varying highp vec2 tex_coord;
+
+void main() {
+    lowp vec4 color = texture2D(frame, tex_coord);
+    gl_FragColor = swap_red_blue ? vec4(color.b, color.g, color.r, 1.0) : vec4(color.rgb, 1.0);
+}
+)";
+
+// Triangle strip covering the viewport; texture row 0 is the top of the screen
+static const GLfloat QUAD_POSITIONS[] = {
+    -1.0f,  1.0f,
+    -1.0f, -1.0f,
+     1.0f,  1.0f,
+     1.0f, -1.0f,
+};
+
+static const GLfloat QUAD_TEX_COORDS[] = {
+    0.0f, 0.0f,
+    0.0f, 1.0f,
+    1.0f, 0.0f,
+    1.0f, 1.0f,
+};
+
+GLRenderSurface::GLRenderSurface(GameRenderWidget *parent): QOpenGLWidget(parent), render_widget(parent) {
+    this->setSizePolicy(QSizePolicy::Policy::Fixed, QSizePolicy::Policy::Fixed);
+    this->setFocusPolicy(Qt::NoFocus);
+    this->setAcceptDrops(false);
+}
+
+GLRenderSurface::~GLRenderSurface() {
+    this->cleanup_gl();
+}
+
+void GLRenderSurface::set_dimensions(unsigned width, unsigned height, unsigned scale, std::uint32_t encoding) {
+    if(this->width != width || this->height != height || this->encoding != encoding) {
+        this->width = width;
+        this->height = height;
+        this->encoding = encoding;
+        this->texture_needs_allocation = true;
+        this->pending_frame.clear();
+    }
+
+    this->setFixedSize(this->width * scale, this->height * scale);
+}
+
+void GLRenderSurface::refresh_screen(const std::uint32_t *pixels) {
+    if(this->failed) {
+        return;
+    }
+
+    // The pixel buffer is only valid for the duration of the callback, so if we cannot upload it yet, hold onto a copy.
+    if(!this->isValid() || this->program == nullptr) {
+        std::size_t pixel_count = static_cast<std::size_t>(this->width) * this->height;
+        std::size_t word_count = this->encoding == SuperShuckieScreenDataEncoding__R5G6B5 ? (pixel_count + 1) / 2 : pixel_count;
+        this->pending_frame.assign(pixels, pixels + word_count);
+        return;
+    }
+
+    this->makeCurrent();
+    this->upload_frame(pixels);
+    this->doneCurrent();
+    this->update();
+}
+
+void GLRenderSurface::upload_frame(const std::uint32_t *pixels) {
+    bool rgb565 = this->encoding == SuperShuckieScreenDataEncoding__R5G6B5;
+    GLenum format = rgb565 ? GL_RGB : GL_RGBA;
+    GLenum type = rgb565 ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE;
+
+    glBindTexture(GL_TEXTURE_2D, this->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, rgb565 ? 2 : 4);
+
+    if(this->texture_needs_allocation) {
+        glTexImage2D(GL_TEXTURE_2D, 0, format, this->width, this->height, 0, format, type, pixels);
+        this->texture_needs_allocation = false;
+    }
+    else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->width, this->height, format, type, pixels);
+    }
+}
+
+void GLRenderSurface::initializeGL() {
+    initializeOpenGLFunctions();
+
+    connect(this->context(), &QOpenGLContext::aboutToBeDestroyed, this, &GLRenderSurface::cleanup_gl);
+
+    auto *program = new QOpenGLShaderProgram(this);
+    if(
+        !program->addShaderFromSourceCode(QOpenGLShader::Vertex, VERTEX_SHADER) ||
+        !program->addShaderFromSourceCode(QOpenGLShader::Fragment, FRAGMENT_SHADER) ||
+        !program->link()
+    ) {
+        auto log = program->log().toStdString();
+        delete program;
+        this->failed = true;
+        this->render_widget->on_gpu_rendering_failed(log.c_str());
+        return;
+    }
+
+    this->program = program;
+
+    glGenTextures(1, &this->texture);
+    glBindTexture(GL_TEXTURE_2D, this->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    this->texture_needs_allocation = true;
+
+    if(!this->pending_frame.empty()) {
+        this->upload_frame(this->pending_frame.data());
+        this->pending_frame = {};
+    }
+}
+
+void GLRenderSurface::paintGL() {
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if(this->program == nullptr || this->texture_needs_allocation) {
+        return;
+    }
+
+    this->program->bind();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, this->texture);
+    this->program->setUniformValue("frame", 0);
+    this->program->setUniformValue("swap_red_blue", this->encoding != SuperShuckieScreenDataEncoding__R5G6B5);
+
+    int position = this->program->attributeLocation("position");
+    int tex_coord = this->program->attributeLocation("tex_coord_in");
+    this->program->enableAttributeArray(position);
+    this->program->enableAttributeArray(tex_coord);
+    this->program->setAttributeArray(position, QUAD_POSITIONS, 2);
+    this->program->setAttributeArray(tex_coord, QUAD_TEX_COORDS, 2);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    this->program->disableAttributeArray(position);
+    this->program->disableAttributeArray(tex_coord);
+    this->program->release();
+}
+
+void GLRenderSurface::cleanup_gl() {
+    if(this->program == nullptr) {
+        return;
+    }
+
+    this->makeCurrent();
+    glDeleteTextures(1, &this->texture);
+    this->texture = 0;
+    delete this->program;
+    this->program = nullptr;
+    this->texture_needs_allocation = true;
+    this->doneCurrent();
+}
@@ -0,0 +1,52 @@
+#ifndef __SUPERSHUCKIE_GL_RENDER_SURFACE_HPP__
+#define __SUPERSHUCKIE_GL_RENDER_SURFACE_HPP__
+
+#include <QOpenGLWidget>
+#include <QOpenGLFunctions>
+#include <vector>
+#include <cstdint>
+
+#include "render_widget.hpp"
+
+class QOpenGLShaderProgram;
+
+namespace SuperShuckie64 {
+
+/**
+ * Uploads frames straight into a persistent texture and lets the GPU do the scaling.
+ */
+class GLRenderSurface: public QOpenGLWidget, protected QOpenGLFunctions, public GameRenderSurface {
+public:
+    GLRenderSurface(GameRenderWidget *parent);
+    ~GLRenderSurface() override;
+
+    QWidget *as_widget() override { return this; }
+    void set_dimensions(unsigned width, unsigned height, unsigned scale, std::uint32_t encoding) override;
+    void refresh_screen(const std::uint32_t *pixels) override;
+
+protected:
+    void initializeGL() override;
+    void paintGL() override;
+
+private:
+    GameRenderWidget *render_widget;
+
+    unsigned width = 1;
+    unsigned height = 1;
+    std::uint32_t encoding = 0;
+
+    QOpenGLShaderProgram *program = nullptr;
+    GLuint texture = 0;
+    bool texture_needs_allocation = true;
+    bool failed = false;
+
+    // Only used if a frame comes in before the GL context exists
+    std::vector<std::uint32_t> pending_frame;
+
+    void upload_frame(const std::uint32_t *pixels);
+    void cleanup_gl();
+};
+
+}
+
+#endif
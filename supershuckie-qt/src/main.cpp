@@ -11,6 +11,8 @@
 #include "theme.hpp"
 
 int main(int argc, char **argv) {
+    // SDL_INIT_VIDEO is only here so SDL inhibits the screensaver; SDLEventWrapper::start_event_thread shuts it down
+    // while events are pumped off of the main thread.
     SDL_Init(SDL_INIT_EVENTS | SDL_INIT_GAMEPAD | SDL_INIT_VIDEO);
 
     QCoreApplication::setOrganizationName("SnowyMouse");
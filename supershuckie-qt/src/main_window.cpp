@@ -13,6 +13,9 @@
 #include <QStandardPaths>
 #include <QDesktopServices>
 #include <QGridLayout>
+#include <QScreen>
+#include <QDateTime>
+#include <QImage>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -30,6 +33,8 @@
 #include "main_window.hpp"
 #include "controller_settings_window.hpp"
 #include "replay_playback_controls.hpp"
+#include "perf_stats_window.hpp"
+#include "pokeabyte_settings_dialog.hpp"
 
 using namespace SuperShuckie64;
 
@@ -37,6 +42,8 @@ static const char *USE_NUMBER_KEYS_FOR_QUICK_SLOTS = "qt__number_keys_for_quick_
 static const char *WINDOW_XY = "qt__window_xy";
 static const char *DISPLAY_STATUS_BAR = "qt__display_status_bar";
 static const char *KEYBOARD_REPLAY_CONTROLS_DISABLED = "qt__replay_controls_disabled";
+static const char *GPU_RENDERING_DISABLED = "qt__gpu_rendering_disabled";
+static const char *WAIT_FOR_FRAMES = "qt__wait_for_frames";
 
 class SuperShuckie64::SuperShuckieTimestamp: public QWidget {
 public:
@@ -147,12 +154,18 @@ MainWindow::MainWindow(): QMainWindow() {
     this->ticker.callOnTimeout(this, &MainWindow::tick);
     this->ticker.start();
 
+    this->present_timer.setSingleShot(true);
+    this->present_timer.setTimerType(Qt::PreciseTimer);
+    this->present_timer.callOnTimeout(this, &MainWindow::tick);
+
     this->set_up_menu();
 
     SuperShuckieFrontendCallbacks callbacks = {};
     callbacks.user_data = this;
     callbacks.refresh_screens = MainWindow::on_refresh_screens;
     callbacks.change_video_mode = MainWindow::on_change_video_mode;
+    callbacks.file_written = MainWindow::on_file_written;
+    callbacks.rom_loaded = MainWindow::on_rom_loaded;
 
     #ifdef __APPLE__
     this->app_dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
@@ -191,6 +204,20 @@ MainWindow::MainWindow(): QMainWindow() {
         this->keyboard_replay_controls->setChecked(false);
     }
 
+    const char *gpu_rendering_disabled = supershuckie_frontend_get_custom_setting(this->frontend, GPU_RENDERING_DISABLED);
+    bool gpu_rendering = gpu_rendering_disabled == nullptr || gpu_rendering_disabled[0] != '1';
+    this->gpu_rendering->setChecked(gpu_rendering);
+    this->render_widget->set_gpu_rendering(gpu_rendering);
+
+    const char *wait_for_frames = supershuckie_frontend_get_custom_setting(this->frontend, WAIT_FOR_FRAMES);
+    if(wait_for_frames != nullptr && wait_for_frames[0] == '1') {
+        this->wait_for_frames_action->setChecked(true);
+        this->set_wait_for_frames(true);
+    }
+
+    this->precise_frame_pacing->setChecked(supershuckie_frontend_get_precise_frame_pacing(this->frontend));
+    supershuckie_frontend_set_display_refresh_rate(this->frontend, this->display_refresh_rate());
+
     const char *xy = supershuckie_frontend_get_custom_setting(this->frontend, WINDOW_XY);
     if(xy != nullptr) {
         int x;
@@ -207,6 +234,7 @@ MainWindow::MainWindow(): QMainWindow() {
     this->auto_stop_replay_on_input->setChecked(supershuckie_frontend_get_auto_stop_playback_on_input_setting(this->frontend));
     this->auto_unpause_on_input->setChecked(supershuckie_frontend_get_auto_unpause_on_input_setting(this->frontend));
     this->auto_pause_on_record->setChecked(supershuckie_frontend_get_auto_pause_on_record_setting(this->frontend));
+    this->deduplicate_save_states->setChecked(supershuckie_frontend_get_deduplicate_save_states_setting(this->frontend));
     this->sgb_enabled->setChecked(supershuckie_frontend_is_sgb_enabled(this->frontend));
 
     this->sdl.frontend = this->frontend;
@@ -240,7 +268,7 @@ void MainWindow::refresh_title() {
     this->setWindowTitle(fmt);
 }
 
-void MainWindow::tick() {
+bool MainWindow::handle_sdl_events() {
     while(true) {
         auto sdl_event = this->sdl.next();
         switch(sdl_event.discriminator) {
@@ -254,7 +282,7 @@ void MainWindow::tick() {
                     break;
                 }
                 else {
-                    return;
+                    return false;
                 }
             case SDLEventWrapperAction::SDLEventWrapper_Axis:
                 supershuckie_frontend_axis(this->frontend, sdl_event.axis.controller->mapping, sdl_event.axis.axis, sdl_event.axis.value);
@@ -269,8 +297,16 @@ void MainWindow::tick() {
         this->set_title(i.c_str());
     }
     this->sdl.events_to_print.clear();
+    return true;
+}
+
+void MainWindow::tick() {
+    if(!this->handle_sdl_events()) {
+        return;
+    }
 
     auto now = clock::now();
+    this->last_present = now;
     auto time_since_last_second_us = std::chrono::duration_cast<std::chrono::microseconds>(now - this->second_start).count();
     if(time_since_last_second_us > 1000000) {
         this->current_fps = 1000000.0 * static_cast<double>(this->frames_in_last_second) / static_cast<double>(time_since_last_second_us);
@@ -419,12 +455,15 @@ void MainWindow::set_up_save_states_menu() {
         std::snprintf(fmt, sizeof(fmt), "Save quick slot #%zu", i);
         auto *quick_save = new NumberedAction(this, fmt, i, &MainWindow::quick_save);
 
+        this->quick_slot_menus[i - 1] = menu;
         this->quick_load_save_states[i - 1] = quick_load;
         menu->addAction(quick_load);
         this->quick_save_save_states[i - 1] = quick_save;
         menu->addAction(quick_save);
     }
 
+    connect(quick_slots, &QMenu::aboutToShow, this, &MainWindow::refresh_quick_slot_info);
+
     quick_slots->addSeparator();
     
     this->use_number_row_for_quick_slots = quick_slots->addAction("Use number row instead of function keys");
@@ -441,6 +480,12 @@ void MainWindow::set_up_save_states_menu() {
     this->redo_load_save_state->setShortcut(QKeyCombination(Qt::ControlModifier | Qt::ShiftModifier, Qt::Key_U));
     connect(this->redo_load_save_state, SIGNAL(triggered()), this, SLOT(do_redo_load_save_state()));
 
+    this->save_states_menu->addSeparator();
+
+    this->deduplicate_save_states = this->save_states_menu->addAction("Deduplicate save states");
+    this->deduplicate_save_states->setCheckable(true);
+    connect(this->deduplicate_save_states, SIGNAL(triggered()), this, SLOT(do_toggle_deduplicate_save_states()));
+
     this->set_quick_load_shortcuts();
 }
 
@@ -490,12 +535,18 @@ void MainWindow::set_video_scale(std::uint8_t scale) {
     supershuckie_frontend_set_video_scale(this->frontend, scale);
 }
 
+void MainWindow::set_video_scaler(std::uint8_t scaler) {
+    supershuckie_frontend_set_video_scaler(this->frontend, scaler);
+    this->refresh_action_states();
+}
+
 void MainWindow::make_save_state(const char *state) {
     char error[256];
     auto success = supershuckie_frontend_create_save_state(this->frontend, state, error, sizeof(error));
     if(success) {
+        // on_file_written reports when it's actually written
         char title[512];
-        std::snprintf(title, sizeof(title), "Created state \"%s\"", error);
+        std::snprintf(title, sizeof(title), "Creating state \"%s\"...", error);
         this->set_title(title);
     }
     else {
@@ -527,6 +578,36 @@ void MainWindow::quick_save(std::uint8_t index) {
     this->make_save_state(fmt);
 }
 
+void MainWindow::refresh_quick_slot_info() {
+    // This comes from the library index, so it is cheap enough to do every time the menu is opened
+    for(std::size_t i = 0; i < MainWindow::QUICK_SAVE_STATE_COUNT; i++) {
+        char name[64];
+        std::snprintf(name, sizeof(name), "quick-%zu", i + 1);
+
+        SuperShuckieSaveStateInfo info = {};
+        std::uint16_t thumbnail[80 * 80];
+        bool exists = this->frontend != nullptr && supershuckie_frontend_get_save_state_info(
+            this->frontend, name, &info, thumbnail, sizeof(thumbnail) / sizeof(thumbnail[0])
+        );
+
+        QIcon icon;
+        if(exists && info.thumbnail_width > 0 && info.thumbnail_width * info.thumbnail_height <= sizeof(thumbnail) / sizeof(thumbnail[0])) {
+            QImage image(reinterpret_cast<const uchar *>(thumbnail), info.thumbnail_width, info.thumbnail_height, info.thumbnail_width * 2, QImage::Format::Format_RGB16);
+            icon = QIcon(QPixmap::fromImage(image));
+        }
+        this->quick_slot_menus[i]->setIcon(icon);
+
+        QString text = QString("Quick slot #%1").arg(i + 1);
+        if(info.created_unix_millis != 0) {
+            text += QDateTime::fromMSecsSinceEpoch(static_cast<qint64>(info.created_unix_millis)).toString(" (yyyy-MM-dd hh:mm:ss)");
+        }
+        else if(!exists && this->is_game_running()) {
+            text += " (empty)";
+        }
+        this->quick_slot_menus[i]->setTitle(text);
+    }
+}
+
 void MainWindow::quick_load(std::uint8_t index) {
     char fmt[16];
     std::snprintf(fmt, sizeof(fmt), "quick-%d", index);
@@ -553,6 +634,66 @@ void MainWindow::set_up_settings_menu() {
         action->setCheckable(true);
     }
 
+    video_scaling->addSeparator();
+    this->video_scaler[0] = new NumberedAction(this, "Scale while drawing", SuperShuckieVideoScaler::SuperShuckieVideoScaler__Frontend, &MainWindow::set_video_scaler);
+    this->video_scaler[1] = new NumberedAction(this, "Prescale (nearest)", SuperShuckieVideoScaler::SuperShuckieVideoScaler__Nearest, &MainWindow::set_video_scaler);
+    this->video_scaler[2] = new NumberedAction(this, "Prescale (Scale2x)", SuperShuckieVideoScaler::SuperShuckieVideoScaler__Scale2x, &MainWindow::set_video_scaler);
+
+    for(auto s : this->video_scaler) {
+        s->setCheckable(true);
+        video_scaling->addAction(s);
+    }
+
+    this->gpu_rendering = this->settings_menu->addAction("Use GPU rendering");
+    this->gpu_rendering->setCheckable(true);
+    connect(this->gpu_rendering, SIGNAL(triggered()), this, SLOT(do_toggle_gpu_rendering()));
+
+    this->rgb565_color = this->settings_menu->addAction("16-bit color (lower memory bandwidth)");
+    this->rgb565_color->setCheckable(true);
+    connect(this->rgb565_color, SIGNAL(triggered()), this, SLOT(do_toggle_rgb565_color()));
+
+    this->wait_for_frames_action = this->settings_menu->addAction("Wait for new frames (lower CPU usage)");
+    this->wait_for_frames_action->setCheckable(true);
+    connect(this->wait_for_frames_action, SIGNAL(triggered()), this, SLOT(do_toggle_wait_for_frames()));
+
+    this->precise_frame_pacing = this->settings_menu->addAction("Precise frame pacing (higher CPU usage)");
+    this->precise_frame_pacing->setCheckable(true);
+    connect(this->precise_frame_pacing, SIGNAL(triggered()), this, SLOT(do_toggle_precise_frame_pacing()));
+
+    auto *run_ahead_items = this->settings_menu->addMenu("Run-ahead (lower input lag, higher CPU usage)");
+    for(std::size_t i = 0; i <= SUPERSHUCKIE_MAX_RUN_AHEAD_FRAMES; i++) {
+        char fmt[256];
+        if(i == 0) {
+            std::snprintf(fmt, sizeof(fmt), "Disabled");
+        }
+        else {
+            std::snprintf(fmt, sizeof(fmt), "%zu frame%s", i, i == 1 ? "" : "s");
+        }
+
+        auto *action = new NumberedAction(this, fmt, static_cast<uint8_t>(i), &MainWindow::set_run_ahead_frames);
+        action->setCheckable(true);
+        run_ahead_items->addAction(action);
+        this->run_ahead[i] = action;
+    }
+
+    auto *sram_autosave_items = this->settings_menu->addMenu("Autosave SRAM");
+    const std::uint8_t sram_autosave_minutes[] = { 0, 1, 5, 10 };
+    for(std::size_t i = 0; i < sizeof(sram_autosave_minutes); i++) {
+        auto minutes = sram_autosave_minutes[i];
+        char fmt[256];
+        if(minutes == 0) {
+            std::snprintf(fmt, sizeof(fmt), "Disabled");
+        }
+        else {
+            std::snprintf(fmt, sizeof(fmt), "Every %u minute%s", minutes, minutes == 1 ? "" : "s");
+        }
+
+        auto *action = new NumberedAction(this, fmt, minutes, &MainWindow::set_sram_autosave_minutes);
+        action->setCheckable(true);
+        sram_autosave_items->addAction(action);
+        this->sram_autosave[i] = action;
+    }
+
     this->settings_menu->addSeparator();
 
     this->game_boy_settings = this->settings_menu->addMenu("Game Boy settings");
@@ -578,9 +719,15 @@ void MainWindow::set_up_settings_menu() {
     this->enable_pokeabyte_integration->setCheckable(true);
     connect(this->enable_pokeabyte_integration, SIGNAL(triggered()), this, SLOT(do_toggle_pokeabyte()));
 
+    auto *pokeabyte_settings = this->settings_menu->addAction("Poke-A-Byte settings...");
+    connect(pokeabyte_settings, SIGNAL(triggered()), this, SLOT(do_open_pokeabyte_settings_dialog()));
+
     this->show_status_bar = this->settings_menu->addAction("Show status bar");
     this->show_status_bar->setCheckable(true);
     connect(this->show_status_bar, SIGNAL(triggered()), this, SLOT(do_toggle_status_bar()));
+
+    auto *perf_stats = this->settings_menu->addAction("Performance stats...");
+    connect(perf_stats, SIGNAL(triggered()), this, SLOT(do_open_perf_stats_window()));
 }
 
 void MainWindow::refresh_action_states() {
@@ -619,6 +766,24 @@ void MainWindow::refresh_action_states() {
         i->setChecked(i->number == gbc_mode);
     }
 
+    auto run_ahead_frames = this->frontend != nullptr ? supershuckie_frontend_get_run_ahead_frames(this->frontend) : 0;
+    for(auto &i : this->run_ahead) {
+        i->setChecked(i->number == run_ahead_frames);
+    }
+
+    auto sram_autosave_interval = this->frontend != nullptr ? supershuckie_frontend_get_sram_autosave_interval(this->frontend) : 0;
+    for(auto &i : this->sram_autosave) {
+        i->setChecked(i->number * 60u == sram_autosave_interval);
+    }
+
+    auto video_scaler = this->frontend != nullptr ? supershuckie_frontend_get_video_scaler(this->frontend) : 0;
+    for(auto &i : this->video_scaler) {
+        i->setChecked(i->number == video_scaler);
+    }
+
+    auto video_encoding = this->frontend != nullptr ? supershuckie_frontend_get_video_encoding(this->frontend) : 0;
+    this->rgb565_color->setChecked(video_encoding == SuperShuckieScreenDataEncoding::SuperShuckieScreenDataEncoding__R5G6B5);
+
     switch(replay_state) {
         case SuperShuckieReplayState::SuperShuckieReplayState__Recording:
             this->play_replay->setEnabled(false);
@@ -672,6 +837,7 @@ void MainWindow::do_open_rom() {
 void MainWindow::load_rom(const std::filesystem::path &path) {
     char error[256] = "";
 
+    // on_rom_loaded reports when it's actually loaded
     auto path_string = path.string();
     if(!supershuckie_frontend_load_rom(this->frontend, path.string().c_str(), error, sizeof(error))) {
         DISPLAY_ERROR_DIALOG("Can't load ROM", "\"%s\" failed to load:\n\n%s", path_string.c_str(), error);
@@ -701,7 +867,7 @@ void MainWindow::do_new_game() noexcept {
 void MainWindow::do_save_game() {
     char err[256];
     if(supershuckie_frontend_save_sram(this->frontend, err, sizeof(err))) {
-        this->set_title("Saved SRAM successfully!");
+        this->set_title("Saving SRAM...");
     }
     else {
         DISPLAY_ERROR_DIALOG("Can't save SRAM", "%s", err);
@@ -764,6 +930,8 @@ void MainWindow::closeEvent(QCloseEvent *event) {
 }
 
 MainWindow::~MainWindow() {
+    this->sdl.stop_event_thread();
+
     if(this->frontend) {
         supershuckie_frontend_free(this->frontend);
         this->frontend = nullptr;
@@ -833,7 +1001,27 @@ void MainWindow::do_play_replay() {
     }
 
     auto replays = wrap_array_std(supershuckie_frontend_get_all_replays_for_rom(this->frontend, nullptr));
-    auto text = SelectItemDialog::ask(this, replays, "Select a replay", "Select a replay file to play.");
+
+    // This comes from the library index, so it doesn't read every replay
+    std::vector<std::string> details;
+    for(auto &replay : replays) {
+        SuperShuckieReplayInfo info = {};
+        char detail[128] = {};
+        if(supershuckie_frontend_get_replay_info(this->frontend, nullptr, replay.c_str(), &info)) {
+            auto seconds = info.total_milliseconds / 1000;
+            std::snprintf(
+                detail, sizeof(detail), "%llu:%02llu:%02llu, %zu bookmark%s",
+                static_cast<unsigned long long>(seconds / 3600),
+                static_cast<unsigned long long>(seconds / 60 % 60),
+                static_cast<unsigned long long>(seconds % 60),
+                info.bookmark_count,
+                info.bookmark_count == 1 ? "" : "s"
+            );
+        }
+        details.emplace_back(detail);
+    }
+
+    auto text = SelectItemDialog::ask(this, replays, "Select a replay", "Select a replay file to play.", "", details);
     if(text == std::nullopt) {
         return;
     }
@@ -873,7 +1061,7 @@ void MainWindow::on_change_video_mode(void *user_data, std::size_t screen_count,
     auto *self = reinterpret_cast<MainWindow *>(user_data);
     
     const SuperShuckieScreenData &first_screen = screen_data[0];
-    self->render_widget->set_dimensions(first_screen.width, first_screen.height, video_scale);
+    self->render_widget->set_dimensions(first_screen.width, first_screen.height, video_scale, first_screen.encoding);
     self->frames_in_last_second = 0;
     self->current_fps = 0.0;
     self->second_start = clock::now();
@@ -884,13 +1072,63 @@ void MainWindow::on_change_video_mode(void *user_data, std::size_t screen_count,
         self->set_title();
     }
 
+    // If the screens are prescaled, video_scale is 1 regardless of the setting
+    auto scale_setting = self->frontend != nullptr ? supershuckie_frontend_get_video_scale(self->frontend) : video_scale;
     for(auto &scale : self->change_video_scale) {
-        scale->setChecked(scale->number == video_scale);
+        scale->setChecked(scale->number == scale_setting);
     }
 
     self->refresh_action_states();
 }
 
+void MainWindow::on_file_written(void *user_data, std::uint32_t kind, const char *name, bool automatic, const char *error) {
+    auto *self = reinterpret_cast<MainWindow *>(user_data);
+    bool sram = kind == SuperShuckieFileWriteKind::SuperShuckieFileWriteKind__SRAM;
+
+    if(error == nullptr) {
+        char title[512];
+        if(sram) {
+            std::snprintf(title, sizeof(title), "Saved SRAM successfully!");
+        }
+        else {
+            std::snprintf(title, sizeof(title), "Created state \"%s\"", name);
+        }
+        self->set_title(title);
+    }
+    else if(automatic) {
+        // Don't pop up a dialog every time the autosave comes around
+        char title[512];
+        std::snprintf(title, sizeof(title), "Failed to autosave SRAM: %s", error);
+        self->set_title(title);
+    }
+    else {
+        // Defer so the dialog's event loop does not tick the frontend from within this callback
+        std::string message = error;
+        QMetaObject::invokeMethod(self, [sram, message]() {
+            if(sram) {
+                DISPLAY_ERROR_DIALOG("Can't save SRAM", "%s", message.c_str());
+            }
+            else {
+                DISPLAY_ERROR_DIALOG("Failed to create save state", "%s", message.c_str());
+            }
+        }, Qt::QueuedConnection);
+    }
+}
+
+void MainWindow::on_rom_loaded(void *user_data, const char *path, const char *error) {
+    auto *self = reinterpret_cast<MainWindow *>(user_data);
+    if(error == nullptr) {
+        return;
+    }
+
+    // Defer so the dialog's event loop does not tick the frontend from within this callback
+    std::string path_string = path;
+    std::string message = error;
+    QMetaObject::invokeMethod(self, [path_string, message]() {
+        DISPLAY_ERROR_DIALOG("Can't load ROM", "\"%s\" failed to load:\n\n%s", path_string.c_str(), message.c_str());
+    }, Qt::QueuedConnection);
+}
+
 bool MainWindow::is_game_running() {
     return this->frontend != nullptr && supershuckie_frontend_is_game_running(this->frontend);
 }
@@ -903,6 +1141,25 @@ void MainWindow::do_open_game_speed_dialog() noexcept {
     delete dialog;
 }
 
+void MainWindow::do_open_pokeabyte_settings_dialog() noexcept {
+    PokeAByteSettingsDialog *dialog = new PokeAByteSettingsDialog(this);
+
+    dialog->exec();
+
+    delete dialog;
+}
+
+void MainWindow::do_open_perf_stats_window() {
+    // Not modal, so it can be left open while playing.
+    if(this->perf_stats_window == nullptr) {
+        this->perf_stats_window = new PerfStatsWindow(this);
+    }
+
+    this->perf_stats_window->show();
+    this->perf_stats_window->raise();
+    this->perf_stats_window->activateWindow();
+}
+
 void MainWindow::do_undo_load_save_state() {
     if(supershuckie_frontend_undo_load_save_state(this->frontend)) {
         this->set_title("Undo load save state successful");
@@ -973,6 +1230,10 @@ void MainWindow::do_toggle_auto_unpause_on_input() {
     supershuckie_frontend_set_auto_unpause_on_input_setting(this->frontend, this->auto_unpause_on_input->isChecked());
 }
 
+void MainWindow::do_toggle_deduplicate_save_states() {
+    supershuckie_frontend_set_deduplicate_save_states_setting(this->frontend, this->deduplicate_save_states->isChecked());
+}
+
 void MainWindow::do_toggle_auto_pause_on_record() {
     supershuckie_frontend_set_auto_pause_on_record_setting(this->frontend, this->auto_pause_on_record->isChecked());
 }
@@ -989,10 +1250,116 @@ void MainWindow::do_toggle_replay_keyboard_controls() {
     supershuckie_frontend_set_custom_setting(this->frontend, KEYBOARD_REPLAY_CONTROLS_DISABLED, !this->keyboard_replay_controls->isChecked() ? "1" : "0");
 }
 
+void MainWindow::do_toggle_gpu_rendering() {
+    bool enabled = this->gpu_rendering->isChecked();
+    supershuckie_frontend_set_custom_setting(this->frontend, GPU_RENDERING_DISABLED, !enabled ? "1" : "0");
+    this->render_widget->set_gpu_rendering(enabled);
+}
+
+void MainWindow::do_toggle_wait_for_frames() {
+    bool enabled = this->wait_for_frames_action->isChecked();
+    supershuckie_frontend_set_custom_setting(this->frontend, WAIT_FOR_FRAMES, enabled ? "1" : "0");
+    this->set_wait_for_frames(enabled);
+}
+
+void MainWindow::do_toggle_precise_frame_pacing() {
+    supershuckie_frontend_set_precise_frame_pacing(this->frontend, this->precise_frame_pacing->isChecked());
+}
+
+void MainWindow::do_toggle_rgb565_color() {
+    auto encoding = this->rgb565_color->isChecked() ?
+        SuperShuckieScreenDataEncoding::SuperShuckieScreenDataEncoding__R5G6B5 : SuperShuckieScreenDataEncoding::SuperShuckieScreenDataEncoding__A8R8G8B8;
+    supershuckie_frontend_set_video_encoding(this->frontend, encoding);
+}
+
+double MainWindow::display_refresh_rate() {
+    auto *screen = this->screen();
+    double refresh_rate = screen != nullptr ? screen->refreshRate() : 0.0;
+    if(refresh_rate <= 0.0) {
+        refresh_rate = 60.0;
+    }
+    return refresh_rate;
+}
+
+MainWindow::clock::duration MainWindow::display_frame_interval() {
+    return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / this->display_refresh_rate()));
+}
+
+void MainWindow::set_wait_for_frames(bool enabled) {
+    this->wait_for_frames = enabled;
+
+    if(enabled) {
+        // Frames and SDL events are handled as they come in, so the ticker only has to keep the status bar up-to-date.
+        this->ticker.setInterval(100);
+
+        supershuckie_frontend_set_frame_ready_callback(this->frontend, MainWindow::on_frame_ready, this);
+        this->sdl.start_event_thread([this]() {
+            if(!this->sdl_events_pending.exchange(true)) {
+                QMetaObject::invokeMethod(this, &MainWindow::handle_pending_sdl_events, Qt::QueuedConnection);
+            }
+        });
+    }
+    else {
+        supershuckie_frontend_set_frame_ready_callback(this->frontend, nullptr, nullptr);
+        this->sdl.stop_event_thread();
+        this->present_timer.stop();
+        this->ticker.setInterval(1);
+    }
+}
+
+void MainWindow::on_frame_ready(void *user_data) {
+    auto *self = reinterpret_cast<MainWindow *>(user_data);
+
+    // Called from the core thread; just make sure a present is queued on the UI thread
+    if(!self->frame_pending.exchange(true)) {
+        QMetaObject::invokeMethod(self, &MainWindow::present_frame, Qt::QueuedConnection);
+    }
+}
+
+void MainWindow::present_frame() {
+    this->frame_pending = false;
+
+    if(!this->wait_for_frames || this->timer_stack > 0 || this->present_timer.isActive()) {
+        return;
+    }
+
+    // Present at most once per display refresh; anything faster than that can't be seen anyway.
+    auto interval = this->display_frame_interval();
+    auto since_last_present = clock::now() - this->last_present;
+    if(since_last_present < interval) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(interval - since_last_present);
+        this->present_timer.start(remaining);
+        return;
+    }
+
+    this->tick();
+}
+
+void MainWindow::handle_pending_sdl_events() {
+    this->sdl_events_pending = false;
+
+    // The controls settings dialog reads SDL events itself while it's open
+    if(this->timer_stack > 0) {
+        return;
+    }
+
+    this->handle_sdl_events();
+}
+
 void MainWindow::do_toggle_sgb() {
     supershuckie_frontend_set_sgb_enabled(this->frontend, this->sgb_enabled->isChecked());
 }
 
+void MainWindow::set_sram_autosave_minutes(std::uint8_t minutes) {
+    supershuckie_frontend_set_sram_autosave_interval(this->frontend, minutes * 60u);
+    this->refresh_action_states();
+}
+
+void MainWindow::set_run_ahead_frames(std::uint8_t frames) {
+    supershuckie_frontend_set_run_ahead_frames(this->frontend, frames);
+    this->refresh_action_states();
+}
+
 void MainWindow::set_gbc_mode(std::uint8_t mode) {
     supershuckie_frontend_set_gbc_mode(this->frontend, mode);
     this->refresh_action_states();
@@ -6,6 +6,7 @@
 #include <filesystem>
 #include <memory>
 #include <chrono>
+#include <atomic>
 #include <supershuckie/supershuckie.h>
 #include "sdl_event_wrapper.hpp"
 
@@ -24,6 +25,8 @@ class AskForTextDialog;
 class SelectItemDialog;
 class ControlsSettingsWindow;
 class ReplayPlaybackControls;
+class PerfStatsWindow;
+class PokeAByteSettingsDialog;
 
 std::vector<std::string> wrap_array_std(SuperShuckieStringArrayRaw *array);
 
@@ -42,6 +45,8 @@ class MainWindow: public QMainWindow {
     friend SelectItemDialog;
     friend ControlsSettingsWindow;
     friend ReplayPlaybackControls;
+    friend PerfStatsWindow;
+    friend PokeAByteSettingsDialog;
     
 public:
     MainWindow();
@@ -59,6 +64,21 @@ private:
     QTimer ticker;
 
     void tick();
+    bool handle_sdl_events();
+
+    // Used when waiting for frames rather than polling
+    bool wait_for_frames = false;
+    QTimer present_timer;
+    std::atomic<bool> frame_pending = false;
+    std::atomic<bool> sdl_events_pending = false;
+    clock::time_point last_present;
+
+    void set_wait_for_frames(bool enabled);
+    void present_frame();
+    void handle_pending_sdl_events();
+    double display_refresh_rate();
+    clock::duration display_frame_interval();
+    static void on_frame_ready(void *user_data);
 
     void set_up_menu();
     QMenuBar *menu_bar;
@@ -72,6 +92,7 @@ private:
     QMenu *quick_slots;
     QAction *undo_load_save_state;
     QAction *redo_load_save_state;
+    QAction *deduplicate_save_states;
 
     QStatusBar *status_bar;
     QLabel *status_bar_fps;
@@ -105,21 +126,30 @@ private:
     QLabel *paused_state;
 
     ReplayPlaybackControls *playback_bar;
+    PerfStatsWindow *perf_stats_window = nullptr;
 
     QAction *use_number_row_for_quick_slots;
     QAction *show_status_bar;
+    QAction *gpu_rendering;
+    QAction *rgb565_color;
+    QAction *wait_for_frames_action;
+    QAction *precise_frame_pacing;
     QAction *enable_pokeabyte_integration;
 
     SuperShuckieReplayState last_known_replay_state = SuperShuckieReplayState::SuperShuckieReplayState__NoReplay;
 
     static const std::size_t QUICK_SAVE_STATE_COUNT = 9;
 
+    QMenu *quick_slot_menus[QUICK_SAVE_STATE_COUNT];
     QAction *quick_load_save_states[QUICK_SAVE_STATE_COUNT];
     QAction *quick_save_save_states[QUICK_SAVE_STATE_COUNT];
 
     static const std::size_t VIDEO_SCALE_COUNT = 12;
 
     NumberedAction *change_video_scale[VIDEO_SCALE_COUNT];
+    NumberedAction *video_scaler[3];
+    NumberedAction *run_ahead[SUPERSHUCKIE_MAX_RUN_AHEAD_FRAMES + 1];
+    NumberedAction *sram_autosave[4];
 
     bool use_number_keys_for_quick_slots = false;
 
@@ -134,6 +164,7 @@ private:
 
     void refresh_action_states();
     void set_quick_load_shortcuts();
+    void refresh_quick_slot_info();
 
     void quick_save(std::uint8_t index);
     void quick_load(std::uint8_t index);
@@ -143,6 +174,9 @@ private:
     void load_save_state(const char *state);
 
     void set_video_scale(std::uint8_t scale);
+    void set_video_scaler(std::uint8_t scaler);
+    void set_run_ahead_frames(std::uint8_t frames);
+    void set_sram_autosave_minutes(std::uint8_t minutes);
 
     void closeEvent(QCloseEvent *event) override;
 
@@ -152,6 +186,8 @@ private:
 
     static void on_refresh_screens(void *user_data, std::size_t screen_count, const uint32_t *const *pixels);
     static void on_change_video_mode(void *user_data, std::size_t screen_count, const SuperShuckieScreenData *screen_data, std::uint8_t scaling);
+    static void on_file_written(void *user_data, std::uint32_t kind, const char *name, bool automatic, const char *error);
+    static void on_rom_loaded(void *user_data, const char *path, const char *error);
 
     std::uint32_t frames_in_last_second = 0;
     double current_fps = 0.0;
@@ -183,8 +219,10 @@ private slots:
     void do_open_game_speed_dialog() noexcept;
     void do_undo_load_save_state();
     void do_redo_load_save_state();
+    void do_toggle_deduplicate_save_states();
     void do_toggle_status_bar();
     void do_toggle_pokeabyte();
+    void do_open_pokeabyte_settings_dialog() noexcept;
     void do_toggle_stop_replay_on_input();
     void do_open_controls_settings_dialog() noexcept;
     void do_toggle_auto_unpause_on_input();
@@ -193,6 +231,11 @@ private slots:
     void do_change_playback_time(int frames);
     void do_toggle_replay_keyboard_controls();
     void do_toggle_sgb();
+    void do_toggle_gpu_rendering();
+    void do_toggle_wait_for_frames();
+    void do_open_perf_stats_window();
+    void do_toggle_precise_frame_pacing();
+    void do_toggle_rgb565_color();
 };
 
 class NumberedAction: public QAction {
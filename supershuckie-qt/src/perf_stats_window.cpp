@@ -0,0 +1,112 @@
+#include "perf_stats_window.hpp"
+#include "main_window.hpp"
+
+#include <cstdio>
+#include <QGridLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QFontDatabase>
+
+using namespace SuperShuckie64;
+
+static const char *ROW_NAMES[] = {
+    "Emulation",
+    "Frame pacing",
+    "Screen swap",
+    "Poke-A-Byte read",
+    "Keyframe creation",
+    "Decompression stall",
+    "Recorder queue depth",
+    "Recorder queue stall"
+};
+
+static const char *COLUMN_NAMES[] = { "Samples", "Mean", "p50", "p99", "Max" };
+
+// Everything but the queue depth is a timing in microseconds.
+static void format_value(char *buf, std::size_t len, std::uint64_t value, bool is_time) {
+    if(!is_time) {
+        std::snprintf(buf, len, "%llu", static_cast<unsigned long long>(value));
+    }
+    else if(value >= 10000) {
+        std::snprintf(buf, len, "%.1f ms", static_cast<double>(value) / 1000.0);
+    }
+    else {
+        std::snprintf(buf, len, "%llu µs", static_cast<unsigned long long>(value));
+    }
+}
+
+PerfStatsWindow::PerfStatsWindow(MainWindow *parent): QDialog(parent), parent(parent) {
+    this->setWindowTitle("Performance stats");
+
+    QGridLayout *layout = new QGridLayout(this);
+    auto fixed_font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+
+    for(int column = 0; column < COLUMN_COUNT; column++) {
+        layout->addWidget(new QLabel(COLUMN_NAMES[column], this), 0, column + 1, Qt::AlignRight);
+    }
+
+    for(int row = 0; row < ROW_COUNT; row++) {
+        layout->addWidget(new QLabel(ROW_NAMES[row], this), row + 1, 0, Qt::AlignLeft);
+        for(int column = 0; column < COLUMN_COUNT; column++) {
+            auto *cell = new QLabel("-", this);
+            cell->setFont(fixed_font);
+            cell->setMinimumWidth(cell->fontMetrics().horizontalAdvance("9999.9 ms"));
+            cell->setAlignment(Qt::AlignRight);
+            layout->addWidget(cell, row + 1, column + 1);
+            this->cells[row][column] = cell;
+        }
+    }
+
+    auto *reset = new QPushButton("Reset", this);
+    connect(reset, SIGNAL(clicked()), this, SLOT(do_reset()));
+    layout->addWidget(reset, ROW_COUNT + 1, 0, 1, COLUMN_COUNT + 1);
+
+    this->ticker.setInterval(500);
+    connect(&this->ticker, SIGNAL(timeout()), this, SLOT(do_refresh()));
+}
+
+void PerfStatsWindow::showEvent(QShowEvent *event) {
+    this->do_refresh();
+    this->ticker.start();
+    QDialog::showEvent(event);
+}
+
+void PerfStatsWindow::hideEvent(QHideEvent *event) {
+    this->ticker.stop();
+    QDialog::hideEvent(event);
+}
+
+void PerfStatsWindow::do_refresh() {
+    SuperShuckiePerfStats stats = {};
+    supershuckie_frontend_get_perf_stats(this->parent->frontend, &stats);
+
+    const SuperShuckiePerfTiming *rows[ROW_COUNT] = {
+        &stats.emulation,
+        &stats.frame_pacing,
+        &stats.screen_swap,
+        &stats.pokeabyte_read,
+        &stats.keyframe_creation,
+        &stats.decompression_stall,
+        &stats.recorder_queue_depth,
+        &stats.recorder_queue_stall
+    };
+
+    for(int row = 0; row < ROW_COUNT; row++) {
+        const auto &timing = *rows[row];
+        bool is_time = rows[row] != &stats.recorder_queue_depth;
+        std::uint64_t values[COLUMN_COUNT] = { timing.count, timing.mean, timing.p50, timing.p99, timing.max };
+
+        for(int column = 0; column < COLUMN_COUNT; column++) {
+            char text[64] = "-";
+            if(timing.count > 0) {
+                format_value(text, sizeof(text), values[column], is_time && column > 0);
+            }
+            this->cells[row][column]->setText(text);
+        }
+    }
+}
+
+void PerfStatsWindow::do_reset() {
+    supershuckie_frontend_reset_perf_stats(this->parent->frontend);
+    this->do_refresh();
+}
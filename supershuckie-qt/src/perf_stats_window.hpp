@@ -0,0 +1,37 @@
+#ifndef __SUPERSHUCKIE_PERF_STATS_WINDOW_HPP__
+#define __SUPERSHUCKIE_PERF_STATS_WINDOW_HPP__
+
+#include <QDialog>
+#include <QTimer>
+
+class QLabel;
+
+namespace SuperShuckie64 {
+
+class MainWindow;
+
+class PerfStatsWindow: public QDialog {
+    Q_OBJECT
+
+public:
+    PerfStatsWindow(MainWindow *parent);
+
+private:
+    static const int ROW_COUNT = 8;
+    static const int COLUMN_COUNT = 5;
+
+    MainWindow *parent;
+    QTimer ticker;
+    QLabel *cells[ROW_COUNT][COLUMN_COUNT];
+
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private slots:
+    void do_refresh();
+    void do_reset();
+};
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include "pokeabyte_settings_dialog.hpp"
+#include "main_window.hpp"
+#include "error.hpp"
+
+#include <QGridLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QSpinBox>
+#include <QPushButton>
+
+using namespace SuperShuckie64;
+
+PokeAByteSettingsDialog::PokeAByteSettingsDialog(MainWindow *parent): QDialog(parent), parent(parent) {
+    this->setWindowTitle("Poke-A-Byte settings");
+
+    uint16_t port = 0;
+    char name[256];
+    supershuckie_frontend_get_pokeabyte_settings(parent->frontend, &port, name, sizeof(name));
+
+    QGridLayout *layout = new QGridLayout(this);
+
+    layout->addWidget(new QLabel("Port", this), 0, 0, Qt::AlignLeft);
+    layout->addWidget(new QLabel("Shared memory name", this), 1, 0, Qt::AlignLeft);
+
+    this->port = new QSpinBox(this);
+    this->port->setMinimum(1);
+    this->port->setMaximum(65535);
+    this->port->setValue(port);
+
+    this->shared_memory_name = new QLineEdit(name, this);
+    this->shared_memory_name->setMaxLength(sizeof(name) - 1);
+
+    layout->addWidget(this->port, 0, 1, Qt::AlignLeft);
+    layout->addWidget(this->shared_memory_name, 1, 1);
+
+    QLabel *note = new QLabel("Note: To use Poke-A-Byte with more than one instance at once, give each instance\nits own port and shared memory name.", this);
+    note->setAttribute(Qt::WA_MacSmallSize);
+    layout->addWidget(note, 10, 0, 1, 2, Qt::AlignLeft);
+
+    auto *save = new QPushButton("OK", this);
+    connect(save, SIGNAL(clicked()), this, SLOT(accept()));
+    layout->addWidget(save, 11, 0, 1, 2);
+    this->setFixedSize(this->sizeHint());
+}
+
+void PokeAByteSettingsDialog::accept() {
+    char err[256];
+
+    QByteArray name = this->shared_memory_name->text().toUtf8();
+    if(!supershuckie_frontend_set_pokeabyte_settings(this->parent->frontend, this->port->value(), name.constData(), err, sizeof(err))) {
+        DISPLAY_ERROR_DIALOG("Failed to restart Poke-A-Byte integration", "An error occurred when restarting Poke-A-Byte integration:\n\n%s", err);
+        this->parent->enable_pokeabyte_integration->setChecked(false);
+    }
+    QDialog::accept();
+}
+
+int PokeAByteSettingsDialog::exec() {
+    this->parent->stop_timer();
+    int return_value = QDialog::exec();
+    this->parent->start_timer();
+    return return_value;
+}
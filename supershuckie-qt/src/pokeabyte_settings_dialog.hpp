@@ -0,0 +1,31 @@
+#ifndef __SUPERSHUCKIE_POKEABYTE_SETTINGS_DIALOG_HPP__
+#define __SUPERSHUCKIE_POKEABYTE_SETTINGS_DIALOG_HPP__
+
+#include <QDialog>
+
+class QSpinBox;
+class QLineEdit;
+
+namespace SuperShuckie64 {
+
+class MainWindow;
+
+class PokeAByteSettingsDialog: public QDialog {
+    Q_OBJECT
+    friend MainWindow;
+
+public:
+    PokeAByteSettingsDialog(MainWindow *parent);
+    int exec() override;
+
+private:
+    MainWindow *parent;
+    QSpinBox *port;
+    QLineEdit *shared_memory_name;
+
+    void accept() override;
+};
+
+}
+
+#endif
@@ -1,27 +1,28 @@
 #include "render_widget.hpp"
+#include "gl_render_surface.hpp"
 #include "main_window.hpp"
+#include <cstdio>
 #include <QGraphicsPixmapItem>
+#include <QGridLayout>
 #include <QKeyEvent>
 #include <QMimeData>
 
 using namespace SuperShuckie64;
 
-GameRenderWidget::GameRenderWidget(MainWindow *window, QWidget *parent): QGraphicsView(parent), main_window(window) {
+GraphicsViewRenderSurface::GraphicsViewRenderSurface(QWidget *parent): QGraphicsView(parent) {
     this->setFrameStyle(0);
     this->setHorizontalScrollBarPolicy(Qt::ScrollBarPolicy::ScrollBarAlwaysOff);
     this->setVerticalScrollBarPolicy(Qt::ScrollBarPolicy::ScrollBarAlwaysOff);
     this->setSizePolicy(QSizePolicy::Policy::Fixed, QSizePolicy::Policy::Fixed);
-    this->setFocusPolicy(Qt::ClickFocus);
+    this->setFocusPolicy(Qt::NoFocus);
+    this->setAcceptDrops(false);
+    this->viewport()->setAcceptDrops(false);
 }
 
-void GameRenderWidget::set_dimensions(unsigned width, unsigned height, unsigned scale) {
-    if(scale == 0) {
-        scale = 1;
-    }
-
-    this->scale(scale, scale);
+void GraphicsViewRenderSurface::set_dimensions(unsigned width, unsigned height, unsigned scale, std::uint32_t encoding) {
     this->width = width;
     this->height = height;
+    this->encoding = encoding;
     this->setTransform(QTransform::fromScale(scale, scale));
 
     this->setFixedSize(this->width * scale, this->height * scale);
@@ -29,12 +30,7 @@ void GameRenderWidget::set_dimensions(unsigned width, unsigned height, unsigned
     this->rebuild_scene();
 }
 
-void GameRenderWidget::rebuild_scene() {
-    if(this->scene == nullptr) {
-        delete this->scene;
-        this->scene = nullptr;
-    }
-
+void GraphicsViewRenderSurface::rebuild_scene() {
     this->pixmap = {};
     auto *new_scene = new QGraphicsScene(this);
     auto *new_pixmap = new_scene->addPixmap(this->pixmap);
@@ -53,13 +49,85 @@ void GameRenderWidget::rebuild_scene() {
     this->setScene(this->scene);
 }
 
+void GraphicsViewRenderSurface::refresh_screen(const std::uint32_t *pixels) {
+    // RGB565 rows are not padded, so the stride has to be given explicitly
+    bool rgb565 = this->encoding == SuperShuckieScreenDataEncoding__R5G6B5;
+    auto format = rgb565 ? QImage::Format::Format_RGB16 : QImage::Format::Format_ARGB32;
+    qsizetype bytes_per_line = static_cast<qsizetype>(this->width) * (rgb565 ? 2 : 4);
+    this->pixmap.convertFromImage(QImage(reinterpret_cast<const uchar *>(pixels), this->width, this->height, bytes_per_line, format));
+    this->pixmap_item->setPixmap(this->pixmap);
+}
+
+GameRenderWidget::GameRenderWidget(MainWindow *window, QWidget *parent): QWidget(parent), main_window(window) {
+    this->setSizePolicy(QSizePolicy::Policy::Fixed, QSizePolicy::Policy::Fixed);
+    this->setFocusPolicy(Qt::ClickFocus);
+    this->setAcceptDrops(true);
+
+    this->layout = new QGridLayout(this);
+    this->layout->setContentsMargins(0,0,0,0);
+    this->layout->setSpacing(0);
+
+    this->set_gpu_rendering(false);
+}
+
+void GameRenderWidget::set_gpu_rendering(bool enabled) {
+    if(this->surface != nullptr && this->gpu_rendering == enabled) {
+        return;
+    }
+
+    if(this->surface != nullptr) {
+        auto *old_widget = this->surface->as_widget();
+        this->layout->removeWidget(old_widget);
+        old_widget->deleteLater();
+        this->surface = nullptr;
+    }
+
+    if(enabled) {
+        this->surface = new GLRenderSurface(this);
+    }
+    else {
+        this->surface = new GraphicsViewRenderSurface(this);
+    }
+
+    this->gpu_rendering = enabled;
+    this->layout->addWidget(this->surface->as_widget(), 0, 0);
+    this->set_dimensions(this->width, this->height, this->scale, this->encoding);
+
+    if(this->main_window->frontend != nullptr) {
+        this->force_refresh_screen();
+    }
+}
+
+void GameRenderWidget::on_gpu_rendering_failed(const char *reason) {
+    std::fprintf(stderr, "GPU rendering unavailable, falling back to software rendering: %s\n", reason);
+
+    // Defer so the failing surface is not deleted from within its own GL callback
+    QMetaObject::invokeMethod(this, [this]() {
+        this->set_gpu_rendering(false);
+        this->main_window->gpu_rendering->setChecked(false);
+    }, Qt::QueuedConnection);
+}
+
+void GameRenderWidget::set_dimensions(unsigned width, unsigned height, unsigned scale, std::uint32_t encoding) {
+    if(scale == 0) {
+        scale = 1;
+    }
+
+    this->width = width;
+    this->height = height;
+    this->scale = scale;
+    this->encoding = encoding;
+
+    this->surface->set_dimensions(width, height, scale, encoding);
+    this->setFixedSize(this->width * scale, this->height * scale);
+}
+
 void GameRenderWidget::force_refresh_screen() {
     supershuckie_frontend_force_refresh_screens(this->main_window->frontend);
 }
 
-void GameRenderWidget::refresh_screen(const uint32_t *pixels) {
-    this->pixmap.convertFromImage(QImage(reinterpret_cast<const uchar *>(pixels), this->width, this->height, QImage::Format::Format_ARGB32));
-    this->pixmap_item->setPixmap(this->pixmap);
+void GameRenderWidget::refresh_screen(const std::uint32_t *pixels) {
+    this->surface->refresh_screen(pixels);
 }
 
 void GameRenderWidget::keyPressEvent(QKeyEvent *event) {
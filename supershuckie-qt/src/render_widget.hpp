@@ -4,38 +4,84 @@
 #include <QWidget>
 #include <QGraphicsView>
 #include <QPixmap>
+#include <cstdint>
 
 class QGraphicsScene;
+class QGridLayout;
 
 namespace SuperShuckie64 {
 
 class MainWindow;
-class SuperShuckieGraphicsView;
+class GameRenderWidget;
 
-class GameRenderWidget: public QGraphicsView {
-    friend MainWindow;
+/**
+ * Something that can present emulated frames.
+ *
+ * Surfaces do not take focus or accept drops; input is handled by the owning GameRenderWidget.
+ */
+class GameRenderSurface {
 public:
-    void set_dimensions(unsigned width, unsigned height, unsigned scale);
+    virtual ~GameRenderSurface() = default;
 
-private:
-    GameRenderWidget(MainWindow *window, QWidget *parent);
-    MainWindow *main_window;
+    virtual QWidget *as_widget() = 0;
+    virtual void set_dimensions(unsigned width, unsigned height, unsigned scale, std::uint32_t encoding) = 0;
+    virtual void refresh_screen(const std::uint32_t *pixels) = 0;
+};
+
+/**
+ * Software fallback which converts each frame into a QPixmap in a QGraphicsScene.
+ */
+class GraphicsViewRenderSurface: public QGraphicsView, public GameRenderSurface {
+public:
+    GraphicsViewRenderSurface(QWidget *parent);
 
-    unsigned nearest_scaling = 1;
+    QWidget *as_widget() override { return this; }
+    void set_dimensions(unsigned width, unsigned height, unsigned scale, std::uint32_t encoding) override;
+    void refresh_screen(const std::uint32_t *pixels) override;
+
+private:
     unsigned width = 1;
     unsigned height = 1;
+    std::uint32_t encoding = 0;
 
     QPixmap pixmap;
     QGraphicsScene *scene = nullptr;
     QGraphicsPixmapItem *pixmap_item = nullptr;
 
     void rebuild_scene();
+};
+
+class GameRenderWidget: public QWidget {
+    friend MainWindow;
+public:
+    void set_dimensions(unsigned width, unsigned height, unsigned scale, std::uint32_t encoding);
+
+    /** Switch between the OpenGL surface and the QGraphicsView fallback. */
+    void set_gpu_rendering(bool enabled);
+    bool is_gpu_rendering() const noexcept { return this->gpu_rendering; }
+
+    /** Called by the OpenGL surface if it fails to initialize. */
+    void on_gpu_rendering_failed(const char *reason);
+
+private:
+    GameRenderWidget(MainWindow *window, QWidget *parent);
+    MainWindow *main_window;
+
+    GameRenderSurface *surface = nullptr;
+    QGridLayout *layout = nullptr;
+    bool gpu_rendering = false;
+
+    unsigned width = 1;
+    unsigned height = 1;
+    unsigned scale = 1;
+    std::uint32_t encoding = 0;
+
     void force_refresh_screen();
-    void refresh_screen(const uint32_t *pixels);
+    void refresh_screen(const std::uint32_t *pixels);
 
     void keyPressEvent(QKeyEvent *event) override;
     void keyReleaseEvent(QKeyEvent *event) override;
-    
+
     void dragEnterEvent(QDragEnterEvent *event) override;
     void dragMoveEvent(QDragMoveEvent *event) override;
     void dropEvent(QDropEvent *event) override;
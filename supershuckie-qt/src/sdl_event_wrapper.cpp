@@ -8,12 +8,78 @@ SDLEventWrapper::SDLEventWrapper() {
 
 }
 
+SDLEventWrapper::~SDLEventWrapper() {
+    this->stop_event_thread();
+}
+
+void SDLEventWrapper::start_event_thread(std::function<void()> on_events_ready) {
+    if(this->event_thread_running) {
+        return;
+    }
+
+    // SDL only allows pumping events off of the main thread if the video subsystem is not initialized. Qt owns the
+    // windows, so all this loses is SDL inhibiting the screensaver.
+    this->restart_video = SDL_WasInit(SDL_INIT_VIDEO) != 0;
+    if(this->restart_video) {
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    }
+
+    this->event_thread_running = true;
+    this->event_thread = std::thread([this, on_events_ready]() {
+        while(this->event_thread_running) {
+            SDL_Event event;
+
+            // Time out occasionally so we can see if we've been stopped
+            if(!SDL_WaitEventTimeout(&event, 100)) {
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(this->event_queue_mutex);
+                do {
+                    this->event_queue.push_back(event);
+                } while(SDL_PollEvent(&event));
+            }
+
+            on_events_ready();
+        }
+    });
+}
+
+void SDLEventWrapper::stop_event_thread() {
+    if(!this->event_thread_running) {
+        return;
+    }
+
+    this->event_thread_running = false;
+    this->event_thread.join();
+
+    if(this->restart_video) {
+        SDL_InitSubSystem(SDL_INIT_VIDEO);
+        this->restart_video = false;
+    }
+}
+
+bool SDLEventWrapper::poll_event(SDL_Event &event) {
+    {
+        std::lock_guard<std::mutex> lock(this->event_queue_mutex);
+        if(!this->event_queue.empty()) {
+            event = this->event_queue.front();
+            this->event_queue.pop_front();
+            return true;
+        }
+    }
+
+    // Only pump events here if the event thread isn't doing it for us
+    return !this->event_thread_running && SDL_PollEvent(&event);
+}
+
 SDLEventWrapperResult SDLEventWrapper::next() {
     SDLEventWrapperResult result = {};
     char msg[256];
 
     SDL_Event event;
-    while(SDL_PollEvent(&event)) {
+    while(this->poll_event(event)) {
         switch(event.type) {
             // If we hit ctrl-c, close the window (saves)
             case SDL_EventType::SDL_EVENT_QUIT:
@@ -2,9 +2,15 @@
 #define __SUPERSHUCKIE_SDL_EVENT_WRAPPER_HPP__
 
 #include <supershuckie/supershuckie.h>
+#include <SDL3/SDL_events.h>
 #include <unordered_map>
 #include <string>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
 #include <cstdint>
 
 namespace SuperShuckie64 {
@@ -46,12 +52,33 @@ class SDLEventWrapper {
     friend MainWindow;
 public:
     SDLEventWrapper();
+    ~SDLEventWrapper();
     SDLEventWrapperResult next();
+
+    /**
+     * Wait for SDL events on a separate thread instead of requiring next() to be polled.
+     *
+     * on_events_ready is called from that thread whenever new events are queued; next() must still be called from the
+     * main thread to handle them.
+     *
+     * The SDL video subsystem is shut down until stop_event_thread() is called, so SDL does not inhibit the
+     * screensaver in the meantime. Both must be called from the main thread.
+     */
+    void start_event_thread(std::function<void()> on_events_ready);
+    void stop_event_thread();
 private:
     SuperShuckieFrontendRaw *frontend = nullptr;
     std::unordered_map<std::uint32_t, ConnectedController> connected_controllers;
 
     std::vector<std::string> events_to_print;
+
+    std::thread event_thread;
+    std::atomic<bool> event_thread_running = false;
+    bool restart_video = false;
+    std::mutex event_queue_mutex;
+    std::deque<SDL_Event> event_queue;
+
+    bool poll_event(SDL_Event &event);
 };
 
 }
@@ -9,7 +9,7 @@
 
 using namespace SuperShuckie64;
 
-SelectItemDialog::SelectItemDialog(MainWindow *parent, std::vector<std::string> items, const QString &title, const QString &message, const QString &subtext): QDialog(parent), parent(parent) {
+SelectItemDialog::SelectItemDialog(MainWindow *parent, std::vector<std::string> items, const QString &title, const QString &message, const QString &subtext, const std::vector<std::string> &details): QDialog(parent), parent(parent) {
     this->setWindowTitle(title);
 
     auto *layout = new QGridLayout(this);
@@ -20,8 +20,15 @@ SelectItemDialog::SelectItemDialog(MainWindow *parent, std::vector<std::string>
 
     this->list = new QListWidget(this);
 
-    for(auto &item : items) {
-        this->list->addItem(item.c_str());
+    // details, if given, is shown next to the item with the same index
+    for(std::size_t i = 0; i < items.size(); i++) {
+        QString text = items[i].c_str();
+        if(i < details.size() && !details[i].empty()) {
+            text += QString(" (%1)").arg(details[i].c_str());
+        }
+
+        auto *item = new QListWidgetItem(text, this->list);
+        item->setData(Qt::UserRole, QString(items[i].c_str()));
     }
 
     this->list->sortItems();
@@ -48,11 +55,11 @@ QString SelectItemDialog::text() const {
     if(item == nullptr) {
         return "";
     }
-    return item->text();
+    return item->data(Qt::UserRole).toString();
 }
 
-std::optional<std::string> SelectItemDialog::ask(MainWindow *parent, std::vector<std::string> items, const QString &title, const QString &message, const QString &subtext) {
-    auto *dialog = new SelectItemDialog(parent, items, title, message, subtext);
+std::optional<std::string> SelectItemDialog::ask(MainWindow *parent, std::vector<std::string> items, const QString &title, const QString &message, const QString &subtext, const std::vector<std::string> &details) {
+    auto *dialog = new SelectItemDialog(parent, items, title, message, subtext, details);
     int exec_result = dialog->exec();
     auto text = dialog->text().toStdString();
     delete dialog;
@@ -16,10 +16,10 @@ class MainWindow;
 class SelectItemDialog: public QDialog {
     Q_OBJECT
 public:
-    SelectItemDialog(MainWindow *parent, std::vector<std::string> items, const QString &title, const QString &message, const QString &subtext = "");
+    SelectItemDialog(MainWindow *parent, std::vector<std::string> items, const QString &title, const QString &message, const QString &subtext = "", const std::vector<std::string> &details = {});
     QString text() const;
     int exec() override;
-    static std::optional<std::string> ask(MainWindow *parent, std::vector<std::string> items, const QString &title, const QString &message, const QString &subtext = "");
+    static std::optional<std::string> ask(MainWindow *parent, std::vector<std::string> items, const QString &title, const QString &message, const QString &subtext = "", const std::vector<std::string> &details = {});
 private:
     QListWidget *list = nullptr;
     MainWindow *parent;
@@ -27,6 +27,13 @@ pub enum Packet {
     #[allow(missing_docs)]
     NextFrame { timestamp_delta: TimestampMillis },
 
+    /// Run emulator for `count` frames.
+    ///
+    /// `total_delta` is the time passed over all of them, which is spread evenly across each frame.
+    /// Recorders write this instead of a run of [`Packet::NextFrame`] with nothing in between.
+    #[allow(missing_docs)]
+    RepeatFrames { count: UnsignedInteger, total_delta: TimestampMillis },
+
     /// Write RAM to the given address
     /// 
     /// How the address is interpreted is emulator-specific
@@ -59,6 +66,22 @@ pub enum Packet {
         state: ByteVec
     },
 
+    /// Adds a keyframe whose save state is a diff against the previous keyframe in the stream.
+    ///
+    /// The previous keyframe is always in the same compressed blob (or top-level run of packets).
+    #[allow(missing_docs)]
+    DeltaKeyframe {
+        metadata: KeyframeMetadata,
+        delta: ByteVec
+    },
+
+    /// Lists every compressed blob in the replay so that it can be opened without scanning it.
+    ///
+    /// This is written once at the very end of a finished replay, and it ends with a footer of
+    /// [`SEEK_INDEX_FOOTER_LENGTH`] bytes so that it can be found from the end of the file.
+    #[allow(missing_docs)]
+    SeekIndex { blobs: Vec<SeekIndexEntry> },
+
     /// Describes a compressed blob of memory.
     #[allow(missing_docs)]
     CompressedBlob {
@@ -119,6 +142,46 @@ pub struct KeyframeMetadata {
     pub elapsed_millis: TimestampMillis
 }
 
+/// Payload for seek indices, describing one compressed blob
+#[derive(Clone, PartialEq, Debug, Default)]
+pub struct SeekIndexEntry {
+    /// Offset of the blob's compressed data from the start of the file
+    pub compressed_data_offset: UnsignedInteger,
+
+    /// Length of the blob's compressed data
+    pub compressed_data_length: UnsignedInteger,
+
+    /// Size of the blob when decompressed
+    pub uncompressed_size: UnsignedInteger,
+
+    /// Elapsed milliseconds at the start of the blob
+    pub timestamp_start: TimestampMillis,
+
+    /// Elapsed milliseconds at the end of the blob
+    pub timestamp_end: TimestampMillis,
+
+    /// Elapsed frames at the start of the blob
+    pub elapsed_frames_start: UnsignedInteger,
+
+    /// Elapsed frames at the end of the blob
+    pub elapsed_frames_end: UnsignedInteger,
+
+    /// Keyframes in the blob
+    pub keyframes: Vec<KeyframeMetadata>,
+
+    /// Bookmarks in the blob
+    pub bookmarks: Vec<BookmarkMetadata>
+}
+
+/// Length of the footer at the end of a [`Packet::SeekIndex`].
+///
+/// The footer is the length of the whole packet as a little endian u64, followed by
+/// [`SEEK_INDEX_MAGIC`].
+pub const SEEK_INDEX_FOOTER_LENGTH: usize = 16;
+
+/// Magic at the very end of a replay file that has a seek index.
+pub const SEEK_INDEX_MAGIC: [u8; 8] = *b"SSRIDX01";
+
 /// Payload for bookmarks
 #[derive(Clone, PartialEq, Debug, Default)]
 pub struct BookmarkMetadata {
@@ -1,6 +1,6 @@
 use core::cmp::Ordering;
 
-use crate::packet::{BookmarkMetadata, ByteVec, KeyframeMetadata, Packet, Speed, UnsignedInteger};
+use crate::packet::{BookmarkMetadata, ByteVec, KeyframeMetadata, Packet, SeekIndexEntry, Speed, UnsignedInteger, SEEK_INDEX_FOOTER_LENGTH, SEEK_INDEX_MAGIC};
 use crate::{InputBuffer, TimestampMillis};
 use alloc::borrow::{Cow, ToOwned};
 use alloc::string::String;
@@ -107,6 +107,60 @@ impl PacketIO<'_> for UnsignedInteger {
     }
 }
 
+/// [`UnsignedInteger`] encoded as LEB128: 7 bits per byte, least significant first, with the high
+/// bit set on every byte but the last.
+///
+/// Values below 128 take one byte, so this is smaller than the length-prefixed encoding for small
+/// numbers. Only [`Packet::RepeatFrames`] uses it; every other packet keeps the length-prefixed
+/// encoding, so it reads the same in every replay format version.
+#[derive(Copy, Clone, PartialEq, Debug)]
+#[repr(transparent)]
+pub struct VarInt(pub UnsignedInteger);
+
+/// Maximum number of bytes in a [`VarInt`].
+pub const VAR_INT_MAX_LENGTH: usize = (UnsignedInteger::BITS as usize).div_ceil(7);
+
+impl PacketIO<'_> for VarInt {
+    fn write_packet_instructions(&'_ self) -> PacketInstructionsVec<'_> {
+        let mut value = self.0;
+        if value < 0x80 {
+            return core::iter::once(PacketWriteCommand::WriteByte { byte: value as u8 }).collect()
+        }
+
+        let mut bytes = ByteVec::new();
+        while value >= 0x80 {
+            bytes.push((value as u8) | 0x80);
+            value >>= 7;
+        }
+        bytes.push(value as u8);
+        core::iter::once(PacketWriteCommand::WriteVec { bytes }).collect()
+    }
+    fn read_all(what: &mut &[u8]) -> Result<Self, PacketReadError> {
+        let too_large = || PacketReadError::ParseFail { explanation: Cow::Borrowed("invalid VarInt (too large)") };
+
+        let mut value: UnsignedInteger = 0;
+        for index in 0..VAR_INT_MAX_LENGTH {
+            let Some(&byte) = what.get(index) else {
+                return Err(PacketReadError::NotEnoughData)
+            };
+
+            let bits = (byte & 0x7F) as UnsignedInteger;
+            let shift = index as u32 * 7;
+            if (bits << shift) >> shift != bits {
+                return Err(too_large())
+            }
+            value |= bits << shift;
+
+            if byte & 0x80 == 0 {
+                *what = &what[index + 1..];
+                return Ok(Self(value))
+            }
+        }
+
+        Err(too_large())
+    }
+}
+
 impl PacketIO<'_> for usize {
     fn write_packet_instructions(&'_ self) -> PacketInstructionsVec<'_> {
         let v = UnsignedInteger::try_from(*self).expect("failed to convert usize to UnsignedInteger; target architecture exceeds 64 bits?");
@@ -265,6 +319,9 @@ pub enum PacketDiscriminator {
     /// Write a variable amount of data.
     WriteMemoryVar = 0x88,
 
+    /// Run for many frames (replay format version 3+)
+    RepeatFrames = 0x89,
+
     /// Describes a keyframe
     Keyframe = 0xF0,
 
@@ -280,6 +337,12 @@ pub enum PacketDiscriminator {
     /// Load the save state at the given keyframe
     LoadSaveState = 0xF4,
 
+    /// Describes a keyframe stored as a diff against the previous keyframe (replay format version 3+)
+    DeltaKeyframe = 0xF5,
+
+    /// Seek index (replay format version 3+)
+    SeekIndex = 0xF6,
+
     /// Compressed blob
     CompressedBlob = 0xFE,
     
@@ -343,6 +406,7 @@ impl Packet {
             Packet::ResetConsole => PacketDiscriminator::ResetConsole as u8,
             Packet::LoadSaveState { .. } => PacketDiscriminator::LoadSaveState as u8,
             Packet::NextFrame { .. } => PacketDiscriminator::NextFrame as u8,
+            Packet::RepeatFrames { .. } => PacketDiscriminator::RepeatFrames as u8,
             Packet::WriteMemory { data, .. } => match data.len() {
                 1 => PacketDiscriminator::WriteMemory8 as u8,
                 2 => PacketDiscriminator::WriteMemory16 as u8,
@@ -358,6 +422,8 @@ impl Packet {
             Packet::ChangeSpeed { .. } => PacketDiscriminator::ChangeSpeed as u8,
             Packet::Bookmark { .. } => PacketDiscriminator::Bookmark as u8,
             Packet::Keyframe { .. } => PacketDiscriminator::Keyframe as u8,
+            Packet::DeltaKeyframe { .. } => PacketDiscriminator::DeltaKeyframe as u8,
+            Packet::SeekIndex { .. } => PacketDiscriminator::SeekIndex as u8,
             Packet::CompressedBlob { .. } => PacketDiscriminator::CompressedBlob as u8,
         }
     }
@@ -375,6 +441,11 @@ impl PacketIO<'_> for Packet {
             Packet::NextFrame { timestamp_delta } => {
                 commands.extend(timestamp_delta.write_packet_instructions());
             },
+
+            Packet::RepeatFrames { count, total_delta } => {
+                commands.extend(static_packet_write_array_references(VarInt(*count).write_packet_instructions()));
+                commands.extend(static_packet_write_array_references(VarInt(*total_delta).write_packet_instructions()));
+            },
             
             Packet::ChangeInput { data } => {
                 match data.len() {
@@ -424,10 +495,23 @@ impl PacketIO<'_> for Packet {
                 commands.extend(state.write_packet_instructions());
             },
 
+            Packet::DeltaKeyframe { delta, metadata } => {
+                commands.extend(metadata.write_packet_instructions());
+                commands.extend(delta.write_packet_instructions());
+            },
+
             Packet::Bookmark { metadata } => {
                 commands.extend(metadata.write_packet_instructions());
             },
 
+            Packet::SeekIndex { blobs } => {
+                commands.extend(blobs.write_packet_instructions());
+
+                let packet_length = commands.iter().map(|c| c.bytes().len()).sum::<usize>() + SEEK_INDEX_FOOTER_LENGTH;
+                commands.push(PacketWriteCommand::WriteVec { bytes: (packet_length as u64).to_le_bytes().as_slice().into() });
+                commands.push(PacketWriteCommand::WriteVec { bytes: SEEK_INDEX_MAGIC.as_slice().into() });
+            },
+
             Packet::ChangeSpeed { speed } => {
                 commands.extend(speed.write_packet_instructions());
             },
@@ -479,6 +563,7 @@ impl PacketIO<'_> for Packet {
         match t {
             PacketDiscriminator::NoOp | PacketDiscriminator::ResetConsole => unreachable!("{t:?} should have already been handled"),
             PacketDiscriminator::NextFrame => Ok(Packet::NextFrame { timestamp_delta: TimestampMillis::read_all(from)? }),
+            PacketDiscriminator::RepeatFrames => Ok(Packet::RepeatFrames { count: VarInt::read_all(from)?.0, total_delta: VarInt::read_all(from)?.0 }),
             PacketDiscriminator::LoadSaveState => Ok(Packet::LoadSaveState { state: ByteVec::read_all(from)? }),
             PacketDiscriminator::ChangeInput8 => change_input!(u8),
             PacketDiscriminator::ChangeInput16 => change_input!(u16),
@@ -489,7 +574,19 @@ impl PacketIO<'_> for Packet {
             PacketDiscriminator::WriteMemory32 => write_memory!(u32),
             PacketDiscriminator::WriteMemoryVar => Ok(Packet::WriteMemory { address: UnsignedInteger::read_all(from)?, data: ByteVec::read_all(from)? }),
             PacketDiscriminator::Keyframe => Ok(Packet::Keyframe { metadata: KeyframeMetadata::read_all(from)?, state: ByteVec::read_all(from)? }),
+            PacketDiscriminator::DeltaKeyframe => Ok(Packet::DeltaKeyframe { metadata: KeyframeMetadata::read_all(from)?, delta: ByteVec::read_all(from)? }),
             PacketDiscriminator::Bookmark => Ok(Packet::Bookmark { metadata: BookmarkMetadata::read_all(from)? }),
+            PacketDiscriminator::SeekIndex => {
+                let blobs = Vec::read_all(from)?;
+                let Some((footer, extra)) = from.split_at_checked(SEEK_INDEX_FOOTER_LENGTH) else {
+                    return Err(PacketReadError::NotEnoughData)
+                };
+                if footer[8..] != SEEK_INDEX_MAGIC {
+                    return Err(PacketReadError::ParseFail { explanation: Cow::Borrowed("seek index footer has the wrong magic") })
+                }
+                *from = extra;
+                Ok(Packet::SeekIndex { blobs })
+            },
             PacketDiscriminator::ChangeSpeed => Ok(Packet::ChangeSpeed { speed: Speed::read_all(from)? }),
             PacketDiscriminator::CompressedBlob => Ok(Packet::CompressedBlob {
                 keyframes: Vec::read_all(from)?,
@@ -543,6 +640,36 @@ impl PacketIO<'_> for NonZeroU16 {
     }
 }
 
+impl PacketIO<'_> for SeekIndexEntry {
+    fn write_packet_instructions(&'_ self) -> PacketInstructionsVec<'_> {
+        let mut instructions = PacketInstructionsVec::new();
+        instructions.extend(self.compressed_data_offset.write_packet_instructions());
+        instructions.extend(self.compressed_data_length.write_packet_instructions());
+        instructions.extend(self.uncompressed_size.write_packet_instructions());
+        instructions.extend(self.timestamp_start.write_packet_instructions());
+        instructions.extend(self.timestamp_end.write_packet_instructions());
+        instructions.extend(self.elapsed_frames_start.write_packet_instructions());
+        instructions.extend(self.elapsed_frames_end.write_packet_instructions());
+        instructions.extend(self.keyframes.write_packet_instructions());
+        instructions.extend(self.bookmarks.write_packet_instructions());
+        instructions
+    }
+
+    fn read_all(from: &mut &[u8]) -> Result<Self, PacketReadError> {
+        Ok(Self {
+            compressed_data_offset: UnsignedInteger::read_all(from)?,
+            compressed_data_length: UnsignedInteger::read_all(from)?,
+            uncompressed_size: UnsignedInteger::read_all(from)?,
+            timestamp_start: TimestampMillis::read_all(from)?,
+            timestamp_end: TimestampMillis::read_all(from)?,
+            elapsed_frames_start: UnsignedInteger::read_all(from)?,
+            elapsed_frames_end: UnsignedInteger::read_all(from)?,
+            keyframes: Vec::read_all(from)?,
+            bookmarks: Vec::read_all(from)?,
+        })
+    }
+}
+
 impl PacketIO<'_> for BookmarkMetadata {
     fn write_packet_instructions(&'_ self) -> PacketInstructionsVec<'_> {
         let mut instructions = PacketInstructionsVec::new();
@@ -560,3 +687,64 @@ impl PacketIO<'_> for BookmarkMetadata {
         })
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn encode(value: UnsignedInteger) -> Vec<u8> {
+        VarInt(value).write_packet_instructions().iter().flat_map(|i| i.bytes().iter().copied()).collect()
+    }
+
+    fn decode(mut bytes: &[u8]) -> Result<(UnsignedInteger, usize), PacketReadError> {
+        let len = bytes.len();
+        let value = VarInt::read_all(&mut bytes)?.0;
+        Ok((value, len - bytes.len()))
+    }
+
+    #[test]
+    fn var_int_round_trip() {
+        for (value, length) in [(0, 1), (127, 1), (128, 2), (16383, 2), (16384, 3), (UnsignedInteger::MAX, VAR_INT_MAX_LENGTH)] {
+            let bytes = encode(value);
+            assert_eq!(bytes.len(), length, "{value}");
+            assert_eq!(decode(&bytes), Ok((value, length)), "{value}");
+        }
+
+        assert_eq!(encode(128), [0x80, 0x01]);
+        assert_eq!(encode(UnsignedInteger::MAX).last(), Some(&0x01));
+    }
+
+    #[test]
+    fn var_int_stops_at_the_last_byte() {
+        let mut bytes = encode(300);
+        bytes.extend_from_slice(&[0xAA, 0xBB]);
+        assert_eq!(decode(&bytes), Ok((300, 2)));
+    }
+
+    #[test]
+    fn var_int_rejects_bad_input() {
+        let too_large = Err(PacketReadError::ParseFail { explanation: Cow::Borrowed("invalid VarInt (too large)") });
+
+        // 11 bytes, which can't be a valid 64-bit integer
+        let mut eleven = [0x80u8; 11];
+        eleven[10] = 0x00;
+        assert_eq!(decode(&eleven), too_large);
+
+        // 10 bytes, but with bits past the 64th set
+        let mut overflow = [0xFFu8; VAR_INT_MAX_LENGTH];
+        overflow[VAR_INT_MAX_LENGTH - 1] = 0x02;
+        assert_eq!(decode(&overflow), too_large);
+
+        assert_eq!(decode(&[]), Err(PacketReadError::NotEnoughData));
+        assert_eq!(decode(&[0x80, 0x80]), Err(PacketReadError::NotEnoughData));
+    }
+
+    #[test]
+    fn repeat_frames_round_trip() {
+        let packet = Packet::RepeatFrames { count: 0x3FFF, total_delta: 273_000 };
+        let bytes: Vec<u8> = packet.write_packet_instructions().iter().flat_map(|i| i.bytes().iter().copied()).collect();
+        let mut from = bytes.as_slice();
+        assert_eq!(Packet::read_all(&mut from), Ok(packet));
+        assert!(from.is_empty());
+    }
+}
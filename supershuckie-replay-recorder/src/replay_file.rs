@@ -3,5 +3,7 @@
 mod header;
 pub use header::*;
 
+pub mod delta;
+
 pub mod record;
 pub mod playback;
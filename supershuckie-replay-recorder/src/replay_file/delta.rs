@@ -0,0 +1,186 @@
+//! Save state diffs, as used by delta keyframes.
+//!
+//! A diff is the new state's length followed by runs of `skip, length, bytes`, with all integers
+//! encoded as [`UnsignedInteger`](crate::UnsignedInteger)s. `skip` bytes are copied from the base
+//! state, then `length` bytes are taken from the diff. Anything past the last run is copied from
+//! the base state.
+//!
+//! States are compared in pages of [`PAGE_SIZE`] bytes so that scattered single-byte changes do
+//! not each cost a run.
+
+use crate::{ByteVec, PacketIO, PacketReadError};
+use alloc::borrow::Cow;
+use alloc::vec::Vec;
+
+const PAGE_SIZE: usize = 64;
+
+/// Get the diff that turns `base` into `state`.
+pub fn diff_state(base: &[u8], state: &[u8]) -> ByteVec {
+    let mut diff = ByteVec::new();
+    diff_state_into(base, state, &mut diff);
+    diff
+}
+
+/// Write the diff that turns `base` into `state` into `diff`, replacing its contents.
+///
+/// This reuses `diff`'s allocation, if it has one.
+pub fn diff_state_into(base: &[u8], state: &[u8], diff: &mut ByteVec) {
+    diff.clear();
+    write_integer(diff, state.len());
+
+    let mut copied_up_to = 0usize;
+    let mut page_start = 0usize;
+
+    while page_start < state.len() {
+        let page_end = (page_start + PAGE_SIZE).min(state.len());
+        if !page_differs(base, state, page_start, page_end) {
+            page_start = page_end;
+            continue
+        }
+
+        // Extend the run over every following changed page.
+        let run_start = page_start;
+        let mut run_end = page_end;
+        while run_end < state.len() {
+            let next_end = (run_end + PAGE_SIZE).min(state.len());
+            if !page_differs(base, state, run_end, next_end) {
+                break
+            }
+            run_end = next_end;
+        }
+
+        write_integer(diff, run_start - copied_up_to);
+        write_integer(diff, run_end - run_start);
+        diff.extend_from_slice(&state[run_start..run_end]);
+
+        copied_up_to = run_end;
+        page_start = run_end;
+    }
+}
+
+/// Apply a diff made by [`diff_state`] to `base`.
+pub fn apply_diff(base: &[u8], mut diff: &[u8]) -> Result<Vec<u8>, Cow<'static, str>> {
+    let broken = |_: PacketReadError| Cow::Borrowed("keyframe diff is truncated");
+
+    let len = usize::read_all(&mut diff).map_err(broken)?;
+    let mut state = Vec::new();
+    state.try_reserve_exact(len).map_err(|_| Cow::Borrowed("failed to allocate RAM for keyframe"))?;
+
+    while !diff.is_empty() {
+        let skip = usize::read_all(&mut diff).map_err(broken)?;
+        let run_len = usize::read_all(&mut diff).map_err(broken)?;
+
+        let copy_end = state.len().checked_add(skip).filter(|end| *end <= base.len() && *end <= len)
+            .ok_or(Cow::Borrowed("keyframe diff does not match its base keyframe"))?;
+        state.extend_from_slice(&base[state.len()..copy_end]);
+
+        let Some((run, remaining)) = diff.split_at_checked(run_len) else {
+            return Err(Cow::Borrowed("keyframe diff is truncated"))
+        };
+        if state.len() + run.len() > len {
+            return Err(Cow::Borrowed("keyframe diff exceeds its stated length"))
+        }
+        state.extend_from_slice(run);
+        diff = remaining;
+    }
+
+    let tail_start = state.len();
+    if tail_start < len {
+        let Some(tail) = base.get(tail_start..len) else {
+            return Err(Cow::Borrowed("keyframe diff does not match its base keyframe"))
+        };
+        state.extend_from_slice(tail);
+    }
+
+    Ok(state)
+}
+
+fn page_differs(base: &[u8], state: &[u8], start: usize, end: usize) -> bool {
+    base.get(start..end) != Some(&state[start..end])
+}
+
+fn write_integer(diff: &mut ByteVec, value: usize) {
+    for i in value.write_packet_instructions() {
+        diff.extend_from_slice(i.bytes());
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use alloc::vec;
+
+    fn round_trip(base: &[u8], state: &[u8]) -> ByteVec {
+        let diff = diff_state(base, state);
+        assert_eq!(apply_diff(base, diff.as_slice()).as_deref(), Ok(state));
+        diff
+    }
+
+    #[test]
+    fn unchanged_state_is_just_its_length() {
+        let base = vec![7u8; PAGE_SIZE * 4 + 10];
+        let diff = round_trip(&base, &base);
+        assert_eq!(diff.as_slice(), [2, (base.len() & 0xFF) as u8, (base.len() >> 8) as u8]);
+    }
+
+    #[test]
+    fn runs_at_page_edges() {
+        let base = vec![0u8; PAGE_SIZE * 4 + 10];
+
+        // Last byte of one page, first byte of the next, and the very last byte (in a short page)
+        for changed in [&[PAGE_SIZE - 1][..], &[PAGE_SIZE], &[PAGE_SIZE - 1, PAGE_SIZE], &[base.len() - 1], &[0, base.len() - 1]] {
+            let mut state = base.clone();
+            for &i in changed {
+                state[i] = 0xFF;
+            }
+            round_trip(&base, &state);
+        }
+
+        // Two adjacent changed pages are one run
+        let mut state = base.clone();
+        state[PAGE_SIZE - 1] = 1;
+        state[PAGE_SIZE] = 1;
+        let diff = diff_state(&base, &state);
+        let mut rest = &diff[..];
+        assert_eq!(usize::read_all(&mut rest), Ok(state.len()));
+        assert_eq!(usize::read_all(&mut rest), Ok(0));
+        assert_eq!(usize::read_all(&mut rest), Ok(PAGE_SIZE * 2));
+        assert_eq!(rest.len(), PAGE_SIZE * 2);
+    }
+
+    #[test]
+    fn changed_length() {
+        let base: Vec<u8> = (0..PAGE_SIZE * 3).map(|i| i as u8).collect();
+
+        let mut longer = base.clone();
+        longer.extend_from_slice(&[0xAB; PAGE_SIZE + 5]);
+        round_trip(&base, &longer);
+
+        round_trip(&base, &base[..PAGE_SIZE * 2 + 1]);
+        round_trip(&base, &base[..PAGE_SIZE]);
+        round_trip(&base, &[]);
+        round_trip(&[], &base);
+    }
+
+    #[test]
+    fn broken_diffs_are_rejected() {
+        let base = vec![0u8; PAGE_SIZE * 2];
+        let mut state = base.clone();
+        state[PAGE_SIZE + 3] = 9;
+        let diff = diff_state(&base, &state);
+
+        // Truncated
+        assert!(apply_diff(&base, &diff[..diff.len() - 1]).is_err());
+
+        // Applied to a base that is too short to copy from
+        assert!(apply_diff(&base[..PAGE_SIZE / 2], &diff).is_err());
+
+        // A run longer than the stated length
+        let mut long = ByteVec::new();
+        write_integer(&mut long, 1);
+        write_integer(&mut long, 0);
+        write_integer(&mut long, 2);
+        long.extend_from_slice(&[1, 2]);
+        assert!(apply_diff(&base, &long).is_err());
+    }
+}
@@ -11,8 +11,24 @@ pub const SIGNATURE_START: [u8; 4] = 0x4E49444Fu32.to_be_bytes();
 /// Signature end (all replay headers must end with this)
 pub const SIGNATURE_END: [u8; 4] = 0x52494E41u32.to_be_bytes();
 
-/// Replay format version
-pub const REPLAY_VERSION: u32 = 2;
+/// Replay format version written by default
+///
+/// Version 3 added [`Packet::RepeatFrames`](crate::Packet::RepeatFrames),
+/// [`Packet::DeltaKeyframe`](crate::Packet::DeltaKeyframe), and
+/// [`Packet::SeekIndex`](crate::Packet::SeekIndex).
+pub const REPLAY_VERSION: u32 = 3;
+
+/// Oldest replay format version that can still be read (or written)
+pub const MINIMUM_REPLAY_VERSION: u32 = 2;
+
+/// First replay format version that can contain [`Packet::RepeatFrames`](crate::Packet::RepeatFrames)
+pub const REPEAT_FRAMES_REPLAY_VERSION: u32 = 3;
+
+/// First replay format version that can contain [`Packet::DeltaKeyframe`](crate::Packet::DeltaKeyframe)
+pub const DELTA_KEYFRAME_REPLAY_VERSION: u32 = 3;
+
+/// First replay format version that can contain [`Packet::SeekIndex`](crate::Packet::SeekIndex)
+pub const SEEK_INDEX_REPLAY_VERSION: u32 = 3;
 
 /// Blake3 checksum
 pub type ReplayHeaderBlake3Hash = [u8; 32];
@@ -158,7 +174,7 @@ impl ReplayHeaderRaw {
         if signature_end != SIGNATURE_END {
             return Err(format!("Unrecognized signature_end {signature_end:X?}"));
         }
-        if self.replay_version != REPLAY_VERSION {
+        if !(MINIMUM_REPLAY_VERSION..=REPLAY_VERSION).contains(&replay_version) {
             return Err(format!("Unrecognized replay format version {replay_version}"));
         }
 
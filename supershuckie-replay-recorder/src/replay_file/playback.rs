@@ -2,27 +2,12 @@
 //!
 //! See [`ReplayFilePlayer`].
 
-#[cfg(not(feature = "std"))]
-use spin::Mutex;
-
-#[cfg(not(feature = "std"))]
-macro_rules! unwrap_mutex_lock {
-    ($e:expr) => {$e};
-}
-
-#[cfg(feature = "std")]
-use std::sync::Mutex;
-
-#[cfg(feature = "std")]
-macro_rules! unwrap_mutex_lock {
-    ($e:expr) => {$e.unwrap()};
-}
-
 use alloc::borrow::Cow;
 use alloc::format;
 use alloc::vec::Vec;
 use alloc::string::String;
 use alloc::borrow::ToOwned;
+use core::ops::Range;
 use core::mem::transmute;
 use alloc::sync::Arc;
 use alloc::collections::BTreeMap;
@@ -30,6 +15,29 @@ use alloc::vec;
 use crate::replay_file::{ReplayFileMetadata, ReplayHeaderBytes, ReplayHeaderRaw};
 use crate::{BookmarkMetadata, KeyframeMetadata, Packet, PacketIO, PacketReadError, TimestampMillis, UnsignedInteger};
 use crate::util::{decompress_data, launder_reference};
+use crate::replay_file::delta::apply_diff;
+use crate::ByteVec;
+
+#[cfg(feature = "std")]
+mod lazy;
+
+#[cfg(feature = "std")]
+pub use lazy::ReplaySource;
+
+#[cfg(feature = "std")]
+use lazy::LazyBlobs;
+
+#[cfg(feature = "std")]
+mod pool;
+
+#[cfg(feature = "std")]
+use pool::{DecompressionPool, DecompressionResult};
+
+#[cfg(feature = "std")]
+use std::sync::mpsc::{Receiver, TryRecvError};
+
+#[cfg(feature = "std")]
+use std::time::{Duration, Instant};
 
 type KeyframeMap<'a> = BTreeMap<UnsignedInteger, Vec<&'a KeyframeMetadata>>;
 type BookmarkMap<'a> = BTreeMap<String, Vec<&'a BookmarkMetadata>>;
@@ -45,16 +53,131 @@ pub struct ReplayFilePlayer {
     total_frame_count: UnsignedInteger,
     total_millis: TimestampMillis,
 
-    compressed_blobs_decompressing: BTreeMap<usize, Option<Arc<Mutex<PacketDecompressionStatus>>>>,
     compressed_blobs_finished: BTreeMap<usize, Option<Arc<Vec<Packet>>>>,
     compressed_blob_uncompressed_packet_indices: Vec<usize>,
     cleanup_enabled: bool,
 
+    cache_settings: ReplayFilePlayerCacheSettings,
+
+    /// When each decompressed blob was last used, for evicting the least recently used first.
+    compressed_blobs_last_used: BTreeMap<usize, u64>,
+    cache_clock: u64,
+
+    /// Uncompressed size of every blob in `compressed_blobs_finished`.
+    cached_bytes: usize,
+
+    /// Blobs that are kept no matter what, as positions in `compressed_blob_uncompressed_packet_indices`.
+    cache_window: Range<usize>,
+
+    /// Number of blobs at or before the next packet when `cache_window` was last updated.
+    cache_window_position: Option<usize>,
+
     next_uncompressed_packet_index: usize,
     next_compressed_packet_index: Option<usize>,
 
+    /// Full keyframe rebuilt by [`ReplayFilePlayer::go_to_keyframe`] to return in place of the
+    /// delta keyframe it was seeked to.
+    reconstructed_keyframe: Option<Packet>,
+    reconstructed_keyframe_pending: bool,
+
+    /// [`Packet::RepeatFrames`] being handed out one [`Packet::NextFrame`] at a time.
+    repeat: Option<RepeatProgress>,
+    repeated_frame: Packet,
+
+    /// Where to read compressed blob data from if the replay was loaded lazily.
+    #[cfg(feature = "std")]
+    lazy_blobs: Option<Arc<LazyBlobs>>,
+
     #[cfg(feature = "std")]
-    threading: bool
+    decompression_pool: Option<DecompressionPool>,
+
+    /// Blobs handed to the pool that have not been collected yet.
+    #[cfg(feature = "std")]
+    compressed_blobs_in_flight: BTreeMap<usize, Receiver<DecompressionResult>>,
+
+    /// Time spent blocked on blobs that were not decompressed in time.
+    #[cfg(feature = "std")]
+    decompression_stall: Duration
+}
+
+/// Where a [`ReplayFilePlayer`] is in its packet stream.
+///
+/// This is only meaningful to the player it came from.
+#[derive(Copy, Clone, PartialEq, Debug)]
+pub struct ReplayPlaybackPosition {
+    uncompressed_packet_index: usize,
+    compressed_packet_index: Option<usize>,
+    repeat: Option<RepeatProgress>
+}
+
+#[derive(Copy, Clone, PartialEq, Debug)]
+struct RepeatProgress {
+    count: UnsignedInteger,
+    total_delta: TimestampMillis,
+    done: UnsignedInteger
+}
+
+impl RepeatProgress {
+    /// Milliseconds into the run at the end of frame `frame`, rounded down.
+    fn millis_at(&self, frame: UnsignedInteger) -> TimestampMillis {
+        (self.total_delta as u128 * frame as u128 / self.count as u128) as TimestampMillis
+    }
+}
+
+/// Settings for how [`ReplayFilePlayer`] keeps decompressed blobs around.
+#[derive(Clone, Debug, PartialEq)]
+pub struct ReplayFilePlayerCacheSettings {
+    /// Blobs after the current one to keep decompressed
+    ///
+    /// If threading is enabled, these are decompressed in the background ahead of time.
+    ///
+    /// Default is [`DEFAULT_READ_AHEAD_BLOBS`]
+    pub read_ahead_blobs: usize,
+
+    /// Blobs before the current one to keep decompressed
+    ///
+    /// If threading is enabled, these are decompressed in the background so that seeking backward
+    /// does not have to wait.
+    ///
+    /// Default is [`DEFAULT_READ_BEHIND_BLOBS`]
+    pub read_behind_blobs: usize,
+
+    /// Maximum uncompressed bytes of decompressed blobs to keep
+    ///
+    /// Blobs outside the read-ahead/read-behind window are kept until this is exceeded, at which
+    /// point the least recently used ones are dropped. Blobs inside the window are always kept. If
+    /// 0, blobs outside the window are dropped immediately.
+    ///
+    /// Default is [`DEFAULT_CACHE_MEMORY_BUDGET`]
+    pub memory_budget: usize,
+
+    /// Number of worker threads to decompress blobs on once threading is enabled
+    ///
+    /// Default is [`DEFAULT_DECOMPRESSION_THREADS`]
+    pub decompression_threads: usize
+}
+
+/// Default blobs to read ahead
+pub const DEFAULT_READ_AHEAD_BLOBS: usize = 2;
+
+/// Default blobs to read behind
+pub const DEFAULT_READ_BEHIND_BLOBS: usize = 1;
+
+/// Default cache memory budget
+pub const DEFAULT_CACHE_MEMORY_BUDGET: usize = 1024 * 1024 * 1024;
+
+/// Default number of decompression worker threads
+pub const DEFAULT_DECOMPRESSION_THREADS: usize = 2;
+
+impl Default for ReplayFilePlayerCacheSettings {
+    fn default() -> Self {
+        Self {
+            read_ahead_blobs: DEFAULT_READ_AHEAD_BLOBS,
+            read_behind_blobs: DEFAULT_READ_BEHIND_BLOBS,
+            memory_budget: DEFAULT_CACHE_MEMORY_BUDGET,
+            decompression_threads: DEFAULT_DECOMPRESSION_THREADS
+        }
+    }
 }
 
 impl ReplayFilePlayer {
@@ -69,14 +192,9 @@ impl ReplayFilePlayer {
         };
 
         let header_buffer_bytes: &ReplayHeaderBytes = header_buffer.try_into().expect("should be able to convert array");
-        let header_raw = ReplayHeaderRaw::from_bytes(header_buffer_bytes);
-        let replay_file_metadata = header_raw
-            .parse()
-            .map_err(|e| ReplayFileReadError::InvalidReplayFile { explanation: Cow::Owned(format!("Failed to read header: {e}")) })?;
+        let (replay_file_metadata, patch_length) = parse_header(header_buffer_bytes)?;
 
         let patch_start = header_buffer_bytes.len();
-        let patch_length = usize::try_from(header_raw.patch_data_length)
-            .map_err(|_| ReplayFileReadError::InvalidReplayFile { explanation: Cow::Borrowed("Cannot read patch length (exceeds usize)") })?;
         let patch_end = patch_length.checked_add(patch_start)
             .ok_or_else(|| ReplayFileReadError::InvalidReplayFile { explanation: Cow::Borrowed("Cannot read patch end (overflowed usize)") })?;
 
@@ -107,6 +225,11 @@ impl ReplayFilePlayer {
             }
         }
 
+        Self::from_packets(replay_file_metadata, patch_data, all_packets)
+    }
+
+    /// Index the top-level packets of a replay.
+    fn from_packets(replay_file_metadata: ReplayFileMetadata, patch_data: Option<Vec<u8>>, all_packets: Vec<Packet>) -> Result<ReplayFilePlayer, ReplayFileReadError> {
         let all_packets = Arc::new(all_packets);
 
         let Some(first_packet) = all_packets.get(0) else {
@@ -148,7 +271,6 @@ impl ReplayFilePlayer {
             };
         }
 
-        let mut compressed_blobs = BTreeMap::new();
         let mut compressed_blobs_finished = BTreeMap::new();
         let mut compressed_blob_indices = Vec::new();
 
@@ -166,7 +288,6 @@ impl ReplayFilePlayer {
                         return Err(ReplayFileReadError::Other { explanation: Cow::Borrowed("Replay has a compressed blob that decompressed beyond the current architectural limits") });
                     }
 
-                    compressed_blobs.insert(packet_index, None);
                     compressed_blobs_finished.insert(packet_index, None);
                     compressed_blob_indices.push(packet_index);
 
@@ -182,13 +303,17 @@ impl ReplayFilePlayer {
 
                     total_millis = *timestamp_end;
                 },
-                Packet::Keyframe { metadata, .. } => {
+                Packet::Keyframe { metadata, .. } | Packet::DeltaKeyframe { metadata, .. } => {
                     add_keyframe!(metadata);
                 },
                 Packet::NextFrame { timestamp_delta } => {
                     total_frame_count += 1;
                     total_millis += timestamp_delta;
                 }
+                Packet::RepeatFrames { count, total_delta } => {
+                    total_frame_count += count;
+                    total_millis += total_delta;
+                }
                 Packet::Bookmark { metadata } => {
                     add_bookmark!(metadata);
                     total_millis = metadata.elapsed_millis;
@@ -209,15 +334,33 @@ impl ReplayFilePlayer {
             all_uncompressed_packets: all_packets,
             next_uncompressed_packet_index: 0usize,
             next_compressed_packet_index: None,
+            reconstructed_keyframe: None,
+            reconstructed_keyframe_pending: false,
+            repeat: None,
+            repeated_frame: Packet::NoOp,
             compressed_blob_uncompressed_packet_indices: compressed_blob_indices,
-            compressed_blobs_decompressing: compressed_blobs,
             compressed_blobs_finished,
             total_frame_count,
             total_millis,
             cleanup_enabled: true,
+            cache_settings: ReplayFilePlayerCacheSettings::default(),
+            compressed_blobs_last_used: BTreeMap::new(),
+            cache_clock: 0,
+            cached_bytes: 0,
+            cache_window: 0..0,
+            cache_window_position: None,
+
+            #[cfg(feature = "std")]
+            lazy_blobs: None,
+
+            #[cfg(feature = "std")]
+            decompression_pool: None,
+
+            #[cfg(feature = "std")]
+            compressed_blobs_in_flight: BTreeMap::new(),
 
             #[cfg(feature = "std")]
-            threading: false
+            decompression_stall: Duration::ZERO
         };
 
         Ok(player)
@@ -233,16 +376,41 @@ impl ReplayFilePlayer {
         self.total_millis
     }
 
-    /// Enable decompression on a separate thread.
+    /// Enable decompression on separate threads.
     ///
-    /// The next compressed blob will be automatically decompressed in the background.
+    /// Compressed blobs in the read-ahead/read-behind window will be automatically decompressed in
+    /// the background. See [`ReplayFilePlayerCacheSettings`].
     ///
     /// This cannot be turned off once activated.
     ///
     /// The `std` feature is required to enable this.
     #[cfg(feature = "std")]
     pub fn enable_threading(&mut self) {
-        self.threading = true;
+        if self.decompression_pool.is_none() {
+            self.decompression_pool = Some(DecompressionPool::new(self.cache_settings.decompression_threads));
+            self.cache_window_position = None;
+        }
+    }
+
+    /// Get the time spent waiting on blobs to decompress since this was last called, and reset it.
+    ///
+    /// This is nonzero when playback had to stop for a blob that read-ahead had not gotten to.
+    #[cfg(feature = "std")]
+    pub fn take_decompression_stall(&mut self) -> Duration {
+        core::mem::take(&mut self.decompression_stall)
+    }
+
+    /// Get the current cache settings.
+    pub fn get_cache_settings(&self) -> &ReplayFilePlayerCacheSettings {
+        &self.cache_settings
+    }
+
+    /// Set how decompressed blobs are kept around.
+    ///
+    /// `decompression_threads` only takes effect if threading has not been enabled yet.
+    pub fn set_cache_settings(&mut self, settings: ReplayFilePlayerCacheSettings) {
+        self.cache_settings = settings;
+        self.cache_window_position = None;
     }
 
     /// Get a reference to a map of keyframes.
@@ -260,6 +428,9 @@ impl ReplayFilePlayer {
     }
 
     /// Get all top-level uncompressed packets.
+    ///
+    /// If the replay was loaded with [`ReplayFilePlayer::new_lazy`], compressed blobs will have
+    /// empty `compressed_data`.
     pub fn all_uncompressed_packets(&self) -> &[Packet] {
         self.all_uncompressed_packets.as_slice()
     }
@@ -274,10 +445,68 @@ impl ReplayFilePlayer {
         self.patch_data.as_ref().map(|i| i.as_slice())
     }
 
+    /// Get the current position in the packet stream.
+    ///
+    /// This can be passed to [`ReplayFilePlayer::set_position`] later to pick up from the same
+    /// packet, e.g. alongside a save state taken at the same time.
+    pub fn get_position(&self) -> ReplayPlaybackPosition {
+        ReplayPlaybackPosition {
+            uncompressed_packet_index: self.next_uncompressed_packet_index,
+            compressed_packet_index: self.next_compressed_packet_index,
+            repeat: self.repeat
+        }
+    }
+
+    /// Go back to a position from [`ReplayFilePlayer::get_position`].
+    ///
+    /// The blob at that position is decompressed when the next packet is read, if it isn't already.
+    pub fn set_position(&mut self, position: ReplayPlaybackPosition) {
+        self.reconstructed_keyframe_pending = false;
+        self.repeat = position.repeat;
+        self.next_uncompressed_packet_index = position.uncompressed_packet_index;
+        self.next_compressed_packet_index = position.compressed_packet_index;
+    }
+
     /// Go to the given keyframe.
     ///
+    /// The next packet returned will be a [`Packet::Keyframe`] with the full save state, even if
+    /// the keyframe was stored as a [`Packet::DeltaKeyframe`].
+    ///
     /// On failure, `Err` is returned.
     pub fn go_to_keyframe(&mut self, keyframe_frames_index: UnsignedInteger) -> Result<(), ReplaySeekError> {
+        self.reconstructed_keyframe_pending = false;
+        self.repeat = None;
+
+        let (packets, index) = match self.seek_to_keyframe_packet(keyframe_frames_index)? {
+            None => (self.all_uncompressed_packets.clone(), self.next_uncompressed_packet_index),
+            Some(subpacket_index) => {
+                let packets = self.compressed_blobs_finished
+                    .get(&self.next_uncompressed_packet_index)
+                    .and_then(|p| p.clone())
+                    .expect("somehow the blob we just seeked into is not decompressed");
+                (packets, subpacket_index)
+            }
+        };
+
+        self.reconstruct_keyframe(packets.as_slice(), index)
+    }
+
+    fn reconstruct_keyframe(&mut self, packets: &[Packet], index: usize) -> Result<(), ReplaySeekError> {
+        let Packet::DeltaKeyframe { metadata, .. } = &packets[index] else {
+            return Ok(())
+        };
+
+        let state = reconstruct_keyframe_state(packets, index)
+            .map_err(|error| ReplaySeekError::ReadError { error })?;
+
+        self.reconstructed_keyframe = Some(Packet::Keyframe { metadata: metadata.clone(), state: ByteVec::Heap(state) });
+        self.reconstructed_keyframe_pending = true;
+        Ok(())
+    }
+
+    /// Point the player at the keyframe packet, returning its index within its compressed blob if
+    /// it is in one.
+    fn seek_to_keyframe_packet(&mut self, keyframe_frames_index: UnsignedInteger) -> Result<Option<usize>, ReplaySeekError> {
         if self.keyframes.get(&keyframe_frames_index).is_none() {
             return Err(ReplaySeekError::NoSuchKeyframe {
                 given: keyframe_frames_index,
@@ -289,10 +518,10 @@ impl ReplayFilePlayer {
 
         for (uncompressed_index, packet) in self.all_uncompressed_packets.iter().enumerate() {
             match packet {
-                Packet::Keyframe { metadata, .. } => {
+                Packet::Keyframe { metadata, .. } | Packet::DeltaKeyframe { metadata, .. } => {
                     if metadata.elapsed_frames == keyframe_frames_index {
                         self.next_uncompressed_packet_index = uncompressed_index;
-                        return Ok(());
+                        return Ok(None);
                     }
                 },
                 Packet::CompressedBlob { keyframes, .. } => {
@@ -317,79 +546,151 @@ impl ReplayFilePlayer {
 
         for (subpacket_index, packet) in decompressed_packets.iter().enumerate() {
             match packet {
-                Packet::Keyframe { metadata, .. } => {
+                Packet::Keyframe { metadata, .. } | Packet::DeltaKeyframe { metadata, .. } => {
                     if metadata.elapsed_frames == keyframe_frames_index {
                         self.next_compressed_packet_index = Some(subpacket_index);
-                        return Ok(())
+                        return Ok(Some(subpacket_index))
                     }
                 },
                 _ => continue
             }
         }
 
-        unreachable!("failed to find keyframe somehow even though we somehow had it in self.keyframes...");
+        // The blob's keyframe list doesn't match what's in it, so the file is corrupt.
+        Err(ReplaySeekError::ReadError { error: ReplayFileReadError::BrokenPacket { explanation: Cow::Owned(format!("Compressed blob is missing keyframe {keyframe_frames_index}")) } })
     }
 
     fn decompress_immediately(&mut self, blob_packet_index: usize) -> Result<(), ReplayFileReadError> {
-        let Some(Packet::CompressedBlob { compressed_data, uncompressed_size, .. }) = self.all_uncompressed_packets.get(blob_packet_index) else {
+        let all_packets = self.all_uncompressed_packets.clone();
+        let Some(Packet::CompressedBlob { compressed_data, uncompressed_size, .. }) = all_packets.get(blob_packet_index) else {
             panic!("decompress_immediately on {blob_packet_index} failed because it's not a compressed blob packet...")
         };
 
+        self.touch_blob(blob_packet_index);
+
         let decompressed_packets = self.compressed_blobs_finished
-            .get_mut(&blob_packet_index)
+            .get(&blob_packet_index)
             .expect("compressed blob should be in finished cache");
 
-        let working_blob = self.compressed_blobs_decompressing
-            .get_mut(&blob_packet_index)
-            .expect("compressed blob should be in working cache");
-
         if decompressed_packets.is_some() {
             return Ok(())
         }
 
-        loop {
-            let Some(working_blob_ref) = working_blob.as_ref() else {
-                // we have to decompress on the main thread. sad.
-                let packets = decompress_compressed_blob(
-                    compressed_data.as_slice(),
-                    usize::try_from(*uncompressed_size).expect("we checked uncompressed size converting earlier")
-                )?;
-                *decompressed_packets = Some(packets);
-                return Ok(());
-            };
+        #[cfg(feature = "std")]
+        let stall_start = Instant::now();
 
-            let status = unwrap_mutex_lock!(working_blob_ref.lock());
-            match &*status {
-                PacketDecompressionStatus::InProgress => {
-                    continue;
-                }
-                PacketDecompressionStatus::Failed { error } => {
-                    let error = error.clone();
-                    drop(status);
-                    *working_blob = None;
-                    return Err(error)
-                }
-                PacketDecompressionStatus::Decompressed { packets } => {
-                    let packets = packets.clone();
-                    drop(status);
-                    *decompressed_packets = Some(packets);
-                    *working_blob = None;
-                    return Ok(());
-                }
+        // If a worker already has it, wait for it rather than decompressing it twice.
+        #[cfg(feature = "std")]
+        if let Some(receiver) = self.compressed_blobs_in_flight.remove(&blob_packet_index) {
+            if let Ok(result) = receiver.recv() {
+                self.decompression_stall += stall_start.elapsed();
+                self.cache_blob(blob_packet_index, result?);
+                return Ok(())
             }
         }
+
+        // we have to decompress on the main thread. sad.
+        #[cfg(feature = "std")]
+        let lazy_data = match self.lazy_blobs.as_ref() {
+            Some(lazy_blobs) => Some(lazy_blobs.read_blob(blob_packet_index)?),
+            None => None
+        };
+
+        #[cfg(feature = "std")]
+        let compressed_data = lazy_data.as_deref().unwrap_or(compressed_data.as_slice());
+
+        #[cfg(not(feature = "std"))]
+        let compressed_data = compressed_data.as_slice();
+
+        let packets = decompress_compressed_blob(
+            compressed_data,
+            usize::try_from(*uncompressed_size).expect("we checked uncompressed size converting earlier")
+        )?;
+
+        #[cfg(feature = "std")]
+        { self.decompression_stall += stall_start.elapsed(); }
+
+        self.cache_blob(blob_packet_index, packets);
+        Ok(())
+    }
+
+    fn blob_uncompressed_size(&self, blob_packet_index: usize) -> usize {
+        let Some(Packet::CompressedBlob { uncompressed_size, .. }) = self.all_uncompressed_packets.get(blob_packet_index) else {
+            unreachable!("not a compressed blob")
+        };
+        usize::try_from(*uncompressed_size).expect("we checked uncompressed size converting earlier")
+    }
+
+    fn touch_blob(&mut self, blob_packet_index: usize) {
+        self.cache_clock += 1;
+        self.compressed_blobs_last_used.insert(blob_packet_index, self.cache_clock);
+    }
+
+    fn cache_blob(&mut self, blob_packet_index: usize, packets: Arc<Vec<Packet>>) {
+        let size = self.blob_uncompressed_size(blob_packet_index);
+        let entry = self.compressed_blobs_finished
+            .get_mut(&blob_packet_index)
+            .expect("compressed blob should be in finished cache");
+        if entry.replace(packets).is_none() {
+            self.cached_bytes += size;
+        }
+    }
+
+    fn evict_blob(&mut self, blob_packet_index: usize) {
+        let size = self.blob_uncompressed_size(blob_packet_index);
+        let entry = self.compressed_blobs_finished
+            .get_mut(&blob_packet_index)
+            .expect("compressed blob should be in finished cache");
+        if entry.take().is_some() {
+            self.cached_bytes -= size;
+        }
+        self.compressed_blobs_last_used.remove(&blob_packet_index);
     }
 
     /// Get the next packet in the stream.
     ///
+    /// [`Packet::RepeatFrames`] is never returned; each of its frames is returned as a
+    /// [`Packet::NextFrame`] instead.
+    ///
     /// If there is no packet, `Ok(None)` will be returned.
     pub fn next_packet(&mut self) -> Result<Option<&Packet>, ReplayFileReadError> {
+        if self.reconstructed_keyframe_pending {
+            // Skip the delta keyframe we seeked to and hand out the full one instead.
+            self.reconstructed_keyframe_pending = false;
+            self.next_stored_packet()?;
+            return Ok(self.reconstructed_keyframe.as_ref())
+        }
+
+        if self.repeat.is_none() {
+            // SAFETY: Nothing below touches the blob cache before the packet is returned.
+            let packet = self.next_stored_packet()?.map(|p| unsafe { launder_reference(p) });
+            match packet {
+                Some(&Packet::RepeatFrames { count, total_delta }) if count > 0 => {
+                    self.repeat = Some(RepeatProgress { count, total_delta, done: 0 });
+                },
+                Some(&Packet::RepeatFrames { .. }) => return self.next_packet(),
+                packet => return Ok(packet)
+            }
+        }
+
+        let repeat = self.repeat.as_mut().expect("checked above");
+        let timestamp_delta = repeat.millis_at(repeat.done + 1) - repeat.millis_at(repeat.done);
+        repeat.done += 1;
+        if repeat.done == repeat.count {
+            self.repeat = None;
+        }
+
+        self.repeated_frame = Packet::NextFrame { timestamp_delta };
+        Ok(Some(&self.repeated_frame))
+    }
+
+    fn next_stored_packet(&mut self) -> Result<Option<&Packet>, ReplayFileReadError> {
         let packet_index = self.next_uncompressed_packet_index;
         if packet_index >= self.all_uncompressed_packets.len() {
             return Ok(None)
         }
 
-        self.hint_decompress_next_blob_and_cleanup();
+        self.update_cache();
 
         // SAFETY: This will never be mutated or moved.
         let next_packet = unsafe { launder_reference({
@@ -426,7 +727,7 @@ impl ReplayFilePlayer {
                 None => {
                     self.next_compressed_packet_index = None;
                     self.next_uncompressed_packet_index += 1;
-                    self.next_packet()
+                    self.next_stored_packet()
                 }
             }
         }
@@ -447,124 +748,110 @@ impl ReplayFilePlayer {
         }
     }
 
-    fn hint_decompress_next_blob_and_cleanup(&mut self) {
-        let current_frame_index = self.next_uncompressed_packet_index;
+    /// Collect finished background work and, if the player moved to another blob, move the
+    /// read-ahead/read-behind window with it.
+    fn update_cache(&mut self) {
+        #[cfg(feature = "std")]
+        self.collect_finished_blobs();
 
-        if self.cleanup_enabled {
-            let last_compressed_blob = self
-                .compressed_blob_uncompressed_packet_indices
-                .iter()
-                .copied()
-                .filter(|frame_index| *frame_index < current_frame_index)
-                .last();
-
-            if let Some(last_compressed_blob_packet_index) = last_compressed_blob {
-                for i in 0..last_compressed_blob_packet_index {
-                    self.compressed_blobs_finished.insert(i, None);
-                    self.compressed_blobs_decompressing.insert(i, None);
-                }
+        // Number of blobs at or before the next packet; blob indices are sorted.
+        let current_packet_index = self.next_uncompressed_packet_index;
+        let position = self.compressed_blob_uncompressed_packet_indices.partition_point(|i| *i <= current_packet_index);
+        if self.cache_window_position == Some(position) {
+            return
+        }
+        self.cache_window_position = Some(position);
+
+        let blob_count = self.compressed_blob_uncompressed_packet_indices.len();
+        let current = position.checked_sub(1);
+        let start = current.map(|c| c.saturating_sub(self.cache_settings.read_behind_blobs)).unwrap_or(0);
+        let end = position.saturating_add(self.cache_settings.read_ahead_blobs).min(blob_count);
+        self.cache_window = start..end.max(start);
+
+        for i in self.cache_window.clone() {
+            let blob_packet_index = self.compressed_blob_uncompressed_packet_indices[i];
+            if self.compressed_blobs_finished[&blob_packet_index].is_some() {
+                self.touch_blob(blob_packet_index);
             }
         }
 
-        #[cfg(feature = "std")]
-        if self.threading {
-            let next_compressed_blob = self
-                .compressed_blob_uncompressed_packet_indices
-                .iter()
-                .copied()
-                .filter(|frame_index| *frame_index > current_frame_index)
-                .next();
+        if self.cleanup_enabled {
+            self.evict_blobs_over_budget();
+        }
 
-            if let Some(next_compressed_blob_index) = next_compressed_blob {
-                self.decompress_blob_threaded(next_compressed_blob_index);
+        #[cfg(feature = "std")]
+        if self.decompression_pool.is_some() {
+            // Closest blobs first, since those will be needed soonest.
+            let anchor = current.unwrap_or(0);
+            let mut wanted: Vec<usize> = self.cache_window.clone().collect();
+            wanted.sort_by_key(|i| i.abs_diff(anchor));
+            for i in wanted {
+                self.decompress_blob_threaded(self.compressed_blob_uncompressed_packet_indices[i]);
             }
         }
     }
 
+    /// Drop the least recently used blobs outside the window until the cache fits the budget.
+    fn evict_blobs_over_budget(&mut self) {
+        let budget = self.cache_settings.memory_budget;
+        while self.cached_bytes > budget {
+            let window = &self.cache_window;
+            let indices = &self.compressed_blob_uncompressed_packet_indices;
+            let least_recently_used = self.compressed_blobs_last_used
+                .iter()
+                .filter(|(blob_packet_index, _)| {
+                    let position = indices.binary_search(blob_packet_index).expect("last used blob is not a blob");
+                    !window.contains(&position)
+                })
+                .min_by_key(|(_, last_used)| **last_used)
+                .map(|(blob_packet_index, _)| *blob_packet_index);
+
+            let Some(blob_packet_index) = least_recently_used else {
+                break
+            };
+            self.evict_blob(blob_packet_index);
+        }
+    }
+
     #[cfg(feature = "std")]
-    fn decompress_blob_threaded(&mut self, blob_index: usize) {
-        if !self.threading {
-            return;
-        }
-
-        if self.compressed_blobs_finished[&blob_index].is_some() {
-            return;
-        }
-
-        let q = self.compressed_blobs_decompressing
-            .get_mut(&blob_index)
-            .expect("compressed_blobs_decompressing exploded");
-
-        let Some(status) = q else {
-            // Not decompressed; start decompression...
-
-            let status = Arc::new(Mutex::new(PacketDecompressionStatus::InProgress));
-            *q = Some(status.clone());
-            let status_ref = Arc::downgrade(&status);
-            let packets = self.all_uncompressed_packets.clone();
-            match std::thread::Builder::new()
-                .name("ReplayFilePlayer-decompression-thread".to_owned())
-                .spawn(move || {
-                    let Packet::CompressedBlob { uncompressed_size, compressed_data, .. } = packets
-                        .get(blob_index)
-                        .expect("failed to get packet") else {
-                        panic!("compressed blob wasn't a compressed blob NOOOOO")
-                    };
-                    let decompressed = decompress_compressed_blob(compressed_data.as_slice(), usize::try_from(*uncompressed_size).expect("we checked this could be a usize!"));
-                    let Some(r) = status_ref.upgrade() else {
-                        return
-                    };
-
-                    let mut r = unwrap_mutex_lock!(r.lock());
-
-                    match decompressed {
-                        Ok(n) => {
-                            *r = PacketDecompressionStatus::Decompressed { packets: n }
-                        },
-                        Err(error) => {
-                            *r = PacketDecompressionStatus::Failed { error }
-                        }
-                    }
+    fn collect_finished_blobs(&mut self) {
+        if self.compressed_blobs_in_flight.is_empty() {
+            return
+        }
 
-                }) {
-                Ok(_) => {
-                    return
+        let mut finished = Vec::new();
+        self.compressed_blobs_in_flight.retain(|blob_packet_index, receiver| {
+            match receiver.try_recv() {
+                Ok(result) => {
+                    finished.push((*blob_packet_index, result));
+                    false
                 },
-                Err(_) => {
-                    *q = None;
-                    return
-                }
+                Err(TryRecvError::Empty) => true,
+                Err(TryRecvError::Disconnected) => false
             }
-        };
-
-        // Decompression was at least started at some point?
+        });
 
-        let lock;
-        #[cfg(feature = "std")]
-        {
-            lock = status.try_lock().ok();
+        // Failures are reported when the blob is actually needed and decompressed on this thread.
+        for (blob_packet_index, result) in finished {
+            if let Ok(packets) = result {
+                self.cache_blob(blob_packet_index, packets);
+                self.touch_blob(blob_packet_index);
+            }
         }
+    }
 
-        #[cfg(not(feature = "std"))]
-        {
-            lock = status.try_lock();
-        }
+    #[cfg(feature = "std")]
+    fn decompress_blob_threaded(&mut self, blob_packet_index: usize) {
+        let Some(pool) = self.decompression_pool.as_ref() else {
+            return
+        };
 
-        if let Some(f) = lock.as_ref() {
-            match &**f {
-                PacketDecompressionStatus::InProgress => return,
-                PacketDecompressionStatus::Failed { .. } => return,
-                PacketDecompressionStatus::Decompressed { packets } => {
-                    self.compressed_blobs_finished.insert(blob_index, Some(packets.clone()));
-                }
-            }
-        }
-        else {
+        if self.compressed_blobs_finished[&blob_packet_index].is_some() || self.compressed_blobs_in_flight.contains_key(&blob_packet_index) {
             return
         }
 
-        drop(lock);
-        *q = None;
+        let receiver = pool.submit(self.all_uncompressed_packets.clone(), self.lazy_blobs.clone(), blob_packet_index);
+        self.compressed_blobs_in_flight.insert(blob_packet_index, receiver);
     }
 }
 
@@ -592,6 +879,43 @@ pub enum ReplayFileReadError {
     Other { explanation: Cow<'static, str> }
 }
 
+fn parse_header(header_bytes: &ReplayHeaderBytes) -> Result<(ReplayFileMetadata, usize), ReplayFileReadError> {
+    let header_raw = ReplayHeaderRaw::from_bytes(header_bytes);
+    let replay_file_metadata = header_raw
+        .parse()
+        .map_err(|e| ReplayFileReadError::InvalidReplayFile { explanation: Cow::Owned(format!("Failed to read header: {e}")) })?;
+
+    let patch_length = usize::try_from(header_raw.patch_data_length)
+        .map_err(|_| ReplayFileReadError::InvalidReplayFile { explanation: Cow::Borrowed("Cannot read patch length (exceeds usize)") })?;
+
+    Ok((replay_file_metadata, patch_length))
+}
+
+/// Rebuild the full save state of the keyframe packet at `index` from the keyframes before it.
+fn reconstruct_keyframe_state(packets: &[Packet], index: usize) -> Result<Vec<u8>, ReplayFileReadError> {
+    let no_base = || ReplayFileReadError::InvalidReplayFile { explanation: Cow::Borrowed("Delta keyframe has no full keyframe before it") };
+
+    let mut deltas = Vec::new();
+    let mut i = index;
+    let base = loop {
+        match &packets[i] {
+            Packet::Keyframe { state, .. } => break state.as_slice(),
+            Packet::DeltaKeyframe { delta, .. } => deltas.push(delta.as_slice()),
+            Packet::CompressedBlob { .. } => return Err(no_base()),
+            _ => {}
+        }
+        i = i.checked_sub(1).ok_or_else(no_base)?;
+    };
+
+    let mut state = base.to_vec();
+    for delta in deltas.iter().rev() {
+        state = apply_diff(state.as_slice(), delta)
+            .map_err(|e| ReplayFileReadError::BrokenPacket { explanation: Cow::Owned(format!("Failed to rebuild keyframe - {e}")) })?;
+    }
+
+    Ok(state)
+}
+
 fn decompress_compressed_blob(blob_data: &[u8], uncompressed_size: usize) -> Result<Arc<Vec<Packet>>, ReplayFileReadError> {
     let decompressed_data = decompress_data(blob_data, uncompressed_size)
         .map_err(|e| ReplayFileReadError::Other { explanation: Cow::Owned(format!("Decompression error: {e}")) })?;
@@ -608,12 +932,4 @@ fn decompress_compressed_blob(blob_data: &[u8], uncompressed_size: usize) -> Res
     Ok(Arc::new(packets))
 }
 
-#[derive(Clone)]
-#[cfg_attr(not(feature = "std"), expect(dead_code))]
-enum PacketDecompressionStatus {
-    InProgress,
-    Failed { error: ReplayFileReadError },
-    Decompressed { packets: Arc<Vec<Packet>> }
-}
-
 // TODO: WRITE UNIT TESTS
@@ -0,0 +1,327 @@
+//! Lazily loaded replays.
+//!
+//! Only the header and the top-level packets are read up front. Compressed blob data is skipped
+//! over and read back from the source when the blob is decompressed.
+//!
+//! If the replay ends with a seek index, only the header and the index are read, and the rest of
+//! the file is not scanned at all.
+
+use super::{parse_header, ReplayFilePlayer, ReplayFileReadError};
+use crate::replay_file::ReplayHeaderBytes;
+use crate::{BookmarkMetadata, ByteVec, KeyframeMetadata, Packet, PacketDiscriminator, PacketIO, PacketReadError, SeekIndexEntry, UnsignedInteger, SEEK_INDEX_FOOTER_LENGTH, SEEK_INDEX_MAGIC};
+use alloc::borrow::Cow;
+use alloc::boxed::Box;
+use alloc::collections::BTreeMap;
+use alloc::format;
+use alloc::sync::Arc;
+use alloc::vec::Vec;
+use std::io::{Read, Seek, SeekFrom};
+use std::sync::Mutex;
+
+/// Something a replay can be lazily read from, such as a [`File`](std::fs::File).
+pub trait ReplaySource: Read + Seek + Send {}
+impl<T: Read + Seek + Send> ReplaySource for T {}
+
+/// How many bytes to read at a time when scanning for packets.
+const READ_SIZE: usize = 64 * 1024;
+
+pub(super) struct LazyBlobs {
+    source: Mutex<Box<dyn ReplaySource>>,
+
+    /// Offset and length of each blob's compressed data, keyed by top-level packet index.
+    ranges: BTreeMap<usize, (u64, usize)>
+}
+
+impl LazyBlobs {
+    pub fn read_blob(&self, packet_index: usize) -> Result<Vec<u8>, ReplayFileReadError> {
+        let (offset, len) = *self.ranges.get(&packet_index).expect("read_blob on something that isn't a lazy blob");
+        let io_error = |e: std::io::Error| ReplayFileReadError::Other { explanation: Cow::Owned(format!("Failed to read compressed blob: {e}")) };
+
+        let mut data = Vec::new();
+        data.try_reserve_exact(len).map_err(|_| ReplayFileReadError::Other { explanation: Cow::Borrowed("failed to allocate RAM to read compressed blob") })?;
+        data.resize(len, 0);
+
+        let Ok(mut source) = self.source.lock() else {
+            return Err(ReplayFileReadError::Other { explanation: Cow::Borrowed("replay source was poisoned") })
+        };
+        source.seek(SeekFrom::Start(offset)).map_err(io_error)?;
+        source.read_exact(data.as_mut_slice()).map_err(io_error)?;
+        Ok(data)
+    }
+}
+
+impl ReplayFilePlayer {
+    /// Read only the header and top-level packets from `source`.
+    ///
+    /// Compressed blobs are read from `source` as they are needed, so it must stay unchanged for
+    /// as long as the player exists. Compressed blobs returned by
+    /// [`ReplayFilePlayer::all_uncompressed_packets`] will have empty `compressed_data`.
+    ///
+    /// See [`ReplayFilePlayer::new`] for what `allow_some_corruption` does.
+    ///
+    /// The `std` feature is required to use this.
+    pub fn new_lazy<S: ReplaySource + 'static>(mut source: S, allow_some_corruption: bool) -> Result<ReplayFilePlayer, ReplayFileReadError> {
+        let io_error = |e: std::io::Error| ReplayFileReadError::Other { explanation: Cow::Owned(format!("Failed to read replay: {e}")) };
+
+        let source_len = source.seek(SeekFrom::End(0)).map_err(io_error)?;
+        source.seek(SeekFrom::Start(0)).map_err(io_error)?;
+
+        let mut header_bytes: ReplayHeaderBytes = [0u8; size_of::<ReplayHeaderBytes>()];
+        source.read_exact(header_bytes.as_mut_slice())
+            .map_err(|_| ReplayFileReadError::InvalidReplayFile { explanation: Cow::Borrowed("cannot read header") })?;
+        let (replay_file_metadata, patch_length) = parse_header(&header_bytes)?;
+
+        let patch_data = if patch_length > 0 {
+            let mut patch_data = Vec::new();
+            if (&mut source).take(patch_length as u64).read_to_end(&mut patch_data).map_err(io_error)? != patch_length {
+                return Err(ReplayFileReadError::InvalidReplayFile { explanation: Cow::Borrowed("Cannot read patch end (out-of-bounds)") })
+            }
+            Some(patch_data)
+        }
+        else {
+            None
+        };
+
+        let data_start = (header_bytes.len() + patch_length) as u64;
+
+        // Older replays and replays that were never closed don't have an index, so scan those.
+        if let Some(blobs) = read_seek_index(&mut source, data_start, source_len) {
+            let mut all_packets = Vec::with_capacity(blobs.len());
+            let mut ranges = BTreeMap::new();
+            for blob in blobs {
+                ranges.insert(all_packets.len(), (blob.compressed_data_offset, blob.compressed_data_length as usize));
+                all_packets.push(Packet::CompressedBlob {
+                    keyframes: blob.keyframes,
+                    bookmarks: blob.bookmarks,
+                    compressed_data: ByteVec::new(),
+                    uncompressed_size: blob.uncompressed_size,
+                    timestamp_start: blob.timestamp_start,
+                    timestamp_end: blob.timestamp_end,
+                    elapsed_frames_start: blob.elapsed_frames_start,
+                    elapsed_frames_end: blob.elapsed_frames_end
+                });
+            }
+
+            let mut player = Self::from_packets(replay_file_metadata, patch_data, all_packets)?;
+            player.lazy_blobs = Some(Arc::new(LazyBlobs { source: Mutex::new(Box::new(source)), ranges }));
+            return Ok(player)
+        }
+
+        source.seek(SeekFrom::Start(data_start)).map_err(io_error)?;
+
+        let mut window = ReadWindow {
+            source: &mut source,
+            buffer: Vec::new(),
+            start: 0,
+            position: data_start,
+            source_len
+        };
+
+        let mut all_packets = Vec::new();
+        let mut ranges = BTreeMap::new();
+
+        loop {
+            match window.next_packet(&mut ranges, all_packets.len()) {
+                Ok(Some(packet)) => all_packets.push(packet),
+                Ok(None) => break,
+                Err(_) if allow_some_corruption => break,
+                Err(LazyReadError::Io(e)) => return Err(io_error(e)),
+                Err(LazyReadError::Packet(PacketReadError::NotEnoughData)) => return Err(ReplayFileReadError::BrokenPacket { explanation: Cow::Borrowed("not enough data for a packet") }),
+                Err(LazyReadError::Packet(PacketReadError::ParseFail { explanation })) => return Err(ReplayFileReadError::BrokenPacket { explanation: Cow::Owned(format!("Parse failure: {explanation}")) })
+            }
+        }
+
+        // Anything we broke off at due to corruption should not be read later.
+        ranges.retain(|index, _| *index < all_packets.len());
+
+        let mut player = Self::from_packets(replay_file_metadata, patch_data, all_packets)?;
+        player.lazy_blobs = Some(Arc::new(LazyBlobs { source: Mutex::new(Box::new(source)), ranges }));
+        Ok(player)
+    }
+}
+
+/// Read the seek index at the end of the source, if there is a valid one.
+///
+/// Any problem with the index just means the file has to be scanned, so errors are not reported.
+fn read_seek_index<S: ReplaySource>(source: &mut S, data_start: u64, source_len: u64) -> Option<Vec<SeekIndexEntry>> {
+    let footer_start = source_len.checked_sub(SEEK_INDEX_FOOTER_LENGTH as u64).filter(|s| *s >= data_start)?;
+
+    let mut footer = [0u8; SEEK_INDEX_FOOTER_LENGTH];
+    source.seek(SeekFrom::Start(footer_start)).ok()?;
+    source.read_exact(&mut footer).ok()?;
+    if footer[8..] != SEEK_INDEX_MAGIC {
+        return None
+    }
+
+    let packet_length = u64::from_le_bytes(footer[..8].try_into().unwrap());
+    let packet_start = source_len.checked_sub(packet_length).filter(|s| *s >= data_start)?;
+
+    let mut packet = Vec::new();
+    packet.try_reserve_exact(packet_length as usize).ok()?;
+    packet.resize(packet_length as usize, 0);
+    source.seek(SeekFrom::Start(packet_start)).ok()?;
+    source.read_exact(packet.as_mut_slice()).ok()?;
+
+    let mut data = packet.as_slice();
+    let Ok(Packet::SeekIndex { blobs }) = Packet::read_all(&mut data) else {
+        return None
+    };
+    if !data.is_empty() {
+        return None
+    }
+
+    // Blobs must be in order and entirely before the index.
+    let mut previous_end = data_start;
+    for blob in &blobs {
+        let end = blob.compressed_data_offset.checked_add(blob.compressed_data_length)?;
+        if blob.compressed_data_offset < previous_end || end > packet_start {
+            return None
+        }
+        previous_end = end;
+    }
+
+    Some(blobs)
+}
+
+enum LazyReadError {
+    Io(std::io::Error),
+    Packet(PacketReadError)
+}
+
+impl From<std::io::Error> for LazyReadError {
+    fn from(value: std::io::Error) -> Self {
+        Self::Io(value)
+    }
+}
+
+impl From<PacketReadError> for LazyReadError {
+    fn from(value: PacketReadError) -> Self {
+        Self::Packet(value)
+    }
+}
+
+/// Buffered view of the source starting at `position`.
+struct ReadWindow<'a, S: ReplaySource> {
+    source: &'a mut S,
+    buffer: Vec<u8>,
+    start: usize,
+
+    /// Offset of `buffer[start]` in the source.
+    position: u64,
+    source_len: u64
+}
+
+impl<S: ReplaySource> ReadWindow<'_, S> {
+    fn available(&self) -> &[u8] {
+        &self.buffer[self.start..]
+    }
+
+    fn is_at_end(&self) -> bool {
+        self.position >= self.source_len
+    }
+
+    /// Buffer at least `len` bytes, or everything left if there aren't that many.
+    fn fill(&mut self, len: usize) -> Result<(), std::io::Error> {
+        let end = (self.position + len as u64).min(self.source_len);
+        let wanted = (end - self.position) as usize;
+        if wanted <= self.available().len() {
+            return Ok(())
+        }
+
+        self.buffer.drain(..self.start);
+        self.start = 0;
+
+        let old_len = self.buffer.len();
+        self.buffer.resize(wanted, 0);
+        self.source.read_exact(&mut self.buffer[old_len..])?;
+        Ok(())
+    }
+
+    fn consume(&mut self, len: usize) {
+        self.start += len;
+        self.position += len as u64;
+    }
+
+    /// Skip `len` bytes, which must not go past the end of the source.
+    fn skip(&mut self, len: u64) -> Result<(), LazyReadError> {
+        if len > self.source_len - self.position {
+            return Err(PacketReadError::NotEnoughData.into())
+        }
+
+        let buffered = self.available().len() as u64;
+        if len <= buffered {
+            self.consume(len as usize);
+            return Ok(())
+        }
+
+        self.buffer.clear();
+        self.start = 0;
+        self.position += len;
+        self.source.seek(SeekFrom::Start(self.position))?;
+        Ok(())
+    }
+
+    /// Read something, buffering more until there is enough data to read it.
+    fn read<T>(&mut self, reader: impl Fn(&mut &[u8]) -> Result<T, PacketReadError>) -> Result<T, LazyReadError> {
+        let mut wanted = READ_SIZE;
+        loop {
+            self.fill(wanted)?;
+
+            let mut data = self.available();
+            let buffered = data.len();
+            match reader(&mut data) {
+                Ok(value) => {
+                    let used = buffered - data.len();
+                    self.consume(used);
+                    return Ok(value)
+                },
+                Err(PacketReadError::NotEnoughData) if self.position + (buffered as u64) < self.source_len => {
+                    wanted = buffered.saturating_mul(2);
+                },
+                Err(e) => return Err(e.into())
+            }
+        }
+    }
+
+    /// Read the next top-level packet, skipping over compressed blob data.
+    fn next_packet(&mut self, ranges: &mut BTreeMap<usize, (u64, usize)>, packet_index: usize) -> Result<Option<Packet>, LazyReadError> {
+        if self.is_at_end() {
+            return Ok(None)
+        }
+
+        // Peek at the discriminator without consuming it.
+        let discriminator = self.read(|from| from.first().copied().ok_or(PacketReadError::NotEnoughData))?;
+        if discriminator != PacketDiscriminator::CompressedBlob {
+            return self.read(|from| Packet::read_all(from)).map(Some)
+        }
+
+        let (keyframes, bookmarks, compressed_len) = self.read(|from| {
+            u8::read_all(from)?;
+            Ok((Vec::<KeyframeMetadata>::read_all(from)?, Vec::<BookmarkMetadata>::read_all(from)?, usize::read_all(from)?))
+        })?;
+
+        let compressed_offset = self.position;
+        self.skip(compressed_len as u64)?;
+
+        let [uncompressed_size, timestamp_start, timestamp_end, elapsed_frames_start, elapsed_frames_end] = self.read(|from| {
+            let mut values = [0; 5];
+            for v in &mut values {
+                *v = UnsignedInteger::read_all(from)?;
+            }
+            Ok(values)
+        })?;
+
+        ranges.insert(packet_index, (compressed_offset, compressed_len));
+
+        Ok(Some(Packet::CompressedBlob {
+            keyframes,
+            bookmarks,
+            compressed_data: ByteVec::new(),
+            uncompressed_size,
+            timestamp_start,
+            timestamp_end,
+            elapsed_frames_start,
+            elapsed_frames_end
+        }))
+    }
+}
@@ -0,0 +1,70 @@
+//! Worker threads that decompress blobs in the background.
+
+use super::{decompress_compressed_blob, LazyBlobs, ReplayFileReadError};
+use crate::Packet;
+use alloc::sync::Arc;
+use alloc::vec::Vec;
+use std::sync::Mutex;
+use std::sync::mpsc::{channel, Receiver, Sender};
+
+pub(super) type DecompressionResult = Result<Arc<Vec<Packet>>, ReplayFileReadError>;
+
+struct DecompressionJob {
+    packets: Arc<Vec<Packet>>,
+    lazy_blobs: Option<Arc<LazyBlobs>>,
+    blob_index: usize,
+    result: Sender<DecompressionResult>
+}
+
+/// Worker threads that decompress blobs; they exit once the pool is dropped.
+pub(super) struct DecompressionPool {
+    jobs: Sender<DecompressionJob>
+}
+
+impl DecompressionPool {
+    pub fn new(threads: usize) -> Self {
+        let (jobs, receiver) = channel::<DecompressionJob>();
+        let receiver = Arc::new(Mutex::new(receiver));
+
+        for i in 0..threads.max(1) {
+            let receiver = receiver.clone();
+            std::thread::Builder::new()
+                .name(alloc::format!("ReplayFilePlayer-decompression-thread{i}"))
+                .spawn(move || {
+                    loop {
+                        let Ok(job) = receiver.lock().map_err(|_| ()).and_then(|r| r.recv().map_err(|_| ())) else {
+                            break
+                        };
+
+                        // Nobody is waiting for this anymore.
+                        let _ = job.result.send(decompress_job(&job));
+                    }
+                })
+                .expect("failed to start a thread...");
+        }
+
+        Self { jobs }
+    }
+
+    /// Queue the compressed blob at `blob_index` of `packets` to be decompressed.
+    pub fn submit(&self, packets: Arc<Vec<Packet>>, lazy_blobs: Option<Arc<LazyBlobs>>, blob_index: usize) -> Receiver<DecompressionResult> {
+        let (result, receiver) = channel();
+
+        // If the workers are gone, the receiver will report it as disconnected.
+        let _ = self.jobs.send(DecompressionJob { packets, lazy_blobs, blob_index, result });
+        receiver
+    }
+}
+
+fn decompress_job(job: &DecompressionJob) -> DecompressionResult {
+    let Some(Packet::CompressedBlob { uncompressed_size, compressed_data, .. }) = job.packets.get(job.blob_index) else {
+        panic!("compressed blob wasn't a compressed blob NOOOOO")
+    };
+    let uncompressed_size = usize::try_from(*uncompressed_size).expect("we checked this could be a usize!");
+
+    match job.lazy_blobs.as_ref() {
+        Some(lazy_blobs) => lazy_blobs.read_blob(job.blob_index)
+            .and_then(|data| decompress_compressed_blob(data.as_slice(), uncompressed_size)),
+        None => decompress_compressed_blob(compressed_data.as_slice(), uncompressed_size)
+    }
+}
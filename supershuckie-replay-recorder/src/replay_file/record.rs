@@ -2,13 +2,16 @@
 //!
 //! See [`ReplayFileRecorder`] and [`NonBlockingReplayFileRecorder`].
 
-use crate::replay_file::ReplayFileMetadata;
-use crate::{BookmarkMetadata, ByteVec, InputBuffer, KeyframeMetadata, Packet, PacketIO, PacketWriteCommand, Speed, TimestampMillis, UnsignedInteger};
+use crate::replay_file::{ReplayFileMetadata, DELTA_KEYFRAME_REPLAY_VERSION, MINIMUM_REPLAY_VERSION, REPEAT_FRAMES_REPLAY_VERSION, REPLAY_VERSION, SEEK_INDEX_REPLAY_VERSION};
+use crate::{BookmarkMetadata, ByteVec, InputBuffer, KeyframeMetadata, Packet, PacketIO, PacketWriteCommand, SeekIndexEntry, Speed, TimestampMillis, UnsignedInteger};
 use alloc::string::String;
 use alloc::borrow::Cow;
 use alloc::vec::Vec;
 use alloc::format;
+use core::time::Duration;
 use zstd_sys::ZSTD_defaultCLevel;
+use compressor::BlobCompressor;
+use crate::replay_file::delta::diff_state_into;
 
 #[cfg(not(feature = "std"))]
 use spin::Lazy as LazyLock;
@@ -16,6 +19,8 @@ use spin::Lazy as LazyLock;
 #[cfg(feature = "std")]
 use std::sync::LazyLock;
 
+mod compressor;
+
 #[cfg(feature = "std")]
 mod thread;
 
@@ -36,15 +41,32 @@ use std::{
 pub struct ReplayFileRecorder<Final: ReplayFileSink, Temp: ReplayFileSink> {
     settings: ReplayFileRecorderSettings,
 
+    /// Uncompressed data not yet handed to the compressor.
     current_blob: Vec<u8>,
+    current_blob_uncompressed_size: u64,
     current_blob_keyframes: Vec<KeyframeMetadata>,
     current_blob_bookmarks: Vec<BookmarkMetadata>,
     current_blob_offset: u64,
+    compressor: BlobCompressor,
+
+    /// Every blob written to the final sink so far, written as a seek index when closed.
+    seek_index: Vec<SeekIndexEntry>,
 
     elapsed_frames: UnsignedInteger,
     elapsed_millis: TimestampMillis,
     last_keyframe_frames: UnsignedInteger,
 
+    /// Frames advanced since the last packet, written as one packet before the next one.
+    pending_frames: UnsignedInteger,
+    pending_frames_millis: TimestampMillis,
+
+    /// State of the last keyframe, which the next delta keyframe is diffed against.
+    last_keyframe_state: ByteVec,
+
+    /// Buffer that delta keyframes are diffed into, kept so it isn't reallocated every keyframe.
+    keyframe_delta: ByteVec,
+    keyframes_since_full: u64,
+
     current_speed: Speed,
     current_input: InputBuffer,
 
@@ -69,12 +91,77 @@ pub struct ReplayFileRecorderSettings {
     /// zstd compression level
     ///
     /// Default is [`DEFAULT_ZSTD_COMPRESSION_LEVEL`]
-    pub compression_level: i32
+    pub compression_level: i32,
+
+    /// Uncompressed bytes per zstd frame
+    ///
+    /// Blobs are compressed in frames of this size as they are recorded rather than all at once
+    /// when the blob is finished. If 0, each blob is compressed in one go.
+    ///
+    /// Default is [`DEFAULT_COMPRESSION_CHUNK_SIZE`]
+    pub compression_chunk_size: usize,
+
+    /// Number of worker threads to compress frames on
+    ///
+    /// If 0 (or if `std` is disabled), frames are compressed on the recording thread.
+    ///
+    /// Default is [`DEFAULT_COMPRESSION_THREADS`]
+    pub compression_threads: usize,
+
+    /// Maximum bytes to hold in memory for the current blob, or 0 for no limit
+    ///
+    /// If set, blobs are finished early at the next keyframe once this much data is buffered,
+    /// regardless of `minimum_uncompressed_bytes_per_blob`, so memory usage does not depend on how
+    /// long the recording runs. Up to one keyframe interval of data may be buffered past this.
+    ///
+    /// This only affects memory; finished blobs are still written to the temp sink, so it stays a
+    /// complete replay if recording is interrupted.
+    ///
+    /// Default is 0
+    pub memory_budget: usize,
+
+    /// Store every nth keyframe in full
+    ///
+    /// The rest are stored as a diff against the previous keyframe. The first keyframe of each
+    /// blob is always stored in full, so a keyframe never depends on another blob. If 0 or 1, or if
+    /// `replay_version` is older than [`DELTA_KEYFRAME_REPLAY_VERSION`], every keyframe is stored in
+    /// full.
+    ///
+    /// Default is 1
+    pub full_keyframe_interval: u64,
+
+    /// Write a seek index at the end of the final sink when closed
+    ///
+    /// This lets players find every blob and keyframe from the end of the file instead of scanning
+    /// the whole file. Players that don't read it skip over it. It is never written if
+    /// `replay_version` is older than [`SEEK_INDEX_REPLAY_VERSION`].
+    ///
+    /// Default is `true`
+    pub write_seek_index: bool,
+
+    /// Replay format version to write
+    ///
+    /// Older versions can be read by older builds, but packets added since are not written, so
+    /// they may be larger. Must be between [`MINIMUM_REPLAY_VERSION`] and [`REPLAY_VERSION`].
+    ///
+    /// Default is [`REPLAY_VERSION`]
+    pub replay_version: u32
 }
 
+/// Most frames written as a single [`Packet::RepeatFrames`].
+///
+/// This bounds how many frames are missing from the temp sink if recording is interrupted.
+pub const MAX_REPEAT_FRAMES: UnsignedInteger = 0x3FFF;
+
 /// Default minimum uncompressed bytes per blob
 pub const DEFAULT_MINIMUM_UNCOMPRESSED_BYTES_PER_BLOB: usize = 256 * 1024 * 1024;
 
+/// Default uncompressed bytes per zstd frame
+pub const DEFAULT_COMPRESSION_CHUNK_SIZE: usize = 4 * 1024 * 1024;
+
+/// Default number of compression worker threads
+pub const DEFAULT_COMPRESSION_THREADS: usize = if cfg!(feature = "std") { 2 } else { 0 };
+
 /// Default compression level
 ///
 /// This is generally going to be equal to `3`.
@@ -97,10 +184,16 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ReplayFileRecorder<Final, Temp
             settings.minimum_uncompressed_bytes_per_blob = 1024 * 1024 * 512;
         }
 
+        let replay_version = settings.replay_version;
+        if !(MINIMUM_REPLAY_VERSION..=REPLAY_VERSION).contains(&replay_version) {
+            return Err(ReplayFileWriteError::BadInput { explanation: Cow::Owned(format!("Cannot write replay format version {replay_version}")) })
+        }
+
         let mut metadata = replay_file_metadata
             .as_raw_header()
             .map_err(|e| ReplayFileWriteError::Other { explanation: Cow::Owned(e) })?;
 
+        metadata.replay_version = replay_version;
         metadata.patch_data_length = u64::try_from(patch_data.len())
             .map_err(|_| ReplayFileWriteError::Other { explanation: Cow::Borrowed("patch data too large") })?;
 
@@ -113,14 +206,24 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ReplayFileRecorder<Final, Temp
         temp_sink.write_bytes(patch_data.as_slice())?;
         final_sink.write_bytes(patch_data.as_slice())?;
 
+        let compressor = BlobCompressor::new(settings.compression_level, settings.compression_threads);
+
         let mut recorder = ReplayFileRecorder {
             settings,
+            compressor,
+            seek_index: Vec::new(),
             elapsed_frames: 0,
             elapsed_millis: 0,
             last_keyframe_frames: 0,
+            pending_frames: 0,
+            pending_frames_millis: 0,
+            last_keyframe_state: ByteVec::new(),
+            keyframe_delta: ByteVec::new(),
+            keyframes_since_full: 0,
             current_speed: starting_speed,
             current_input: starting_input,
             current_blob: Vec::new(),
+            current_blob_uncompressed_size: 0,
             current_blob_keyframes: Vec::new(),
             current_blob_bookmarks: Vec::new(),
             current_blob_offset: u64::try_from(current_blob_offset).expect("failed to read"),
@@ -146,6 +249,8 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ReplayFileRecorder<Final, Temp
 
     /// Close the replay file recorder.
     ///
+    /// The current blob is finished, and if enabled, the seek index is written.
+    ///
     /// You can no longer write to this.
     ///
     /// # Panics
@@ -154,18 +259,34 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ReplayFileRecorder<Final, Temp
     pub fn close(&mut self) -> Result<(Final, Temp), (Final, Temp, ReplayFileWriteError)> {
         assert!(!self.is_closed(), "Already closed...");
 
-        let _ = self.next_blob();
+        let result = self.next_blob().and_then(|_| self.write_seek_index());
 
         let Some(SinkTuple { final_sink, temp_sink }) = self.sink.take() else {
             unreachable!();
         };
 
-        if let Err(e) = self.next_blob() {
-            self.poisoned = true;
-            return Err((final_sink, temp_sink, e))
-        }
         self.poisoned = true;
-        Ok((final_sink, temp_sink))
+        match result {
+            Ok(()) => Ok((final_sink, temp_sink)),
+            Err(e) => Err((final_sink, temp_sink, e))
+        }
+    }
+
+    fn writes_seek_index(&self) -> bool {
+        self.settings.write_seek_index && self.settings.replay_version >= SEEK_INDEX_REPLAY_VERSION
+    }
+
+    fn write_seek_index(&mut self) -> Result<(), ReplayFileWriteError> {
+        if !self.writes_seek_index() {
+            return Ok(())
+        }
+
+        self.do_with_poison(|this| {
+            let seek_index = Packet::SeekIndex { blobs: core::mem::take(&mut this.seek_index) };
+            let (final_sink, _) = this.get_sinks();
+            final_sink.write_packet_data(&seek_index.write_packet_instructions())?;
+            Ok(())
+        })
     }
 
     /// Returns true if an unrecoverable error occurred.
@@ -174,15 +295,57 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ReplayFileRecorder<Final, Temp
     }
 
     /// Advance a new frame.
+    #[inline]
     pub fn next_frame(&mut self, timestamp: TimestampMillis) -> Result<(), ReplayFileWriteError> {
+        self.next_frames(1, timestamp)
+    }
+
+    /// Advance `count` frames, ending at `timestamp`.
+    ///
+    /// Frames are not written until something else is, so that a run of evenly paced frames with
+    /// nothing in between is written as one [`Packet::RepeatFrames`].
+    pub fn next_frames(&mut self, count: UnsignedInteger, timestamp: TimestampMillis) -> Result<(), ReplayFileWriteError> {
+        self.assert_not_closed()?;
+
         let elapsed_old = self.elapsed_millis;
         let timestamp_delta = timestamp.checked_sub(self.elapsed_millis)
             .ok_or_else(|| ReplayFileWriteError::BadInput { explanation: Cow::Owned(format!("Timestamp overflowed ({elapsed_old} -> {timestamp}")) })?;
 
-        self.elapsed_frames += 1;
+        if count == 0 {
+            return Ok(())
+        }
+        if !joins_repeat(self.pending_frames, self.pending_frames_millis, count, timestamp_delta) {
+            self.do_with_poison(|this| this.write_pending_frames())?;
+        }
+
+        self.elapsed_frames += count;
         self.elapsed_millis = timestamp;
+        self.pending_frames += count;
+        self.pending_frames_millis += timestamp_delta;
+
+        if self.pending_frames >= MAX_REPEAT_FRAMES {
+            self.do_with_poison(|this| this.write_pending_frames())?;
+        }
+
+        Ok(())
+    }
 
-        self.write_packet_data(&Packet::NextFrame { timestamp_delta })
+    fn write_pending_frames(&mut self) -> Result<(), ReplayFileWriteError> {
+        let count = core::mem::take(&mut self.pending_frames);
+        let total_delta = core::mem::take(&mut self.pending_frames_millis);
+        match count {
+            0 => Ok(()),
+            1 => self.write_packet_unchecked(&Packet::NextFrame { timestamp_delta: total_delta }),
+            _ if self.settings.replay_version < REPEAT_FRAMES_REPLAY_VERSION => {
+                // Spread the time the same way playback spreads a RepeatFrames packet.
+                let millis_at = |frame: UnsignedInteger| (total_delta as u128 * frame as u128 / count as u128) as TimestampMillis;
+                for frame in 0..count {
+                    self.write_packet_unchecked(&Packet::NextFrame { timestamp_delta: millis_at(frame + 1) - millis_at(frame) })?;
+                }
+                Ok(())
+            },
+            _ => self.write_packet_unchecked(&Packet::RepeatFrames { count, total_delta })
+        }
     }
 
     /// Add a bookmark.
@@ -210,7 +373,7 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ReplayFileRecorder<Final, Temp
         self.elapsed_millis = elapsed_millis;
         self.last_keyframe_frames = self.elapsed_frames;
 
-        if self.current_blob.len() >= self.settings.minimum_uncompressed_bytes_per_blob {
+        if self.current_blob_uncompressed_size >= self.settings.minimum_uncompressed_bytes_per_blob as u64 || self.is_over_memory_budget() {
             self.next_blob()?;
         }
 
@@ -223,36 +386,96 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ReplayFileRecorder<Final, Temp
 
         self.current_blob_keyframes.push(metadata.clone());
 
-        self.write_packet_data(&Packet::Keyframe {
-            metadata,
-            state
-        })?;
+        let interval = self.settings.full_keyframe_interval;
+        let full = interval <= 1
+            || self.settings.replay_version < DELTA_KEYFRAME_REPLAY_VERSION
+            || self.current_blob_keyframes.len() == 1
+            || self.keyframes_since_full + 1 >= interval;
+
+        if !full {
+            diff_state_into(self.last_keyframe_state.as_slice(), state.as_slice(), &mut self.keyframe_delta);
+        }
+
+        // The state becomes the next base and the delta buffer is kept, rather than either being
+        // copied or reallocated.
+        let result = if !full && self.keyframe_delta.len() < state.len() {
+            self.keyframes_since_full += 1;
+            let packet = Packet::DeltaKeyframe { metadata, delta: core::mem::take(&mut self.keyframe_delta) };
+            let result = self.write_packet_data(&packet);
+            let Packet::DeltaKeyframe { delta, .. } = packet else { unreachable!() };
+            self.keyframe_delta = delta;
+            self.last_keyframe_state = state;
+            result
+        }
+        else {
+            self.keyframes_since_full = 0;
+            let packet = Packet::Keyframe { metadata, state };
+            let result = self.write_packet_data(&packet);
+            let Packet::Keyframe { state, .. } = packet else { unreachable!() };
+            self.last_keyframe_state = state;
+            result
+        };
+        result?;
 
         Ok(self.elapsed_frames)
     }
 
+    fn is_over_memory_budget(&self) -> bool {
+        let budget = self.settings.memory_budget;
+        budget != 0 && self.compressor.buffered_bytes().saturating_add(self.current_blob.len()) >= budget
+    }
+
     fn next_blob(&mut self) -> Result<(), ReplayFileWriteError> {
         self.do_with_poison(|this| {
-            let uncompressed_size = this.current_blob.len();
-            let compressed = crate::compress_data(this.current_blob.as_slice(), this.settings.compression_level)
-                .map_err(|e| ReplayFileWriteError::Other { explanation: Cow::Owned(format!("next_blob failed to compress: {e}")) })?;
+            this.write_pending_frames()?;
 
-            this.current_blob.clear();
+            let uncompressed_size = core::mem::take(&mut this.current_blob_uncompressed_size);
+            if !this.current_blob.is_empty() {
+                this.push_current_chunk()?;
+            }
+            let compressed = this.compressor.finish()
+                .map_err(|e| ReplayFileWriteError::Other { explanation: Cow::Owned(format!("next_blob failed to compress: {e}")) })?;
 
             let keyframes_len = this.current_blob_keyframes.len();
 
             let first_keyframe =  this.current_blob_keyframes.first().expect("no keyframes in blob?");
+            let elapsed_frames_start = first_keyframe.elapsed_frames;
+            let timestamp_start = first_keyframe.elapsed_millis;
+
+            let keyframes = core::mem::take(&mut this.current_blob_keyframes);
+            let bookmarks = core::mem::take(&mut this.current_blob_bookmarks);
+
+            if this.writes_seek_index() {
+                // The compressed data comes after the discriminator, keyframes, bookmarks, and length.
+                let compressed_data_offset = this.current_blob_offset
+                    + 1
+                    + encoded_length(&keyframes)
+                    + encoded_length(&bookmarks)
+                    + encoded_length(&compressed.len());
+
+                this.seek_index.push(SeekIndexEntry {
+                    compressed_data_offset,
+                    compressed_data_length: compressed.len() as UnsignedInteger,
+                    uncompressed_size,
+                    timestamp_start,
+                    timestamp_end: this.elapsed_millis,
+                    elapsed_frames_start,
+                    elapsed_frames_end: this.elapsed_frames,
+                    keyframes: keyframes.clone(),
+                    bookmarks: bookmarks.clone()
+                });
+            }
 
             let compressed_blob = Packet::CompressedBlob {
-                elapsed_frames_start: first_keyframe.elapsed_frames,
+                elapsed_frames_start,
                 elapsed_frames_end: this.elapsed_frames,
-                timestamp_start: first_keyframe.elapsed_millis,
+                timestamp_start,
                 timestamp_end: this.elapsed_millis,
 
-                keyframes: core::mem::take(&mut this.current_blob_keyframes),
-                bookmarks: core::mem::take(&mut this.current_blob_bookmarks),
+                keyframes,
+                bookmarks,
                 compressed_data: ByteVec::Heap(compressed),
-                uncompressed_size: u64::try_from(uncompressed_size).expect("failed to convert uncompressed_size from usize to u64"),
+                uncompressed_size,
             };
 
             this.current_blob_keyframes.reserve(keyframes_len + 1024);
@@ -306,6 +529,7 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ReplayFileRecorder<Final, Temp
 
     fn write_packet_data<'a, P: PacketIO<'a>>(&mut self, what: &'a P) -> Result<(), ReplayFileWriteError> {
         self.do_with_poison(|this| {
+            this.write_pending_frames()?;
             this.write_packet_unchecked(what)?;
             Ok(())
         })
@@ -313,11 +537,25 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ReplayFileRecorder<Final, Temp
 
     fn write_packet_unchecked<'a, P: PacketIO<'a>>(&mut self, what: &'a P) -> Result<(), ReplayFileWriteError> {
         let instructions = what.write_packet_instructions();
-        self.current_blob.write_packet_data(&instructions)?;
+        let written = self.current_blob.write_packet_data(&instructions)?;
+        self.current_blob_uncompressed_size += u64::try_from(written).expect("failed to convert written packet data from usize to u64");
         self.sink.as_mut().expect("write_packet_data on None sink").temp_sink.write_packet_data(&instructions)?;
+
+        let chunk_size = self.settings.compression_chunk_size;
+        if chunk_size != 0 && self.current_blob.len() >= chunk_size {
+            self.push_current_chunk()?;
+        }
+
         Ok(())
     }
 
+    fn push_current_chunk(&mut self) -> Result<(), ReplayFileWriteError> {
+        let next_chunk = Vec::with_capacity(self.settings.compression_chunk_size);
+        let chunk = core::mem::replace(&mut self.current_blob, next_chunk);
+        self.compressor.push_chunk(chunk)
+            .map_err(|e| ReplayFileWriteError::Other { explanation: Cow::Owned(format!("failed to compress: {e}")) })
+    }
+
     fn get_sinks(&mut self) -> (&mut Final, &mut Temp) {
         let sink = self.sink.as_mut().expect("can't get sinks (already closed?)");
 
@@ -350,10 +588,29 @@ impl Default for ReplayFileRecorderSettings {
         Self {
             minimum_uncompressed_bytes_per_blob: DEFAULT_MINIMUM_UNCOMPRESSED_BYTES_PER_BLOB,
             compression_level: *DEFAULT_ZSTD_COMPRESSION_LEVEL,
+            compression_chunk_size: DEFAULT_COMPRESSION_CHUNK_SIZE,
+            compression_threads: DEFAULT_COMPRESSION_THREADS,
+            memory_budget: 0,
+            full_keyframe_interval: 1,
+            write_seek_index: true,
+            replay_version: REPLAY_VERSION
         }
     }
 }
 
+/// Return `true` if `count` frames taking `millis` can be added to a run of `run_count` frames
+/// taking `run_millis`.
+///
+/// Playback spreads a run's time evenly across its frames, so this only allows frames paced about
+/// the same as the rest of the run, which keeps each frame's time within a millisecond or two.
+pub(crate) fn joins_repeat(run_count: UnsignedInteger, run_millis: TimestampMillis, count: UnsignedInteger, millis: TimestampMillis) -> bool {
+    run_count == 0 || (millis / count).abs_diff(run_millis / run_count) <= 1
+}
+
+fn encoded_length<'a, P: PacketIO<'a>>(what: &'a P) -> u64 {
+    what.write_packet_instructions().iter().map(|i| i.bytes().len() as u64).sum()
+}
+
 /// Describes something that can store bytes contiguously, making it suitable for a replay file.
 pub trait ReplayFileSink {
     /// Writes bytes to the end of the sink.
@@ -476,6 +733,16 @@ pub trait ReplayFileRecorderFns: core::any::Any + 'static + Send {
     fn write_memory(&mut self, address: UnsignedInteger, data: ByteVec) -> Result<(), ReplayFileWriteError>;
     fn set_speed(&mut self, speed: Speed) -> Result<(), ReplayFileWriteError>;
     fn load_save_state(&mut self, state: ByteVec) -> Result<(), ReplayFileWriteError>;
+
+    /// Get the number of operations queued but not yet written, if the recorder is asynchronous.
+    fn queue_depth(&self) -> usize {
+        0
+    }
+
+    /// Get the time spent waiting for the recorder to catch up since this was last called, and reset it.
+    fn take_queue_stall(&mut self) -> Duration {
+        Duration::ZERO
+    }
 }
 
 impl<Final: ReplayFileSink + 'static + Send, Temp: ReplayFileSink + 'static + Send> ReplayFileRecorderFns for ReplayFileRecorder<Final, Temp> {
@@ -0,0 +1,173 @@
+//! Compresses blobs as a series of independent zstd frames.
+//!
+//! zstd decompresses concatenated frames as if they were one, so the resulting blobs are read by
+//! playback exactly the same way as blobs compressed in one go.
+
+use crate::compress_data;
+use alloc::borrow::Cow;
+use alloc::vec::Vec;
+
+#[cfg(feature = "std")]
+use std::{
+    collections::VecDeque,
+    sync::{Arc, Mutex},
+    sync::mpsc::{channel, Receiver, Sender}
+};
+
+#[cfg(feature = "std")]
+type CompressionResult = Result<Vec<u8>, Cow<'static, str>>;
+
+pub(crate) struct BlobCompressor {
+    compression_level: i32,
+
+    /// Frames that have finished compressing, in order.
+    compressed: Vec<u8>,
+
+    /// Uncompressed bytes of chunks handed to the pool that have not been collected yet.
+    #[cfg(feature = "std")]
+    in_flight_bytes: usize,
+
+    #[cfg(feature = "std")]
+    pool: Option<CompressionPool>,
+
+    /// Chunks handed to the pool that have not been collected yet, oldest first.
+    #[cfg(feature = "std")]
+    in_flight: VecDeque<(usize, Receiver<CompressionResult>)>
+}
+
+impl BlobCompressor {
+    /// Make a compressor.
+    ///
+    /// If `threads` is non-zero and `std` is enabled, chunks are compressed on that many worker
+    /// threads. Otherwise, they are compressed immediately in [`BlobCompressor::push_chunk`].
+    pub fn new(compression_level: i32, threads: usize) -> Self {
+        #[cfg(not(feature = "std"))]
+        let _ = threads;
+
+        Self {
+            compression_level,
+            compressed: Vec::new(),
+
+            #[cfg(feature = "std")]
+            in_flight_bytes: 0,
+
+            #[cfg(feature = "std")]
+            pool: (threads > 0).then(|| CompressionPool::new(threads)),
+
+            #[cfg(feature = "std")]
+            in_flight: VecDeque::new()
+        }
+    }
+
+    /// Compress `chunk` as the next frame of the current blob.
+    pub fn push_chunk(&mut self, chunk: Vec<u8>) -> Result<(), Cow<'static, str>> {
+        #[cfg(feature = "std")]
+        if let Some(pool) = self.pool.as_ref() {
+            self.in_flight_bytes += chunk.len();
+            self.in_flight.push_back((chunk.len(), pool.submit(chunk, self.compression_level)));
+
+            // Don't let uncompressed chunks pile up if the workers can't keep up.
+            let max_in_flight = pool.threads * 2;
+            while self.in_flight.len() > max_in_flight {
+                self.collect_oldest()?;
+            }
+
+            return self.collect_finished()
+        }
+
+        let compressed = compress_data(chunk.as_slice(), self.compression_level)?;
+        self.compressed.extend_from_slice(compressed.as_slice());
+        Ok(())
+    }
+
+    /// Get the number of bytes held for the current blob, compressed or not.
+    pub fn buffered_bytes(&self) -> usize {
+        #[cfg(feature = "std")]
+        return self.compressed.len() + self.in_flight_bytes;
+
+        #[cfg(not(feature = "std"))]
+        return self.compressed.len();
+    }
+
+    /// Wait for all pushed chunks and take the compressed blob.
+    pub fn finish(&mut self) -> Result<Vec<u8>, Cow<'static, str>> {
+        #[cfg(feature = "std")]
+        while !self.in_flight.is_empty() {
+            self.collect_oldest()?;
+        }
+
+        Ok(core::mem::take(&mut self.compressed))
+    }
+
+    #[cfg(feature = "std")]
+    fn collect_finished(&mut self) -> Result<(), Cow<'static, str>> {
+        while let Some((chunk_len, receiver)) = self.in_flight.front() {
+            match receiver.try_recv() {
+                Ok(result) => {
+                    self.in_flight_bytes -= *chunk_len;
+                    self.in_flight.pop_front();
+                    self.compressed.extend_from_slice(result?.as_slice());
+                },
+                Err(std::sync::mpsc::TryRecvError::Empty) => break,
+                Err(std::sync::mpsc::TryRecvError::Disconnected) => return Err(Cow::Borrowed("compression worker crashed"))
+            }
+        }
+        Ok(())
+    }
+
+    #[cfg(feature = "std")]
+    fn collect_oldest(&mut self) -> Result<(), Cow<'static, str>> {
+        let (chunk_len, receiver) = self.in_flight.pop_front().expect("collect_oldest with nothing in flight");
+        self.in_flight_bytes -= chunk_len;
+        let result = receiver.recv().map_err(|_| Cow::Borrowed("compression worker crashed"))?;
+        self.compressed.extend_from_slice(result?.as_slice());
+        Ok(())
+    }
+}
+
+#[cfg(feature = "std")]
+struct CompressionJob {
+    chunk: Vec<u8>,
+    compression_level: i32,
+    result: Sender<CompressionResult>
+}
+
+/// Worker threads that compress chunks; they exit once the pool is dropped.
+#[cfg(feature = "std")]
+struct CompressionPool {
+    threads: usize,
+    jobs: Sender<CompressionJob>
+}
+
+#[cfg(feature = "std")]
+impl CompressionPool {
+    fn new(threads: usize) -> Self {
+        let (jobs, receiver) = channel::<CompressionJob>();
+        let receiver = Arc::new(Mutex::new(receiver));
+
+        for i in 0..threads {
+            let receiver = receiver.clone();
+            std::thread::Builder::new()
+                .name(alloc::format!("ReplayCompressionThread{i}"))
+                .spawn(move || {
+                    loop {
+                        let Ok(job) = receiver.lock().map_err(|_| ()).and_then(|r| r.recv().map_err(|_| ())) else {
+                            break
+                        };
+                        let _ = job.result.send(compress_data(job.chunk.as_slice(), job.compression_level));
+                    }
+                })
+                .expect("failed to start a thread...");
+        }
+
+        Self { threads, jobs }
+    }
+
+    fn submit(&self, chunk: Vec<u8>, compression_level: i32) -> Receiver<CompressionResult> {
+        let (result, receiver) = channel();
+
+        // If the workers are gone, the receiver will report it as disconnected.
+        let _ = self.jobs.send(CompressionJob { chunk, compression_level, result });
+        receiver
+    }
+}
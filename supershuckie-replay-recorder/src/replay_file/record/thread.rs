@@ -1,35 +1,64 @@
-use super::{ReplayFileWriteError, ReplayFileRecorder, ReplayFileSink, ReplayFileRecorderFns};
+use super::{joins_repeat, ReplayFileWriteError, ReplayFileRecorder, ReplayFileSink, ReplayFileRecorderFns, MAX_REPEAT_FRAMES};
 use crate::{ByteVec, InputBuffer, Speed, TimestampMillis, UnsignedInteger};
 use alloc::borrow::ToOwned;
 use alloc::string::String;
-use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc::{channel, sync_channel, Receiver, Sender, SyncSender, TrySendError};
 use std::sync::Mutex;
 use std::sync::{Arc, Weak};
+use std::time::{Duration, Instant};
 
 type RecorderMutex<Final, Temp> = Mutex<ReplayFileRecorder<Final, Temp>>;
 
+/// Most commands that can be queued for the helper thread at once.
+///
+/// The queue is allocated up front, so queueing a command does not allocate. If the helper thread
+/// falls this far behind, queueing waits for it to catch up rather than letting the queue grow.
+pub const RECORDER_QUEUE_CAPACITY: usize = 1024;
+
 /// File recorder that records in a separate thread and is non-blocking.
 ///
+/// This only blocks if the helper thread falls [`RECORDER_QUEUE_CAPACITY`] commands behind (see
+/// [`NonBlockingReplayFileRecorder::take_queue_stall`]).
+///
 /// The `std` feature is required to use this.
 pub struct NonBlockingReplayFileRecorder<Final: ReplayFileSink + Send + 'static, Temp: ReplayFileSink + Send + 'static> {
     recorder: Option<Arc<RecorderMutex<Final, Temp>>>,
 
-    sender: Sender<ThreadedReplayFileRecorderCommand>,
-    receiver: Receiver<ThreadedReplayFileRecorderResponse>
+    sender: SyncSender<ThreadedReplayFileRecorderCommand>,
+    receiver: Receiver<ThreadedReplayFileRecorderResponse>,
+
+    /// Commands sent but not yet handled by the helper thread.
+    queued: Arc<AtomicUsize>,
+
+    /// Time spent waiting for room in the queue.
+    queue_stall: Duration,
+
+    /// Frames advanced since the last command, and how long they took.
+    ///
+    /// These are sent as one command before the next one rather than one command per frame.
+    pending_frames: UnsignedInteger,
+    pending_frames_millis: TimestampMillis,
+
+    /// Timestamp of the last frame or keyframe.
+    last_timestamp: TimestampMillis
 }
 
 impl<Final: ReplayFileSink + Send + 'static, Temp: ReplayFileSink + Send + 'static> NonBlockingReplayFileRecorder<Final, Temp> {
     /// Instantiate a non-blocking replay recorder.
     pub fn new(recorder: ReplayFileRecorder<Final, Temp>) -> NonBlockingReplayFileRecorder<Final, Temp> {
+        let last_timestamp = recorder.elapsed_millis;
         let recorder = Arc::new(Mutex::new(recorder));
 
-        let (sender_main, receiver_helper) = channel();
+        let (sender_main, receiver_helper) = sync_channel(RECORDER_QUEUE_CAPACITY);
         let (sender_helper, receiver_main) = channel();
+        let queued = Arc::new(AtomicUsize::new(0));
 
         let helper = ThreadedReplayFileRecorderThread {
             recorder: Arc::downgrade(&recorder),
             sender: sender_helper,
-            receiver: receiver_helper
+            receiver: receiver_helper,
+            queued: queued.clone()
         };
 
         std::thread::Builder::new()
@@ -42,7 +71,61 @@ impl<Final: ReplayFileSink + Send + 'static, Temp: ReplayFileSink + Send + 'stat
         Self {
             sender: sender_main,
             receiver: receiver_main,
-            recorder: Some(recorder)
+            recorder: Some(recorder),
+            queued,
+            queue_stall: Duration::ZERO,
+            pending_frames: 0,
+            pending_frames_millis: 0,
+            last_timestamp
+        }
+    }
+
+    /// Get the number of commands that the helper thread has yet to write.
+    ///
+    /// If this keeps growing, the recorder is not keeping up.
+    #[inline]
+    pub fn get_queue_depth(&self) -> usize {
+        self.queued.load(Ordering::Relaxed)
+    }
+
+    /// Get the time spent waiting for room in the queue since this was last called, and reset it.
+    ///
+    /// This is nonzero when the helper thread fell [`RECORDER_QUEUE_CAPACITY`] commands behind.
+    #[inline]
+    pub fn take_queue_stall(&mut self) -> Duration {
+        core::mem::take(&mut self.queue_stall)
+    }
+
+    fn send(&mut self, command: ThreadedReplayFileRecorderCommand) {
+        self.send_pending_frames();
+        self.send_now(command);
+    }
+
+    fn send_pending_frames(&mut self) {
+        if self.pending_frames != 0 {
+            let count = core::mem::take(&mut self.pending_frames);
+            self.pending_frames_millis = 0;
+            self.send_now(ThreadedReplayFileRecorderCommand::NextFrames { count, timestamp: self.last_timestamp });
+        }
+    }
+
+    fn send_now(&mut self, command: ThreadedReplayFileRecorderCommand) {
+        // Count it first so the helper thread can't decrement it before it is incremented.
+        self.queued.fetch_add(1, Ordering::Relaxed);
+        let command = match self.sender.try_send(command) {
+            Ok(()) => return,
+            Err(TrySendError::Full(command)) => command,
+            Err(TrySendError::Disconnected(_)) => {
+                self.queued.fetch_sub(1, Ordering::Relaxed);
+                return
+            }
+        };
+
+        let start = Instant::now();
+        let result = self.sender.send(command);
+        self.queue_stall += start.elapsed();
+        if result.is_err() {
+            self.queued.fetch_sub(1, Ordering::Relaxed);
         }
     }
 
@@ -59,10 +142,18 @@ impl<Final: ReplayFileSink + Send + 'static, Temp: ReplayFileSink + Send + 'stat
     /// Panics if already closed.
     pub fn close(&mut self) -> Result<(Final, Temp), (Final, Temp, ReplayFileWriteError)> {
         // Close it
+        self.send_pending_frames();
         let _ = self.sender.send(ThreadedReplayFileRecorderCommand::Close);
 
         // Sever the connection
-        self.sender = channel().0;
+        self.sender = sync_channel(0).0;
+
+        // Wait for everything queued before closing to be written.
+        while let Ok(response) = self.receiver.recv() {
+            if matches!(response, ThreadedReplayFileRecorderResponse::Closed) {
+                break
+            }
+        }
 
         // If the other thread is busy, we'll need to spin here until it's done.
         let mut a = self.recorder.take().expect("recorder already closed");
@@ -82,42 +173,53 @@ impl<Final: ReplayFileSink + Send + 'static, Temp: ReplayFileSink + Send + 'stat
 
     /// Advance a new frame.
     pub fn next_frame(&mut self, timestamp: TimestampMillis) {
-        let _ = self.sender.send(ThreadedReplayFileRecorderCommand::NextFrame { timestamp });
+        let delta = timestamp.saturating_sub(self.last_timestamp);
+        if !joins_repeat(self.pending_frames, self.pending_frames_millis, 1, delta) {
+            self.send_pending_frames();
+        }
+
+        self.pending_frames += 1;
+        self.pending_frames_millis += delta;
+        self.last_timestamp = timestamp;
+        if self.pending_frames >= MAX_REPEAT_FRAMES {
+            self.send_pending_frames();
+        }
     }
 
     /// Add a bookmark.
     pub fn add_bookmark<S: Into<String>>(&mut self, name: S) {
-        let _ = self.sender.send(ThreadedReplayFileRecorderCommand::AddBookmark { bookmark: name.into() });
+        self.send(ThreadedReplayFileRecorderCommand::AddBookmark { bookmark: name.into() });
     }
 
     /// Add a new keyframe.
     pub fn insert_keyframe(&mut self, state: ByteVec, timestamp: TimestampMillis) {
-        let _ = self.sender.send(ThreadedReplayFileRecorderCommand::NewKeyframe { state, timestamp });
+        self.send(ThreadedReplayFileRecorderCommand::NewKeyframe { state, timestamp });
+        self.last_timestamp = self.last_timestamp.max(timestamp);
     }
 
     /// Set the current input.
     pub fn set_input(&mut self, input: InputBuffer) {
-        let _ = self.sender.send(ThreadedReplayFileRecorderCommand::SetInput { input });
+        self.send(ThreadedReplayFileRecorderCommand::SetInput { input });
     }
 
     /// Hard-reset the console.
     pub fn reset_console(&mut self) {
-        let _ = self.sender.send(ThreadedReplayFileRecorderCommand::ResetConsole);
+        self.send(ThreadedReplayFileRecorderCommand::ResetConsole);
     }
 
     /// Write RAM to an address.
     pub fn write_memory(&mut self, address: UnsignedInteger, data: ByteVec) {
-        let _ = self.sender.send(ThreadedReplayFileRecorderCommand::WriteMemory { address, data });
+        self.send(ThreadedReplayFileRecorderCommand::WriteMemory { address, data });
     }
 
     /// Set the current speed.
     pub fn set_speed(&mut self, speed: Speed) {
-        let _ = self.sender.send(ThreadedReplayFileRecorderCommand::SetSpeed { speed });
+        self.send(ThreadedReplayFileRecorderCommand::SetSpeed { speed });
     }
 
     /// Load the keyframe at the given frame index.
     pub fn load_save_state(&mut self, state: ByteVec) {
-        let _ = self.sender.send(ThreadedReplayFileRecorderCommand::LoadSaveState { state });
+        self.send(ThreadedReplayFileRecorderCommand::LoadSaveState { state });
     }
 
     /// Check for errors, if any.
@@ -136,6 +238,7 @@ struct ThreadedReplayFileRecorderThread<Final: ReplayFileSink, Temp: ReplayFileS
     // eventually be closed if it fails
     sender: Sender<ThreadedReplayFileRecorderResponse>,
     receiver: Receiver<ThreadedReplayFileRecorderCommand>,
+    queued: Arc<AtomicUsize>
 }
 
 impl<Final: ReplayFileSink, Temp: ReplayFileSink> ThreadedReplayFileRecorderThread<Final, Temp> {
@@ -155,7 +258,10 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ThreadedReplayFileRecorderThre
                 break
             };
 
-            if let Err(e) = self.handle_command(command, &mut recorder) {
+            let result = self.handle_command(command, &mut recorder);
+            self.queued.fetch_sub(1, Ordering::Relaxed);
+
+            if let Err(e) = result {
                 let _ = self.sender.send(ThreadedReplayFileRecorderResponse::Error { error: e });
             }
         }
@@ -185,8 +291,8 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ThreadedReplayFileRecorderThre
             ThreadedReplayFileRecorderCommand::ResetConsole => {
                 recorder.reset_console()
             },
-            ThreadedReplayFileRecorderCommand::NextFrame { timestamp } => {
-                recorder.next_frame(timestamp)
+            ThreadedReplayFileRecorderCommand::NextFrames { count, timestamp } => {
+                recorder.next_frames(count, timestamp)
             },
             ThreadedReplayFileRecorderCommand::LoadSaveState { state } => {
                 recorder.load_save_state(state)
@@ -196,7 +302,7 @@ impl<Final: ReplayFileSink, Temp: ReplayFileSink> ThreadedReplayFileRecorderThre
 }
 
 enum ThreadedReplayFileRecorderCommand {
-    NextFrame { timestamp: TimestampMillis },
+    NextFrames { count: UnsignedInteger, timestamp: TimestampMillis },
     AddBookmark { bookmark: String },
     NewKeyframe { state: ByteVec, timestamp: UnsignedInteger },
     SetInput { input: InputBuffer },
@@ -271,6 +377,16 @@ impl<Final: ReplayFileSink + Sync + Send + 'static, Temp: ReplayFileSink + Sync
         self.load_save_state(state);
         Ok(())
     }
+
+    #[inline]
+    fn queue_depth(&self) -> usize {
+        self.get_queue_depth()
+    }
+
+    #[inline]
+    fn take_queue_stall(&mut self) -> Duration {
+        self.take_queue_stall()
+    }
 }
 
 // TODO: write unit tests
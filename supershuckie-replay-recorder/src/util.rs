@@ -54,7 +54,8 @@ pub(crate) const unsafe fn reinterpret_ref<F: Copy, T: Copy>(from: &F) -> &T {
     unsafe { transmute(from) }
 }
 
-pub(crate) fn compress_data(data: &[u8], compression_level: i32) -> Result<Vec<u8>, Cow<'static, str>> {
+/// Compress `data` with zstd at the given level (clamped to what zstd supports).
+pub fn compress_data(data: &[u8], compression_level: i32) -> Result<Vec<u8>, Cow<'static, str>> {
     // SAFETY: This function is safe.
     let bound = unsafe { zstd_sys::ZSTD_compressBound(data.len()) };
 
@@ -92,7 +93,8 @@ pub(crate) fn compress_data(data: &[u8], compression_level: i32) -> Result<Vec<u
     Ok(v)
 }
 
-pub(crate) fn decompress_data(data: &[u8], uncompressed_size: usize) -> Result<Vec<u8>, Cow<'static, str>> {
+/// Decompress zstd-compressed `data`, which must decompress to exactly `uncompressed_size` bytes.
+pub fn decompress_data(data: &[u8], uncompressed_size: usize) -> Result<Vec<u8>, Cow<'static, str>> {
     let mut decompressed_data: Vec<u8> = Vec::new();
     if decompressed_data.try_reserve_exact(uncompressed_size).is_err() {
         return Err(Cow::Borrowed("failed to allocate RAM to decompress compressed blob"))